@@ -0,0 +1,83 @@
+// Host simulation: websocket fan-out with one stalled client, one slow client and several healthy
+// ones, using the same LiveClientState the device runs per client.
+//
+// Each healthy client drains everything every tick, the slow one takes one frame every third tick
+// and the stalled one never reads. The AsyncTCP side is modelled as LIVE_MAX_IN_FLIGHT messages per
+// client at most (the pump never hands over more). Memory is reported as frames held per client.
+//
+// Build and run from the project root:
+//   g++ -O2 -std=gnu++17 -Ilib/LiveStream bench/bench_backpressure.cpp -o bench_backpressure && ./bench_backpressure
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "LiveStream.h"
+
+#define SAMPLE_PERIOD_MS 1000
+#define LIVE_MAX_IN_FLIGHT 4
+#define HOURS 24
+#define CLIENTS 6
+
+enum Behaviour { HEALTHY, SLOW, STALLED };
+
+struct SimClient {
+    const char* name;
+    Behaviour behaviour;
+    LiveClientState state;
+    uint32_t inFlight;
+    uint32_t peakHeld;
+};
+
+int main() {
+    SimClient clients[CLIENTS] = {
+        {"healthy-1", HEALTHY, LiveClientState(), 0, 0},
+        {"healthy-2", HEALTHY, LiveClientState(), 0, 0},
+        {"healthy-3", HEALTHY, LiveClientState(), 0, 0},
+        {"healthy-4", HEALTHY, LiveClientState(), 0, 0},
+        {"slow", SLOW, LiveClientState(), 0, 0},
+        {"stalled", STALLED, LiveClientState(), 0, 0},
+    };
+    LiveSubscription subscription = {0x1F, 1};
+    for (SimClient& client : clients) client.state.subscribe(subscription);
+
+    printf("hour  held frames per client (ours + in flight)\n");
+    uint32_t tick = 0;
+    for (uint32_t hour = 1; hour <= HOURS; hour++) {
+        for (uint32_t second = 0; second < 3600; second++, tick++) {
+            LiveSample sample;
+            sample.timestampMicros = (int64_t)tick * SAMPLE_PERIOD_MS * 1000;
+            for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+                sample.busRaw[ch] = 9600 + (tick + ch) % 40;
+                sample.shuntRaw[ch] = (int16_t)((tick * 31 + ch) % 2000) - 1000;
+            }
+            for (SimClient& client : clients) {
+                client.state.add(sample);
+
+                // The network drains what AsyncTCP already holds
+                if (client.behaviour == HEALTHY) client.inFlight = 0;
+                if (client.behaviour == SLOW && tick % 3 == 0 && client.inFlight > 0) client.inFlight--;
+
+                // Pump: only hand over frames while the in-flight queue has room
+                LiveFrame frame;
+                while (client.inFlight < LIVE_MAX_IN_FLIGHT && client.state.next(frame)) client.inFlight++;
+
+                uint32_t held = client.state.queue.count + client.inFlight;
+                if (held > client.peakHeld) client.peakHeld = held;
+            }
+        }
+        if (hour == 1 || hour % 6 == 0) {
+            printf("%4u ", hour);
+            for (SimClient& client : clients) printf(" %s=%u", client.name, client.state.queue.count + client.inFlight);
+            printf("\n");
+        }
+    }
+
+    printf("\n%-10s %6s %10s %10s %10s %10s\n", "client", "peak", "sent", "coalesced", "downgrades", "period_ms");
+    for (SimClient& client : clients) {
+        printf("%-10s %6u %10u %10u %10u %10u\n", client.name, client.peakHeld, client.state.framesSent,
+               client.state.framesCoalesced, client.state.downgrades, client.state.decimation() * SAMPLE_PERIOD_MS);
+    }
+    printf("\nbound: %u frames (%u bytes) queued + %u in flight per client\n", LIVE_QUEUE_DEPTH,
+           (unsigned)(LIVE_QUEUE_DEPTH * sizeof(LiveFrame)), LIVE_MAX_IN_FLIGHT);
+    return 0;
+}
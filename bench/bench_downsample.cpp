@@ -0,0 +1,116 @@
+// Host benchmark: downsampling a day of 1 Hz readings for all five channels (432k points) to chart
+// size, for the streaming LTTB and min/max downsamplers on their own and for /api/downsample end to
+// end over generated log files.
+//
+// Build and run from the project root:
+//   g++ -O2 -std=gnu++17 -Ilib/ShuntLog -Ilib/Downsample bench/bench_downsample.cpp -o bench_downsample && ./bench_downsample
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "Downsample.h"
+#include "ShuntLog.h"
+#include "ShuntDownsample.h"
+#include "MemoryLogStorage.h"
+
+#define SECONDS 86400
+#define POINTS 500
+#define ROUNDS 10
+
+// 2023-07-23T00:00:00Z
+static const int64_t START = 1690070400;
+
+static int32_t reading(uint32_t i, uint8_t ch) {
+    return (int32_t)(2000.0 * sin((i + ch * 3000) * 2 * M_PI / 21600.0)) + (int32_t)((i * 2654435761u) >> 26) - 32;
+}
+
+template <typename Stream>
+static void runStreams(const char* name) {
+    static Stream streams[SHUNT_LOG_CHANNELS];
+    uint64_t emitted = 0;
+    DownsamplePoint point;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) streams[ch].setup(START, START + SECONDS, POINTS);
+        for (uint32_t i = 0; i < SECONDS; i++) {
+            for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+                streams[ch].add(START + i, reading(i, ch));
+                while (streams[ch].pop(point)) emitted++;
+            }
+        }
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            streams[ch].finish();
+            while (streams[ch].pop(point)) emitted++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double points = (double)SECONDS * SHUNT_LOG_CHANNELS * ROUNDS;
+    printf("  %-7s %6.1f M points/s  (%u -> %llu points, %zu B state per channel)\n", name, points / seconds / 1e6,
+           SECONDS * SHUNT_LOG_CHANNELS, (unsigned long long)(emitted / ROUNDS), sizeof(Stream));
+}
+
+static void runReader(MemoryLogStorage& storage, const char* name, DownsampleQuery query) {
+    uint8_t chunk[1436];  // One TCP segment, about what the async web server asks for
+    size_t bytes = 0;
+    uint32_t points = 0;
+    uint32_t records = 0;
+    const char* level = "";
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        ShuntDownsampleReader reader(storage, query);
+        bytes = 0;
+        while (!reader.finished()) bytes += reader.fill(chunk, sizeof(chunk));
+        points = reader.points;
+        records = reader.cursor.recordsRead;
+        level = shunt_log_level_name(reader.level);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / ROUNDS;
+    printf("  %-22s %-6s %6u records -> %5u points, %7zu B  %7.2f ms  %6.2f M points/s\n", name, level, records,
+           points, bytes, seconds * 1000, records * (double)__builtin_popcount(query.channels) / seconds / 1e6);
+}
+
+int main() {
+    printf("Streams alone, a day at 1 Hz x %u channels to %u points each:\n", SHUNT_LOG_CHANNELS, POINTS);
+    runStreams<LttbStream>("lttb");
+    runStreams<MinMaxStream>("minmax");
+
+    // A day of full-rate minute files and the daily minute rollups, like the logger writes them
+    MemoryLogStorage storage;
+    uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+    char path[40];
+    for (uint32_t i = 0; i < SECONDS; i++) {
+        FullRecord record;
+        record.timestamp = START + i;
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            record.busRaw[ch] = 9600 + (i + ch) % 50;
+            record.shuntRaw[ch] = reading(i, ch);
+        }
+        shunt_log_path(SHUNT_LOG_FULL, shunt_log_file_start(SHUNT_LOG_FULL, record.timestamp), path, sizeof(path));
+        storage.append(path, buffer, shunt_log_encode_full(record, 4, buffer));
+    }
+    for (uint32_t minute = 1; minute <= SECONDS / 60; minute++) {
+        RollupRecord record;
+        record.timestamp = START + minute * 60;
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            int32_t value = reading(minute * 60 - 30, ch);
+            record.busMin[ch] = record.busMax[ch] = record.busMean[ch] = 9600;
+            record.shuntMin[ch] = value - 40;
+            record.shuntMean[ch] = value;
+            record.shuntMax[ch] = value + 40;
+        }
+        shunt_log_path(SHUNT_LOG_MINUTE, shunt_log_file_start(SHUNT_LOG_MINUTE, record.timestamp), path, sizeof(path));
+        storage.append(path, buffer, shunt_log_encode_rollup(record, 4, buffer));
+    }
+
+    printf("\n/api/downsample, all channels, %u points each (per request):\n", POINTS);
+    runReader(storage, "hour, lttb, json", {START + 43200, START + 46800, POINTS, DOWNSAMPLE_LTTB, 0x1F, false, false});
+    runReader(storage, "hour, minmax, bin", {START + 43200, START + 46800, POINTS, DOWNSAMPLE_MINMAX, 0x1F, false, true});
+    runReader(storage, "day, lttb, json", {START, START + SECONDS, POINTS, DOWNSAMPLE_LTTB, 0x1F, false, false});
+    runReader(storage, "day, minmax, bin", {START, START + SECONDS, POINTS, DOWNSAMPLE_MINMAX, 0x1F, false, true});
+    printf("\nThe same day as raw points: %u points, %u B of /full files\n", SECONDS * SHUNT_LOG_CHANNELS,
+           (unsigned)(SECONDS * shunt_log_record_size(SHUNT_LOG_FULL, 4)));
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Host benchmark: float + sprintf (the old getINAMeasurements path) versus ShuntScale + FixedWriter.
+//
+// Build and run from the project root:
+//   g++ -O2 -std=gnu++17 -Ilib/FixedPoint bench/bench_fixed_point.cpp -o bench_fixed_point && ./bench_fixed_point
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+
+#include "FixedPoint.h"
+
+#define SAMPLES 2000000
+
+// 2.5 uV per LSB
+#define SHUNT_VOLTS_PER_LSB 0.0000025
+
+// 1.25 mV per LSB
+#define BUS_VOLTS_PER_LSB 0.00125
+
+static volatile uint32_t sink;
+
+static double nsPerSample(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / SAMPLES;
+}
+
+int main() {
+    char buffer[100];
+
+    // Old path: four floats and sprintf("%f") for every sample
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        int32_t shuntRawVoltage = (int32_t)(i % 4000) - 2000;
+        uint32_t busRawVoltage = 9600 + (i % 64);
+        float shuntVolts = SHUNT_VOLTS_PER_LSB * shuntRawVoltage;
+        float busVolts = BUS_VOLTS_PER_LSB * busRawVoltage;
+        float busAmps = shuntVolts * 10000.0;
+        float busWatts = busAmps * busVolts;
+        sink += sprintf(buffer, "%f,%f,%f,%f,", busVolts, shuntVolts, busAmps, busWatts);
+    }
+    double floatSprintf = nsPerSample(start);
+
+    // New path, conversion only (what the sampling loop does now)
+    ShuntScale scale(100);
+    ShuntReading reading;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        scale.convert(9600 + (i % 64), (int32_t)(i % 4000) - 2000, reading);
+        sink += (uint32_t)reading.microWatts;
+    }
+    double fixedConvert = nsPerSample(start);
+
+    // New path, conversion plus text formatting (only when text is actually wanted)
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        scale.convert(9600 + (i % 64), (int32_t)(i % 4000) - 2000, reading);
+        FixedWriter writer(buffer, sizeof(buffer));
+        writer.appendFixed(reading.busMicroVolts, 6);
+        writer.append(',');
+        writer.appendFixed(reading.shuntNanoVolts, 9);
+        writer.append(',');
+        writer.appendFixed(reading.microAmps, 6);
+        writer.append(',');
+        writer.appendFixed(reading.microWatts, 6);
+        writer.append(',');
+        sink += writer.length;
+    }
+    double fixedFormat = nsPerSample(start);
+
+    printf("float + sprintf:          %8.1f ns/sample\n", floatSprintf);
+    printf("fixed-point convert:      %8.1f ns/sample\n", fixedConvert);
+    printf("fixed-point + FixedWriter:%8.1f ns/sample\n", fixedFormat);
+    return 0;
+}
@@ -0,0 +1,226 @@
+// Host benchmark: finding data in a generated month of 1 Hz /full logs (43k minute files, a reboot
+// every three days) three ways:
+//   scan      open the minute's file by name and read records from the start, like RowReader
+//   by name   open by name and binary-search the fixed-size records (no index files)
+//   indexed   binary-search the manifest, seek with the file's sparse index
+//
+// SD time is estimated as SD_OPEN_MICROS per open attempt (including misses), SD_SEEK_MICROS per
+// read call and SD_BYTES_PER_SECOND. Opening a file in a directory of tens of thousands of entries
+// is the dominant cost on FAT, so the open estimate is deliberately rough.
+//
+// Build and run from the project root (needs about 600 MB of RAM):
+//   g++ -O2 -std=gnu++17 -Ilib/ShuntLog bench/bench_index.cpp -o bench_index && ./bench_index
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+// The minute files in one flat directory these numbers were first taken with
+#define SHUNT_FULL_FILE_SECONDS 60
+#define SHUNT_FULL_PARTITION SHUNT_PARTITION_NONE
+
+#include "ShuntLog.h"
+#include "ShuntIndex.h"
+#include "ShuntCursor.h"
+#include "MemoryLogStorage.h"
+
+#define DAYS 30
+#define REBOOT_EVERY (3 * 86400)
+#define REBOOT_GAP 317
+#define LOOKUPS 2000
+#define RANGES 200
+#define SD_OPEN_MICROS 2000.0
+#define SD_SEEK_MICROS 200.0
+#define SD_BYTES_PER_SECOND 1000000.0
+
+// 2023-07-01T00:00:00Z
+static const int64_t START = 1688169600;
+
+// Counts open attempts and can pretend the index files don't exist
+class CountingStorage : public ShuntLogStorage {
+public:
+    MemoryLogStorage& inner;
+    bool hideIndex;
+    uint32_t attempts;
+
+    CountingStorage(MemoryLogStorage& inner, bool hideIndex) : inner(inner), hideIndex(hideIndex), attempts(0) {}
+
+    bool open(const char* path) override {
+        attempts++;
+        if (hideIndex && strncmp(path, "/index", 6) == 0) return false;
+        return inner.open(path);
+    }
+    uint32_t size() override { return inner.size(); }
+    size_t readAt(uint32_t offset, uint8_t* buffer, size_t length) override { return inner.readAt(offset, buffer, length); }
+    void close() override { inner.close(); }
+
+    void reset() {
+        attempts = 0;
+        inner.reads = 0;
+        inner.bytesRead = 0;
+    }
+
+    double sdMillis() const {
+        return (attempts * SD_OPEN_MICROS + inner.reads * SD_SEEK_MICROS) / 1000.0 + inner.bytesRead / SD_BYTES_PER_SECOND * 1000.0;
+    }
+};
+
+static void flush(MemoryLogStorage& storage, ShuntIndexBuilder& builder) {
+    uint8_t buffer[SHUNT_INDEX_MAX_ENTRIES * SHUNT_INDEX_ENTRY_SIZE];
+    char path[40];
+    shunt_index_path(builder.manifest.fileStart, path, sizeof(path));
+    storage.append(path, buffer, builder.encodeIndex(buffer));
+    shunt_manifest_encode(builder.manifest, buffer);
+    storage.append(SHUNT_MANIFEST_PATH, buffer, SHUNT_MANIFEST_ENTRY_SIZE);
+}
+
+// Writes the month the way the logger does: a file per minute, a mid-minute file after each boot
+static uint32_t generate(MemoryLogStorage& storage) {
+    uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+    char path[40];
+    ShuntIndexBuilder builder;
+    std::vector<uint8_t>* file = NULL;
+    uint32_t records = 0;
+    for (int64_t t = START; t < START + DAYS * 86400; t++) {
+        int64_t sinceStart = t - START;
+        bool rebooting = sinceStart > 0 && sinceStart % REBOOT_EVERY == 0;
+        if (rebooting) {
+            t += REBOOT_GAP;
+        }
+        if (file == NULL || rebooting || t % 60 == 0) {
+            if (file != NULL) flush(storage, builder);
+            builder.begin(t);
+            shunt_log_path(SHUNT_LOG_FULL, t, path, sizeof(path));
+            file = &storage.files[path];
+            file->reserve(60 * 174);
+        }
+        FullRecord record;
+        record.timestamp = t;
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            record.busRaw[ch] = 9600 + (uint32_t)((t * 7 + ch) % 50);
+            record.shuntRaw[ch] = (int32_t)((t * 13 + ch) % 400) - 200;
+        }
+        size_t length = shunt_log_encode_full(record, 4, buffer);
+        file->insert(file->end(), buffer, buffer + length);
+        builder.add(t, length);
+        records++;
+    }
+    flush(storage, builder);
+    return records;
+}
+
+// The old way: open the minute's file by name and read records until the target
+static bool scanLookup(CountingStorage& storage, int64_t target) {
+    char path[40];
+    uint8_t record[SHUNT_LOG_MAX_RECORD_SIZE];
+    shunt_log_path(SHUNT_LOG_FULL, shunt_log_file_start(SHUNT_LOG_FULL, target), path, sizeof(path));
+    if (!storage.open(path)) return false;
+    for (uint32_t offset = 0;; offset += 174) {
+        FullRecord full;
+        size_t length = storage.readAt(offset, record, 174);
+        if (!shunt_log_decode_full(record, length, full)) break;
+        if (full.timestamp >= target) {
+            storage.close();
+            return true;
+        }
+    }
+    storage.close();
+    return false;
+}
+
+static bool cursorLookup(CountingStorage& storage, int64_t target) {
+    ShuntLogCursor cursor(storage, SHUNT_LOG_FULL, target, target + 1);
+    bool found = cursor.next();
+    cursor.close();
+    return found;
+}
+
+struct Result {
+    uint32_t hits;
+    uint32_t attempts;
+    uint32_t reads;
+    uint64_t bytes;
+    double sdMs;
+    double hostMs;
+};
+
+static void report(const char* name, const Result& r, uint32_t count, uint32_t expected) {
+    printf("  %-9s found %5u/%-5u  opens %6.2f  reads %7.1f  bytes %9.0f  host %7.2f us  est. SD %7.2f ms\n", name,
+           r.hits, expected, (double)r.attempts / count, (double)r.reads / count, (double)r.bytes / count,
+           r.hostMs * 1000.0 / count, r.sdMs / count);
+}
+
+template <typename F>
+static Result run(CountingStorage& storage, const int64_t* targets, uint32_t count, F lookup) {
+    Result r = {0, 0, 0, 0, 0, 0};
+    storage.reset();
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++) r.hits += lookup(storage, targets[i]);
+    r.hostMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    r.attempts = storage.attempts;
+    r.reads = storage.inner.reads;
+    r.bytes = storage.inner.bytesRead;
+    r.sdMs = storage.sdMillis();
+    return r;
+}
+
+int main() {
+    MemoryLogStorage storage;
+    auto start = std::chrono::steady_clock::now();
+    uint32_t records = generate(storage);
+    double generateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t manifestBytes = storage.files[SHUNT_MANIFEST_PATH].size();
+    printf("Generated %u records in %zu files (%.0f ms); manifest %zu B, index files %zu B each\n\n", records,
+           manifestBytes / SHUNT_MANIFEST_ENTRY_SIZE, generateMs, manifestBytes,
+           storage.files["/index/full/20230701T000000.idx"].size());
+
+    // Timestamps that exist, a quarter of them in the first minute after a reboot
+    srand(1);
+    static int64_t targets[LOOKUPS];
+    for (uint32_t i = 0; i < LOOKUPS; i++) {
+        if (i % 4 == 0) {
+            int64_t boot = START + (int64_t)(1 + rand() % (DAYS / 3 - 1)) * REBOOT_EVERY + REBOOT_GAP;
+            targets[i] = boot + rand() % (60 - boot % 60);
+        } else {
+            targets[i] = START + rand() % (REBOOT_EVERY - 60);
+        }
+    }
+
+    CountingStorage plain(storage, true);
+    CountingStorage indexed(storage, false);
+    printf("Point lookups (first record at or after t), per lookup:\n");
+    report("scan", run(plain, targets, LOOKUPS, scanLookup), LOOKUPS, LOOKUPS);
+    report("by name", run(plain, targets, LOOKUPS, cursorLookup), LOOKUPS, LOOKUPS);
+    report("indexed", run(indexed, targets, LOOKUPS, cursorLookup), LOOKUPS, LOOKUPS);
+
+    // One-hour ranges starting anywhere, including across reboots
+    static int64_t rangeStarts[RANGES];
+    for (uint32_t i = 0; i < RANGES; i++) rangeStarts[i] = START + rand() % (DAYS * 86400 - 3600);
+    auto rangeLookup = [](CountingStorage& s, int64_t from) -> bool {
+        ShuntLogCursor cursor(s, SHUNT_LOG_FULL, from, from + 3600);
+        uint32_t n = 0;
+        while (cursor.next()) n++;
+        return n > 0;
+    };
+    uint64_t expectedRecords = 0;
+    uint64_t namedRecords = 0;
+    uint64_t indexedRecords = 0;
+    for (uint32_t i = 0; i < RANGES; i++) {
+        ShuntLogCursor a(indexed, SHUNT_LOG_FULL, rangeStarts[i], rangeStarts[i] + 3600);
+        while (a.next()) indexedRecords++;
+        ShuntLogCursor b(plain, SHUNT_LOG_FULL, rangeStarts[i], rangeStarts[i] + 3600);
+        while (b.next()) namedRecords++;
+        for (int64_t t = rangeStarts[i]; t < rangeStarts[i] + 3600; t++) {
+            int64_t s = t - START;
+            bool inGap = s >= REBOOT_EVERY && s % REBOOT_EVERY < REBOOT_GAP;
+            if (!inGap) expectedRecords++;
+        }
+    }
+    printf("\nOne-hour ranges, per range (records found: by name %llu, indexed %llu of %llu):\n",
+           (unsigned long long)namedRecords, (unsigned long long)indexedRecords, (unsigned long long)expectedRecords);
+    report("by name", run(plain, rangeStarts, RANGES, rangeLookup), RANGES, RANGES);
+    report("indexed", run(indexed, rangeStarts, RANGES, rangeLookup), RANGES, RANGES);
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Host load test: live data fan-out to simulated websocket clients, old JSON text broadcast versus
+// binary LiveStream frames with per-client decimation.
+//
+// Wire bytes count the payload, the websocket frame header (2 bytes under 126, else 4) and 40 bytes
+// of TCP/IP header per message, assuming each message goes out in its own segment as AsyncTCP does
+// for small writes.
+//
+// Build and run from the project root:
+//   g++ -O2 -std=gnu++17 -Ilib/LiveStream bench/bench_live_stream.cpp -o bench_live_stream && ./bench_live_stream
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+
+#include "LiveStream.h"
+
+#define SAMPLE_PERIOD_MS 1000
+#define SAMPLES 86400  // One day at 1 Hz
+#define CLIENTS 8
+#define TCP_IP_OVERHEAD 40
+
+static uint64_t wireBytes(size_t payload) {
+    return payload + (payload < 126 ? 2 : 4) + TCP_IP_OVERHEAD;
+}
+
+static LiveSample makeSample(uint32_t i) {
+    LiveSample sample;
+    sample.timestampMicros = (int64_t)i * SAMPLE_PERIOD_MS * 1000;
+    for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+        sample.busRaw[ch] = 9600 + (i * 7 + ch) % 50;
+        sample.shuntRaw[ch] = (int16_t)((i * 13 + ch * 100) % 4000) - 2000;
+    }
+    return sample;
+}
+
+int main() {
+    // Client mix: two dashboards at full rate on all channels, three following one shunt every
+    // 5 s, three trend views at one frame per minute
+    const uint8_t subscribeMessages[CLIENTS][LIVE_SUBSCRIBE_SIZE] = {
+        {LIVE_MSG_SUBSCRIBE, 0x1F, 0xE8, 0x03}, {LIVE_MSG_SUBSCRIBE, 0x1F, 0xE8, 0x03},
+        {LIVE_MSG_SUBSCRIBE, 0x01, 0x88, 0x13}, {LIVE_MSG_SUBSCRIBE, 0x02, 0x88, 0x13},
+        {LIVE_MSG_SUBSCRIBE, 0x04, 0x88, 0x13}, {LIVE_MSG_SUBSCRIBE, 0x1F, 0x60, 0xEA},
+        {LIVE_MSG_SUBSCRIBE, 0x1F, 0x60, 0xEA}, {LIVE_MSG_SUBSCRIBE, 0x1F, 0x60, 0xEA},
+    };
+
+    // Old path: five "Shunt n: {...}" LOG_MESSAGE JSON texts per sample, sent to every client
+    uint64_t oldMessages = 0, oldBytes = 0;
+    volatile size_t sink = 0;
+    char json[160];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        LiveSample sample = makeSample(i);
+        for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+            int length = snprintf(json, sizeof(json),
+                                  "{\"message\":\"Shunt %d: {bus_voltage:%u, shunt_voltage:%d}\",\"type\":\"LOG_MESSAGE\"}",
+                                  ch, sample.busRaw[ch], sample.shuntRaw[ch]);
+            for (uint8_t c = 0; c < CLIENTS; c++) {
+                // ws.printfAll formats again for each client's message buffer
+                char copy[160];
+                sink += snprintf(copy, sizeof(copy), "%s", json);
+                oldMessages++;
+                oldBytes += wireBytes(length);
+            }
+        }
+    }
+    double oldNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    // New path
+    LiveDecimator decimators[CLIENTS];
+    for (uint8_t c = 0; c < CLIENTS; c++) {
+        LiveSubscription subscription;
+        live_parse_subscribe(subscribeMessages[c], LIVE_SUBSCRIBE_SIZE, SAMPLE_PERIOD_MS, subscription);
+        decimators[c].subscribe(subscription);
+    }
+    uint64_t newMessages = 0, newBytes = 0;
+    uint8_t frame[LIVE_FRAME_MAX_SIZE];
+    LiveFrame liveFrame;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        LiveSample sample = makeSample(i);
+        for (uint8_t c = 0; c < CLIENTS; c++) {
+            if (decimators[c].add(sample, liveFrame)) {
+                size_t size = live_encode_frame(liveFrame, frame, sizeof(frame));
+                sink += frame[size - 1];
+                newMessages++;
+                newBytes += wireBytes(size);
+            }
+        }
+    }
+    double newNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%u samples, %u clients\n", SAMPLES, CLIENTS);
+    printf("JSON text broadcast: %10llu messages %12llu wire bytes %8.1f ns/sample\n",
+           (unsigned long long)oldMessages, (unsigned long long)oldBytes, oldNs / SAMPLES);
+    printf("binary + decimation: %10llu messages %12llu wire bytes %8.1f ns/sample\n",
+           (unsigned long long)newMessages, (unsigned long long)newBytes, newNs / SAMPLES);
+    printf("reduction: %.1fx messages, %.1fx wire bytes\n",
+           (double)oldMessages / newMessages, (double)oldBytes / newBytes);
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Host benchmark: cost of one log call in the caller, old dual_log() versus LogRing.
+//
+// The old path is modelled without the Arduino dependencies: vsnprintf into 128 bytes, copy into a
+// document, serialize {"message":...,"type":"LOG_MESSAGE"} into a freshly allocated string, then
+// vsnprintf it again as ws.printfAll does. Serial.println is not modelled; on the device it
+// blocks for ~87 us per 10 bytes at 115200 baud, which dwarfs everything measured here.
+//
+// Build and run from the project root:
+//   g++ -O2 -std=gnu++17 -Ilib/LogRing bench/bench_logger.cpp -o bench_logger && ./bench_logger
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <chrono>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+#else
+static uint64_t cycles() { return 0; }
+#endif
+
+#include "LogRing.h"
+
+#define CALLS 1000000
+
+static volatile size_t sink;
+static LogRing<64> ring;
+
+static void old_dual_log(const char *format, ...) {
+    char buffer[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    std::string documentMessage(buffer);
+    std::string json;
+    json += "{\"message\":\"";
+    char escaped[256];
+    json.append(escaped, json_escape(escaped, sizeof(escaped), documentMessage.c_str(), documentMessage.size()));
+    json += "\",\"type\":\"LOG_MESSAGE\"}";
+
+    char* wsMessage = new char[json.size() + 1];
+    sink += snprintf(wsMessage, json.size() + 1, json.c_str());
+    delete[] wsMessage;
+}
+
+static void new_log_write(uint8_t level, const char *format, ...) {
+    char buffer[LOG_RING_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length >= (int)sizeof(buffer)) length = sizeof(buffer) - 1;
+    ring.write(level, 0, buffer, length);
+}
+
+template <typename F>
+static void run(const char* name, F call) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startCycles = cycles();
+    for (uint32_t i = 0; i < CALLS; i++) call(i);
+    uint64_t endCycles = cycles();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("%-34s %8.1f ns/call %8.1f cycles/call\n", name, ns / CALLS, (double)(endCycles - startCycles) / CALLS);
+}
+
+int main() {
+    run("dual_log (JSON doc + String)", [](uint32_t i) {
+        old_dual_log("Shunt %d: {bus_voltage:%u, shunt_voltage:%d}", (int)(i % 5), 9600u, -120);
+    });
+    run("log_write (ring, formatted)", [](uint32_t i) {
+        new_log_write(3, "Shunt %d: {bus_voltage:%u, shunt_voltage:%d}", (int)(i % 5), 9600u, -120);
+    });
+    run("log_write (ring, constant)", [](uint32_t) {
+        new_log_write(3, "openNewLogFile");
+    });
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Host benchmark: what opening and creating a /full file costs on FAT as the logs grow to 10k, 50k
+// and 100k files, for the flat layout and the date-partitioned ones (SHUNT_FULL_PARTITION).
+//
+// There is no card here, so this models FatFs (as used by the ESP32 SD library, long names on,
+// no exFAT) over a directory tree built from the logger's file names:
+//   open    each path component is found by reading its directory from the start up to the entry
+//   create  a miss for the long name (the whole directory), then one lookup per generated short
+//           name tried ("202307~1.BIN", ..., hashed after the fifth; FR_DENIED after 99), then a
+//           scan for free entries (the whole directory again, nothing is ever deleted)
+// Each directory entry is 32 bytes, a long name takes one more per 13 characters, and a directory
+// can't have more than 65536 entries. Every sector read is counted (16 entries, plus one FAT
+// sector per 32 KB cluster crossed), since FatFs keeps only one sector cached; the time is
+// estimated at SD_SECTOR_MICROS per sector, a rough figure for a single-block SPI read.
+//
+// Build and run from the project root:
+//   g++ -O2 -std=gnu++17 -Ilib/ShuntLog bench/bench_open.cpp -o bench_open && ./bench_open
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ShuntLog.h"
+
+#define FAT_ENTRIES_PER_SECTOR 16
+#define FAT_ENTRIES_PER_CLUSTER 1024
+#define FAT_MAX_ENTRIES 65536
+#define SD_SECTOR_MICROS 250.0
+#define RANDOM_OPENS 1000
+#define CREATES_AVERAGED 100
+
+// 2023-07-01T00:00:00Z
+static const int64_t START = 1688169600;
+static const uint32_t CHECKPOINTS[] = {10000, 50000, 100000};
+
+// Sectors read to go through a directory's entries [0, entry]
+static uint32_t scanSectors(uint32_t entry) {
+    return entry / FAT_ENTRIES_PER_SECTOR + 1 + entry / FAT_ENTRIES_PER_CLUSTER;
+}
+
+class FatDirectory {
+public:
+
+    std::unordered_map<std::string, uint32_t> longNames;   // Name -> index of its last entry
+    std::unordered_map<std::string, uint32_t> shortNames;
+    std::map<std::string, std::unique_ptr<FatDirectory>> children;
+    uint32_t used;
+
+    explicit FatDirectory(bool root) : used(root ? 0 : 2) {}  // "." and ".."
+
+    // Sectors read looking `name` up; sets `found`
+    uint32_t find(const std::string& name, bool& found) const {
+        auto it = longNames.find(name);
+        found = it != longNames.end();
+        return scanSectors(found ? it->second : used);
+    }
+
+    // Adds `name`, counting the sectors read; false if FatFs would refuse
+    bool create(const std::string& name, uint32_t& sectors) {
+        bool found;
+        sectors += find(name, found);
+        char body[9], extension[4];
+        bool lossy = shortName(name, body, extension);
+        std::string shortForm;
+        if (lossy) {
+            uint32_t n;
+            for (n = 1; n < 100; n++) {
+                shortForm = numbered(body, extension, name, n);
+                auto it = shortNames.find(shortForm);
+                if (it == shortNames.end()) {
+                    sectors += scanSectors(used);
+                    break;
+                }
+                sectors += scanSectors(it->second);
+            }
+            if (n == 100) return false;
+        } else {
+            shortForm = std::string(body) + "." + extension;
+        }
+        uint32_t entries = lossy ? 1 + (uint32_t)(name.size() + 12) / 13 : 1;
+        if (used + entries > FAT_MAX_ENTRIES) return false;
+        sectors += scanSectors(used);
+        used += entries;
+        longNames[name] = used - 1;
+        shortNames[shortForm] = used - 1;
+        return true;
+    }
+
+private:
+
+    // FatFs's short name: up to 8 + 3 upper-case characters; true when that loses something and a
+    // numbered one is needed
+    static bool shortName(const std::string& name, char* body, char* extension) {
+        size_t dot = name.rfind('.');
+        std::string base = dot == std::string::npos ? name : name.substr(0, dot);
+        std::string ext = dot == std::string::npos ? "" : name.substr(dot + 1);
+        bool lossy = base.size() > 8 || ext.size() > 3;
+        for (char c : name) lossy |= islower((unsigned char)c) != 0;
+        snprintf(body, 9, "%.8s", base.c_str());
+        snprintf(extension, 4, "%.3s", ext.c_str());
+        for (char* p = body; *p; p++) *p = (char)toupper((unsigned char)*p);
+        for (char* p = extension; *p; p++) *p = (char)toupper((unsigned char)*p);
+        return lossy;
+    }
+
+    // gen_numname(): "BODY~n", with a CRC of the long name instead of n after the fifth try
+    static std::string numbered(const char* body, const char* extension, const std::string& name, uint32_t seq) {
+        if (seq > 5) {
+            uint32_t sreg = seq;
+            for (char c : name) {
+                uint16_t wc = (uint8_t)c;
+                for (uint8_t i = 0; i < 16; i++) {
+                    sreg = (sreg << 1) + (wc & 1);
+                    wc >>= 1;
+                    if (sreg & 0x10000) sreg ^= 0x11021;
+                }
+            }
+            seq = sreg;
+        }
+        char ns[9];
+        int i = 7;
+        do {
+            char c = (char)(seq % 16 + '0');
+            seq /= 16;
+            if (c > '9') c += 7;
+            ns[i--] = c;
+        } while (i && seq);
+        ns[i] = '~';
+        std::string out(body);
+        if (out.size() > (size_t)i) out.resize(i);
+        out.append(ns + i, 8 - i);
+        return out + "." + extension;
+    }
+};
+
+struct Layout {
+    const char* name;
+    uint8_t partition;
+    uint32_t fileSeconds;
+};
+
+static std::vector<std::string> components(int64_t fileStart, uint8_t partition) {
+    char name[24];
+    shunt_full_name(fileStart, partition, name, sizeof(name));
+    std::vector<std::string> parts;
+    char* save;
+    for (char* part = strtok_r(name, "/", &save); part; part = strtok_r(NULL, "/", &save)) parts.push_back(part);
+    parts.back() += ".bin0";
+    return parts;
+}
+
+// Sectors read to open an existing file; /full itself is an entry of the root
+static uint32_t openFile(FatDirectory& full, int64_t fileStart, uint8_t partition) {
+    uint32_t sectors = 1;
+    FatDirectory* dir = &full;
+    std::vector<std::string> parts = components(fileStart, partition);
+    for (size_t i = 0; i < parts.size(); i++) {
+        bool found;
+        sectors += dir->find(parts[i], found);
+        if (!found) abort();
+        if (i + 1 < parts.size()) dir = dir->children[parts[i]].get();
+    }
+    return sectors;
+}
+
+// Sectors read to create a file, making its directories as needed; false if FatFs would refuse
+static bool createFile(FatDirectory& full, int64_t fileStart, uint8_t partition, uint32_t& sectors) {
+    sectors = 1;
+    FatDirectory* dir = &full;
+    std::vector<std::string> parts = components(fileStart, partition);
+    for (size_t i = 0; i + 1 < parts.size(); i++) {
+        bool found;
+        sectors += dir->find(parts[i], found);
+        if (!found) {
+            if (!dir->create(parts[i], sectors)) return false;
+            dir->children[parts[i]].reset(new FatDirectory(false));
+        }
+        dir = dir->children[parts[i]].get();
+    }
+    return dir->create(parts.back(), sectors);
+}
+
+static void report(const char* what, double sectors) {
+    printf("  %-12s %9.1f sectors %9.1f ms\n", what, sectors, sectors * SD_SECTOR_MICROS / 1000.0);
+}
+
+static void run(const Layout& layout) {
+    FatDirectory full(false);
+    std::vector<int64_t> files;
+    uint32_t checkpoint = 0;
+    uint64_t recentCreates = 0;
+    srand(1);
+    printf("\n%s\n", layout.name);
+    for (int64_t t = START; checkpoint < sizeof(CHECKPOINTS) / sizeof(CHECKPOINTS[0]); t += layout.fileSeconds) {
+        uint32_t sectors = 0;
+        if (!createFile(full, t, layout.partition, sectors)) {
+            printf(" %6lu files: can't create %s, the directory is full\n", (unsigned long)files.size(),
+                   components(t, layout.partition).back().c_str());
+            return;
+        }
+        files.push_back(t);
+        if (files.size() > CHECKPOINTS[checkpoint] - CREATES_AVERAGED) recentCreates += sectors;
+        if (files.size() < CHECKPOINTS[checkpoint]) continue;
+
+        uint64_t randomSectors = 0;
+        for (uint32_t i = 0; i < RANDOM_OPENS; i++) {
+            randomSectors += openFile(full, files[(size_t)rand() % files.size()], layout.partition);
+        }
+        printf(" %6lu files, %.0f days:\n", (unsigned long)files.size(), (double)(t - START) / 86400.0);
+        report("create", (double)recentCreates / CREATES_AVERAGED);
+        report("open newest", openFile(full, files.back(), layout.partition));
+        report("open random", (double)randomSectors / RANDOM_OPENS);
+        recentCreates = 0;
+        checkpoint++;
+    }
+}
+
+int main() {
+    // Open newest is what the logger does every minute, reopening its file after the rollups
+    const Layout layouts[] = {
+        {"flat, a file a minute (the old layout)", SHUNT_PARTITION_NONE, 60},
+        {"day partitions, a file a minute", SHUNT_PARTITION_DAY, 60},
+        {"hour partitions, a file a minute", SHUNT_PARTITION_HOUR, 60},
+        {"day partitions, a file an hour (the default)", SHUNT_PARTITION_DAY, 3600},
+    };
+    for (const Layout& layout : layouts) run(layout);
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Host benchmark: /api/series over a generated week of logs, compared with what the web UI
+// downloads today (every /daily file, or every /full minute file, for the range).
+//
+// SD time is estimated from bytes read at SD_BYTES_PER_SECOND plus SD_SEEK_MICROS per read call,
+// which is roughly what the ESP32 gets from a class 10 card over SPI at 20 MHz.
+//
+// Build and run from the project root:
+//   g++ -O2 -std=gnu++17 -Ilib/ShuntLog bench/bench_series.cpp -o bench_series && ./bench_series
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+
+#include "ShuntLog.h"
+#include "ShuntSeries.h"
+#include "MemoryLogStorage.h"
+
+#define DAYS 7
+#define SD_BYTES_PER_SECOND 1000000.0
+#define SD_SEEK_MICROS 200.0
+
+// 2023-07-17T00:00:00Z
+static const int64_t START = 1689552000;
+
+static RollupRecord makeRollup(int64_t timestamp, uint32_t i) {
+    RollupRecord record;
+    record.timestamp = timestamp;
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+        int32_t bus = 9600 + (int32_t)((i * 7 + ch) % 50);
+        int32_t shunt = (int32_t)((i * 13 + ch) % 400) - 200;
+        record.busMin[ch] = bus - 5;
+        record.busMean[ch] = bus;
+        record.busMax[ch] = bus + 5;
+        record.shuntMin[ch] = shunt - 20;
+        record.shuntMean[ch] = shunt;
+        record.shuntMax[ch] = shunt + 20;
+    }
+    return record;
+}
+
+static void writeRollups(MemoryLogStorage& storage, ShuntLogLevel level, uint32_t count) {
+    uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+    char path[40];
+    uint32_t seconds = shunt_log_level_seconds(level);
+    for (uint32_t i = 0; i < count; i++) {
+        int64_t end = START + (int64_t)(i + 1) * seconds;
+        shunt_log_path(level, shunt_log_file_start(level, end), path, sizeof(path));
+        size_t length = shunt_log_encode_rollup(makeRollup(end, i), 4, buffer);
+        storage.append(path, buffer, length);
+    }
+}
+
+static void run(MemoryLogStorage& storage, const char* name, SeriesQuery query) {
+    storage.reads = 0;
+    storage.bytesRead = 0;
+    storage.opens = 0;
+    uint8_t chunk[1436];  // One TCP segment
+    size_t bytesOut = 0;
+    uint32_t chunks = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    ShuntSeriesReader reader(storage, query);
+    while (!reader.finished()) {
+        bytesOut += reader.fill(chunk, sizeof(chunk));
+        chunks++;
+    }
+    double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double sdMs = storage.bytesRead / SD_BYTES_PER_SECOND * 1000.0 + storage.reads * SD_SEEK_MICROS / 1000.0;
+
+    printf("%-28s level %-6s res %5us  points %5u  files %4u  reads %6u  read %8.1f kB  sent %7.1f kB  host %6.2f ms  est. SD %7.1f ms\n",
+           name, shunt_log_level_name(reader.level), reader.query.resolution, reader.points, storage.opens, storage.reads,
+           storage.bytesRead / 1000.0, bytesOut / 1000.0, cpuMs, sdMs);
+}
+
+int main() {
+    MemoryLogStorage storage;
+    writeRollups(storage, SHUNT_LOG_MINUTE, DAYS * 1440);
+    writeRollups(storage, SHUNT_LOG_HOUR, DAYS * 24);
+
+    uint64_t dailyBytes = 0;
+    for (auto& file : storage.files) {
+        if (file.first.compare(0, 7, "/daily/") == 0) dailyBytes += file.second.size();
+    }
+    uint64_t fullBytes = (uint64_t)DAYS * 86400 * shunt_log_record_size(SHUNT_LOG_FULL, 4);
+    printf("Today, a week chart downloads %.1f MB of /daily files (%u files) or %.1f MB of /full files (%u files)\n\n",
+           dailyBytes / 1e6, DAYS, fullBytes / 1e6, DAYS * 1440);
+
+    const int64_t week = (int64_t)DAYS * 86400;
+    run(storage, "week, default resolution", {0, START, START + week, 0, false});
+    run(storage, "week, 1 h, binary", {0, START, START + week, 3600, true});
+    run(storage, "week, 10 min (falls back)", {0, START, START + week, 600, false});
+    run(storage, "day, 5 min", {0, START + 2 * 86400, START + 3 * 86400, 300, false});
+    run(storage, "6 hours, 1 min", {3, START + 86400 + 3600, START + 86400 + 7 * 3600, 60, false});
+    return 0;
+}
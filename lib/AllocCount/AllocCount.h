@@ -0,0 +1,68 @@
+#ifndef ALLOCCOUNT_h
+#define ALLOCCOUNT_h
+
+#include <stdint.h>
+
+/*
+ * Checking that a loop leaves the heap alone. The sampler's steady state (reading the shunts,
+ * writing the record, the minute's rollup, queueing the live sample) allocates nothing: a malloc()
+ * there is time taken out of the sample, and a block freed again a moment later is a hole in the
+ * heap the web server needs in large pieces.
+ *
+ * Hooks installed by the build call AllocCounter::note() for every allocation made by the code
+ * being watched: the firmware wraps malloc() when built with SHUNT_COUNT_ALLOCS (see
+ * src/alloc_count.h), the tests replace operator new. AllocWatch takes the count across each
+ * iteration. Iterations that open a file are expected to allocate, the SD library keeps its file
+ * handles on the heap, and are counted apart.
+ */
+
+class AllocCounter {
+public:
+    uint32_t count = 0;
+
+    void note() {
+        count++;
+    }
+};
+
+class AllocWatch {
+public:
+    uint32_t iterations = 0;            // steady-state iterations ended
+    uint32_t allocatingIterations = 0;  // of those, ones that allocated
+    uint32_t allocations = 0;           // made by those
+    uint32_t worst = 0;                 // most made by one of them
+    uint32_t rotations = 0;             // iterations that opened files
+    uint32_t rotationAllocations = 0;
+    uint32_t rotationWorst = 0;         // most made by one of them
+
+    void begin(const AllocCounter& counter) {
+        mark = counter.count;
+    }
+
+    // Ends the iteration begun last; returns how many allocations it made if it should have made
+    // none, 0 if it didn't or was a `rotation`
+    uint32_t end(const AllocCounter& counter, bool rotation) {
+        uint32_t made = counter.count - mark;
+        if (rotation) {
+            rotations++;
+            rotationAllocations += made;
+            if (made > rotationWorst) rotationWorst = made;
+            return 0;
+        }
+        iterations++;
+        if (made == 0) return 0;
+        allocatingIterations++;
+        allocations += made;
+        if (made > worst) worst = made;
+        return made;
+    }
+
+    bool clean() const {
+        return allocatingIterations == 0;
+    }
+
+private:
+    uint32_t mark = 0;
+};
+
+#endif
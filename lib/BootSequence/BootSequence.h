@@ -0,0 +1,158 @@
+#ifndef BOOTSEQUENCE_h
+#define BOOTSEQUENCE_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * The boot split in two: what logging needs (SD card, RTC, recovery, INAs) runs straight through in
+ * setup(), and the network (Wi-Fi, then mDNS, OTA and the web server once it connects) comes up
+ * alongside in a task of its own, so a missing access point never holds up a sample.
+ *
+ * BootTimeline times the stages of each for the boot report; NetworkBoot decides, each time it is
+ * polled, what the network task should do next. Both take the time in ms and do no I/O.
+ */
+
+#define BOOT_MAX_STAGES 10
+
+// How long a connection attempt gets before Wi-Fi is started over, doubling each time it fails
+#ifndef NETWORK_CONNECT_TIMEOUT_MS
+#define NETWORK_CONNECT_TIMEOUT_MS 15000
+#endif
+#ifndef NETWORK_CONNECT_MAX_TIMEOUT_MS
+#define NETWORK_CONNECT_MAX_TIMEOUT_MS 240000
+#endif
+
+struct BootStage {
+    const char* name;
+    uint32_t ms;
+};
+
+// Consecutive stages of one task's part of the boot
+class BootTimeline {
+public:
+    uint32_t startMs = 0;
+    uint32_t endMs = 0;
+    uint8_t count = 0;
+    BootStage stages[BOOT_MAX_STAGES];
+
+    void begin(uint32_t now) {
+        startMs = endMs = now;
+        count = 0;
+        current = NULL;
+    }
+
+    // Ends the stage running, if any, and starts `name`; beyond BOOT_MAX_STAGES the time goes to
+    // the last one
+    void stage(const char* name, uint32_t now) {
+        finish(now);
+        current = name;
+    }
+
+    void finish(uint32_t now) {
+        if (current != NULL) {
+            if (count < BOOT_MAX_STAGES) {
+                stages[count].name = current;
+                stages[count].ms = now - endMs;
+                count++;
+            } else {
+                stages[BOOT_MAX_STAGES - 1].ms += now - endMs;
+            }
+            current = NULL;
+        }
+        endMs = now;
+    }
+
+    uint32_t totalMs() const {
+        return endMs - startMs;
+    }
+
+    // "sd 120 ms, rtc 1003 ms"; truncated to fit, always terminated
+    size_t format(char* out, size_t capacity) const {
+        if (capacity == 0) return 0;
+        size_t length = 0;
+        out[0] = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            int written = snprintf(out + length, capacity - length, "%s%s %u ms", i == 0 ? "" : ", ",
+                                   stages[i].name, (unsigned)stages[i].ms);
+            if (written < 0) break;
+            if ((size_t)written >= capacity - length) return capacity - 1;
+            length += written;
+        }
+        return length;
+    }
+
+private:
+    const char* current = NULL;
+};
+
+enum NetworkBootState {
+    NETWORK_IDLE,
+    NETWORK_CONNECTING,
+    NETWORK_UP,
+};
+
+enum NetworkBootAction {
+    NETWORK_WAIT,             // nothing to do until the next poll
+    NETWORK_CONNECT,          // start (or restart) joining the access point
+    NETWORK_START_SERVICES,   // first connection: bring up mDNS, OTA and the web server
+    NETWORK_CONNECTED,        // connected again after a drop; the services are still there
+};
+
+class NetworkBoot {
+public:
+    NetworkBootState state = NETWORK_IDLE;
+    uint32_t attempts = 0;     // connection attempts started
+    uint32_t drops = 0;        // times a connection was lost
+    bool servicesStarted = false;
+
+    NetworkBootAction step(uint32_t now, bool connected) {
+        switch (state) {
+            case NETWORK_IDLE:
+                return connect(now, NETWORK_CONNECT_TIMEOUT_MS);
+            case NETWORK_CONNECTING:
+                if (connected) {
+                    state = NETWORK_UP;
+                    timeout = NETWORK_CONNECT_TIMEOUT_MS;
+                    if (servicesStarted) return NETWORK_CONNECTED;
+                    servicesStarted = true;
+                    return NETWORK_START_SERVICES;
+                }
+                if (now - since >= timeout) {
+                    uint32_t next = timeout * 2;
+                    return connect(now, next > NETWORK_CONNECT_MAX_TIMEOUT_MS ? NETWORK_CONNECT_MAX_TIMEOUT_MS : next);
+                }
+                return NETWORK_WAIT;
+            case NETWORK_UP:
+                if (!connected) {
+                    // The driver reconnects by itself; only if it hasn't within the timeout is it
+                    // started over
+                    state = NETWORK_CONNECTING;
+                    since = now;
+                    drops++;
+                }
+                return NETWORK_WAIT;
+        }
+        return NETWORK_WAIT;
+    }
+
+    // Until the current attempt is given up on
+    uint32_t timeoutMs() const {
+        return timeout;
+    }
+
+private:
+    uint32_t since = 0;
+    uint32_t timeout = NETWORK_CONNECT_TIMEOUT_MS;
+
+    NetworkBootAction connect(uint32_t now, uint32_t nextTimeout) {
+        state = NETWORK_CONNECTING;
+        since = now;
+        timeout = nextTimeout;
+        attempts++;
+        return NETWORK_CONNECT;
+    }
+};
+
+#endif
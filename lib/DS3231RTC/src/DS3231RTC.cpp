@@ -121,6 +121,25 @@ void DS3231RTC::set12HourMode() {
   Wire.endTransmission();
 }
 
+// SQW/INT as a 1 Hz square wave rather than the alarm interrupt; its falling edge is where the
+// seconds register ticks over. The pin is open drain, so it needs a pull-up.
+void DS3231RTC::enableSquareWave1Hz() {
+  Wire.beginTransmission(_deviceAddress);
+  Wire.write(DS_REG_CON);
+  Wire.endTransmission();
+
+  Wire.requestFrom(_deviceAddress, 1);
+  uint8_t control = Wire.read();
+  control &= ~(1 << 7); // Clear EOSC (oscillator runs)
+  control &= ~(1 << 2); // Clear INTCN (square wave on SQW/INT)
+  control &= ~(3 << 3); // Clear RS2 and RS1 (1 Hz)
+
+  Wire.beginTransmission(_deviceAddress);
+  Wire.write(DS_REG_CON);
+  Wire.write(control);
+  Wire.endTransmission();
+}
+
 String DS3231RTC::getTimestamp() {
   uint8_t second, minute, hour, dayOfWeek, dayOfMonth, month;
   uint16_t year;
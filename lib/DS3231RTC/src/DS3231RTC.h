@@ -33,6 +33,7 @@ class DS3231RTC {
     void getTimeDate(uint16_t *year, uint8_t *month, uint8_t *dayOfMonth, uint8_t *hour, uint8_t *minute, uint8_t *second, uint8_t *dayOfWeek);
     void set24HourMode();
     void set12HourMode();
+    void enableSquareWave1Hz();
     String getTimestamp();
     String getFSSafeTimestamp();
 };
@@ -0,0 +1,288 @@
+#ifndef DIRLISTING_h
+#define DIRLISTING_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+/*
+ * Paged directory listings, streamed as JSON one entry at a time:
+ *   {"path":"/full","offset":0,"limit":100,"entries":[
+ *     {"name":"20230723T113500.bin0","size":10440,"mtime":1690112159},{"name":"old","dir":true,...},...],
+ *    "next":100,"total":43155,"bytes":7508970}
+ * `next` is the offset of the following page, null on the last one. `total` and `bytes` count the
+ * entries that match (and their sizes); they are null when they would need a scan of the rest of a
+ * filtered listing.
+ *
+ * The directory is read in its own (creation) order. Paging skips `offset` entries each time, so
+ * a page costs as many directory reads as entries before it, but no RAM beyond one entry.
+ */
+
+#ifndef DIR_LISTING_DEFAULT_LIMIT
+#define DIR_LISTING_DEFAULT_LIMIT 100
+#endif
+#ifndef DIR_LISTING_MAX_LIMIT
+#define DIR_LISTING_MAX_LIMIT 1000
+#endif
+
+struct DirEntryInfo {
+    const char* name;  // Valid until the next call to the source
+    bool dir;
+    uint32_t size;
+    int64_t mtime;
+};
+
+// Where entries come from: the SD card on the device, a vector on the host
+class DirListingSource {
+public:
+    virtual ~DirListingSource() {}
+    virtual bool next(DirEntryInfo& entry) = 0;
+};
+
+struct DirListingQuery {
+    uint32_t offset;
+    uint32_t limit;
+    const char* pattern;  // Glob, NULL for everything
+    bool hidden;          // Include names starting with '.'
+};
+
+// Visible entries of a whole directory
+struct DirSummary {
+    uint32_t entries;
+    uint64_t bytes;
+    int64_t newest;
+};
+
+// A directory's summary, built by a full listing and dropped whenever the directory changes.
+// invalidate() may be called from another task than get() and store().
+class DirSummaryCache {
+public:
+
+    DirSummaryCache() : generation(1), storedGeneration(0) {}
+
+    void invalidate() {
+        generation.fetch_add(1);
+    }
+
+    // The generation to pass to store() for a scan starting now
+    uint32_t current() const {
+        return generation.load();
+    }
+
+    bool get(DirSummary& out) const {
+        if (storedGeneration != generation.load()) return false;
+        out = summary;
+        return true;
+    }
+
+    // Keeps a summary scanned since current() returned `scanGeneration`, unless it changed meanwhile
+    void store(const DirSummary& scanned, uint32_t scanGeneration) {
+        if (scanGeneration != generation.load()) return;
+        summary = scanned;
+        storedGeneration = scanGeneration;
+    }
+
+private:
+
+    std::atomic<uint32_t> generation;
+    uint32_t storedGeneration;
+    DirSummary summary;
+};
+
+// Shell-style match of `*` (any run) and `?` (any one character)
+inline bool dir_glob_match(const char* pattern, const char* name) {
+    const char* star = NULL;
+    const char* resume = NULL;
+    while (*name) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (*pattern == '?' || *pattern == *name) {
+            pattern++;
+            name++;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') pattern++;
+    return *pattern == 0;
+}
+
+// Copies `text` as the inside of a JSON string; returns the length, or 0 if it doesn't fit
+inline size_t dir_json_escape(char* out, size_t capacity, const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    size_t written = 0;
+    for (; *text; text++) {
+        uint8_t c = (uint8_t)*text;
+        size_t need = c == '"' || c == '\\' ? 2 : c < 0x20 ? 6 : 1;
+        if (written + need >= capacity) return 0;
+        if (need == 2) {
+            out[written++] = '\\';
+            out[written++] = (char)c;
+        } else if (need == 6) {
+            memcpy(out + written, "\\u00", 4);
+            out[written + 4] = hex[c >> 4];
+            out[written + 5] = hex[c & 0xF];
+            written += 6;
+        } else {
+            out[written++] = (char)c;
+        }
+    }
+    out[written] = 0;
+    return written;
+}
+
+// Streams one page of a listing as a sequence of chunks
+class DirListingReader {
+public:
+
+    DirListingQuery query;
+    uint32_t matched;     // Matching entries read so far, listed or not
+    uint64_t matchedBytes;
+    int64_t newest;
+    uint32_t listed;
+    uint32_t read;        // Entries read from the source
+    bool complete;        // Read to the end of the directory
+
+    // `cached` is the directory's summary if one is known; it saves reading past the page
+    DirListingReader(DirListingSource& source, const char* path, const DirListingQuery& request, const DirSummary* cached)
+        : query(request), matched(0), matchedBytes(0), newest(0), listed(0), read(0), complete(false), source(source),
+          path(path), haveCached(false), stage(HEADER), more(false), pendingLength(0), pendingOffset(0) {
+        if (query.limit == 0) query.limit = DIR_LISTING_DEFAULT_LIMIT;
+        if (query.limit > DIR_LISTING_MAX_LIMIT) query.limit = DIR_LISTING_MAX_LIMIT;
+        if (query.pattern != NULL && query.pattern[0] == 0) query.pattern = NULL;
+        // The summary only counts what an unfiltered listing shows
+        if (cached != NULL && unfiltered()) {
+            summary = *cached;
+            haveCached = true;
+        }
+    }
+
+    // The whole directory's summary, once an unfiltered listing has read all of it
+    bool scanned(DirSummary& out) const {
+        if (!complete || !unfiltered()) return false;
+        out.entries = matched;
+        out.bytes = matchedBytes;
+        out.newest = newest;
+        return true;
+    }
+
+    bool finished() const {
+        return stage == DONE && pendingOffset == pendingLength;
+    }
+
+    // Writes as much output as fits; an entry is never split across calls. Returns 0 once finished.
+    size_t fill(uint8_t* out, size_t capacity) {
+        size_t written = 0;
+        while (true) {
+            if (pendingOffset < pendingLength) {
+                size_t length = pendingLength - pendingOffset;
+                if (length > capacity - written) {
+                    if (written > 0 || pendingOffset > 0) return written;
+                    // Smaller than one entry: hand it over in pieces
+                    length = capacity - written;
+                }
+                memcpy(out + written, pending + pendingOffset, length);
+                written += length;
+                pendingOffset += length;
+                if (pendingOffset < pendingLength) return written;
+            }
+            pendingOffset = pendingLength = 0;
+            if (stage == DONE) return written;
+            produce();
+        }
+    }
+
+private:
+
+    enum Stage { HEADER, ENTRIES, DONE };
+
+    DirListingSource& source;
+    const char* path;
+    DirSummary summary;
+    bool haveCached;
+    Stage stage;
+    bool more;
+    char pending[400];
+    size_t pendingLength;
+    size_t pendingOffset;
+
+    bool unfiltered() const {
+        return query.pattern == NULL && !query.hidden;
+    }
+
+    void setPending(int length) {
+        pendingLength = length > 0 && (size_t)length < sizeof(pending) ? (size_t)length : 0;
+    }
+
+    // Puts the next piece of output in `pending`
+    void produce() {
+        if (stage == HEADER) {
+            stage = ENTRIES;
+            char name[256];
+            dir_json_escape(name, sizeof(name), path);
+            setPending(snprintf(pending, sizeof(pending), "{\"path\":\"%s\",\"offset\":%lu,\"limit\":%lu,\"entries\":[", name,
+                                (unsigned long)query.offset, (unsigned long)query.limit));
+            return;
+        }
+        if (stage == ENTRIES) {
+            DirEntryInfo entry;
+            while (nextMatch(entry)) {
+                if (matched <= query.offset) continue;
+                if (listed == query.limit) {
+                    more = true;
+                    // With a summary there's nothing more to learn; an unfiltered listing reads on to
+                    // make one, a filtered one stops here
+                    if (haveCached || !unfiltered()) break;
+                    continue;
+                }
+                char name[256];
+                if (dir_json_escape(name, sizeof(name), entry.name) == 0) continue;
+                if (entry.dir) {
+                    setPending(snprintf(pending, sizeof(pending), "%s{\"name\":\"%s\",\"dir\":true,\"mtime\":%lld}",
+                                        listed ? "," : "", name, (long long)entry.mtime));
+                } else {
+                    setPending(snprintf(pending, sizeof(pending), "%s{\"name\":\"%s\",\"size\":%lu,\"mtime\":%lld}",
+                                        listed ? "," : "", name, (unsigned long)entry.size, (long long)entry.mtime));
+                }
+                listed++;
+                return;
+            }
+        }
+        stage = DONE;
+        int length = snprintf(pending, sizeof(pending), "],\"next\":");
+        length += more ? snprintf(pending + length, sizeof(pending) - length, "%lu", (unsigned long)(query.offset + listed))
+                       : snprintf(pending + length, sizeof(pending) - length, "null");
+        if (complete) {
+            length += snprintf(pending + length, sizeof(pending) - length, ",\"total\":%lu,\"bytes\":%llu}",
+                               (unsigned long)matched, (unsigned long long)matchedBytes);
+        } else if (haveCached) {
+            length += snprintf(pending + length, sizeof(pending) - length, ",\"total\":%lu,\"bytes\":%llu}",
+                               (unsigned long)summary.entries, (unsigned long long)summary.bytes);
+        } else {
+            length += snprintf(pending + length, sizeof(pending) - length, ",\"total\":null,\"bytes\":null}");
+        }
+        setPending(length);
+    }
+
+    bool nextMatch(DirEntryInfo& entry) {
+        while (source.next(entry)) {
+            read++;
+            if (entry.name[0] == '.' && !query.hidden) continue;
+            if (query.pattern != NULL && !dir_glob_match(query.pattern, entry.name)) continue;
+            matched++;
+            if (!entry.dir) matchedBytes += entry.size;
+            if (entry.mtime > newest) newest = entry.mtime;
+            return true;
+        }
+        complete = true;
+        return false;
+    }
+};
+
+#endif
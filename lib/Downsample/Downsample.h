@@ -0,0 +1,246 @@
+#ifndef DOWNSAMPLE_h
+#define DOWNSAMPLE_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Streaming downsamplers for charting. Both split [from, to) into equal time buckets, take points
+ * in time order one at a time and hold a fixed amount of state however many points they see.
+ *
+ * LttbStream: largest-triangle-three-buckets. Emits the first and last point plus one point per
+ * bucket, the one that makes the largest triangle with the point picked in the bucket before and
+ * the mean of the bucket after. Classic LTTB looks at every point of the bucket; to stay in
+ * constant memory this keeps four candidates per bucket (first, last, lowest, highest), which is
+ * where the largest triangle is for anything that looks like a time series, and picks among them
+ * once the following bucket has closed.
+ *
+ * MinMaxStream: one (bucket start, min, max) envelope per bucket, so no spike is ever lost.
+ */
+
+struct DownsamplePoint {
+    int64_t x;
+    int32_t y;
+    int32_t y2;  // Max of the bucket for MinMaxStream, same as y for LTTB
+};
+
+// Tiny FIFO for points a stream has finished with
+template <uint8_t DEPTH>
+class DownsampleQueue {
+public:
+
+    DownsampleQueue() : head(0), count(0) {}
+
+    void push(const DownsamplePoint& point) {
+        if (count == DEPTH) return;  // Callers drain after every add(), so this can't happen
+        points[(head + count) % DEPTH] = point;
+        count++;
+    }
+
+    bool pop(DownsamplePoint& point) {
+        if (count == 0) return false;
+        point = points[head];
+        head = (head + 1) % DEPTH;
+        count--;
+        return true;
+    }
+
+private:
+
+    DownsamplePoint points[DEPTH];
+    uint8_t head;
+    uint8_t count;
+};
+
+// Maps x to equal-width buckets over [from, to)
+class DownsampleBuckets {
+public:
+
+    int64_t from;
+    int64_t to;
+    uint32_t buckets;
+
+    void setup(int64_t rangeFrom, int64_t rangeTo, uint32_t bucketCount) {
+        from = rangeFrom;
+        to = rangeTo > rangeFrom ? rangeTo : rangeFrom + 1;
+        buckets = bucketCount > 0 ? bucketCount : 1;
+    }
+
+    uint32_t bucket(int64_t x) const {
+        if (x <= from) return 0;
+        uint64_t index = (uint64_t)(x - from) * buckets / (uint64_t)(to - from);
+        return index >= buckets ? buckets - 1 : (uint32_t)index;
+    }
+
+    // The first whole x in the bucket
+    int64_t bucketStart(uint32_t index) const {
+        return from + (int64_t)(((uint64_t)index * (uint64_t)(to - from) + buckets - 1) / buckets);
+    }
+};
+
+class LttbStream {
+public:
+
+    // At most `maxPoints` points (at least 3) for the range
+    void setup(int64_t from, int64_t to, uint32_t maxPoints) {
+        ranges.setup(from, to, maxPoints > 3 ? maxPoints - 2 : 1);
+        seen = 0;
+        pendingValid = false;
+        current.reset(0);
+    }
+
+    void add(int64_t x, int32_t y) {
+        DownsamplePoint point = {x, y, y};
+        if (seen++ == 0) {
+            // The first point is always kept and anchors the first triangle
+            selected = point;
+            output.push(point);
+            return;
+        }
+        last = point;
+        uint32_t index = ranges.bucket(x);
+        if (current.count > 0 && index != current.index) closeBucket();
+        if (current.count == 0) current.reset(index);
+        current.add(point);
+    }
+
+    // Flushes the last buckets and the final point; call once after the last add()
+    void finish() {
+        if (seen < 2) return;
+        // The final point plays the part of the next bucket's mean for the last bucket
+        if (current.count > 0) closeBucket();
+        if (pendingValid) {
+            Candidates end;
+            end.reset(0);
+            end.add(last);
+            pickPending(end);
+        }
+        // Unless it was picked as a candidate already
+        if (selected.x != last.x || selected.y != last.y) output.push(last);
+    }
+
+    bool pop(DownsamplePoint& point) {
+        return output.pop(point);
+    }
+
+private:
+
+    struct Candidates {
+        uint32_t index;
+        uint32_t count;
+        int64_t sumX;  // Integer sums: the ESP32 has no double-precision FPU
+        int64_t sumY;
+        DownsamplePoint first;
+        DownsamplePoint last;
+        DownsamplePoint low;
+        DownsamplePoint high;
+
+        void reset(uint32_t bucketIndex) {
+            index = bucketIndex;
+            count = 0;
+            sumX = 0;
+            sumY = 0;
+        }
+
+        void add(const DownsamplePoint& point) {
+            if (count == 0) {
+                first = low = high = point;
+            }
+            if (point.y < low.y) low = point;
+            if (point.y > high.y) high = point;
+            last = point;
+            sumX += point.x;
+            sumY += point.y;
+            count++;
+        }
+    };
+
+    DownsampleBuckets ranges;
+    uint32_t seen;
+    DownsamplePoint selected;  // Picked in the bucket before the pending one
+    DownsamplePoint last;
+    Candidates pending;        // Waiting for the bucket after it to close
+    bool pendingValid;
+    Candidates current;
+    DownsampleQueue<4> output;
+
+    static double area(const DownsamplePoint& a, const DownsamplePoint& b, double cx, double cy) {
+        double value = ((double)b.x - (double)a.x) * (cy - a.y) - ((double)b.y - a.y) * (cx - (double)a.x);
+        return value < 0 ? -value : value;
+    }
+
+    void pickPending(const Candidates& next) {
+        double cx = (double)next.sumX / next.count;
+        double cy = (double)next.sumY / next.count;
+        const DownsamplePoint* options[4] = {&pending.first, &pending.low, &pending.high, &pending.last};
+        const DownsamplePoint* best = options[0];
+        double bestArea = -1;
+        for (const DownsamplePoint* option : options) {
+            double a = area(selected, *option, cx, cy);
+            if (a > bestArea) {
+                bestArea = a;
+                best = option;
+            }
+        }
+        selected = *best;
+        output.push(selected);
+    }
+
+    void closeBucket() {
+        if (pendingValid) pickPending(current);
+        pending = current;
+        pendingValid = true;
+        current.count = 0;
+    }
+};
+
+class MinMaxStream {
+public:
+
+    void setup(int64_t from, int64_t to, uint32_t maxPoints) {
+        ranges.setup(from, to, maxPoints);
+        count = 0;
+    }
+
+    void add(int64_t x, int32_t y) {
+        add(x, y, y);
+    }
+
+    // Adds something that already has a spread, like a rollup record
+    void add(int64_t x, int32_t low, int32_t high) {
+        uint32_t index = ranges.bucket(x);
+        if (count > 0 && index != bucketIndex) flush();
+        if (count == 0) {
+            bucketIndex = index;
+            envelope.x = ranges.bucketStart(index);
+            envelope.y = low;
+            envelope.y2 = high;
+        }
+        if (low < envelope.y) envelope.y = low;
+        if (high > envelope.y2) envelope.y2 = high;
+        count++;
+    }
+
+    void finish() {
+        if (count > 0) flush();
+    }
+
+    bool pop(DownsamplePoint& point) {
+        return output.pop(point);
+    }
+
+private:
+
+    DownsampleBuckets ranges;
+    uint32_t bucketIndex;
+    uint32_t count;
+    DownsamplePoint envelope;
+    DownsampleQueue<2> output;
+
+    void flush() {
+        output.push(envelope);
+        count = 0;
+    }
+};
+
+#endif
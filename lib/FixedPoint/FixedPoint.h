@@ -0,0 +1,122 @@
+#ifndef FIXEDPOINT_h
+#define FIXEDPOINT_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// INA226 register scales. The shunt LSB is 2.5 uV, so it is kept in nanovolts to stay integral.
+#define INA226_SHUNT_NANOVOLTS_PER_LSB 2500
+#define INA226_BUS_MICROVOLTS_PER_LSB 1250
+
+// One converted sample, all in integer engineering units
+struct ShuntReading {
+    int32_t busMicroVolts;
+    int32_t shuntNanoVolts;
+    int32_t microAmps;
+    int64_t microWatts;
+};
+
+// Converts raw INA226 register values to engineering units using multipliers that are
+// computed once from the shunt resistance, so the sampling path is a couple of integer multiplies.
+class ShuntScale {
+public:
+
+    // Microamps per shunt LSB in Q16 fixed point (2500 nV / R uOhm * 1000)
+    int64_t microAmpsPerLsbQ16;
+
+    explicit ShuntScale(uint32_t shuntMicroOhm)
+        : microAmpsPerLsbQ16(((int64_t)INA226_SHUNT_NANOVOLTS_PER_LSB * 1000 * 65536 + shuntMicroOhm / 2) / shuntMicroOhm) {}
+
+    int32_t busMicroVolts(uint32_t busRaw) const {
+        return (int32_t)(busRaw * INA226_BUS_MICROVOLTS_PER_LSB);
+    }
+
+    int32_t shuntNanoVolts(int32_t shuntRaw) const {
+        return shuntRaw * INA226_SHUNT_NANOVOLTS_PER_LSB;
+    }
+
+    int32_t microAmps(int32_t shuntRaw) const {
+        int64_t scaled = (int64_t)shuntRaw * microAmpsPerLsbQ16;
+        // Round half away from zero before dropping the fraction bits
+        if (scaled >= 0) {
+            return (int32_t)((scaled + 32768) >> 16);
+        }
+        return (int32_t)-((-scaled + 32768) >> 16);
+    }
+
+    static int64_t microWatts(int32_t busMicroVolts, int32_t microAmps) {
+        return (int64_t)busMicroVolts * microAmps / 1000000;
+    }
+
+    void convert(uint32_t busRaw, int32_t shuntRaw, ShuntReading& reading) const {
+        reading.busMicroVolts = busMicroVolts(busRaw);
+        reading.shuntNanoVolts = shuntNanoVolts(shuntRaw);
+        reading.microAmps = microAmps(shuntRaw);
+        reading.microWatts = microWatts(reading.busMicroVolts, reading.microAmps);
+    }
+};
+
+// Appends text into a caller-owned buffer without touching the heap. Output is truncated (but
+// always null-terminated) if the buffer is too small; check `truncated` if that matters.
+class FixedWriter {
+public:
+
+    char* buffer;
+    size_t capacity;
+    size_t length;
+    bool truncated;
+
+    FixedWriter(char* buffer, size_t capacity) : buffer(buffer), capacity(capacity), length(0), truncated(false) {
+        if (capacity > 0) buffer[0] = '\0';
+    }
+
+    void append(char c) {
+        if (length + 1 < capacity) {
+            buffer[length++] = c;
+            buffer[length] = '\0';
+        } else {
+            truncated = true;
+        }
+    }
+
+    void append(const char* text) {
+        while (*text) append(*text++);
+    }
+
+    void appendUInt(uint64_t value) {
+        char digits[20];
+        uint8_t count = 0;
+        do {
+            digits[count++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (count > 0) append(digits[--count]);
+    }
+
+    void appendInt(int64_t value) {
+        if (value < 0) {
+            append('-');
+            appendUInt(0 - (uint64_t)value);
+        } else {
+            appendUInt((uint64_t)value);
+        }
+    }
+
+    // Writes value / 10^decimals with exactly `decimals` digits after the point,
+    // e.g. appendFixed(12345678, 6) -> "12.345678"
+    void appendFixed(int64_t value, uint8_t decimals) {
+        uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+        uint64_t divisor = 1;
+        for (uint8_t i = 0; i < decimals; i++) divisor *= 10;
+        if (value < 0) append('-');
+        appendUInt(magnitude / divisor);
+        if (decimals == 0) return;
+        append('.');
+        uint64_t fraction = magnitude % divisor;
+        for (divisor /= 10; divisor > 0; divisor /= 10) {
+            append((char)('0' + (fraction / divisor) % 10));
+        }
+    }
+};
+
+#endif
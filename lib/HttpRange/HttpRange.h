@@ -0,0 +1,197 @@
+#ifndef HTTPRANGE_h
+#define HTTPRANGE_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * Conditional and partial GETs of files (RFC 9110 sections 13 and 14), kept free of the web server
+ * so it can be tested on the host.
+ *
+ * Validators come from the file's size and mtime: the ETag is "<size hex>-<mtime hex>", which
+ * changes with every append. A collector pulling the tail of a growing file sends
+ *   If-None-Match: <etag it has>       -> 304 while nothing was appended
+ *   Range: bytes=<bytes it has>-       -> 206 with just the new bytes otherwise
+ * A Range starting at the end of the file gets 416 with the current size in Content-Range.
+ *
+ * Only single ranges are served; a multi-range request gets the whole file, which the RFC allows.
+ */
+
+#define HTTP_ETAG_SIZE 24
+#define HTTP_DATE_SIZE 30
+
+// Request headers that matter here, NULL when absent
+struct HttpConditionalHeaders {
+    const char* range;
+    const char* ifNoneMatch;
+    const char* ifModifiedSince;
+    const char* ifRange;
+};
+
+struct HttpFilePlan {
+    int status;             // 200, 206, 304 or 416
+    uint32_t offset;        // Body to send (none for 304/416)
+    uint32_t length;
+    char etag[HTTP_ETAG_SIZE];
+    char lastModified[HTTP_DATE_SIZE];
+    char contentRange[48];  // Empty unless 206 or 416
+};
+
+// IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT"
+inline size_t http_date_format(int64_t time, char* out, size_t capacity) {
+    static const char* const days[] = {"Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed"};
+    static const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                         "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    int64_t dayCount = time >= 0 ? time / 86400 : (time - 86399) / 86400;
+    int64_t secondOfDay = time - dayCount * 86400;
+    // Civil date from days since the epoch (Howard Hinnant's algorithm)
+    int64_t z = dayCount + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    unsigned day = (unsigned)(doy - (153 * mp + 2) / 5 + 1);
+    unsigned month = (unsigned)(mp < 10 ? mp + 3 : mp - 9);
+    int64_t year = yoe + era * 400 + (month <= 2);
+    int weekday = (int)(((dayCount % 7) + 7) % 7);
+    int length = snprintf(out, capacity, "%s, %02u %s %04d %02u:%02u:%02u GMT", days[weekday], day, months[month - 1],
+                          (int)year, (unsigned)(secondOfDay / 3600), (unsigned)(secondOfDay / 60 % 60),
+                          (unsigned)(secondOfDay % 60));
+    return length > 0 ? (size_t)length : 0;
+}
+
+// Parses an IMF-fixdate; false for anything else (the obsolete formats are treated as absent)
+inline bool http_date_parse(const char* text, int64_t& time) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month[4];
+    int day, year, hour, minute, second;
+    if (sscanf(text, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, month, &year, &hour, &minute, &second) != 6) return false;
+    const char* found = strstr(months, month);
+    if (found == NULL || strlen(month) != 3 || (found - months) % 3 != 0) return false;
+    int64_t m = (found - months) / 3 + 1;
+    // Days since the epoch from a civil date (Howard Hinnant's algorithm)
+    int64_t y = year - (m <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    time = (era * 146097 + doe - 719468) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+inline size_t http_etag(uint32_t size, int64_t mtime, char* out, size_t capacity) {
+    int length = snprintf(out, capacity, "\"%lx-%llx\"", (unsigned long)size, (unsigned long long)mtime);
+    return length > 0 ? (size_t)length : 0;
+}
+
+// If-None-Match: "*" or a list of entity tags, compared weakly (W/ is ignored)
+inline bool http_etag_list_matches(const char* list, const char* etag) {
+    size_t etagLength = strlen(etag);
+    const char* p = list;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        if (*p == '*') return true;
+        if (p[0] == 'W' && p[1] == '/') p += 2;
+        const char* end = p;
+        if (*p == '"') {
+            end = strchr(p + 1, '"');
+            if (end == NULL) return false;
+            end++;
+        } else {
+            while (*end && *end != ',') end++;
+        }
+        if ((size_t)(end - p) == etagLength && strncmp(p, etag, etagLength) == 0) return true;
+        p = end;
+    }
+    return false;
+}
+
+// Parses "bytes=first-last", "bytes=first-" or "bytes=-suffix" against a file of `size` bytes.
+// Returns 1 with the range filled in, 0 if the header is to be ignored (malformed or several
+// ranges) and -1 if it can't be satisfied.
+inline int http_range_parse(const char* header, uint32_t size, uint32_t& offset, uint32_t& length) {
+    while (*header == ' ') header++;
+    if (strncmp(header, "bytes=", 6) != 0) return 0;
+    const char* p = header + 6;
+    if (strchr(p, ',') != NULL) return 0;
+    while (*p == ' ') p++;
+    char* end;
+    if (*p == '-') {
+        if (p[1] < '0' || p[1] > '9') return 0;
+        unsigned long long suffix = strtoull(p + 1, &end, 10);
+        while (*end == ' ') end++;
+        if (*end != 0) return 0;
+        if (suffix == 0 || size == 0) return -1;
+        length = suffix < size ? (uint32_t)suffix : size;
+        offset = size - length;
+        return 1;
+    }
+    if (*p < '0' || *p > '9') return 0;
+    unsigned long long first = strtoull(p, &end, 10);
+    if (*end != '-') return 0;
+    p = end + 1;
+    unsigned long long last = (unsigned long long)size - 1;
+    if (*p >= '0' && *p <= '9') {
+        last = strtoull(p, &end, 10);
+        p = end;
+        if (last < first) return 0;
+    }
+    while (*p == ' ') p++;
+    if (*p != 0) return 0;
+    if (first >= size) return -1;
+    if (last >= size) last = size - 1;
+    offset = (uint32_t)first;
+    length = (uint32_t)(last - first + 1);
+    return 1;
+}
+
+// Decides how to answer a GET or HEAD of a file of `size` bytes last written at `mtime`
+inline void http_file_plan(uint32_t size, int64_t mtime, const HttpConditionalHeaders& headers, HttpFilePlan& plan) {
+    http_etag(size, mtime, plan.etag, sizeof(plan.etag));
+    http_date_format(mtime, plan.lastModified, sizeof(plan.lastModified));
+    plan.contentRange[0] = 0;
+    plan.status = 200;
+    plan.offset = 0;
+    plan.length = size;
+
+    // If-None-Match takes precedence; If-Modified-Since only counts without it
+    int64_t since;
+    if (headers.ifNoneMatch != NULL) {
+        if (http_etag_list_matches(headers.ifNoneMatch, plan.etag)) plan.status = 304;
+    } else if (headers.ifModifiedSince != NULL && http_date_parse(headers.ifModifiedSince, since) && mtime <= since) {
+        plan.status = 304;
+    }
+    if (plan.status == 304) {
+        plan.length = 0;
+        return;
+    }
+
+    if (headers.range == NULL) return;
+    // A stale If-Range means the client's copy changed: send all of it rather than a piece
+    if (headers.ifRange != NULL) {
+        const char* ifRange = headers.ifRange;
+        while (*ifRange == ' ') ifRange++;
+        bool current = ifRange[0] == '"' ? strcmp(ifRange, plan.etag) == 0 : strcmp(ifRange, plan.lastModified) == 0;
+        if (!current) return;
+    }
+    uint32_t offset, length;
+    int result = http_range_parse(headers.range, size, offset, length);
+    if (result == 0) return;
+    if (result < 0) {
+        plan.status = 416;
+        plan.length = 0;
+        snprintf(plan.contentRange, sizeof(plan.contentRange), "bytes */%lu", (unsigned long)size);
+        return;
+    }
+    plan.status = 206;
+    plan.offset = offset;
+    plan.length = length;
+    snprintf(plan.contentRange, sizeof(plan.contentRange), "bytes %lu-%lu/%lu", (unsigned long)offset,
+             (unsigned long)(offset + length - 1), (unsigned long)size);
+}
+
+#endif
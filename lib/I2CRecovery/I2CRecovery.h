@@ -0,0 +1,93 @@
+#ifndef I2CRECOVERY_h
+#define I2CRECOVERY_h
+
+#include <stdint.h>
+
+/*
+ * Getting an I2C bus going again after a glitch. A slave that misses a clock edge (noise on long
+ * wiring, a brown-out mid-transfer) is left part way through a byte, holding SDA low while it
+ * waits for clocks the master will never send; every transfer after that fails with a timeout or
+ * lost arbitration until the board is reset. Clocking SCL by hand until the slave lets go of SDA,
+ * at most nine times (the rest of a byte and its acknowledge), then sending a STOP puts it back to
+ * idle (UM10204, "Bus clear"). The controller is reinitialized around it, since its own state
+ * machine may be stuck too.
+ *
+ * The codes are what TwoWire::endTransmission() returns, plus I2C_SHORT_READ for a requestFrom()
+ * that came back with fewer bytes than asked for. A NACK is a device not answering, which isn't
+ * the bus's fault; the rest are worth a recovery.
+ */
+
+#define I2C_OK 0
+#define I2C_DATA_TOO_LONG 1
+#define I2C_NACK_ADDRESS 2
+#define I2C_NACK_DATA 3
+#define I2C_BUS_ERROR 4
+#define I2C_TIMEOUT 5
+#define I2C_SHORT_READ 16
+
+// Clocks sent before giving up on a slave holding SDA
+#define I2C_CLEAR_CLOCKS 9
+// Half-periods a slave may stretch SCL for before the bus is given up on
+#define I2C_CLEAR_STRETCH_WAITS 100
+
+inline bool i2c_needs_recovery(uint8_t error) {
+    return error == I2C_BUS_ERROR || error == I2C_TIMEOUT || error == I2C_SHORT_READ;
+}
+
+// What came of the reads on one bus, each counted by how it ended
+struct I2CBusStats {
+    uint32_t reads = 0;
+    uint32_t nacks = 0;
+    uint32_t timeouts = 0;
+    uint32_t shortReads = 0;
+    uint32_t busErrors = 0;       // lost arbitration and the like
+    uint32_t recoveries = 0;      // bus clears that left both lines high
+    uint32_t failedRecoveries = 0;
+
+    void count(uint8_t error) {
+        reads++;
+        switch (error) {
+            case I2C_OK: break;
+            case I2C_NACK_ADDRESS:
+            case I2C_NACK_DATA: nacks++; break;
+            case I2C_TIMEOUT: timeouts++; break;
+            case I2C_SHORT_READ: shortReads++; break;
+            default: busErrors++; break;
+        }
+    }
+};
+
+// Runs the bus clear on `pins`, which drives the lines open-drain:
+//   void releaseSda(), releaseScl()  let the line float high
+//   void driveSdaLow(), driveSclLow()
+//   bool sda(), scl()                the level on the line
+//   void wait()                      half a clock period
+// Returns true if both lines were left high, the bus idle.
+template <typename Pins>
+bool i2c_bus_clear(Pins& pins) {
+    pins.releaseSda();
+    pins.releaseScl();
+    pins.wait();
+    // A slave stretching the clock gets a while to let it go
+    for (uint16_t i = 0; i < I2C_CLEAR_STRETCH_WAITS && !pins.scl(); i++) pins.wait();
+    if (!pins.scl()) return false;
+    for (uint8_t i = 0; i < I2C_CLEAR_CLOCKS && !pins.sda(); i++) {
+        pins.driveSclLow();
+        pins.wait();
+        pins.releaseScl();
+        pins.wait();
+    }
+    if (!pins.sda()) return false;
+    // STOP: SDA rising while SCL is high
+    pins.driveSclLow();
+    pins.wait();
+    pins.driveSdaLow();
+    pins.wait();
+    pins.releaseScl();
+    pins.wait();
+    pins.releaseSda();
+    pins.wait();
+    return pins.sda() && pins.scl();
+}
+
+#endif
@@ -62,12 +62,19 @@ int16_t INA_Class::readWord(const uint8_t addr, const uint8_t deviceAddress) con
                  added to let the INAxxx devices have sufficient time to get the return data ready
       @param[in] addr I2C address to read from
       @param[in] deviceAddress Address on the I2C device to read from
-      @return    integer value read from the I2C device */
+      @return    integer value read from the I2C device, 0 if it didn't answer (see takeI2CError) */
   _wire->beginTransmission(deviceAddress);        // Address the I2C device
   _wire->write(addr);                             // Send register address to read
-  _wire->endTransmission();                       // Close transmission
+  uint8_t result = _wire->endTransmission();      // Close transmission
+  if (result != 0) {                               // NAK, timeout or bus error
+    _i2cError = result;
+    return 0;
+  }
   delayMicroseconds(I2C_DELAY);                 // delay required for sync
-  _wire->requestFrom(deviceAddress, (uint8_t)2);  // Request 2 consecutive bytes
+  if (_wire->requestFrom(deviceAddress, (uint8_t)2) != 2) {  // Request 2 consecutive bytes
+    _i2cError = INA_I2C_SHORT_READ;
+    return 0;
+  }
   return ((uint16_t)_wire->read() << 8) | _wire->read();
 }  // of method readWord()
 int32_t INA_Class::read3Bytes(const uint8_t addr, const uint8_t deviceAddress) const {
@@ -76,12 +83,19 @@ int32_t INA_Class::read3Bytes(const uint8_t addr, const uint8_t deviceAddress) c
                  added to let the INAxxx devices have sufficient time to get the return data ready
       @param[in] addr I2C address to read from
       @param[in] deviceAddress Address on the I2C device to read from
-      @return    integer value read from the I2C device */
+      @return    integer value read from the I2C device, 0 if it didn't answer (see takeI2CError) */
   _wire->beginTransmission(deviceAddress);        // Address the I2C device
   _wire->write(addr);                             // Send register address to read
-  _wire->endTransmission();                       // Close transmission
+  uint8_t result = _wire->endTransmission();      // Close transmission
+  if (result != 0) {                               // NAK, timeout or bus error
+    _i2cError = result;
+    return 0;
+  }
   delayMicroseconds(I2C_DELAY);                 // delay required for sync
-  _wire->requestFrom(deviceAddress, (uint8_t)3);  // Request 3 consecutive bytes
+  if (_wire->requestFrom(deviceAddress, (uint8_t)3) != 3) {  // Request 3 consecutive bytes
+    _i2cError = INA_I2C_SHORT_READ;
+    return 0;
+  }
   return ((uint32_t)_wire->read() << 16) | ((uint32_t)_wire->read() << 8) | ((uint32_t)_wire->read());
 }  // of method readWord()
 void INA_Class::writeWord(const uint8_t addr, const uint16_t data,
@@ -151,7 +165,6 @@ uint8_t INA_Class::begin(const uint16_t maxBusAmps, const uint32_t microOhmR,
                  by default all devices found get set to the same initial values for these 2 params
       @return    The integer number of INAxxxx devices found on the I2C bus
   */
-  uint16_t originalRegister, tempRegister;
   if (device_count == 0)  // Enumerate all devices on first call
   {
     uint16_t maxDevices = 32;
@@ -163,67 +176,8 @@ uint8_t INA_Class::begin(const uint16_t maxBusAmps, const uint32_t microOhmR,
       uint8_t good = _wire->endTransmission();
       if (good == 0 && device_count < maxDevices)  // If no error and EEPROM has space
       {
-        originalRegister = readWord(INA_CONFIGURATION_REGISTER, deviceAddress);  // Save settings
-        writeWord(INA_CONFIGURATION_REGISTER, INA_RESET_DEVICE, deviceAddress);  // Force reset
-        tempRegister = readWord(INA_CONFIGURATION_REGISTER, deviceAddress);      // Read reset reg.
-        if (tempRegister == INA_RESET_DEVICE)  // If the register wasn't reset then not an INA
-        {
-          writeWord(INA_CONFIGURATION_REGISTER, originalRegister, deviceAddress);  // restore value
-        } else {
-          if (tempRegister == 0x399F) {
-            inaEE.type = INA219;
-          } else {
-            if (tempRegister == 0x4127)  // INA226, INA230, INA231
-            {
-              tempRegister = readWord(INA_DIE_ID_REGISTER, deviceAddress);  // Read the INA high-reg
-              if (tempRegister == INA226_DIE_ID_VALUE) {
-                inaEE.type = INA226;
-              } else {
-                if (tempRegister != 0) {
-                  inaEE.type = INA230;
-                } else {
-                  inaEE.type = INA231;
-                }  // of if-then-else a INA230 or INA231
-              }    // of if-then-else an INA226
-            } else {
-              if (tempRegister == 0x6127) {
-                inaEE.type = INA260;
-              } else {
-                if (tempRegister == 0x7127) {
-                  inaEE.type = INA3221_0;
-                } else {
-                  if (tempRegister == 0x0) {
-                    inaEE.type = INA228;
-                  } else {
-                    inaEE.type = INA_UNKNOWN;
-                  }                       // of if-then-else it is an INA228
-                }                         // of if-then-else it is an INA3221
-              }                           // of if-then-else it is an INA260
-            }                             // of if-then-else it is an INA226, INA230, INA231
-          }                               // of if-then-else it is an INA209, INA219, INA220
-          if (inaEE.type != INA_UNKNOWN)  // Increment device if valid INA2xx
-          {
-            inaEE.address    = deviceAddress;
-            inaEE.maxBusAmps = maxBusAmps > 1022 ? 1022 : maxBusAmps;  // Clamp to maximum of 1022A
-            inaEE.microOhmR  = microOhmR;
-            ina              = inaEE;  // see inaDet constructor
-            if (inaEE.type == INA3221_0) {
-              ina.type = INA3221_0;  // Set to INA3221 1st channel
-              initDevice(device_count);
-              device_count = ((device_count + 1) % maxDevices);
-              ina.type     = INA3221_1;  // Set to INA3221 2nd channel
-              initDevice(device_count);
-              device_count = ((device_count + 1) % maxDevices);
-              ina.type     = INA3221_2;  // Set to INA3221 3rd channel
-              initDevice(device_count);
-              device_count = ((device_count + 1) % maxDevices);
-            } else {
-              initDevice(device_count);                          // perform initialization on device
-              device_count = ((device_count + 1) % maxDevices);  // start again at 0 if overflow
-            }                                                    // of if-then inaEE.type
-          }                                                      // of if-then we can add device
-        }  // of if-then-else we have an INA-Type device
-      }    // of if-then we have a device
+        probeDevice(deviceAddress, maxBusAmps, microOhmR);
+      }  // of if-then we have a device
     }      // for-next each possible I2C address
   } else {
     readInafromEEPROM(deviceNumber);                         // Load EEPROM to ina structure
@@ -234,6 +188,115 @@ uint8_t INA_Class::begin(const uint16_t maxBusAmps, const uint32_t microOhmR,
   _currentINA = UINT8_MAX;  // Force read on next call
   return device_count;
 }  // of method begin()
+uint8_t INA_Class::probeDevice(const uint8_t deviceAddress, const uint16_t maxBusAmps,
+                               const uint32_t microOhmR) {
+  /*! @brief     Identifies the device answering at an address and adds it if it is an INA
+      @details   The per-address part of begin(): the device is reset to read its power-on
+                 configuration, which gives its type, and is initialized if it is one we know
+      @param[in] deviceAddress I2C address of the device
+      @param[in] maxBusAmps Maximum expected bus amperage
+      @param[in] microOhmR Shunt resistance in micro-ohms
+      @return    The number of devices added, 3 for an INA3221 and 0 if it isn't an INA */
+  const uint16_t maxDevices = 32;
+  uint8_t  before           = device_count;
+  uint8_t  earlier          = _i2cError;
+  uint16_t originalRegister, tempRegister;
+  _i2cError = 0;
+  originalRegister = readWord(INA_CONFIGURATION_REGISTER, deviceAddress);  // Save settings
+  writeWord(INA_CONFIGURATION_REGISTER, INA_RESET_DEVICE, deviceAddress);  // Force reset
+  tempRegister = readWord(INA_CONFIGURATION_REGISTER, deviceAddress);      // Read reset reg.
+  if (_i2cError) {  // Gone again, or a read of 0 would pass for an INA228
+    inaEE.type = INA_UNKNOWN;
+  } else if (tempRegister == INA_RESET_DEVICE)  // If the register wasn't reset then not an INA
+  {
+    writeWord(INA_CONFIGURATION_REGISTER, originalRegister, deviceAddress);  // restore value
+  } else {
+    if (tempRegister == 0x399F) {
+      inaEE.type = INA219;
+    } else {
+      if (tempRegister == 0x4127)  // INA226, INA230, INA231
+      {
+        tempRegister = readWord(INA_DIE_ID_REGISTER, deviceAddress);  // Read the INA high-reg
+        if (tempRegister == INA226_DIE_ID_VALUE) {
+          inaEE.type = INA226;
+        } else {
+          if (tempRegister != 0) {
+            inaEE.type = INA230;
+          } else {
+            inaEE.type = INA231;
+          }  // of if-then-else a INA230 or INA231
+        }    // of if-then-else an INA226
+      } else {
+        if (tempRegister == 0x6127) {
+          inaEE.type = INA260;
+        } else {
+          if (tempRegister == 0x7127) {
+            inaEE.type = INA3221_0;
+          } else {
+            if (tempRegister == 0x0) {
+              inaEE.type = INA228;
+            } else {
+              inaEE.type = INA_UNKNOWN;
+            }                       // of if-then-else it is an INA228
+          }                         // of if-then-else it is an INA3221
+        }                           // of if-then-else it is an INA260
+      }                             // of if-then-else it is an INA226, INA230, INA231
+    }                               // of if-then-else it is an INA209, INA219, INA220
+    if (inaEE.type != INA_UNKNOWN)  // Increment device if valid INA2xx
+    {
+      inaEE.address    = deviceAddress;
+      inaEE.maxBusAmps = maxBusAmps > 1022 ? 1022 : maxBusAmps;  // Clamp to maximum of 1022A
+      inaEE.microOhmR  = microOhmR;
+      ina              = inaEE;  // see inaDet constructor
+      if (inaEE.type == INA3221_0) {
+        ina.type = INA3221_0;  // Set to INA3221 1st channel
+        initDevice(device_count);
+        device_count = ((device_count + 1) % maxDevices);
+        ina.type     = INA3221_1;  // Set to INA3221 2nd channel
+        initDevice(device_count);
+        device_count = ((device_count + 1) % maxDevices);
+        ina.type     = INA3221_2;  // Set to INA3221 3rd channel
+        initDevice(device_count);
+        device_count = ((device_count + 1) % maxDevices);
+      } else {
+        initDevice(device_count);                          // perform initialization on device
+        device_count = ((device_count + 1) % maxDevices);  // start again at 0 if overflow
+      }                                                    // of if-then inaEE.type
+    }                                                      // of if-then we can add device
+  }  // of if-then-else we have an INA-Type device
+  _i2cError = earlier;  // Not a failed reading
+  return device_count - before;
+}  // of method probeDevice()
+uint8_t INA_Class::addDevice(const uint8_t deviceAddress, const uint16_t maxBusAmps,
+                             const uint32_t microOhmR) {
+  /*! @brief     Adds a device attached after begin() found the others
+      @details   Nothing is done if the address is already one of ours, doesn't answer, or there is
+                 no room for another device. The new devices are numbered after the others
+      @param[in] deviceAddress I2C address of the device
+      @param[in] maxBusAmps Maximum expected bus amperage
+      @param[in] microOhmR Shunt resistance in micro-ohms
+      @return    The number of devices added */
+  for (uint8_t i = 0; i < device_count; i++) {
+    if (getDeviceAddress(i) == deviceAddress) return 0;
+  }  // for-next each known device
+  uint8_t room = _expectedDevices ? _expectedDevices : 32;
+  if (device_count + 3 > room) return 0;  // An INA3221 takes three
+  _wire->beginTransmission(deviceAddress);
+  if (_wire->endTransmission() != 0) return 0;
+  uint8_t added = probeDevice(deviceAddress, maxBusAmps, microOhmR);
+  _currentINA   = UINT8_MAX;  // Force read on next call
+  return added;
+}  // of method addDevice()
+uint8_t INA_Class::takeI2CError() {
+  /*! @brief     How the last failed read since the last call failed
+      @details   readWord() and read3Bytes() return 0 when the device NAKs or returns short, so a
+                 caller that needs to tell that from a reading checks here after it
+      @return    0 if every read succeeded, else what endTransmission() returned for the last one
+                 to fail, or INA_I2C_SHORT_READ. The error is cleared */
+  uint8_t error = _i2cError;
+  _i2cError     = 0;
+  return error;
+}  // of method takeI2CError()
 void INA_Class::initDevice(const uint8_t deviceNumber) {
   /*! @brief     Initializes the the given devices using the settings from the internal structure
       @details   This includes (re)computing the device's calibration values.
@@ -468,6 +531,55 @@ uint8_t INA_Class::getDeviceAddress(const uint8_t deviceNumber) {
   readInafromEEPROM(deviceNumber);  // Load EEPROM to ina structure
   return (ina.address);
 }  // of method getDeviceAddress()
+inaEEPROM INA_Class::getDeviceSettings(const uint8_t deviceNumber) {
+  /*! @brief     returns what is stored for the device specified in the input parameter
+      @details   The type, address, operating mode and calibration inputs found by begin(), as
+                 restore() takes them back. Zeroed if the number is out of range
+      @param[in] deviceNumber to return the settings of
+      @return    The device's stored settings
+      */
+  if (deviceNumber >= device_count) return inaEEPROM();
+  readInafromEEPROM(deviceNumber);  // Load EEPROM to ina structure
+  return inaEE;
+}  // of method getDeviceSettings()
+uint8_t INA_Class::restore(const inaEEPROM* devices, const uint8_t count) {
+  /*! @brief     Takes the devices from an earlier begin() instead of searching for them
+      @details   Nothing is read from or written to the devices: the caller has checked they are
+                 still there and still configured as they were. Used in place of the first begin()
+      @param[in] devices Settings of each device, as getDeviceSettings() returned them
+      @param[in] count Number of devices
+      @return    The integer number of INAxxxx devices restored
+      */
+  device_count = 0;
+  for (uint8_t i = 0; i < count && i < 32; i++) {
+    if (_expectedDevices == 0) {
+      _EEPROMEmulation[i] = devices[i];
+    } else if (i < _expectedDevices) {
+      _DeviceArray[i] = devices[i];
+    } else {
+      break;
+    }  // if-then-else use EEPROM to store data
+    device_count++;
+  }  // for-next each device
+  _currentINA = UINT8_MAX;  // Force read on next call
+  return device_count;
+}  // of method restore()
+bool INA_Class::readRegister(const uint8_t reg, const uint8_t deviceAddress, uint16_t& value) const {
+  /*! @brief     Read one word from a device, reporting whether it answered
+      @details   Unlike readWord(), a device that NAKs or returns short is an error rather than
+                 a value of 0xFFFF
+      @param[in] reg Register to read
+      @param[in] deviceAddress I2C address of the device
+      @param[out] value Register contents, if the read succeeded
+      @return    true if the device answered with both bytes */
+  _wire->beginTransmission(deviceAddress);
+  _wire->write(reg);
+  if (_wire->endTransmission() != 0) return false;
+  delayMicroseconds(I2C_DELAY);
+  if (_wire->requestFrom(deviceAddress, (uint8_t)2) != 2) return false;
+  value = ((uint16_t)_wire->read() << 8) | _wire->read();
+  return true;
+}  // of method readRegister()
 uint16_t INA_Class::getBusMilliVolts(const uint8_t deviceNumber) {
   /*! @brief     returns the bus voltage in millivolts
       @details   The converted millivolt value is returned and if the device is in triggered mode
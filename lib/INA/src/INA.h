@@ -278,6 +278,7 @@ const uint16_t INA3221_SHUNT_VOLTAGE_LSB{400};      ///< INA3221 LSB in uV *10
 const uint16_t INA3221_CONFIG_BADC_MASK{0x01C0};    ///< INA3221 Bits 7-10  masked
 const uint8_t  INA3221_MASK_REGISTER{0xF};          ///< INA32219 Mask register
 const uint8_t  I2C_DELAY{10};                       ///< Microsecond delay on I2C writes
+const uint8_t  INA_I2C_SHORT_READ{16};              ///< takeI2CError(): fewer bytes than asked for
 // clang-format on
 
 class INA_Class {
@@ -303,6 +304,12 @@ class INA_Class {
   int64_t     getBusMicroWatts(const uint8_t deviceNumber = 0);
   const char* getDeviceName(const uint8_t deviceNumber = 0);
   uint8_t     getDeviceAddress(const uint8_t deviceNumber = 0);
+  inaEEPROM   getDeviceSettings(const uint8_t deviceNumber = 0);
+  uint8_t     restore(const inaEEPROM* devices, const uint8_t count);
+  bool        readRegister(const uint8_t reg, const uint8_t deviceAddress, uint16_t& value) const;
+  uint8_t     addDevice(const uint8_t deviceAddress, const uint16_t maxBusAmps,
+                        const uint32_t microOhmR);
+  uint8_t     takeI2CError();
   void        reset(const uint8_t deviceNumber = 0);
   bool        conversionFinished(const uint8_t deviceNumber = 0);
   void        waitForConversion(const uint8_t deviceNumber = UINT8_MAX);
@@ -334,7 +341,10 @@ class INA_Class {
   void       readInafromEEPROM(const uint8_t deviceNumber);
   void       writeInatoEEPROM(const uint8_t deviceNumber);
   void       initDevice(const uint8_t deviceNumber);
+  uint8_t    probeDevice(const uint8_t deviceAddress, const uint16_t maxBusAmps,
+                         const uint32_t microOhmR);
   uint8_t    _currentINA{UINT8_MAX};  ///< Stores current INA device number
+  mutable uint8_t _i2cError{0};       ///< How the last read to fail since takeI2CError() failed
   uint8_t    _expectedDevices{0};     ///< If 0 use EEPROM, otherwise use RAM for INA structures
   inaEEPROM* _DeviceArray;            ///< Pointer to dynamic array of devices if not using EEPROM
   inaEEPROM  inaEE;                   ///< INA device structure
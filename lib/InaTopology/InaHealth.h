@@ -0,0 +1,103 @@
+#ifndef INAHEALTH_h
+#define INAHEALTH_h
+
+#include <stdint.h>
+
+/*
+ * Whether each INA is still answering, and when to look for it again once it isn't. A device that
+ * fails INA_HEALTH_FAILURES reads in a row is taken as gone: the sampler stops reading it (each
+ * read of an absent device costs a NAK, or a timeout on a bus it holds down) and logs its samples
+ * as missing, and it is probed again after INA_HEALTH_REPROBE_MS, then twice as long after each
+ * probe that finds nothing, up to INA_HEALTH_MAX_REPROBE_MS. A single failed read before that is
+ * just a missing sample.
+ *
+ * Buses are scanned for devices attached since the boot on the same kind of schedule, starting
+ * over whenever a scan finds something or a device on the bus drops out: a device that comes back
+ * may come back at another address.
+ *
+ * Times are millis(), and compared by difference so they survive it wrapping.
+ */
+
+#define INA_HEALTH_FAILURES 3
+#define INA_HEALTH_REPROBE_MS 1000
+#define INA_HEALTH_MAX_REPROBE_MS 60000
+#define INA_HEALTH_SCAN_MS 5000
+#define INA_HEALTH_MAX_SCAN_MS 300000
+
+// A wait that doubles with every retry, from `initialMs` up to `maxMs`
+class InaBackoff {
+public:
+    uint32_t initialMs;
+    uint32_t maxMs;
+    uint32_t waitMs;
+    uint32_t lastMs;
+
+    InaBackoff(uint32_t initial, uint32_t maximum) : initialMs(initial), maxMs(maximum), waitMs(initial), lastMs(0) {}
+
+    // Waits the initial time from `now`
+    void start(uint32_t now) {
+        lastMs = now;
+        waitMs = initialMs;
+    }
+
+    bool due(uint32_t now) const {
+        return now - lastMs >= waitMs;
+    }
+
+    // Waits twice as long as last time from `now`
+    void retry(uint32_t now) {
+        lastMs = now;
+        waitMs = waitMs > maxMs / 2 ? maxMs : waitMs * 2;
+    }
+};
+
+enum InaDeviceState : uint8_t {
+    INA_DEVICE_OK,
+    INA_DEVICE_MISSING,
+};
+
+class InaDeviceHealth {
+public:
+    InaDeviceState state = INA_DEVICE_OK;
+    uint8_t failures = 0;     // reads failed in a row
+    uint32_t errors = 0;      // reads failed since boot
+    uint32_t dropouts = 0;    // times it was given up on
+    uint32_t recoveries = 0;  // times a probe found it again
+    InaBackoff reprobe{INA_HEALTH_REPROBE_MS, INA_HEALTH_MAX_REPROBE_MS};
+
+    bool present() const {
+        return state == INA_DEVICE_OK;
+    }
+
+    // After each read by the sampler; returns true if this read gave up on the device
+    bool read(bool ok, uint32_t now) {
+        if (ok) {
+            failures = 0;
+            return false;
+        }
+        errors++;
+        if (state == INA_DEVICE_MISSING || ++failures < INA_HEALTH_FAILURES) return false;
+        state = INA_DEVICE_MISSING;
+        dropouts++;
+        reprobe.start(now);
+        return true;
+    }
+
+    bool probeDue(uint32_t now) const {
+        return state == INA_DEVICE_MISSING && reprobe.due(now);
+    }
+
+    // After probing a missing device; returns true if it is back
+    bool probed(bool answered, uint32_t now) {
+        if (!answered) {
+            reprobe.retry(now);
+            return false;
+        }
+        state = INA_DEVICE_OK;
+        failures = 0;
+        recoveries++;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef INATOPOLOGY_h
+#define INATOPOLOGY_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * The INAs found at the last full scan, kept so a reboot can skip the scan. INA_Class::begin()
+ * probes all sixteen addresses on a bus, resets each device that answers and reads its die ID, then
+ * setup() writes every configuration register again; after a watchdog reset the devices are still
+ * powered and still configured, so all of that only delays the first sample.
+ *
+ * Instead each cached device gets one read of its configuration register. If every one reads back
+ * what was configured, the devices are taken as they are; anything else (a device gone, moved, or
+ * reset by a power cycle) and the boot does the full scan and saves what it finds. So does a cache
+ * saved by firmware that configures the devices differently, which the devices themselves can't
+ * show: the cache carries a fingerprint of the settings it was made with.
+ *
+ * The blob is small enough for an NVS entry, which checks its own integrity; the header here only
+ * guards against a layout from other firmware.
+ */
+
+#define INA_TOPOLOGY_MAGIC 0x54414E49u   // "INAT"
+#define INA_TOPOLOGY_VERSION 1
+#define INA_TOPOLOGY_MAX_DEVICES 16
+#define INA_TOPOLOGY_HEADER_SIZE 12
+#define INA_TOPOLOGY_DEVICE_SIZE 12
+#define INA_TOPOLOGY_MAX_SIZE (INA_TOPOLOGY_HEADER_SIZE + INA_TOPOLOGY_MAX_DEVICES * INA_TOPOLOGY_DEVICE_SIZE)
+
+struct InaTopologyDevice {
+    uint8_t bus;
+    uint8_t address;
+    uint8_t type;          // ina_Type
+    uint16_t config;       // configuration register as it read back once set up
+    uint16_t maxBusAmps;
+    uint32_t microOhmR;
+};
+
+// FNV-1a over the values the devices are configured from
+inline uint32_t ina_topology_fingerprint(const uint32_t* values, size_t count) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < count; i++) {
+        for (uint8_t b = 0; b < 4; b++) {
+            hash ^= (uint8_t)(values[i] >> (8 * b));
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+class InaTopology {
+public:
+    uint32_t settings = 0;  // ina_topology_fingerprint() of the configuration
+    uint8_t count = 0;
+    InaTopologyDevice devices[INA_TOPOLOGY_MAX_DEVICES];
+
+    void clear() {
+        count = 0;
+    }
+
+    bool add(const InaTopologyDevice& device) {
+        if (count >= INA_TOPOLOGY_MAX_DEVICES) return false;
+        devices[count++] = device;
+        return true;
+    }
+
+    uint8_t countOnBus(uint8_t bus) const {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (devices[i].bus == bus) n++;
+        }
+        return n;
+    }
+
+    // Little-endian: u32 magic, u8 version, u8 count, u16 0, u32 settings, then per device u8 bus,
+    // u8 address, u8 type, u8 0, u16 config, u16 maxBusAmps, u32 microOhmR. Returns the bytes
+    // written.
+    size_t encode(uint8_t* out) const {
+        put32(out, INA_TOPOLOGY_MAGIC);
+        out[4] = INA_TOPOLOGY_VERSION;
+        out[5] = count;
+        out[6] = out[7] = 0;
+        put32(out + 8, settings);
+        uint8_t* p = out + INA_TOPOLOGY_HEADER_SIZE;
+        for (uint8_t i = 0; i < count; i++, p += INA_TOPOLOGY_DEVICE_SIZE) {
+            const InaTopologyDevice& device = devices[i];
+            p[0] = device.bus;
+            p[1] = device.address;
+            p[2] = device.type;
+            p[3] = 0;
+            put16(p + 4, device.config);
+            put16(p + 6, device.maxBusAmps);
+            put32(p + 8, device.microOhmR);
+        }
+        return p - out;
+    }
+
+    // False, and empty, unless `data` is a whole topology in this layout
+    bool decode(const uint8_t* data, size_t length) {
+        count = 0;
+        if (length < INA_TOPOLOGY_HEADER_SIZE || get32(data) != INA_TOPOLOGY_MAGIC ||
+            data[4] != INA_TOPOLOGY_VERSION || data[5] > INA_TOPOLOGY_MAX_DEVICES ||
+            length != INA_TOPOLOGY_HEADER_SIZE + (size_t)data[5] * INA_TOPOLOGY_DEVICE_SIZE) {
+            return false;
+        }
+        settings = get32(data + 8);
+        const uint8_t* p = data + INA_TOPOLOGY_HEADER_SIZE;
+        for (uint8_t i = 0; i < data[5]; i++, p += INA_TOPOLOGY_DEVICE_SIZE) {
+            InaTopologyDevice& device = devices[i];
+            device.bus = p[0];
+            device.address = p[1];
+            device.type = p[2];
+            device.config = get16(p + 4);
+            device.maxBusAmps = get16(p + 6);
+            device.microOhmR = get32(p + 8);
+        }
+        count = data[5];
+        return true;
+    }
+
+    // Reads each device's configuration register with `read(bus, address, value)`, which returns
+    // false if the device didn't answer. Returns the index of the first device that didn't answer
+    // or read back something else, or `count` if all of them are as cached. A cache made with other
+    // `settings` matches nothing and reads nothing; nor does an empty one, there being no scan to
+    // skip.
+    template <typename Read>
+    uint8_t check(uint32_t expectedSettings, Read&& read) const {
+        if (count == 0 || settings != expectedSettings) return 0;
+        for (uint8_t i = 0; i < count; i++) {
+            uint16_t value;
+            if (!read(devices[i].bus, devices[i].address, value) || value != devices[i].config) return i;
+        }
+        return count;
+    }
+
+    bool operator==(const InaTopology& other) const {
+        if (settings != other.settings || count != other.count) return false;
+        for (uint8_t i = 0; i < count; i++) {
+            const InaTopologyDevice& a = devices[i];
+            const InaTopologyDevice& b = other.devices[i];
+            if (a.bus != b.bus || a.address != b.address || a.type != b.type || a.config != b.config ||
+                a.maxBusAmps != b.maxBusAmps || a.microOhmR != b.microOhmR) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static void put16(uint8_t* out, uint16_t value) {
+        out[0] = (uint8_t)value;
+        out[1] = (uint8_t)(value >> 8);
+    }
+
+    static void put32(uint8_t* out, uint32_t value) {
+        for (uint8_t i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+    }
+
+    static uint16_t get16(const uint8_t* data) {
+        return (uint16_t)(data[0] | (data[1] << 8));
+    }
+
+    static uint32_t get32(const uint8_t* data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+};
+
+#endif
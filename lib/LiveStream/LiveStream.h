@@ -0,0 +1,323 @@
+#ifndef LIVESTREAM_h
+#define LIVESTREAM_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Binary live-sample protocol spoken on the /ws websocket. All integers are little-endian.
+ *
+ * Client -> server, SUBSCRIBE (4 bytes):
+ *   u8 type = 0x01, u8 channelMask (bit n = shunt n, 0 unsubscribes), u16 periodMs
+ *
+ * Server -> client, SAMPLES frame (16 byte header + 4 or 8 bytes per channel in the mask):
+ *   u8 type = 0x10, u8 channelMask, u16 sampleCount, u32 frameSeq, i64 timestampMicros (first sample)
+ *   then for each channel in the mask, lowest first:
+ *     sampleCount == 1: u16 busRaw, i16 shuntRaw
+ *     sampleCount  > 1: u16 busMin, u16 busMax, i16 shuntMin, i16 shuntMax
+ *
+ * Raw values are the INA226 register contents (1.25 mV and 2.5 uV per LSB), clamped to LIVE_MAX_BUS
+ * and +-LIVE_MAX_SHUNT. A shunt whose INA didn't answer is sent as busRaw LIVE_MISSING_BUS, which a
+ * 15 bit bus register can't hold, and shuntRaw LIVE_MISSING_SHUNT; a min/max pair has only the
+ * samples there were, and busMin > busMax if there were none. A client that can't keep up gets
+ * coalesced frames (frameSeq skips, sampleCount grows) and, if it keeps lagging, a slower rate;
+ * sampleCount always says how many samples a frame covers.
+ */
+
+#define LIVE_STREAM_CHANNELS 5
+
+#define LIVE_MSG_SUBSCRIBE 0x01
+#define LIVE_MSG_SAMPLES 0x10
+
+#define LIVE_SUBSCRIBE_SIZE 4
+#define LIVE_FRAME_HEADER_SIZE 16
+#define LIVE_FRAME_MAX_SIZE (LIVE_FRAME_HEADER_SIZE + LIVE_STREAM_CHANNELS * 8)
+
+#define LIVE_MISSING_BUS 0xFFFF
+#define LIVE_MISSING_SHUNT INT16_MIN
+
+// Widest readings a frame carries: the bus register's 15 bits, and the shunt's 16 short of the marker
+#define LIVE_MAX_BUS 0x7FFF
+#define LIVE_MAX_SHUNT INT16_MAX
+
+struct LiveSample {
+    int64_t timestampMicros;
+    uint16_t busRaw[LIVE_STREAM_CHANNELS];
+    int16_t shuntRaw[LIVE_STREAM_CHANNELS];
+};
+
+struct LiveSubscription {
+    uint8_t channelMask;
+    uint16_t decimation;  // Samples folded into each frame
+};
+
+// The logger keeps raw readings in 32 bits; anything outside what the frame's 16 can hold is
+// clamped to the nearest limit instead of wrapping into another value or the missing marker
+inline uint16_t live_bus_raw(uint32_t busRaw) {
+    return busRaw > LIVE_MAX_BUS ? LIVE_MAX_BUS : (uint16_t)busRaw;
+}
+
+inline int16_t live_shunt_raw(int32_t shuntRaw) {
+    if (shuntRaw > LIVE_MAX_SHUNT) return LIVE_MAX_SHUNT;
+    if (shuntRaw < -LIVE_MAX_SHUNT) return -LIVE_MAX_SHUNT;
+    return (int16_t)shuntRaw;
+}
+
+inline void live_put16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+inline uint16_t live_get16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+// Parses a SUBSCRIBE message, converting the requested period into a whole number of samples
+inline bool live_parse_subscribe(const uint8_t* data, size_t length, uint32_t samplePeriodMs, LiveSubscription& out) {
+    if (length != LIVE_SUBSCRIBE_SIZE || data[0] != LIVE_MSG_SUBSCRIBE) return false;
+    out.channelMask = data[1] & ((1 << LIVE_STREAM_CHANNELS) - 1);
+    uint32_t periodMs = live_get16(data + 2);
+    uint32_t decimation = (periodMs + samplePeriodMs / 2) / samplePeriodMs;
+    if (decimation < 1) decimation = 1;
+    if (decimation > UINT16_MAX) decimation = UINT16_MAX;
+    out.decimation = (uint16_t)decimation;
+    return true;
+}
+
+// One outgoing frame before encoding; kept decoded so queued frames can be merged
+struct LiveFrame {
+    uint8_t channelMask;
+    uint16_t sampleCount;
+    uint32_t frameSeq;
+    int64_t timestampMicros;
+    uint16_t busMin[LIVE_STREAM_CHANNELS];
+    uint16_t busMax[LIVE_STREAM_CHANNELS];
+    int16_t shuntMin[LIVE_STREAM_CHANNELS];
+    int16_t shuntMax[LIVE_STREAM_CHANNELS];
+};
+
+inline size_t live_encode_frame(const LiveFrame& frame, uint8_t* out, size_t capacity) {
+    if (capacity < LIVE_FRAME_MAX_SIZE) return 0;
+    out[0] = LIVE_MSG_SAMPLES;
+    out[1] = frame.channelMask;
+    live_put16(out + 2, frame.sampleCount);
+    for (uint8_t i = 0; i < 4; i++) out[4 + i] = (uint8_t)(frame.frameSeq >> (8 * i));
+    for (uint8_t i = 0; i < 8; i++) out[8 + i] = (uint8_t)((uint64_t)frame.timestampMicros >> (8 * i));
+
+    size_t size = LIVE_FRAME_HEADER_SIZE;
+    for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+        if (!(frame.channelMask & (1 << ch))) continue;
+        if (frame.sampleCount == 1) {
+            bool missing = frame.busMin[ch] > frame.busMax[ch];
+            live_put16(out + size, missing ? LIVE_MISSING_BUS : frame.busMin[ch]);
+            live_put16(out + size + 2, (uint16_t)(missing ? LIVE_MISSING_SHUNT : frame.shuntMin[ch]));
+            size += 4;
+        } else {
+            live_put16(out + size, frame.busMin[ch]);
+            live_put16(out + size + 2, frame.busMax[ch]);
+            live_put16(out + size + 4, (uint16_t)frame.shuntMin[ch]);
+            live_put16(out + size + 6, (uint16_t)frame.shuntMax[ch]);
+            size += 8;
+        }
+    }
+    return size;
+}
+
+// Folds `newer` into `older`, keeping the older frame's sequence number and start time
+inline void live_merge_frames(LiveFrame& older, const LiveFrame& newer) {
+    uint32_t samples = (uint32_t)older.sampleCount + newer.sampleCount;
+    older.sampleCount = samples > UINT16_MAX ? UINT16_MAX : (uint16_t)samples;
+    for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+        if (newer.busMin[ch] < older.busMin[ch]) older.busMin[ch] = newer.busMin[ch];
+        if (newer.busMax[ch] > older.busMax[ch]) older.busMax[ch] = newer.busMax[ch];
+        if (newer.shuntMin[ch] < older.shuntMin[ch]) older.shuntMin[ch] = newer.shuntMin[ch];
+        if (newer.shuntMax[ch] > older.shuntMax[ch]) older.shuntMax[ch] = newer.shuntMax[ch];
+    }
+}
+
+// Folds samples for one subscriber into min/max frames at the subscriber's rate
+class LiveDecimator {
+public:
+
+    LiveSubscription subscription;
+    uint32_t frameSeq;
+
+    LiveDecimator() : frameSeq(0), count(0) {
+        subscription.channelMask = 0;
+        subscription.decimation = 1;
+    }
+
+    void subscribe(const LiveSubscription& newSubscription) {
+        subscription = newSubscription;
+        count = 0;
+    }
+
+    // Changes the rate without dropping the frame in progress
+    void setDecimation(uint16_t decimation) {
+        subscription.decimation = decimation;
+    }
+
+    // Adds a sample; returns true and fills `frame` when a frame is complete
+    bool add(const LiveSample& sample, LiveFrame& frame) {
+        if (subscription.channelMask == 0) return false;
+        if (count == 0) {
+            pending.channelMask = subscription.channelMask;
+            pending.timestampMicros = sample.timestampMicros;
+            // Empty, min > max, until a channel has a sample
+            for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+                pending.busMin[ch] = UINT16_MAX;
+                pending.busMax[ch] = 0;
+                pending.shuntMin[ch] = INT16_MAX;
+                pending.shuntMax[ch] = INT16_MIN;
+            }
+        }
+        for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+            if (sample.busRaw[ch] == LIVE_MISSING_BUS) continue;
+            if (sample.busRaw[ch] < pending.busMin[ch]) pending.busMin[ch] = sample.busRaw[ch];
+            if (sample.busRaw[ch] > pending.busMax[ch]) pending.busMax[ch] = sample.busRaw[ch];
+            if (sample.shuntRaw[ch] < pending.shuntMin[ch]) pending.shuntMin[ch] = sample.shuntRaw[ch];
+            if (sample.shuntRaw[ch] > pending.shuntMax[ch]) pending.shuntMax[ch] = sample.shuntRaw[ch];
+        }
+        if (++count < subscription.decimation) return false;
+        pending.sampleCount = count;
+        pending.frameSeq = frameSeq++;
+        frame = pending;
+        count = 0;
+        return true;
+    }
+
+private:
+
+    uint16_t count;
+    LiveFrame pending;
+};
+
+// Bounded per-client send queue. When full, the two oldest frames are coalesced into one (min/max
+// and sample counts merged) instead of growing, so a stalled client costs a fixed amount of RAM and
+// still gets the extremes it missed once it catches up.
+template <uint8_t DEPTH>
+class LiveFrameQueue {
+public:
+
+    uint8_t count;
+
+    LiveFrameQueue() : count(0), head(0) {}
+
+    void clear() {
+        count = 0;
+        head = 0;
+    }
+
+    // Returns false if the queue was full and had to coalesce
+    bool push(const LiveFrame& frame) {
+        bool fit = true;
+        if (count == DEPTH) {
+            uint8_t second = (head + 1) % DEPTH;
+            LiveFrame merged = frames[head];
+            live_merge_frames(merged, frames[second]);
+            frames[second] = merged;
+            head = second;
+            count--;
+            fit = false;
+        }
+        frames[(head + count) % DEPTH] = frame;
+        count++;
+        return fit;
+    }
+
+    bool pop(LiveFrame& frame) {
+        if (count == 0) return false;
+        frame = frames[head];
+        head = (head + 1) % DEPTH;
+        count--;
+        return true;
+    }
+
+private:
+
+    uint8_t head;
+    LiveFrame frames[DEPTH];
+};
+
+// Frames buffered per client before coalescing kicks in
+#ifndef LIVE_QUEUE_DEPTH
+#define LIVE_QUEUE_DEPTH 8
+#endif
+// Coalesces tolerated before the client's rate is halved
+#define LIVE_DOWNGRADE_AFTER 4
+// A lagging client is never slowed below requested rate / LIVE_MAX_DOWNGRADE
+#define LIVE_MAX_DOWNGRADE 64
+// Frames sent with an empty queue before a downgraded client is sped back up. Doubles with every
+// downgrade (up to LIVE_RECOVER_AFTER_MAX) so a client on a marginal link settles instead of flapping.
+#define LIVE_RECOVER_AFTER 30
+#define LIVE_RECOVER_AFTER_MAX 1800
+
+// Decimation, queueing and the downgrade/recover policy for one websocket client
+class LiveClientState {
+public:
+
+    LiveDecimator decimator;
+    LiveFrameQueue<LIVE_QUEUE_DEPTH> queue;
+    uint16_t requestedDecimation;
+    uint32_t framesSent;
+    uint32_t framesCoalesced;
+    uint32_t downgrades;
+
+    LiveClientState() : requestedDecimation(1), framesSent(0), framesCoalesced(0), downgrades(0),
+                        coalescedSinceDowngrade(0), healthyStreak(0), recoverAfter(LIVE_RECOVER_AFTER) {}
+
+    void subscribe(const LiveSubscription& subscription) {
+        decimator.subscribe(subscription);
+        queue.clear();
+        requestedDecimation = subscription.decimation;
+        coalescedSinceDowngrade = 0;
+        healthyStreak = 0;
+        recoverAfter = LIVE_RECOVER_AFTER;
+    }
+
+    uint16_t decimation() const {
+        return decimator.subscription.decimation;
+    }
+
+    void add(const LiveSample& sample) {
+        LiveFrame frame;
+        if (!decimator.add(sample, frame)) return;
+        if (queue.push(frame)) return;
+        framesCoalesced++;
+        healthyStreak = 0;
+        if (++coalescedSinceDowngrade < LIVE_DOWNGRADE_AFTER) return;
+        coalescedSinceDowngrade = 0;
+        uint32_t slower = (uint32_t)decimation() * 2;
+        uint32_t slowest = (uint32_t)requestedDecimation * LIVE_MAX_DOWNGRADE;
+        if (slowest > UINT16_MAX) slowest = UINT16_MAX;
+        if (slower > slowest) slower = slowest;
+        if (slower > decimation()) {
+            decimator.setDecimation((uint16_t)slower);
+            downgrades++;
+            if (recoverAfter < LIVE_RECOVER_AFTER_MAX) recoverAfter *= 2;
+        }
+    }
+
+    // Takes the next frame to send; the caller is expected to send it
+    bool next(LiveFrame& frame) {
+        if (!queue.pop(frame)) return false;
+        framesSent++;
+        if (queue.count > 0) {
+            healthyStreak = 0;
+        } else if (++healthyStreak >= recoverAfter && decimation() > requestedDecimation) {
+            uint16_t faster = decimation() / 2;
+            decimator.setDecimation(faster < requestedDecimation ? requestedDecimation : faster);
+            healthyStreak = 0;
+        }
+        return true;
+    }
+
+private:
+
+    uint8_t coalescedSinceDowngrade;
+    uint16_t healthyStreak;
+    uint16_t recoverAfter;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef LOGRING_h
+#define LOGRING_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+// Bytes of (already JSON-escaped) message text kept per record
+#ifndef LOG_RING_MESSAGE_SIZE
+#define LOG_RING_MESSAGE_SIZE 120
+#endif
+
+struct LogRecord {
+    uint32_t seq;
+    uint8_t level;
+    uint8_t length;
+    uint64_t timestampMicros;
+    char message[LOG_RING_MESSAGE_SIZE];
+};
+
+// Copies `length` bytes of `text` into `out` with JSON string escaping applied, never splitting an
+// escape sequence. Returns the number of bytes written; `out` is not null-terminated.
+inline size_t json_escape(char* out, size_t capacity, const char* text, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    size_t written = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = (uint8_t)text[i];
+        if (c == '"' || c == '\\') {
+            if (written + 2 > capacity) break;
+            out[written++] = '\\';
+            out[written++] = (char)c;
+        } else if (c < 0x20) {
+            if (written + 6 > capacity) break;
+            memcpy(out + written, "\\u00", 4);
+            out[written + 4] = hex[c >> 4];
+            out[written + 5] = hex[c & 0xF];
+            written += 6;
+        } else {
+            if (written + 1 > capacity) break;
+            out[written++] = (char)c;
+        }
+    }
+    return written;
+}
+
+#define LOG_RECORD_HEADER_SIZE 14
+
+// Binary wire form of a record: seq (u32), timestampMicros (u64), level (u8), length (u8), message.
+// All integers little-endian. Returns the encoded size, or 0 if it does not fit in `capacity`.
+inline size_t log_record_encode(const LogRecord& record, uint8_t* out, size_t capacity) {
+    size_t size = LOG_RECORD_HEADER_SIZE + record.length;
+    if (size > capacity) return 0;
+    for (uint8_t i = 0; i < 4; i++) out[i] = (uint8_t)(record.seq >> (8 * i));
+    for (uint8_t i = 0; i < 8; i++) out[4 + i] = (uint8_t)(record.timestampMicros >> (8 * i));
+    out[12] = record.level;
+    out[13] = record.length;
+    memcpy(out + LOG_RECORD_HEADER_SIZE, record.message, record.length);
+    return size;
+}
+
+// Fixed-size, overwrite-oldest ring of log records. Any number of tasks may write; any number of
+// readers may follow it with their own cursor (a sequence number). Slots are guarded by a seqlock,
+// so writers never wait for readers and a reader that gets lapped simply skips ahead.
+template <uint16_t CAPACITY>
+class LogRing {
+public:
+
+    LogRing() : nextSeq(0) {
+        for (uint16_t i = 0; i < CAPACITY; i++) {
+            slotSeq[i].store(EMPTY, std::memory_order_relaxed);
+        }
+    }
+
+    // Escapes `text` into the next slot and publishes it. Returns the record's sequence number.
+    uint32_t write(uint8_t level, uint64_t timestampMicros, const char* text, size_t length) {
+        uint32_t seq = nextSeq.fetch_add(1, std::memory_order_relaxed);
+        uint16_t slot = seq % CAPACITY;
+        slotSeq[slot].store(BUSY, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        LogRecord& record = records[slot];
+        record.seq = seq;
+        record.level = level;
+        record.timestampMicros = timestampMicros;
+        record.length = (uint8_t)json_escape(record.message, LOG_RING_MESSAGE_SIZE, text, length);
+
+        slotSeq[slot].store(seq, std::memory_order_release);
+        return seq;
+    }
+
+    // Sequence number the next write will get; a reader starting here sees only new records
+    uint32_t head() const {
+        return nextSeq.load(std::memory_order_acquire);
+    }
+
+    // Oldest sequence number that may still be in the ring
+    uint32_t oldest() const {
+        uint32_t next = head();
+        return next > CAPACITY ? next - CAPACITY : 0;
+    }
+
+    // Copies the record at `cursor` into `out` and advances the cursor. If the reader fell behind
+    // and records were overwritten, the cursor jumps to the oldest surviving record and `dropped`
+    // is increased by the number skipped. Returns false once the reader has caught up.
+    bool read(uint32_t& cursor, LogRecord& out, uint32_t* dropped = NULL) const {
+        while (true) {
+            uint32_t next = head();
+            if (cursor >= next) return false;
+            if (next - cursor > CAPACITY) {
+                if (dropped) *dropped += (next - CAPACITY) - cursor;
+                cursor = next - CAPACITY;
+            }
+            uint16_t slot = cursor % CAPACITY;
+            uint32_t before = slotSeq[slot].load(std::memory_order_acquire);
+            if (before == BUSY) {
+                // Either our record is still being written, or it is being overwritten and we got lapped
+                if (head() - cursor > CAPACITY) continue;
+                return false;
+            }
+            if (before == EMPTY || before < cursor) return false;  // Claimed but not yet published
+            if (before > cursor) continue;  // Lapped while looking, recompute the oldest record
+            memcpy(&out, &records[slot], sizeof(LogRecord));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slotSeq[slot].load(std::memory_order_relaxed) != before) continue;
+            cursor++;
+            return true;
+        }
+    }
+
+private:
+
+    static const uint32_t EMPTY = 0xFFFFFFFF;
+    static const uint32_t BUSY = 0xFFFFFFFE;
+
+    std::atomic<uint32_t> nextSeq;
+    std::atomic<uint32_t> slotSeq[CAPACITY];
+    LogRecord records[CAPACITY];
+};
+
+#endif
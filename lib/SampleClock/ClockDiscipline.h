@@ -0,0 +1,149 @@
+#ifndef CLOCKDISCIPLINE_h
+#define CLOCKDISCIPLINE_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "SampleClock.h"
+
+/*
+ * Keeps a reference clock (the DS3231) on the monotonic one (esp_timer, off the ESP32's own
+ * crystal, which is good to tens of ppm: seconds a day). The RTC's 1 Hz square wave marks each of
+ * its whole seconds; the time of every edge on the monotonic clock tells how far the model has
+ * drifted since the last one.
+ *
+ * The model is a line, reference = anchorRef + elapsed * (1 + rate), re-anchored at each edge by a
+ * second-order (PI) loop: a sixteenth of the phase error comes out straight away, and the rate
+ * integrates the error, so a constant frequency offset ends with no phase error at all. The gains
+ * put both poles at 0.97, a time constant of about half a minute: small enough not to chase the
+ * interrupt latency, and a 50 ppm crystal is followed to a few µs within a few minutes.
+ *
+ * An edge more than CLOCK_STEP_MICROS off the model steps the clock instead (at boot, or after the
+ * RTC was set); an edge that doesn't fall a whole number of seconds after the last one is noise on
+ * the pin and is ignored, unless the next edge confirms it. All times are in microseconds, rates in ppb.
+ */
+
+#define CLOCK_PHASE_SHIFT 4          // phase gain 1/16 per edge
+#define CLOCK_FREQ_SHIFT 10          // frequency gain 1/1024 per edge; 1/4 of the phase gain squared
+#define CLOCK_STEP_MICROS 100000
+#define CLOCK_EDGE_TOLERANCE_MICROS 5000
+#define CLOCK_MAX_RATE_PPB 500000    // ten times a poor crystal's error; past this something is broken
+#define CLOCK_LOCK_MICROS 500        // phase error below which an edge counts towards the lock
+#define CLOCK_LOCK_EDGES 16
+
+struct ClockDisciplineStats {
+    uint32_t edges;        // edges used
+    uint32_t rejected;     // edges ignored as noise
+    uint32_t steps;        // times the clock was stepped rather than slewed
+    int64_t offset;        // phase error at the last edge: model minus reference, before correction
+    int64_t lastEdge;      // monotonic time of the last edge used, 0 before the first
+    int64_t lastRejected;  // and of the last one ignored
+    uint32_t lockedEdges;  // edges in a row within CLOCK_LOCK_MICROS
+};
+
+class ClockDiscipline {
+public:
+    int64_t anchorMono = 0;
+    // In ns, so the corrections don't round to a limit cycle of a few µs
+    int64_t anchorRefNanos = 0;
+    // ppb << CLOCK_FREQ_SHIFT, so the integrator keeps the fractions of a ppb it adds up
+    int64_t rateScaled = 0;
+    ClockDisciplineStats stats = {};
+
+    // The reference is at `reference` at monotonic `monotonic`; a boot-time read of the RTC
+    void begin(int64_t monotonic, int64_t reference) {
+        anchorMono = monotonic;
+        anchorRefNanos = reference * 1000;
+        rateScaled = 0;
+        stats = {};
+    }
+
+    int32_t ratePpb() const {
+        return (int32_t)(rateScaled >> CLOCK_FREQ_SHIFT);
+    }
+
+    bool locked() const {
+        return stats.lockedEdges >= CLOCK_LOCK_EDGES;
+    }
+
+    int64_t toReferenceNanos(int64_t monotonic) const {
+        int64_t elapsed = monotonic - anchorMono;
+        // elapsed * rate without overflowing over days without an edge
+        int64_t seconds = sample_floor_div(elapsed, 1000000);
+        int64_t micros = elapsed - seconds * 1000000;
+        int64_t correctionNanos = ((seconds * rateScaled) >> CLOCK_FREQ_SHIFT) +
+                                  ((micros * rateScaled / 1000000) >> CLOCK_FREQ_SHIFT);
+        return anchorRefNanos + elapsed * 1000 + correctionNanos;
+    }
+
+    int64_t toReference(int64_t monotonic) const {
+        return sample_floor_div(toReferenceNanos(monotonic), 1000);
+    }
+
+    // When the reference will read `reference`; to the µs for the rates allowed
+    int64_t toMonotonic(int64_t reference) const {
+        int64_t monotonic = anchorMono + (reference - sample_floor_div(anchorRefNanos, 1000));
+        monotonic -= toReference(monotonic) - reference;
+        return monotonic - (toReference(monotonic) - reference);
+    }
+
+    // A square-wave edge at monotonic `edge`: the reference is on a whole second there. Returns
+    // false if it was ignored.
+    bool edge(int64_t edge) {
+        int64_t predicted = toReferenceNanos(edge);
+        int64_t second = sample_snap(predicted, 1000000000, 0);
+        int64_t error = predicted - second;
+
+        // Off the beat of the edges before it, unless the one ignored before it agrees: the RTC was
+        // set, and the edges have a new phase
+        if (stats.lastEdge != 0 && !onBeat(edge, stats.lastEdge) &&
+            (stats.lastRejected == 0 || !onBeat(edge, stats.lastRejected))) {
+            stats.rejected++;
+            stats.lastRejected = edge;
+            return false;
+        }
+        stats.lastRejected = 0;
+
+        stats.edges++;
+        stats.offset = sample_floor_div(error + 500, 1000);
+        if (stats.offset > CLOCK_STEP_MICROS || stats.offset < -CLOCK_STEP_MICROS) {
+            // Too far off to slew: take the RTC's word for it and start the rate over
+            anchorMono = edge;
+            anchorRefNanos = second;
+            rateScaled = 0;
+            stats.steps++;
+            stats.lockedEdges = 0;
+            stats.lastEdge = edge;
+            return true;
+        }
+
+        int64_t seconds = stats.lastEdge == 0 ? 1 : sample_snap(edge - stats.lastEdge, 1000000, 0) / 1000000;
+        // Model ahead of the reference: it runs fast, so slow it down
+        rateScaled -= error / seconds;
+        const int64_t maxRate = (int64_t)CLOCK_MAX_RATE_PPB << CLOCK_FREQ_SHIFT;
+        if (rateScaled > maxRate) rateScaled = maxRate;
+        if (rateScaled < -maxRate) rateScaled = -maxRate;
+        anchorMono = edge;
+        anchorRefNanos = predicted - sample_floor_div(error, 1 << CLOCK_PHASE_SHIFT);
+        stats.lastEdge = edge;
+        if (stats.offset < CLOCK_LOCK_MICROS && stats.offset > -CLOCK_LOCK_MICROS) {
+            stats.lockedEdges++;
+        } else {
+            stats.lockedEdges = 0;
+        }
+        return true;
+    }
+
+private:
+
+    // Whether `edge` is a whole number of seconds after `earlier`, give or take the crystal
+    static bool onBeat(int64_t edge, int64_t earlier) {
+        int64_t interval = edge - earlier;
+        int64_t seconds = sample_snap(interval, 1000000, 0) / 1000000;
+        int64_t slack = interval - seconds * 1000000;
+        if (slack < 0) slack = -slack;
+        return seconds >= 1 && slack <= CLOCK_EDGE_TOLERANCE_MICROS + seconds * (CLOCK_MAX_RATE_PPB / 1000);
+    }
+};
+
+#endif
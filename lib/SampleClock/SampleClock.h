@@ -0,0 +1,137 @@
+#ifndef SAMPLECLOCK_h
+#define SAMPLECLOCK_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * When the sampler takes its readings. A timer wakes it for each tick; this works out which tick it
+ * woke for, how late it got there and what wall-clock time the sample belongs to.
+ *
+ * Ticks fall `phase` into each period of the wall clock (the RTC-disciplined one, see
+ * ClockDiscipline.h): mid-second at 1 Hz, where a small error in either clock can't move a sample
+ * into the neighbouring second. A sample is stamped with the ideal time of its tick rather than
+ * whenever the sampler got round to it, so late wakeups cost jitter in the readings, not seconds in
+ * the log. A sampler that falls behind skips the ticks it missed and counts them; a wall clock
+ * stepped backwards never gets a second stamped twice.
+ *
+ * All times are in microseconds.
+ */
+
+// Upper edges of the lateness histogram buckets; the last bucket takes everything later
+#define SAMPLE_JITTER_BUCKETS 12
+static const int64_t SAMPLE_JITTER_EDGES[SAMPLE_JITTER_BUCKETS - 1] = {
+    50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000};
+
+// How late the sampler woke for each tick it took, plus the ticks it lost
+struct SampleClockStats {
+    uint32_t buckets[SAMPLE_JITTER_BUCKETS];
+    uint32_t samples;
+    uint32_t missed;        // ticks skipped because the sampler was still busy with an earlier one
+    uint32_t duplicates;    // wakeups that found the wall clock set back behind the last tick taken
+    int64_t maxLate;
+    int64_t totalLate;
+
+    void reset() {
+        for (uint8_t i = 0; i < SAMPLE_JITTER_BUCKETS; i++) buckets[i] = 0;
+        samples = 0;
+        missed = 0;
+        duplicates = 0;
+        maxLate = 0;
+        totalLate = 0;
+    }
+
+    void record(int64_t late) {
+        if (late < 0) late = 0;
+        uint8_t bucket = 0;
+        while (bucket < SAMPLE_JITTER_BUCKETS - 1 && late > SAMPLE_JITTER_EDGES[bucket]) bucket++;
+        buckets[bucket]++;
+        samples++;
+        totalLate += late;
+        if (late > maxLate) maxLate = late;
+    }
+
+    int64_t meanLate() const {
+        return samples == 0 ? 0 : totalLate / samples;
+    }
+
+    // Lateness below which at least `permille` of the samples fell, as a bucket edge (-1 past the
+    // last edge)
+    int64_t percentile(uint32_t permille) const {
+        uint64_t wanted = ((uint64_t)samples * permille + 999) / 1000;
+        uint64_t seen = 0;
+        for (uint8_t i = 0; i < SAMPLE_JITTER_BUCKETS - 1; i++) {
+            seen += buckets[i];
+            if (seen >= wanted) return SAMPLE_JITTER_EDGES[i];
+        }
+        return -1;
+    }
+};
+
+// One tick as the sampler takes it
+struct SampleTick {
+    uint64_t index;        // ticks since the schedule began
+    int64_t wallMicros;    // ideal time of the tick on the wall clock
+    int64_t lateMicros;    // how long after the tick the sampler woke
+    uint32_t missed;       // ticks between this one and the last one taken
+};
+
+// floor(a / b) for b > 0
+inline int64_t sample_floor_div(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// The point `phase` into a period of `period` nearest to `t`
+inline int64_t sample_snap(int64_t t, int64_t period, int64_t phase) {
+    return phase + sample_floor_div(t - phase + period / 2, period) * period;
+}
+
+class SampleSchedule {
+public:
+    int64_t period = 0;
+    int64_t phase = 0;
+    int64_t first = 0;        // wall time of tick 0
+    uint64_t next = 0;        // first tick not taken yet
+    SampleClockStats stats;
+
+    // Ticks every `period` from the first point `phase` into a period that is at least `lead` after
+    // `wallNow`
+    void begin(int64_t wallNow, int64_t period, int64_t phase, int64_t lead) {
+        this->period = period;
+        this->phase = phase;
+        first = phase + sample_floor_div(wallNow + lead - phase + period - 1, period) * period;
+        next = 0;
+        stats.reset();
+    }
+
+    // Wall time of tick `index`
+    int64_t tickTime(uint64_t index) const {
+        return first + (int64_t)index * period;
+    }
+
+    // Wall time of the next tick not taken yet, when the timer should fire
+    int64_t nextTime() const {
+        return tickTime(next);
+    }
+
+    // Called when the sampler wakes at `wallNow`. False if there is no new tick to take: an early
+    // wakeup, or a clock set back over ticks already taken.
+    bool take(int64_t wallNow, SampleTick& tick) {
+        if (wallNow < first) return false;
+        uint64_t index = (uint64_t)((wallNow - first) / period);
+        if (index < next) {
+            if (index + 1 < next) stats.duplicates++;
+            return false;
+        }
+        tick.index = index;
+        tick.missed = (uint32_t)(index - next);
+        tick.wallMicros = tickTime(index);
+        tick.lateMicros = wallNow - tick.wallMicros;
+        next = index + 1;
+        stats.missed += tick.missed;
+        stats.record(tick.lateMicros);
+        return true;
+    }
+};
+
+#endif
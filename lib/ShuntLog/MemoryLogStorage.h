@@ -0,0 +1,159 @@
+#ifndef MEMORYLOGSTORAGE_h
+#define MEMORYLOGSTORAGE_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ShuntLog.h"
+
+// In-memory stand-in for the SD card, for host tests and benchmarks
+class MemoryLogStorage : public ShuntLogStorage {
+public:
+
+    std::map<std::string, std::vector<uint8_t> >& files;
+    uint32_t opens;
+    uint32_t reads;
+    uint64_t bytesRead;
+
+    MemoryLogStorage() : files(ownFiles), opens(0), reads(0), bytesRead(0), current(NULL) {}
+
+    // Another reader of `shared`'s files, with its own open file
+    explicit MemoryLogStorage(MemoryLogStorage* shared)
+        : files(shared->files), opens(0), reads(0), bytesRead(0), current(NULL) {}
+
+    void append(const char* path, const uint8_t* data, size_t length) {
+        std::vector<uint8_t>& file = files[path];
+        file.insert(file.end(), data, data + length);
+    }
+
+    bool open(const char* path) override {
+        std::map<std::string, std::vector<uint8_t> >::iterator it = files.find(path);
+        current = it == files.end() ? NULL : &it->second;
+        if (current) opens++;
+        return current != NULL;
+    }
+
+    uint32_t size() override {
+        return current ? (uint32_t)current->size() : 0;
+    }
+
+    size_t readAt(uint32_t offset, uint8_t* buffer, size_t length) override {
+        if (!current || offset >= current->size()) return 0;
+        if (length > current->size() - offset) length = current->size() - offset;
+        memcpy(buffer, current->data() + offset, length);
+        reads++;
+        bytesRead += length;
+        return length;
+    }
+
+    void close() override {
+        current = NULL;
+    }
+
+private:
+
+    std::map<std::string, std::vector<uint8_t> > ownFiles;
+    std::vector<uint8_t>* current;
+};
+
+// ShuntLogFiles over a MemoryLogStorage's files. Directories exist while they have files in them.
+class MemoryLogFiles : public ShuntLogFiles {
+public:
+
+    MemoryLogStorage& storage;
+    uint64_t capacity;
+    uint64_t bytesWritten;
+    uint32_t removed;
+
+    MemoryLogFiles(MemoryLogStorage& storage, uint64_t capacity)
+        : storage(storage), capacity(capacity), bytesWritten(0), removed(0) {}
+
+    bool append(const char* path, const uint8_t* data, size_t length) override {
+        if (length > freeBytes()) return false;
+        storage.append(path, data, length);
+        bytesWritten += length;
+        return true;
+    }
+
+    bool remove(const char* path) override {
+        if (storage.files.erase(path) == 0) return false;
+        removed++;
+        return true;
+    }
+
+    bool replace(const char* from, const char* to) override {
+        std::map<std::string, std::vector<uint8_t> >::iterator it = storage.files.find(from);
+        if (it == storage.files.end()) return false;
+        storage.files[to].swap(it->second);
+        storage.files.erase(from);
+        return true;
+    }
+
+    bool removeDir(const char* path) override {
+        return firstUnder(path) == storage.files.end();
+    }
+
+    // Paths sort like their names, so the first file under `dir` is in its first entry
+    bool first(const char* dir, char* name, size_t capacity, bool& isDir) override {
+        std::string prefix = std::string(dir) + "/";
+        std::map<std::string, std::vector<uint8_t> >::iterator it = firstUnder(dir);
+        while (it != storage.files.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+            std::string rest = it->first.substr(prefix.size());
+            size_t slash = rest.find('/');
+            std::string entry = rest.substr(0, slash);
+            if (entry[0] != '.') {
+                isDir = slash != std::string::npos;
+                snprintf(name, capacity, "%s", entry.c_str());
+                return true;
+            }
+            it++;
+        }
+        return false;
+    }
+
+    bool last(const char* dir, char* name, size_t capacity, bool& isDir) override {
+        std::string prefix = std::string(dir) + "/";
+        bool found = false;
+        for (std::map<std::string, std::vector<uint8_t> >::iterator it = firstUnder(dir);
+             it != storage.files.end() && it->first.compare(0, prefix.size(), prefix) == 0; it++) {
+            std::string rest = it->first.substr(prefix.size());
+            size_t slash = rest.find('/');
+            std::string entry = rest.substr(0, slash);
+            if (entry[0] == '.') continue;
+            isDir = slash != std::string::npos;
+            snprintf(name, capacity, "%s", entry.c_str());
+            found = true;
+        }
+        return found;
+    }
+
+    bool truncate(const char* path, uint32_t size) override {
+        std::map<std::string, std::vector<uint8_t> >::iterator it = storage.files.find(path);
+        if (it == storage.files.end() || size > it->second.size()) return false;
+        it->second.resize(size);
+        return true;
+    }
+
+    uint64_t freeBytes() override {
+        uint64_t used = 0;
+        for (std::map<std::string, std::vector<uint8_t> >::iterator it = storage.files.begin(); it != storage.files.end(); it++) {
+            used += it->second.size();
+        }
+        return used < capacity ? capacity - used : 0;
+    }
+
+private:
+
+    std::map<std::string, std::vector<uint8_t> >::iterator firstUnder(const char* dir) {
+        std::string prefix = std::string(dir) + "/";
+        std::map<std::string, std::vector<uint8_t> >::iterator it = storage.files.lower_bound(prefix);
+        if (it != storage.files.end() && it->first.compare(0, prefix.size(), prefix) != 0) return storage.files.end();
+        return it;
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef SHUNTCURSOR_h
+#define SHUNTCURSOR_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ShuntLog.h"
+#include "ShuntIndex.h"
+
+// Manifest entries held per open of the manifest, and read per call
+#define SHUNT_MANIFEST_BATCH 32
+#define SHUNT_MANIFEST_READ 8
+
+// Walks the records of one log level whose interval starts in [from, to), across files, in time
+// order. Keeps one file open at a time and seeks into the first one; full-rate files are found
+// through the manifest where it covers the range and by name after it or when there is no
+// manifest. The file still being written has no manifest entry and, if the logger booted during
+// the hour, isn't named on the hour, so its start is passed in as `liveFileStart` (0 if unknown).
+class ShuntLogCursor {
+public:
+
+    ShuntLogLevel level;
+    int64_t from;
+    int64_t to;
+
+    // The current record, valid after next() returns true. `start` is the start of its interval
+    // (the timestamp for full-rate records, the rollup timestamp minus its interval otherwise).
+    int64_t start;
+    FullRecord full;
+    RollupRecord rollup;
+
+    uint32_t recordsRead;
+    uint32_t recordsSkipped;  // Torn or corrupt
+    uint32_t filesOpened;
+
+    ShuntLogCursor(ShuntLogStorage& storage, ShuntLogLevel level, int64_t from, int64_t to, int64_t liveFileStart = 0)
+        : level(level), from(from), to(to), recordsRead(0), recordsSkipped(0), filesOpened(0), storage(storage),
+          liveFileStart(level == SHUNT_LOG_FULL ? liveFileStart : 0), visitedStart(INT64_MIN), fileOpen(false),
+          seekPending(true), manifestIndex(0), manifestCount(0), cacheIndex(0), cacheCount(0) {
+        interval = level == SHUNT_LOG_FULL ? 0 : shunt_log_level_seconds(level);
+        // Rollups are stamped (and filed) at the end of their interval
+        fileStart = shunt_log_file_start(level, from + interval);
+        lastFileStart = shunt_log_file_start(level, to - 1 + interval);
+        if (level == SHUNT_LOG_FULL && storage.open(SHUNT_MANIFEST_PATH)) {
+            manifestCount = storage.size() / SHUNT_MANIFEST_ENTRY_SIZE;
+            manifestIndex = shunt_manifest_lower_bound(storage, manifestCount, from);
+            // Just enough for short ranges, which are the common case
+            fillCache(SHUNT_MANIFEST_READ);
+            storage.close();
+        }
+    }
+
+    // Advances to the next record in range; false once there are no more
+    bool next() {
+        while (true) {
+            if (!fileOpen && !openNextFile()) return false;
+            if (recordIndex >= recordCount) {
+                close();
+                continue;
+            }
+            size_t length = storage.readAt(recordIndex * recordSize, record, recordSize);
+            recordIndex++;
+            recordsRead++;
+            bool ok;
+            if (level == SHUNT_LOG_FULL) {
+                ok = shunt_log_decode_full(record, length, full);
+                start = full.timestamp;
+            } else {
+                ok = shunt_log_decode_rollup(record, length, rollup);
+                start = rollup.timestamp - interval;
+            }
+            if (!ok) {
+                recordsSkipped++;
+                continue;
+            }
+            if (start < from) continue;
+            if (start >= to) {
+                // Files are visited in time order, nothing later can match
+                close();
+                manifestIndex = manifestCount;
+                fileStart = lastFileStart + 1;
+                liveFileStart = 0;
+                return false;
+            }
+            return true;
+        }
+    }
+
+    void close() {
+        if (fileOpen) storage.close();
+        fileOpen = false;
+    }
+
+private:
+
+    ShuntLogStorage& storage;
+    uint32_t interval;
+    int64_t liveFileStart;
+    int64_t visitedStart;  // Of the last file tried
+    int64_t fileStart;
+    int64_t lastFileStart;
+    bool fileOpen;
+    bool seekPending;
+    uint32_t recordIndex;
+    uint32_t recordCount;
+    size_t recordSize;
+    uint8_t record[SHUNT_LOG_MAX_RECORD_SIZE];
+
+    uint32_t manifestIndex;
+    uint32_t manifestCount;
+    uint8_t cacheIndex;
+    uint8_t cacheCount;
+    ShuntManifestEntry cache[SHUNT_MANIFEST_BATCH];
+
+    // Reads up to `limit` entries from the open manifest, SHUNT_MANIFEST_READ at a time
+    void fillCache(uint8_t limit) {
+        uint8_t buffer[SHUNT_MANIFEST_READ * SHUNT_MANIFEST_ENTRY_SIZE];
+        cacheIndex = 0;
+        cacheCount = 0;
+        while (cacheCount < limit && manifestIndex + cacheCount < manifestCount) {
+            uint32_t wanted = manifestCount - manifestIndex - cacheCount;
+            if (wanted > SHUNT_MANIFEST_READ) wanted = SHUNT_MANIFEST_READ;
+            if (wanted > (uint32_t)(limit - cacheCount)) wanted = limit - cacheCount;
+            size_t read = storage.readAt((manifestIndex + cacheCount) * SHUNT_MANIFEST_ENTRY_SIZE, buffer,
+                                         wanted * SHUNT_MANIFEST_ENTRY_SIZE) / SHUNT_MANIFEST_ENTRY_SIZE;
+            for (uint8_t i = 0; i < read; i++) {
+                shunt_manifest_decode(buffer + i * SHUNT_MANIFEST_ENTRY_SIZE, cache[cacheCount++]);
+            }
+            if (read < wanted) break;
+        }
+    }
+
+    bool nextManifestEntry(ShuntManifestEntry& entry) {
+        if (manifestIndex >= manifestCount) return false;
+        if (cacheIndex >= cacheCount) {
+            cacheCount = 0;
+            if (storage.open(SHUNT_MANIFEST_PATH)) {
+                fillCache(SHUNT_MANIFEST_BATCH);
+                storage.close();
+            }
+            if (cacheCount == 0) {
+                manifestCount = manifestIndex;
+                return false;
+            }
+        }
+        entry = cache[cacheIndex++];
+        manifestIndex++;
+        return true;
+    }
+
+    // Start (name) of the next file to try and its record count if known: from the manifest while
+    // it lasts, then by name, with the live file in its place among them
+    bool nextFileStart(int64_t& start, uint32_t& records) {
+        ShuntManifestEntry entry;
+        records = 0;
+        if (nextManifestEntry(entry)) {
+            if (entry.firstTimestamp >= to) {
+                manifestIndex = manifestCount;
+                fileStart = lastFileStart + 1;
+                liveFileStart = 0;
+                return false;
+            }
+            // Whatever comes after the manifest is probed by name from the following file
+            int64_t after = shunt_log_next_file_start(level, shunt_log_file_start(level, entry.lastTimestamp));
+            if (after > fileStart) fileStart = after;
+            start = visitedStart = entry.fileStart;
+            records = entry.records;
+            return true;
+        }
+        if (liveFileStart != 0 && liveFileStart > visitedStart && liveFileStart < to
+            && (liveFileStart < fileStart || fileStart > lastFileStart)) {
+            start = visitedStart = liveFileStart;
+            return true;
+        }
+        if (fileStart > lastFileStart) return false;
+        start = visitedStart = fileStart;
+        fileStart = shunt_log_next_file_start(level, fileStart);
+        return true;
+    }
+
+    bool openNextFile() {
+        char path[40];
+        int64_t start;
+        uint32_t records;
+        while (nextFileStart(start, records)) {
+            // Only the first file needs a seek; every record of the later ones is in range
+            uint32_t seekOffset = 0;
+            bool indexed = false;
+            if (seekPending && records >= SHUNT_INDEX_MIN_RECORDS) {
+                shunt_index_path(start, path, sizeof(path));
+                if (storage.open(path)) {
+                    seekOffset = shunt_index_seek(storage, storage.size() / SHUNT_INDEX_ENTRY_SIZE, from);
+                    storage.close();
+                    indexed = true;
+                }
+            }
+            shunt_log_path(level, start, path, sizeof(path));
+            if (!storage.open(path)) continue;
+            filesOpened++;
+            uint8_t header[SHUNT_LOG_FIELD_OVERHEAD];
+            uint8_t timestampSize = shunt_log_timestamp_size(header, storage.readAt(0, header, sizeof(header)));
+            if (timestampSize == 0) {
+                storage.close();
+                continue;
+            }
+            fileOpen = true;
+            recordSize = shunt_log_record_size(level, timestampSize);
+            recordCount = storage.size() / recordSize;
+            recordIndex = 0;
+            if (indexed) {
+                recordIndex = seekOffset / recordSize;
+            } else if (seekPending) {
+                recordIndex = shunt_log_lower_bound(storage, recordSize, recordCount, from + interval);
+            }
+            seekPending = false;
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef SHUNTDOWNSAMPLE_h
+#define SHUNTDOWNSAMPLE_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ShuntLog.h"
+#include "ShuntCursor.h"
+#include "ShuntSeries.h"
+#include "Downsample.h"
+
+/*
+ * Chart-sized views of the on-card logs: at most `points` points per channel for any range, for
+ * any subset of the channels, in one pass and constant memory.
+ *
+ *   lttb    largest-triangle-three-buckets over the readings (rollup means on the coarser levels);
+ *           keeps the shape of the line with real samples
+ *   minmax  per bucket the lowest and highest reading (rollup min/max), so spikes always show
+ *
+ * As JSON:
+ *   {"level":"minute","mode":"lttb","quantity":"shunt","from":..,"to":..,
+ *    "points":[[ch,ts,value],...]}                 lttb
+ *    "points":[[ch,ts,min,max],...]}               minmax
+ * As binary, just the points, DOWNSAMPLE_POINT_SIZE bytes each, little-endian:
+ *   u8 channel, i64 ts, i32 value (min), i32 value (max)
+ * Points are in time order per channel; channels are interleaved.
+ */
+
+#define DOWNSAMPLE_POINT_SIZE 17
+
+#ifndef DOWNSAMPLE_MAX_POINTS
+#define DOWNSAMPLE_MAX_POINTS 5000
+#endif
+
+enum DownsampleMode { DOWNSAMPLE_LTTB, DOWNSAMPLE_MINMAX };
+
+struct DownsampleQuery {
+    int64_t from;
+    int64_t to;
+    uint32_t points;       // Per channel; 0 means SERIES_DEFAULT_POINTS
+    DownsampleMode mode;
+    uint8_t channels;      // Bit mask
+    bool bus;              // Bus voltage instead of shunt voltage
+    bool binary;
+};
+
+inline size_t downsample_encode_point(uint8_t channel, const DownsamplePoint& point, uint8_t* out) {
+    out[0] = channel;
+    for (uint8_t i = 0; i < 8; i++) out[1 + i] = (uint8_t)((uint64_t)point.x >> (8 * i));
+    for (uint8_t i = 0; i < 4; i++) out[9 + i] = (uint8_t)((uint32_t)point.y >> (8 * i));
+    for (uint8_t i = 0; i < 4; i++) out[13 + i] = (uint8_t)((uint32_t)point.y2 >> (8 * i));
+    return DOWNSAMPLE_POINT_SIZE;
+}
+
+// Picks the log level like a series query with one bucket per output point would
+inline ShuntLogLevel downsample_plan(DownsampleQuery& query) {
+    if (query.points == 0) query.points = SERIES_DEFAULT_POINTS;
+    if (query.points > DOWNSAMPLE_MAX_POINTS) query.points = DOWNSAMPLE_MAX_POINTS;
+    if (query.points < 3) query.points = 3;
+    SeriesQuery series = {0, query.from, query.to, (uint32_t)((uint64_t)(query.to - query.from) / query.points), false};
+    return series_plan(series);
+}
+
+// Streams one query as a sequence of chunks, the same way ShuntSeriesReader does
+class ShuntDownsampleReader {
+public:
+
+    DownsampleQuery query;
+    ShuntLogLevel level;
+    ShuntLogCursor cursor;
+    uint32_t points;
+
+    // `liveFileStart` as for ShuntSeriesReader
+    ShuntDownsampleReader(ShuntLogStorage& storage, const DownsampleQuery& request, int64_t liveFileStart = 0)
+        : query(request), level(downsample_plan(query)), cursor(storage, level, query.from, query.to, liveFileStart),
+          points(0), stage(HEADER), pendingLength(0), pendingOffset(0) {
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            lttb[ch].setup(query.from, query.to, query.points);
+            minmax[ch].setup(query.from, query.to, query.points);
+        }
+    }
+
+    bool finished() const {
+        return stage == DONE && pendingOffset == pendingLength;
+    }
+
+    // Writes as much output as fits; a point is never split across calls. Returns 0 once finished.
+    size_t fill(uint8_t* out, size_t capacity) {
+        size_t written = 0;
+        while (true) {
+            size_t length = series_pending_left(pendingLength, pendingOffset, sizeof(pending));
+            if (length > 0) {
+                if (length > capacity - written) {
+                    if (written > 0 || pendingOffset > 0) return written;
+                    // Smaller than one point: hand it over in pieces
+                    length = capacity - written;
+                }
+                memcpy(out + written, pending + pendingOffset, length);
+                written += length;
+                pendingOffset += length;
+                if (pendingOffset < pendingLength) return written;
+            }
+            pendingOffset = pendingLength = 0;
+            if (stage == DONE) {
+                cursor.close();
+                return written;
+            }
+            produce();
+        }
+    }
+
+private:
+
+    enum Stage { HEADER, POINTS, DRAIN, FOOTER, DONE };
+
+    Stage stage;
+    LttbStream lttb[SHUNT_LOG_CHANNELS];
+    MinMaxStream minmax[SHUNT_LOG_CHANNELS];
+    char pending[96];
+    size_t pendingLength;
+    size_t pendingOffset;
+
+    bool selected(uint8_t ch) const {
+        return (query.channels >> ch) & 1;
+    }
+
+    // Puts the next piece of output in `pending`
+    void produce() {
+        if (stage == HEADER) {
+            stage = POINTS;
+            if (query.binary) return;
+            int length = snprintf(pending, sizeof(pending),
+                                  "{\"level\":\"%s\",\"mode\":\"%s\",\"quantity\":\"%s\",\"from\":%lld,\"to\":%lld,\"points\":[",
+                                  shunt_log_level_name(level), query.mode == DOWNSAMPLE_LTTB ? "lttb" : "minmax",
+                                  query.bus ? "bus" : "shunt", (long long)query.from, (long long)query.to);
+            pendingLength = length > 0 && (size_t)length < sizeof(pending) ? (size_t)length : 0;
+            return;
+        }
+        // Feed records until one of the channels has a point ready
+        while (stage != FOOTER) {
+            for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+                DownsamplePoint point;
+                bool ready = query.mode == DOWNSAMPLE_LTTB ? lttb[ch].pop(point) : minmax[ch].pop(point);
+                if (ready) {
+                    emit(ch, point);
+                    return;
+                }
+            }
+            if (stage == DRAIN) {
+                stage = FOOTER;
+            } else if (!feed()) {
+                // The last buckets are only complete now; drain them before the footer
+                for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+                    lttb[ch].finish();
+                    minmax[ch].finish();
+                }
+                stage = DRAIN;
+            }
+        }
+        stage = DONE;
+        if (!query.binary) {
+            memcpy(pending, "]}", 2);
+            pendingLength = 2;
+        }
+    }
+
+    // Adds the next record to every selected channel
+    bool feed() {
+        if (!cursor.next()) return false;
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            if (!selected(ch)) continue;
+            int32_t low, mean, high;
+            if (level == SHUNT_LOG_FULL) {
+                if (shunt_log_missing(cursor.full, ch)) continue;
+                low = mean = high = query.bus ? (int32_t)cursor.full.busRaw[ch] : cursor.full.shuntRaw[ch];
+            } else {
+                const RollupRecord& rollup = cursor.rollup;
+                if (shunt_log_missing(rollup, ch)) continue;
+                low = (int32_t)(query.bus ? rollup.busMin[ch] : rollup.shuntMin[ch]);
+                mean = query.bus ? rollup.busMean[ch] : rollup.shuntMean[ch];
+                high = (int32_t)(query.bus ? rollup.busMax[ch] : rollup.shuntMax[ch]);
+            }
+            if (query.mode == DOWNSAMPLE_LTTB) {
+                lttb[ch].add(cursor.start, mean);
+            } else {
+                minmax[ch].add(cursor.start, low, high);
+            }
+        }
+        return true;
+    }
+
+    void emit(uint8_t ch, const DownsamplePoint& point) {
+        if (query.binary) {
+            pendingLength = downsample_encode_point(ch, point, (uint8_t*)pending);
+        } else {
+            int length;
+            if (query.mode == DOWNSAMPLE_LTTB) {
+                length = snprintf(pending, sizeof(pending), "%s[%u,%lld,%ld]", points ? "," : "", ch,
+                                  (long long)point.x, (long)point.y);
+            } else {
+                length = snprintf(pending, sizeof(pending), "%s[%u,%lld,%ld,%ld]", points ? "," : "", ch,
+                                  (long long)point.x, (long)point.y, (long)point.y2);
+            }
+            pendingLength = length > 0 && (size_t)length < sizeof(pending) ? (size_t)length : 0;
+        }
+        points++;
+    }
+};
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef SHUNTINDEX_h
+#define SHUNTINDEX_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ShuntLog.h"
+
+/*
+ * Time indexes for the full-rate logs, written when a file is rotated.
+ *
+ *   /index/full.man                        manifest, one 32 byte entry per closed /full file, in
+ *                                          time order: i64 fileStart (from its name), i64 first and
+ *                                          i64 last record timestamp, u32 records, u32 bytes
+ *   /index/full/YYYY/MM/DD/HHMMSS.idx      sparse index of one file, 12 byte entries:
+ *                                          i64 timestamp, u32 byte offset, every
+ *                                          SHUNT_INDEX_STRIDE records (doubled as often as
+ *                                          needed to fit SHUNT_INDEX_MAX_ENTRIES)
+ *
+ * The manifest finds the files that overlap a range with a binary search instead of probing or
+ * listing /full, and includes files that don't start on the hour (the first one after a boot).
+ * All integers are little-endian.
+ */
+
+#define SHUNT_INDEX_STRIDE 8
+#define SHUNT_INDEX_MAX_ENTRIES 64
+#define SHUNT_INDEX_ENTRY_SIZE 12
+#define SHUNT_MANIFEST_ENTRY_SIZE 32
+#define SHUNT_MANIFEST_PATH "/index/full.man"
+
+// Files with fewer records than this are found faster with a binary search of the file itself
+// than by opening its index
+#define SHUNT_INDEX_MIN_RECORDS 256
+
+struct ShuntIndexEntry {
+    int64_t timestamp;
+    uint32_t offset;
+};
+
+struct ShuntManifestEntry {
+    int64_t fileStart;
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    uint32_t records;
+    uint32_t bytes;
+};
+
+inline void shunt_index_put(uint8_t* out, uint64_t value, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+inline uint64_t shunt_index_get(const uint8_t* in, uint8_t size) {
+    uint64_t value = 0;
+    for (uint8_t i = 0; i < size; i++) value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+inline void shunt_manifest_encode(const ShuntManifestEntry& entry, uint8_t* out) {
+    shunt_index_put(out, (uint64_t)entry.fileStart, 8);
+    shunt_index_put(out + 8, (uint64_t)entry.firstTimestamp, 8);
+    shunt_index_put(out + 16, (uint64_t)entry.lastTimestamp, 8);
+    shunt_index_put(out + 24, entry.records, 4);
+    shunt_index_put(out + 28, entry.bytes, 4);
+}
+
+inline void shunt_manifest_decode(const uint8_t* in, ShuntManifestEntry& entry) {
+    entry.fileStart = (int64_t)shunt_index_get(in, 8);
+    entry.firstTimestamp = (int64_t)shunt_index_get(in + 8, 8);
+    entry.lastTimestamp = (int64_t)shunt_index_get(in + 16, 8);
+    entry.records = (uint32_t)shunt_index_get(in + 24, 4);
+    entry.bytes = (uint32_t)shunt_index_get(in + 28, 4);
+}
+
+// "/index/full/2023/07/23/113425.idx", laid out like /full
+inline size_t shunt_index_path(int64_t fileStart, char* out, size_t capacity) {
+    char name[24];
+    shunt_full_name(fileStart, SHUNT_FULL_PARTITION, name, sizeof(name));
+    int length = snprintf(out, capacity, "/index/full/%s.idx", name);
+    return length > 0 ? (size_t)length : 0;
+}
+
+// Collects the index of the file being written; the logger adds every record and writes the
+// result out when it rotates
+class ShuntIndexBuilder {
+public:
+
+    ShuntManifestEntry manifest;
+    ShuntIndexEntry entries[SHUNT_INDEX_MAX_ENTRIES];
+    uint8_t count;
+    uint32_t stride;
+
+    ShuntIndexBuilder() {
+        begin(0);
+    }
+
+    void begin(int64_t fileStart) {
+        manifest.fileStart = fileStart;
+        manifest.firstTimestamp = 0;
+        manifest.lastTimestamp = 0;
+        manifest.records = 0;
+        manifest.bytes = 0;
+        count = 0;
+        stride = SHUNT_INDEX_STRIDE;
+    }
+
+    // Records one record of `length` bytes, written at the current end of the file
+    void add(int64_t timestamp, uint32_t length) {
+        if (manifest.records % stride == 0 && count == SHUNT_INDEX_MAX_ENTRIES) {
+            // Full: keep every other entry, so a file of any length fits in fixed RAM
+            for (uint8_t i = 0; i < count / 2; i++) entries[i] = entries[2 * i];
+            count /= 2;
+            stride *= 2;
+        }
+        if (manifest.records % stride == 0) {
+            entries[count].timestamp = timestamp;
+            entries[count].offset = manifest.bytes;
+            count++;
+        }
+        if (manifest.records == 0) manifest.firstTimestamp = timestamp;
+        manifest.lastTimestamp = timestamp;
+        manifest.records++;
+        manifest.bytes += length;
+    }
+
+    // The sidecar file contents, count * SHUNT_INDEX_ENTRY_SIZE bytes
+    size_t encodeIndex(uint8_t* out) const {
+        for (uint8_t i = 0; i < count; i++) {
+            shunt_index_put(out + i * SHUNT_INDEX_ENTRY_SIZE, (uint64_t)entries[i].timestamp, 8);
+            shunt_index_put(out + i * SHUNT_INDEX_ENTRY_SIZE + 8, entries[i].offset, 4);
+        }
+        return count * SHUNT_INDEX_ENTRY_SIZE;
+    }
+};
+
+inline bool shunt_manifest_read(ShuntLogStorage& storage, uint32_t index, ShuntManifestEntry& entry) {
+    uint8_t buffer[SHUNT_MANIFEST_ENTRY_SIZE];
+    if (storage.readAt(index * SHUNT_MANIFEST_ENTRY_SIZE, buffer, sizeof(buffer)) != sizeof(buffer)) return false;
+    shunt_manifest_decode(buffer, entry);
+    return true;
+}
+
+// First manifest entry (of `count` in the open manifest) whose last record is at or after
+// `timestamp`. Files are about SHUNT_FULL_FILE_SECONDS each, so the first few probes interpolate between the
+// bounds and usually land within an entry or two; after that it bisects, so gaps and reboots cost
+// at most a binary search.
+inline uint32_t shunt_manifest_lower_bound(ShuntLogStorage& storage, uint32_t count, int64_t timestamp) {
+    ShuntManifestEntry entry;
+    uint32_t low = 0;
+    uint32_t high = count;
+    if (count == 0 || !shunt_manifest_read(storage, 0, entry)) return 0;
+    int64_t lowTimestamp = entry.lastTimestamp;
+    if (!shunt_manifest_read(storage, count - 1, entry)) return 0;
+    int64_t highTimestamp = entry.lastTimestamp;
+    // Invariant: every entry before `low` ends before `timestamp`, entry `high - 1` ends at or after it
+    for (uint8_t step = 0; low < high; step++) {
+        if (timestamp <= lowTimestamp) return low;
+        if (timestamp > highTimestamp) return high;
+        // Entry `low` ends too early, so with only one other candidate it is the answer
+        if (high - low <= 2) return high - 1;
+        uint32_t probe;
+        if (step < 4) {
+            probe = low + (uint32_t)((uint64_t)(timestamp - lowTimestamp) * (high - 1 - low) / (uint64_t)(highTimestamp - lowTimestamp));
+        } else {
+            probe = low + (high - 1 - low) / 2;
+        }
+        if (probe <= low) probe = low + 1;
+        if (probe > high - 2) probe = high - 2;
+        if (!shunt_manifest_read(storage, probe, entry)) return low;
+        if (entry.lastTimestamp < timestamp) {
+            low = probe + 1;
+            if (low < high && !shunt_manifest_read(storage, low, entry)) return low;
+            lowTimestamp = entry.lastTimestamp;
+        } else {
+            high = probe + 1;
+            highTimestamp = entry.lastTimestamp;
+        }
+    }
+    return low;
+}
+
+// First manifest entry (of `count` in the open manifest) for a file that starts after `fileStart`
+inline uint32_t shunt_manifest_after(ShuntLogStorage& storage, uint32_t count, int64_t fileStart) {
+    ShuntManifestEntry entry;
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (!shunt_manifest_read(storage, middle, entry) || entry.fileStart > fileStart) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+// Byte offset in the data file to start scanning from for the first record at or after
+// `timestamp`, using the open sidecar index of `count` entries. Records before the returned offset
+// are all earlier; at most one index stride of records after it may be too.
+inline uint32_t shunt_index_seek(ShuntLogStorage& storage, uint32_t count, int64_t timestamp) {
+    uint8_t buffer[SHUNT_INDEX_ENTRY_SIZE];
+    uint32_t low = 0;
+    uint32_t high = count;
+    // Find the first entry at or after `timestamp` and start from the one before it
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (storage.readAt(middle * SHUNT_INDEX_ENTRY_SIZE, buffer, sizeof(buffer)) != sizeof(buffer)
+            || (int64_t)shunt_index_get(buffer, 8) >= timestamp) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    if (low == 0) return 0;
+    if (storage.readAt((low - 1) * SHUNT_INDEX_ENTRY_SIZE, buffer, sizeof(buffer)) != sizeof(buffer)) return 0;
+    return (uint32_t)shunt_index_get(buffer + 8, 4);
+}
+
+#endif
@@ -0,0 +1,711 @@
+#ifndef SHUNTLOG_h
+#define SHUNTLOG_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * On-card log layout (".bin0", format version 0).
+ *
+ * Every value is written as a field: i32 0, u16 size, <size bytes little-endian value>, i32 0.
+ * A record ends with a u64 check field: the CRC-32C of every byte of the record before it in the
+ * low half and SHUNT_LOG_SYNC in the high half. Records are fixed size for a given timestamp width,
+ * and the marker lets a reader that has lost its place (a torn write, dropped bytes) find where the
+ * next one ends. Files written before hold the wrapping sum of every value
+ * (signed values sign-extended) instead, which never has those high bits; both are accepted.
+ *
+ *   /full/YYYY/MM/DD/HHMMSS.bin0  one file per SHUNT_FULL_FILE_SECONDS, one record per sample:
+ *       timestamp, then per shunt: u32 busRaw, i32 shuntRaw, check, "\r\n"
+ *       The timestamp is 12 bytes, i64 second and u32 µs from it to the moment the shunts were
+ *       read (SHUNT_LOG_TIMESTAMP_MICROS); files from older firmware have just the second, as a
+ *       4 or 8 byte time_t. The size in the first field says which.
+ *   /daily/YYYYMMDD.bin0          one record per minute, /hourly/YYYYMM.bin0 one record per hour:
+ *       timestamp, then per shunt: i64 busMin, i32 busMean, i64 busMax,
+ *       i64 shuntMin, i32 shuntMean, i64 shuntMax, check
+ *       The timestamp is the second, 8 bytes (4 from firmware with a 32 bit time_t).
+ *   /system/YYYYMM.bin0           the logger's own memory every few minutes, see ShuntSystemLog.h
+ *
+ * A shunt with nothing to show for a sample (its INA stopped answering, or there isn't one) is
+ * written as SHUNT_LOG_MISSING_BUS and SHUNT_LOG_MISSING_SHUNT in /full, and a rollup that had no
+ * sample of it keeps SimpleStats' empty min > max. Readers skip both: see shunt_log_missing().
+ *
+ * A /full file is named after the time it was opened (usually the start of its hour, later after a
+ * boot) and kept in a directory per day, or per hour, or in /full itself (SHUNT_FULL_PARTITION).
+ * FAT looks names up by reading a directory from the start, so a flat /full gets slower to open
+ * and create files in as it grows; partitions keep every directory short.
+ *
+ * Rollup records are written at the rollover, so their timestamp is the end of the interval they
+ * cover; the file they land in is named after that time too.
+ */
+
+#define SHUNT_LOG_CHANNELS 5
+#define SHUNT_LOG_FIELD_OVERHEAD 10
+#define SHUNT_LOG_MAX_RECORD_SIZE 544
+
+// A full-rate timestamp field this size is the second and the µs into it the sample was taken
+#define SHUNT_LOG_TIMESTAMP_MICROS 12
+
+// High half of every record's check field, "\xA5SLZ" on the card
+#define SHUNT_LOG_SYNC 0x5A4C53A5u
+
+// Layouts of /full
+#define SHUNT_PARTITION_NONE 0  // /full/20230723T110000.bin0
+#define SHUNT_PARTITION_DAY 1   // /full/2023/07/23/110000.bin0
+#define SHUNT_PARTITION_HOUR 2  // /full/2023/07/23/11/0000.bin0
+
+#ifndef SHUNT_FULL_PARTITION
+#define SHUNT_FULL_PARTITION SHUNT_PARTITION_DAY
+#endif
+
+// How long the logger writes to one /full file: 3600 for an hour, 60 for the old file a minute.
+// Must divide a day.
+#ifndef SHUNT_FULL_FILE_SECONDS
+#define SHUNT_FULL_FILE_SECONDS 3600
+#endif
+
+enum ShuntLogLevel {
+    SHUNT_LOG_FULL,
+    SHUNT_LOG_MINUTE,
+    SHUNT_LOG_HOUR,
+};
+
+// Seconds covered by one record at each level
+inline uint32_t shunt_log_level_seconds(ShuntLogLevel level) {
+    switch (level) {
+        case SHUNT_LOG_HOUR: return 3600;
+        case SHUNT_LOG_MINUTE: return 60;
+        default: return 1;
+    }
+}
+
+inline const char* shunt_log_level_name(ShuntLogLevel level) {
+    switch (level) {
+        case SHUNT_LOG_HOUR: return "hour";
+        case SHUNT_LOG_MINUTE: return "minute";
+        default: return "full";
+    }
+}
+
+inline size_t shunt_log_record_size(ShuntLogLevel level, uint8_t timestampSize) {
+    if (level == SHUNT_LOG_FULL) {
+        // timestamp + 10 x 4 byte fields + check + CRLF
+        return SHUNT_LOG_FIELD_OVERHEAD + timestampSize + 10 * (SHUNT_LOG_FIELD_OVERHEAD + 4)
+               + SHUNT_LOG_FIELD_OVERHEAD + 8 + 2;
+    }
+    // timestamp + 5 x (4 x 8 byte + 2 x 4 byte fields) + check
+    return SHUNT_LOG_FIELD_OVERHEAD + timestampSize
+           + SHUNT_LOG_CHANNELS * (4 * (SHUNT_LOG_FIELD_OVERHEAD + 8) + 2 * (SHUNT_LOG_FIELD_OVERHEAD + 4))
+           + SHUNT_LOG_FIELD_OVERHEAD + 8;
+}
+
+struct FullRecord {
+    int64_t timestamp;
+    uint32_t micros;  // after `timestamp` the sample was taken; 0 in files with only the second
+    uint32_t busRaw[SHUNT_LOG_CHANNELS];
+    int32_t shuntRaw[SHUNT_LOG_CHANNELS];
+};
+
+struct RollupRecord {
+    int64_t timestamp;
+    int64_t busMin[SHUNT_LOG_CHANNELS];
+    int32_t busMean[SHUNT_LOG_CHANNELS];
+    int64_t busMax[SHUNT_LOG_CHANNELS];
+    int64_t shuntMin[SHUNT_LOG_CHANNELS];
+    int32_t shuntMean[SHUNT_LOG_CHANNELS];
+    int64_t shuntMax[SHUNT_LOG_CHANNELS];
+};
+
+// Neither can come from an INA: their bus registers are at most 20 bits, and the shunt registers
+// sign-extend from at most 20
+#define SHUNT_LOG_MISSING_BUS 0xFFFFFFFFu
+#define SHUNT_LOG_MISSING_SHUNT INT32_MIN
+
+// Whether channel `ch` of a record has no sample in it
+inline bool shunt_log_missing(const FullRecord& record, uint8_t ch) {
+    return record.busRaw[ch] == SHUNT_LOG_MISSING_BUS;
+}
+
+inline bool shunt_log_missing(const RollupRecord& record, uint8_t ch) {
+    return record.busMin[ch] > record.busMax[ch];
+}
+
+// CRC-32C (Castagnoli), a byte at a time from a 1 KB table. The ESP32 only has the IEEE CRC-32 in
+// ROM; a record a second doesn't need more than this. Pass the previous result as `crc` to go on.
+struct ShuntCrc32cTable {
+    uint32_t entries[256];
+
+    ShuntCrc32cTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (uint8_t bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78u : 0);
+            entries[i] = crc;
+        }
+    }
+};
+
+inline uint32_t shunt_crc32c(const uint8_t* data, size_t length, uint32_t crc = 0) {
+    static const ShuntCrc32cTable table;
+    crc = ~crc;
+    while (length--) crc = table.entries[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// The check field's value for a record whose bytes so far have CRC-32C `crc`
+inline uint64_t shunt_log_check(uint32_t crc) {
+    return (uint64_t)SHUNT_LOG_SYNC << 32 | crc;
+}
+
+// Walks the padded fields of one record, checking the framing and the check field
+class ShuntLogFieldReader {
+public:
+
+    uint64_t checksum;
+    bool ok;
+
+    ShuntLogFieldReader(const uint8_t* data, size_t length)
+        : checksum(0), ok(true), start(data), data(data), remaining(length) {}
+
+    int64_t readSigned(uint8_t size) {
+        int64_t value = 0;
+        const uint8_t* field = next(size);
+        if (field == NULL) return 0;
+        uint64_t raw = 0;
+        for (uint8_t i = 0; i < size; i++) raw |= (uint64_t)field[i] << (8 * i);
+        if (size < 8 && (raw >> (8 * size - 1)) & 1) raw |= ~(uint64_t)0 << (8 * size);
+        value = (int64_t)raw;
+        checksum += (uint64_t)value;
+        return value;
+    }
+
+    uint32_t readUnsigned32() {
+        const uint8_t* field = next(4);
+        if (field == NULL) return 0;
+        uint32_t value = field[0] | (field[1] << 8) | (field[2] << 16) | ((uint32_t)field[3] << 24);
+        checksum += value;
+        return value;
+    }
+
+    // The timestamp field may be 4 or 8 bytes of time_t, or 12 with the µs as well
+    int64_t readTimestamp(uint32_t* micros = NULL) {
+        if (micros != NULL) *micros = 0;
+        if (remaining < 6) {
+            ok = false;
+            return 0;
+        }
+        uint8_t size = data[4];
+        if (size == SHUNT_LOG_TIMESTAMP_MICROS) {
+            const uint8_t* field = next(size);
+            if (field == NULL) return 0;
+            uint64_t seconds = 0;
+            for (uint8_t i = 0; i < 8; i++) seconds |= (uint64_t)field[i] << (8 * i);
+            if (micros != NULL) {
+                *micros = field[8] | (field[9] << 8) | (field[10] << 16) | ((uint32_t)field[11] << 24);
+            }
+            return (int64_t)seconds;
+        }
+        if (size != 4 && size != 8) {
+            ok = false;
+            return 0;
+        }
+        return readSigned(size);
+    }
+
+    // Checks the trailing check field against the CRC of the record so far, or against the running
+    // sum for records written before there was a CRC
+    void verifyChecksum() {
+        uint32_t crc = shunt_crc32c(start, data - start);
+        uint64_t sum = checksum;
+        uint64_t stored = (uint64_t)readSigned(8);
+        if ((uint32_t)(stored >> 32) == SHUNT_LOG_SYNC ? (uint32_t)stored != crc : stored != sum) ok = false;
+    }
+
+    void expectBytes(const char* bytes, size_t count) {
+        if (remaining < count || memcmp(data, bytes, count) != 0) {
+            ok = false;
+            return;
+        }
+        data += count;
+        remaining -= count;
+    }
+
+private:
+
+    const uint8_t* start;
+    const uint8_t* data;
+    size_t remaining;
+
+    const uint8_t* next(uint8_t size) {
+        if (!ok || remaining < (size_t)SHUNT_LOG_FIELD_OVERHEAD + size) {
+            ok = false;
+            return NULL;
+        }
+        static const uint8_t zero[4] = {0, 0, 0, 0};
+        if (memcmp(data, zero, 4) != 0 || data[4] != size || data[5] != 0 || memcmp(data + 6 + size, zero, 4) != 0) {
+            ok = false;
+            return NULL;
+        }
+        const uint8_t* field = data + 6;
+        data += SHUNT_LOG_FIELD_OVERHEAD + size;
+        remaining -= SHUNT_LOG_FIELD_OVERHEAD + size;
+        return field;
+    }
+};
+
+// Timestamp width of a file, from the size of its first field; 0 if it doesn't look like a log
+inline uint8_t shunt_log_timestamp_size(const uint8_t* data, size_t length) {
+    if (length < 6 || data[0] || data[1] || data[2] || data[3] || data[5]) return 0;
+    return (data[4] == 4 || data[4] == 8 || data[4] == SHUNT_LOG_TIMESTAMP_MICROS) ? data[4] : 0;
+}
+
+// Rollups keep whole seconds: the width of theirs next to full-rate records of `fullSize`
+inline uint8_t shunt_log_rollup_timestamp_size(uint8_t fullSize) {
+    return fullSize == SHUNT_LOG_TIMESTAMP_MICROS ? 8 : fullSize;
+}
+
+// Reads only the leading timestamp of a record
+inline bool shunt_log_decode_timestamp(const uint8_t* data, size_t length, int64_t& timestamp) {
+    ShuntLogFieldReader reader(data, length);
+    timestamp = reader.readTimestamp();
+    return reader.ok;
+}
+
+inline bool shunt_log_decode_full(const uint8_t* data, size_t length, FullRecord& record) {
+    ShuntLogFieldReader reader(data, length);
+    record.timestamp = reader.readTimestamp(&record.micros);
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+        record.busRaw[ch] = reader.readUnsigned32();
+        record.shuntRaw[ch] = (int32_t)reader.readSigned(4);
+    }
+    reader.verifyChecksum();
+    reader.expectBytes("\r\n", 2);
+    return reader.ok;
+}
+
+inline bool shunt_log_decode_rollup(const uint8_t* data, size_t length, RollupRecord& record) {
+    ShuntLogFieldReader reader(data, length);
+    record.timestamp = reader.readTimestamp();
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+        record.busMin[ch] = reader.readSigned(8);
+        record.busMean[ch] = (int32_t)reader.readSigned(4);
+        record.busMax[ch] = reader.readSigned(8);
+        record.shuntMin[ch] = reader.readSigned(8);
+        record.shuntMean[ch] = (int32_t)reader.readSigned(4);
+        record.shuntMax[ch] = reader.readSigned(8);
+    }
+    reader.verifyChecksum();
+    return reader.ok;
+}
+
+// Builds records in the same layout the logger writes; used by tests and tools
+class ShuntLogFieldWriter {
+public:
+
+    uint8_t* data;
+    size_t length;
+    uint64_t checksum;  // The sum older firmware wrote in place of the CRC
+
+    explicit ShuntLogFieldWriter(uint8_t* data) : data(data), length(0), checksum(0) {}
+
+    void write(int64_t value, uint8_t size) {
+        memset(data + length, 0, SHUNT_LOG_FIELD_OVERHEAD + size);
+        data[length + 4] = size;
+        for (uint8_t i = 0; i < size; i++) data[length + 6 + i] = (uint8_t)((uint64_t)value >> (8 * i));
+        length += SHUNT_LOG_FIELD_OVERHEAD + size;
+    }
+
+    void add(int64_t value, uint8_t size) {
+        write(value, size);
+        checksum += (uint64_t)value;
+    }
+
+    // A timestamp field of `size` bytes; the µs only go in SHUNT_LOG_TIMESTAMP_MICROS
+    void addTimestamp(int64_t seconds, uint32_t micros, uint8_t size) {
+        if (size != SHUNT_LOG_TIMESTAMP_MICROS) {
+            add(seconds, size);
+            return;
+        }
+        memset(data + length, 0, SHUNT_LOG_FIELD_OVERHEAD + size);
+        data[length + 4] = size;
+        for (uint8_t i = 0; i < 8; i++) data[length + 6 + i] = (uint8_t)((uint64_t)seconds >> (8 * i));
+        for (uint8_t i = 0; i < 4; i++) data[length + 14 + i] = (uint8_t)(micros >> (8 * i));
+        length += SHUNT_LOG_FIELD_OVERHEAD + size;
+    }
+
+    void finish(bool newline) {
+        write((int64_t)shunt_log_check(shunt_crc32c(data, length)), 8);
+        if (newline) {
+            data[length++] = '\r';
+            data[length++] = '\n';
+        }
+    }
+};
+
+inline size_t shunt_log_encode_full(const FullRecord& record, uint8_t timestampSize, uint8_t* out) {
+    ShuntLogFieldWriter writer(out);
+    writer.addTimestamp(record.timestamp, record.micros, timestampSize);
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+        writer.add(record.busRaw[ch], 4);
+        writer.add(record.shuntRaw[ch], 4);
+    }
+    writer.finish(true);
+    return writer.length;
+}
+
+inline size_t shunt_log_encode_rollup(const RollupRecord& record, uint8_t timestampSize, uint8_t* out) {
+    ShuntLogFieldWriter writer(out);
+    writer.add(record.timestamp, timestampSize);
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+        writer.add(record.busMin[ch], 8);
+        writer.add(record.busMean[ch], 4);
+        writer.add(record.busMax[ch], 8);
+        writer.add(record.shuntMin[ch], 8);
+        writer.add(record.shuntMean[ch], 4);
+        writer.add(record.shuntMax[ch], 8);
+    }
+    writer.finish(false);
+    return writer.length;
+}
+
+struct ShuntLogTime {
+    int32_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+};
+
+// UTC calendar fields from Unix time, without going through the C library's timezone handling
+inline void shunt_log_civil(int64_t timestamp, ShuntLogTime& out) {
+    int64_t days = timestamp / 86400;
+    int64_t seconds = timestamp % 86400;
+    if (seconds < 0) {
+        seconds += 86400;
+        days--;
+    }
+    out.hour = (uint8_t)(seconds / 3600);
+    out.minute = (uint8_t)(seconds / 60 % 60);
+    out.second = (uint8_t)(seconds % 60);
+
+    // Howard Hinnant's civil_from_days
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    uint32_t dayOfEra = (uint32_t)(days - era * 146097);
+    uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    uint32_t monthIndex = (5 * dayOfYear + 2) / 153;
+    out.day = (uint8_t)(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    out.month = (uint8_t)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    out.year = (int32_t)(yearOfEra + era * 400 + (out.month <= 2 ? 1 : 0));
+}
+
+// Unix time from UTC calendar fields (days_from_civil)
+inline int64_t shunt_log_unix(int32_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t minute = 0, uint8_t second = 0) {
+    year -= month <= 2 ? 1 : 0;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    uint32_t yearOfEra = (uint32_t)(year - era * 400);
+    uint32_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    int64_t days = era * 146097 + dayOfEra - 719468;
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// Start of the file that holds records for `timestamp` at a level (SHUNT_FULL_FILE_SECONDS, day or
+// month)
+inline int64_t shunt_log_file_start(ShuntLogLevel level, int64_t timestamp) {
+    ShuntLogTime t;
+    shunt_log_civil(timestamp, t);
+    switch (level) {
+        case SHUNT_LOG_HOUR: return shunt_log_unix(t.year, t.month, 1);
+        case SHUNT_LOG_MINUTE: return shunt_log_unix(t.year, t.month, t.day);
+        default: return shunt_log_unix(t.year, t.month, t.day) +
+                        (t.hour * 3600 + t.minute * 60 + t.second) / SHUNT_FULL_FILE_SECONDS * SHUNT_FULL_FILE_SECONDS;
+    }
+}
+
+// Start of the file after the one starting at `fileStart`
+inline int64_t shunt_log_next_file_start(ShuntLogLevel level, int64_t fileStart) {
+    if (level == SHUNT_LOG_FULL) return fileStart + SHUNT_FULL_FILE_SECONDS;
+    if (level == SHUNT_LOG_MINUTE) return fileStart + 86400;
+    ShuntLogTime t;
+    shunt_log_civil(fileStart, t);
+    return t.month == 12 ? shunt_log_unix(t.year + 1, 1, 1) : shunt_log_unix(t.year, t.month + 1, 1);
+}
+
+// Where a /full file goes under /full (or /index/full), without an extension: "20230723T113425",
+// "2023/07/23/113425" or "2023/07/23/11/3425"
+inline size_t shunt_full_name(int64_t fileStart, uint8_t partition, char* out, size_t capacity) {
+    ShuntLogTime t;
+    shunt_log_civil(fileStart, t);
+    int length;
+    switch (partition) {
+        case SHUNT_PARTITION_NONE:
+            length = snprintf(out, capacity, "%04d%02u%02uT%02u%02u%02u", (int)t.year, t.month, t.day, t.hour,
+                              t.minute, t.second);
+            break;
+        case SHUNT_PARTITION_HOUR:
+            length = snprintf(out, capacity, "%04d/%02u/%02u/%02u/%02u%02u", (int)t.year, t.month, t.day, t.hour,
+                              t.minute, t.second);
+            break;
+        default:
+            length = snprintf(out, capacity, "%04d/%02u/%02u/%02u%02u%02u", (int)t.year, t.month, t.day, t.hour,
+                              t.minute, t.second);
+            break;
+    }
+    return length > 0 && (size_t)length < capacity ? (size_t)length : 0;
+}
+
+// Reads exactly `count` decimal digits
+inline bool shunt_log_digits(const char*& p, uint8_t count, uint32_t& value) {
+    value = 0;
+    for (uint8_t i = 0; i < count; i++, p++) {
+        if (*p < '0' || *p > '9') return false;
+        value = value * 10 + (uint32_t)(*p - '0');
+    }
+    return true;
+}
+
+// The start of a /full file from its path under /full in any of the layouts, e.g.
+// "20230723T113425.bin0" or "2023/07/23/113425.bin0"; false for anything else
+inline bool shunt_full_parse(const char* name, int64_t& fileStart) {
+    const char* p = name;
+    uint32_t year, month, day, hour, minute, second;
+    if (!shunt_log_digits(p, 4, year)) return false;
+    bool flat = *p != '/';
+    if (!flat) p++;
+    if (!shunt_log_digits(p, 2, month)) return false;
+    if (!flat && *p++ != '/') return false;
+    if (!shunt_log_digits(p, 2, day)) return false;
+    if (*p++ != (flat ? 'T' : '/')) return false;
+    if (!shunt_log_digits(p, 2, hour)) return false;
+    if (!flat && *p == '/') p++;
+    if (!shunt_log_digits(p, 2, minute) || !shunt_log_digits(p, 2, second)) return false;
+    if (strcmp(p, ".bin0") != 0) return false;
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 59) return false;
+    fileStart = shunt_log_unix((int32_t)year, (uint8_t)month, (uint8_t)day, (uint8_t)hour, (uint8_t)minute, (uint8_t)second);
+    return true;
+}
+
+// The start of a /daily ("20230723.bin0") or /hourly ("202307.bin0") file from its name
+inline bool shunt_rollup_parse(ShuntLogLevel level, const char* name, int64_t& fileStart) {
+    const char* p = name;
+    uint32_t year, month, day = 1;
+    if (!shunt_log_digits(p, 4, year) || !shunt_log_digits(p, 2, month)) return false;
+    if (level == SHUNT_LOG_MINUTE && !shunt_log_digits(p, 2, day)) return false;
+    if (strcmp(p, ".bin0") != 0 || month < 1 || month > 12 || day < 1 || day > 31) return false;
+    fileStart = shunt_log_unix((int32_t)year, (uint8_t)month, (uint8_t)day);
+    return true;
+}
+
+// "/full/2023/07/23/113425.bin0", "/daily/20230723.bin0" or "/hourly/202307.bin0"
+inline size_t shunt_log_path(ShuntLogLevel level, int64_t fileStart, char* out, size_t capacity) {
+    ShuntLogTime t;
+    shunt_log_civil(fileStart, t);
+    int length;
+    switch (level) {
+        case SHUNT_LOG_HOUR:
+            length = snprintf(out, capacity, "/hourly/%04d%02u.bin0", (int)t.year, t.month);
+            break;
+        case SHUNT_LOG_MINUTE:
+            length = snprintf(out, capacity, "/daily/%04d%02u%02u.bin0", (int)t.year, t.month, t.day);
+            break;
+        default: {
+            char name[24];
+            shunt_full_name(fileStart, SHUNT_FULL_PARTITION, name, sizeof(name));
+            length = snprintf(out, capacity, "/full/%s.bin0", name);
+            break;
+        }
+    }
+    return length > 0 ? (size_t)length : 0;
+}
+
+// Random access to log files, implemented over SD on the device and stdio on the host
+class ShuntLogStorage {
+public:
+    virtual ~ShuntLogStorage() {}
+    // Opens `path` for reading (closing any previous file); returns false if it doesn't exist
+    virtual bool open(const char* path) = 0;
+    virtual uint32_t size() = 0;
+    virtual size_t readAt(uint32_t offset, uint8_t* buffer, size_t length) = 0;
+    virtual void close() = 0;
+};
+
+// Changes to log files beside appending records: what retention needs to rewrite and delete them
+class ShuntLogFiles {
+public:
+    virtual ~ShuntLogFiles() {}
+    // Appends to `path`, creating it and its directories; false if not all of it was written
+    virtual bool append(const char* path, const uint8_t* data, size_t length) = 0;
+    virtual bool remove(const char* path) = 0;
+    // Puts `from` in place of `to`, which may exist
+    virtual bool replace(const char* from, const char* to) = 0;
+    // Removes `path` if it is an empty directory
+    virtual bool removeDir(const char* path) = 0;
+    // The entry of `dir` with the smallest name, skipping hidden ones; false if there are none
+    virtual bool first(const char* dir, char* name, size_t capacity, bool& isDir) = 0;
+    // Same with the largest name
+    virtual bool last(const char* dir, char* name, size_t capacity, bool& isDir) = 0;
+    // Cuts `path` down to `size` bytes
+    virtual bool truncate(const char* path, uint32_t size) = 0;
+    virtual uint64_t freeBytes() = 0;
+    // Puts anything append() is holding on the card, so it reads back
+    virtual void finish() {}
+};
+
+// Index of the first record in the open file with timestamp >= `timestamp` (binary search over
+// fixed-size records); `count` is the number of whole records in the file
+inline uint32_t shunt_log_lower_bound(ShuntLogStorage& storage, size_t recordSize, uint32_t count, int64_t timestamp) {
+    uint8_t header[SHUNT_LOG_FIELD_OVERHEAD + SHUNT_LOG_TIMESTAMP_MICROS];
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        int64_t recordTimestamp;
+        size_t read = storage.readAt(middle * recordSize, header, sizeof(header));
+        if (!shunt_log_decode_timestamp(header, read, recordTimestamp) || recordTimestamp < timestamp) {
+            // Unreadable records sort low, so a corrupt record never hides the ones after it
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Whether data[0, recordSize) is a whole, intact record of `level`
+inline bool shunt_log_record_valid(ShuntLogLevel level, const uint8_t* data, size_t recordSize) {
+    if (level == SHUNT_LOG_FULL) {
+        FullRecord full;
+        return shunt_log_decode_full(data, recordSize, full);
+    }
+    RollupRecord rollup;
+    return shunt_log_decode_rollup(data, recordSize, rollup);
+}
+
+// Offset of the sync marker in a record: the high half of the check field's value
+inline size_t shunt_log_sync_offset(ShuntLogLevel level, size_t recordSize) {
+    return recordSize - (level == SHUNT_LOG_FULL ? 2 : 0) - 4 - 4;
+}
+
+// Start of the first intact record in data[from, length), found by its sync marker; `length` if
+// none. Starts past length - recordSize haven't been looked at.
+inline size_t shunt_log_resync(ShuntLogLevel level, size_t recordSize, const uint8_t* data, size_t length, size_t from) {
+    static const uint8_t sync[4] = {SHUNT_LOG_SYNC & 0xFF, (SHUNT_LOG_SYNC >> 8) & 0xFF, (SHUNT_LOG_SYNC >> 16) & 0xFF,
+                                    SHUNT_LOG_SYNC >> 24};
+    size_t syncOffset = shunt_log_sync_offset(level, recordSize);
+    for (size_t start = from; start + recordSize <= length; start++) {
+        const uint8_t* marker = (const uint8_t*)memchr(data + start + syncOffset, sync[0], length - recordSize - start + 1);
+        if (marker == NULL) break;
+        start = marker - data - syncOffset;
+        if (memcmp(marker, sync, 4) == 0 && shunt_log_record_valid(level, data + start, recordSize)) return start;
+    }
+    return length;
+}
+
+// Reads the intact records of a log file in order. Records are where they should be unless bytes
+// went missing or got in, so each is looked for there first; past one that doesn't check out the
+// scanner looks for the next sync marker and carries on from the record it ends. Records written
+// before there was a marker are read as long as they stay in place.
+class ShuntLogScanner {
+public:
+
+    uint32_t recordSize;
+    uint32_t recovered;   // Times it lost its place and found a record further on
+    uint64_t skipped;     // Bytes that weren't part of an intact record
+
+    explicit ShuntLogScanner(ShuntLogStorage& storage)
+        : recordSize(0), recovered(0), skipped(0), storage(storage), level(SHUNT_LOG_FULL), fileSize(0), position(0),
+          bufferStart(0), bufferLength(0) {}
+
+    // The timestamp width is the one an intact record near the start has, or else what the first
+    // field says
+    bool open(const char* path, ShuntLogLevel logLevel) {
+        recovered = 0;
+        skipped = 0;
+        position = bufferStart = bufferLength = 0;
+        level = logLevel;
+        if (!storage.open(path)) return false;
+        fileSize = storage.size();
+        uint8_t first = shunt_log_timestamp_size(buffer, fill(0));
+        const uint8_t candidates[4] = {first, SHUNT_LOG_TIMESTAMP_MICROS, 8, 4};
+        uint8_t timestampSize = first ? first : 4;
+        for (uint8_t size : candidates) {
+            if (size == 0) continue;
+            recordSize = shunt_log_record_size(level, size);
+            if (shunt_log_resync(level, recordSize, buffer, bufferLength, 0) < bufferLength) {
+                timestampSize = size;
+                break;
+            }
+        }
+        recordSize = shunt_log_record_size(level, timestampSize);
+        return true;
+    }
+
+    void close() {
+        storage.close();
+        fileSize = 0;
+    }
+
+    // The next intact record and where it starts; NULL at the end
+    const uint8_t* next(uint32_t& offset) {
+        while (position + recordSize <= fileSize) {
+            const uint8_t* record = at(position);
+            if (record != NULL && shunt_log_record_valid(level, record, recordSize)) {
+                offset = position;
+                position += recordSize;
+                return record;
+            }
+            find(position + 1);
+        }
+        skipped += fileSize - position;
+        position = fileSize;
+        return NULL;
+    }
+
+private:
+
+    ShuntLogStorage& storage;
+    ShuntLogLevel level;
+    uint32_t fileSize;
+    uint32_t position;
+    uint32_t bufferStart;
+    size_t bufferLength;
+    uint8_t buffer[2 * SHUNT_LOG_MAX_RECORD_SIZE];
+
+    size_t fill(uint32_t offset) {
+        bufferStart = offset;
+        bufferLength = storage.readAt(offset, buffer, sizeof(buffer));
+        return bufferLength;
+    }
+
+    const uint8_t* at(uint32_t offset) {
+        if (offset < bufferStart || offset + recordSize > bufferStart + bufferLength) {
+            if (fill(offset) < recordSize) return NULL;
+        }
+        return buffer + (offset - bufferStart);
+    }
+
+    // Moves to the first intact record at or after `from`, or the end of the file
+    void find(uint32_t from) {
+        uint32_t lost = position;
+        uint32_t start = from;
+        while (start + recordSize <= fileSize) {
+            fill(start);
+            if (bufferLength < recordSize) break;
+            size_t found = shunt_log_resync(level, recordSize, buffer, bufferLength, 0);
+            if (found < bufferLength) {
+                position = bufferStart + (uint32_t)found;
+                skipped += position - lost;
+                recovered++;
+                return;
+            }
+            start += (uint32_t)(bufferLength - recordSize + 1);
+        }
+        skipped += fileSize - lost;
+        position = fileSize;
+    }
+};
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef SHUNTRECOVERY_h
+#define SHUNTRECOVERY_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ShuntLog.h"
+#include "ShuntIndex.h"
+#include "ShuntRetention.h"
+
+/*
+ * Recovery from a power cut, run once at boot before the logger opens anything.
+ *
+ * A record counts once its check field (CRC and sync marker, see ShuntLog.h) is on the card, so
+ * anything after the last intact record of a file is a write cut short. The newest /full, /daily and
+ * /hourly files are cut back to there; the rollup files are appended to again after a boot and
+ * would otherwise have every later record out of place. Files left with nothing in them go.
+ *
+ * Then what the logger only writes at a rollover is made from what it had written before:
+ *   - the minute rollups of the newest /full file's minutes after the last one in /daily
+ *   - the hour rollups of the minutes in /daily after the last one in /hourly
+ *   - the newest /full file's index sidecar and manifest entry, if it has none
+ * only for intervals that ended before the one the boot is in. The logger's own rollup covers
+ * that one: minuteCarry and hourCarry hold what was recorded of it before the power went, for the
+ * logger to start its stats from. Running it again finds nothing more to do.
+ */
+
+struct ShuntRecoveryStats {
+    uint32_t filesTruncated;
+    uint32_t bytesTruncated;
+    uint32_t filesRemoved;
+    uint32_t minutesRebuilt;
+    uint32_t hoursRebuilt;
+    uint32_t indexesRebuilt;
+    uint32_t errors;
+};
+
+class ShuntRecovery {
+public:
+
+    ShuntRecoveryStats stats;
+    ShuntRollupBuilder minuteCarry;  // The boot minute, from the full-rate records before the boot
+    ShuntRollupBuilder hourCarry;    // The boot hour, from the minute rollups before the boot minute
+
+    // `target` reads the rollup files while `source` has the full-rate one open
+    ShuntRecovery(ShuntLogStorage& source, ShuntLogStorage& target, ShuntLogFiles& files)
+        : stats(), files(files), sourceReader(source), targetReader(target), timestampSize(4) {}
+
+    void run(int64_t now) {
+        stats = ShuntRecoveryStats();
+        minuteCarry.reset();
+        hourCarry.reset();
+        char fullPath[48];
+        int64_t fullStart;
+        bool haveFull = newestFull(fullStart, fullPath, sizeof(fullPath));
+        char path[48];
+        int64_t fileStart;
+        if (newestRollup(SHUNT_LOG_MINUTE, fileStart, path, sizeof(path))) trim(SHUNT_LOG_MINUTE, path, "/daily");
+        if (newestRollup(SHUNT_LOG_HOUR, fileStart, path, sizeof(path))) trim(SHUNT_LOG_HOUR, path, "/hourly");
+
+        if (haveFull) rebuildMinutes(fullPath, now);
+        rebuildHours(now);
+        if (haveFull) rebuildIndex(fullStart, fullPath);
+        files.finish();
+    }
+
+    // End of the last intact record of the file open in `storage`, or its size if it can't tell
+    uint32_t intactEnd(ShuntLogStorage& storage, ShuntLogLevel level) {
+        uint32_t size = storage.size();
+        uint8_t header[SHUNT_LOG_FIELD_OVERHEAD];
+        uint8_t width = shunt_log_timestamp_size(header, storage.readAt(0, header, sizeof(header)));
+        if (size < shunt_log_record_size(level, 4)) return 0;
+        if (width == 0) return size;
+        uint32_t recordSize = (uint32_t)shunt_log_record_size(level, width);
+        uint32_t windowStart = size > sizeof(window) ? size - (uint32_t)sizeof(window) : 0;
+        size_t length = storage.readAt(windowStart, window, size - windowStart);
+        size_t last = length;
+        size_t found;
+        for (size_t from = 0; (found = shunt_log_resync(level, recordSize, window, length, from)) < length; from = found + 1) {
+            last = found;
+        }
+        if (last < length) return windowStart + (uint32_t)last + recordSize;
+        // Written before there was a marker: the last whole record, if it checks out
+        uint32_t whole = size - size % recordSize;
+        if (whole >= recordSize && storage.readAt(whole - recordSize, window, recordSize) == recordSize &&
+            shunt_log_record_valid(level, window, recordSize)) {
+            return whole;
+        }
+        return size;
+    }
+
+private:
+
+    ShuntLogFiles& files;
+    ShuntRecordReader sourceReader;
+    ShuntRecordReader targetReader;
+    ShuntRollupBuilder builder;
+    ShuntIndexBuilder index;
+    FullRecord full;
+    RollupRecord rollup;
+    uint8_t timestampSize;  // Of the records written here, as the logger writes them
+    uint8_t window[2 * SHUNT_LOG_MAX_RECORD_SIZE];
+
+    // The newest /full file, cut back to its last intact record; empty ones (opened just before the
+    // power went) are removed along the way
+    bool newestFull(int64_t& fileStart, char* path, size_t capacity) {
+        for (uint8_t attempt = 0; attempt < 4; attempt++) {
+            if (!shunt_full_find(files, true, fileStart, path, capacity)) return false;
+            if (trim(SHUNT_LOG_FULL, path, "/full")) return true;
+        }
+        return false;
+    }
+
+    bool newestRollup(ShuntLogLevel level, int64_t& fileStart, char* path, size_t capacity) {
+        const char* dir = level == SHUNT_LOG_MINUTE ? "/daily" : "/hourly";
+        char name[32];
+        bool isDir;
+        if (!files.last(dir, name, sizeof(name), isDir) || isDir || !shunt_rollup_parse(level, name, fileStart)) return false;
+        snprintf(path, capacity, "%s/%s", dir, name);
+        return true;
+    }
+
+    // Cuts a torn record off the end of `path`; false if nothing was left and the file was removed
+    bool trim(ShuntLogLevel level, const char* path, const char* top) {
+        ShuntLogStorage& storage = sourceReader.storage;
+        if (!storage.open(path)) return true;
+        uint32_t size = storage.size();
+        uint32_t end = intactEnd(storage, level);
+        storage.close();
+        if (end == 0) {
+            if (files.remove(path)) {
+                stats.filesRemoved++;
+                shunt_remove_empty_parents(files, path, top);
+            } else {
+                stats.errors++;
+            }
+            return false;
+        }
+        if (end < size) {
+            if (files.truncate(path, end)) {
+                stats.filesTruncated++;
+                stats.bytesTruncated += size - end;
+            } else {
+                stats.errors++;
+            }
+        }
+        return true;
+    }
+
+    // Where the rollups in the newest file of `level` stop: the end of the last interval it covers
+    bool coveredUntil(ShuntLogLevel level, int64_t& end) {
+        char path[48];
+        int64_t fileStart;
+        if (!newestRollup(level, fileStart, path, sizeof(path)) || !targetReader.open(path, level)) return false;
+        uint32_t seconds = shunt_log_level_seconds(level);
+        bool found = false;
+        for (uint32_t i = targetReader.count; i > 0 && !found; i--) {
+            targetReader.seek(i - 1);
+            const uint8_t* bytes = targetReader.next();
+            if (bytes != NULL && shunt_log_decode_rollup(bytes, targetReader.recordSize, rollup)) {
+                end = shunt_retention_floor(rollup.timestamp, seconds);
+                found = true;
+            }
+        }
+        targetReader.close();
+        return found;
+    }
+
+    void rebuildMinutes(const char* fullPath, int64_t now) {
+        int64_t covered = INT64_MIN;
+        coveredUntil(SHUNT_LOG_MINUTE, covered);
+        int64_t bootMinute = shunt_retention_floor(now, 60);
+        if (!sourceReader.open(fullPath, SHUNT_LOG_FULL)) return;
+        timestampSize = shunt_log_rollup_timestamp_size(sourceReader.timestampSize);
+        if (covered != INT64_MIN) {
+            sourceReader.seek(shunt_log_lower_bound(sourceReader.storage, sourceReader.recordSize, sourceReader.count, covered));
+        }
+        builder.reset();
+        int64_t current = 0;
+        const uint8_t* bytes;
+        while ((bytes = sourceReader.next()) != NULL) {
+            if (!shunt_log_decode_full(bytes, sourceReader.recordSize, full)) continue;
+            int64_t key = shunt_retention_floor(full.timestamp, 60);
+            if (key < covered) continue;
+            if (key >= bootMinute) {
+                // A clock set back by the boot puts nothing here
+                if (key == bootMinute) minuteCarry.add(full);
+                continue;
+            }
+            if (builder.count > 0 && key != current) emit(SHUNT_LOG_MINUTE, current);
+            current = key;
+            builder.add(full);
+        }
+        if (builder.count > 0) emit(SHUNT_LOG_MINUTE, current);
+        sourceReader.close();
+        files.finish();
+    }
+
+    // From the day files of the newest /daily file and the day before it: an hour cut short at
+    // midnight has its last minute in the next day's file
+    void rebuildHours(int64_t now) {
+        int64_t covered = INT64_MIN;
+        coveredUntil(SHUNT_LOG_HOUR, covered);
+        char path[48];
+        int64_t newestDay;
+        if (!newestRollup(SHUNT_LOG_MINUTE, newestDay, path, sizeof(path))) return;
+        int64_t bootMinute = shunt_retention_floor(now, 60);
+        int64_t bootHour = shunt_retention_floor(now, 3600);
+        builder.reset();
+        int64_t current = 0;
+        for (int64_t day = newestDay - 86400; day <= newestDay; day += 86400) {
+            if (covered != INT64_MIN && day + 86400 <= covered) continue;
+            shunt_log_path(SHUNT_LOG_MINUTE, day, path, sizeof(path));
+            if (!sourceReader.open(path, SHUNT_LOG_MINUTE)) continue;
+            timestampSize = sourceReader.timestampSize;
+            if (covered != INT64_MIN) {
+                sourceReader.seek(shunt_log_lower_bound(sourceReader.storage, sourceReader.recordSize, sourceReader.count, covered));
+            }
+            const uint8_t* bytes;
+            while ((bytes = sourceReader.next()) != NULL) {
+                if (!shunt_log_decode_rollup(bytes, sourceReader.recordSize, rollup)) continue;
+                int64_t minute = shunt_retention_floor(rollup.timestamp, 60) - 60;
+                int64_t key = shunt_retention_floor(minute, 3600);
+                if (key < covered) continue;
+                if (key >= bootHour) {
+                    if (key == bootHour && minute < bootMinute) hourCarry.add(rollup);
+                    continue;
+                }
+                if (builder.count > 0 && key != current) emit(SHUNT_LOG_HOUR, current);
+                current = key;
+                builder.add(rollup);
+            }
+            sourceReader.close();
+        }
+        if (builder.count > 0) emit(SHUNT_LOG_HOUR, current);
+    }
+
+    // Appends the rollup of the interval starting at `key` to the file it belongs in
+    void emit(ShuntLogLevel level, int64_t key) {
+        uint32_t seconds = shunt_log_level_seconds(level);
+        RollupRecord computed;
+        builder.finish(key + seconds, computed);
+        builder.reset();
+        char path[48];
+        shunt_log_path(level, shunt_log_file_start(level, key + seconds), path, sizeof(path));
+        uint8_t encoded[SHUNT_LOG_MAX_RECORD_SIZE];
+        if (!files.append(path, encoded, shunt_log_encode_rollup(computed, timestampSize, encoded))) {
+            stats.errors++;
+        } else if (level == SHUNT_LOG_MINUTE) {
+            stats.minutesRebuilt++;
+        } else {
+            stats.hoursRebuilt++;
+        }
+    }
+
+    // The sidecar and manifest entry writeFullIndex() would have written at rotation
+    void rebuildIndex(int64_t fileStart, const char* fullPath) {
+        char indexPath[48];
+        shunt_index_path(fileStart, indexPath, sizeof(indexPath));
+        if (targetReader.storage.open(indexPath)) {
+            targetReader.storage.close();
+            return;
+        }
+        if (!sourceReader.open(fullPath, SHUNT_LOG_FULL)) return;
+        index.begin(fileStart);
+        int64_t timestamp = fileStart;
+        const uint8_t* bytes;
+        while ((bytes = sourceReader.next()) != NULL) {
+            // A damaged record keeps its place with the time of the one before
+            int64_t decoded;
+            if (shunt_log_decode_timestamp(bytes, sourceReader.recordSize, decoded)) timestamp = decoded;
+            index.add(timestamp, sourceReader.recordSize);
+        }
+        sourceReader.close();
+        if (index.manifest.records == 0) return;
+        uint8_t buffer[SHUNT_INDEX_MAX_ENTRIES * SHUNT_INDEX_ENTRY_SIZE];
+        bool ok = files.append(indexPath, buffer, index.encodeIndex(buffer));
+        shunt_manifest_encode(index.manifest, buffer);
+        ok = files.append(SHUNT_MANIFEST_PATH, buffer, SHUNT_MANIFEST_ENTRY_SIZE) && ok;
+        if (ok) {
+            stats.indexesRebuilt++;
+        } else {
+            stats.errors++;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,520 @@
+#ifndef SHUNTRETENTION_h
+#define SHUNTRETENTION_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ShuntLog.h"
+#include "ShuntIndex.h"
+
+/*
+ * Retention of the logs: full-rate files are kept for `fullDays` days, minute rollups (/daily) for
+ * `minuteMonths` months and hour rollups (/hourly) for good.
+ *
+ * Before a file is deleted, the next level's file is checked for a rollup of every interval the
+ * file has records in. The logger writes those as it goes, but misses some (the minute cut short
+ * by a reboot, an append that failed); they are computed from the file and merged into the rollup
+ * file in time order, by writing it out again next to it and swapping it in. Retiring data only
+ * ever lowers its resolution.
+ *
+ * When free space is under `freeFloor`, the oldest files go early: full-rate ones first, then
+ * minute rollups. The files being written are never touched, nor are hour rollups.
+ *
+ * step() retires one file at a time, reading and writing through the storage and ShuntLogFiles
+ * it was given, so the device can pace the I/O around its own writes.
+ */
+
+// Bytes read or written per call: 3 rollup records, 9 full ones
+#define SHUNT_RETENTION_BUFFER 1600
+
+struct ShuntRetentionPolicy {
+    uint16_t fullDays;      // At least 1
+    uint16_t minuteMonths;  // At least 1
+    uint64_t freeFloor;     // Bytes
+};
+
+struct ShuntRetentionStats {
+    uint32_t fullRetired;
+    uint32_t minuteRetired;
+    uint32_t rollupsAdded;    // Computed from a retired file because its rollup file lacked them
+    uint32_t filesRewritten;
+    uint32_t errors;
+};
+
+inline int64_t shunt_retention_floor(int64_t value, int64_t step) {
+    return (value >= 0 ? value : value - step + 1) / step * step;
+}
+
+// Partition directories emptied by a removal, up to `top`
+inline void shunt_remove_empty_parents(ShuntLogFiles& files, const char* path, const char* top) {
+    char dir[48];
+    snprintf(dir, sizeof(dir), "%s", path);
+    size_t topLength = strlen(top);
+    char* slash;
+    while ((slash = strrchr(dir, '/')) != NULL && (size_t)(slash - dir) > topLength) {
+        *slash = 0;
+        if (!files.removeDir(dir)) return;
+    }
+}
+
+// The oldest (or newest) /full file: names sort by time in every layout, so it is down the first
+// (or last) entries
+inline bool shunt_full_find(ShuntLogFiles& files, bool newest, int64_t& fileStart, char* path, size_t capacity) {
+    char dir[48] = "/full";
+    for (uint8_t depth = 0; depth < 8; depth++) {
+        char name[32];
+        bool isDir;
+        if (!(newest ? files.last(dir, name, sizeof(name), isDir) : files.first(dir, name, sizeof(name), isDir))) {
+            // A partition left empty by a removal cut short
+            if (strcmp(dir, "/full") == 0 || !files.removeDir(dir)) return false;
+            strcpy(dir, "/full");
+            continue;
+        }
+        size_t length = strlen(dir);
+        if (snprintf(dir + length, sizeof(dir) - length, "/%s", name) >= (int)(sizeof(dir) - length)) return false;
+        if (!isDir) {
+            snprintf(path, capacity, "%s", dir);
+            return shunt_full_parse(dir + 6, fileStart);
+        }
+    }
+    return false;
+}
+
+// Reads the whole records of one log file in order, a buffer at a time
+class ShuntRecordReader {
+public:
+
+    uint32_t recordSize;
+    uint32_t count;
+    uint8_t timestampSize;
+
+    explicit ShuntRecordReader(ShuntLogStorage& storage)
+        : recordSize(0), count(0), timestampSize(0), storage(storage), index(0), bufferIndex(0), bufferCount(0) {}
+
+    bool open(const char* path, ShuntLogLevel level) {
+        count = index = bufferIndex = bufferCount = 0;
+        if (!storage.open(path)) return false;
+        uint8_t header[SHUNT_LOG_FIELD_OVERHEAD];
+        timestampSize = shunt_log_timestamp_size(header, storage.readAt(0, header, sizeof(header)));
+        if (timestampSize == 0) {
+            storage.close();
+            return false;
+        }
+        recordSize = shunt_log_record_size(level, timestampSize);
+        count = storage.size() / recordSize;
+        return true;
+    }
+
+    void close() {
+        storage.close();
+        count = 0;
+    }
+
+    // Index of the record next() returns next
+    uint32_t position() const {
+        return index;
+    }
+
+    void seek(uint32_t record) {
+        index = record;
+    }
+
+    // The next record's bytes, valid until the next call; NULL after the last
+    const uint8_t* next() {
+        if (index >= count) return NULL;
+        if (index < bufferIndex || index >= bufferIndex + bufferCount) {
+            uint32_t records = SHUNT_RETENTION_BUFFER / recordSize;
+            if (records > count - index) records = count - index;
+            bufferIndex = index;
+            bufferCount = (uint32_t)(storage.readAt(index * recordSize, buffer, records * recordSize) / recordSize);
+            if (bufferCount == 0) {
+                // Shorter than it said
+                count = index;
+                return NULL;
+            }
+        }
+        return buffer + (index++ - bufferIndex) * recordSize;
+    }
+
+    ShuntLogStorage& storage;
+
+private:
+
+    uint32_t index;
+    uint32_t bufferIndex;
+    uint32_t bufferCount;
+    uint8_t buffer[SHUNT_RETENTION_BUFFER];
+};
+
+// The rollup of one interval, made the way the logger's SimpleStats make them: min, max and the
+// truncated mean of the samples, or of the means of finer rollups. Missing samples, and rollups
+// with nothing in them, are left out of their channel; a channel left with nothing keeps the empty
+// min > max.
+class ShuntRollupBuilder {
+public:
+
+    uint32_t count;  // records added
+
+    ShuntRollupBuilder() {
+        reset();
+    }
+
+    void reset() {
+        count = 0;
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            bus[ch] = Stat();
+            shunt[ch] = Stat();
+        }
+    }
+
+    void add(const FullRecord& record) {
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            if (shunt_log_missing(record, ch)) continue;
+            bus[ch].add(record.busRaw[ch], record.busRaw[ch], record.busRaw[ch]);
+            shunt[ch].add(record.shuntRaw[ch], record.shuntRaw[ch], record.shuntRaw[ch]);
+        }
+        count++;
+    }
+
+    void add(const RollupRecord& record) {
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            if (shunt_log_missing(record, ch)) continue;
+            bus[ch].add(record.busMin[ch], record.busMean[ch], record.busMax[ch]);
+            shunt[ch].add(record.shuntMin[ch], record.shuntMean[ch], record.shuntMax[ch]);
+        }
+        count++;
+    }
+
+    void finish(int64_t timestamp, RollupRecord& out) const {
+        out.timestamp = timestamp;
+        for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+            out.busMin[ch] = bus[ch].min;
+            out.busMean[ch] = bus[ch].mean();
+            out.busMax[ch] = bus[ch].max;
+            out.shuntMin[ch] = shunt[ch].min;
+            out.shuntMean[ch] = shunt[ch].mean();
+            out.shuntMax[ch] = shunt[ch].max;
+        }
+    }
+
+    // What went in for one channel: how many samples (or rollups), their sum (or the sum of the
+    // rollups' means) and the extremes
+    void totals(uint8_t ch, bool shuntChannel, uint32_t& added, int64_t& sum, int64_t& min, int64_t& max) const {
+        const Stat& stat = shuntChannel ? shunt[ch] : bus[ch];
+        added = stat.count;
+        sum = stat.sum;
+        min = stat.min;
+        max = stat.max;
+    }
+
+private:
+
+    struct Stat {
+        int64_t sum;
+        int64_t min;
+        int64_t max;
+        uint32_t count;
+
+        Stat() : sum(0), min(INT32_MAX), max(INT32_MIN), count(0) {}
+
+        void add(int64_t low, int64_t mean, int64_t high) {
+            sum += mean;
+            if (low < min) min = low;
+            if (high > max) max = high;
+            count++;
+        }
+
+        int32_t mean() const {
+            return count ? (int32_t)(sum / count) : 0;
+        }
+    };
+
+    Stat bus[SHUNT_LOG_CHANNELS];
+    Stat shunt[SHUNT_LOG_CHANNELS];
+};
+
+class ShuntRetention {
+public:
+
+    ShuntRetentionPolicy policy;
+    ShuntRetentionStats stats;
+
+    // `source` and `target` are two readers of the same card: a retired file and its rollup file
+    // are open at once
+    ShuntRetention(ShuntLogStorage& source, ShuntLogStorage& target, ShuntLogFiles& files, const ShuntRetentionPolicy& policy)
+        : policy(policy), stats(), files(files), sourceReader(source), targetReader(target), outLength(0), outFailed(false) {
+        if (this->policy.fullDays < 1) this->policy.fullDays = 1;
+        if (this->policy.minuteMonths < 1) this->policy.minuteMonths = 1;
+    }
+
+    // Retires the oldest file if it is past its time or space is short. Returns false when there is
+    // nothing (more) to do now. `liveFullStart` is the start of the /full file being written.
+    bool step(int64_t now, int64_t liveFullStart) {
+        bool low = files.freeBytes() < policy.freeFloor;
+        char path[48];
+        int64_t fileStart;
+        if (oldestFull(fileStart, path, sizeof(path)) && fileStart < liveFullStart &&
+            (low || fileStart + SHUNT_FULL_FILE_SECONDS <= fullCutoff(now))) {
+            return retire(SHUNT_LOG_FULL, fileStart, path, now, low);
+        }
+        if (oldestMinute(fileStart, path, sizeof(path)) && fileStart < shunt_log_file_start(SHUNT_LOG_MINUTE, now) &&
+            (low || fileStart + 86400 <= minuteCutoff(now))) {
+            return retire(SHUNT_LOG_MINUTE, fileStart, path, now, low);
+        }
+        return false;
+    }
+
+    // Full-rate files wholly before this go
+    int64_t fullCutoff(int64_t now) const {
+        return shunt_log_file_start(SHUNT_LOG_MINUTE, now) - (int64_t)policy.fullDays * 86400;
+    }
+
+    // Minute rollup files wholly before this go
+    int64_t minuteCutoff(int64_t now) const {
+        ShuntLogTime t;
+        shunt_log_civil(now, t);
+        int32_t months = t.year * 12 + (t.month - 1) - policy.minuteMonths;
+        return shunt_log_unix(months / 12, (uint8_t)(months % 12 + 1), 1);
+    }
+
+    // Adds to the `targetLevel` files the rollups of the intervals `sourcePath` has records in and
+    // they lack, leaving alone those starting at or after `liveTargetStart`. False if a rollup file
+    // couldn't be written.
+    bool compact(ShuntLogLevel sourceLevel, const char* sourcePath, ShuntLogLevel targetLevel, int64_t liveTargetStart) {
+        if (!sourceReader.open(sourcePath, sourceLevel)) return true;
+        uint32_t interval = shunt_log_level_seconds(targetLevel);
+        bool ok = true;
+        uint32_t groupStart = sourceReader.position();
+        int64_t key;
+        while (ok && nextSource(sourceLevel, interval, key)) {
+            int64_t targetStart = shunt_log_file_start(targetLevel, key + interval);
+            // Records are in time order: the rest is for the live file or later
+            if (targetStart >= liveTargetStart) break;
+            char targetPath[48];
+            shunt_log_path(targetLevel, targetStart, targetPath, sizeof(targetPath));
+            sourceReader.seek(groupStart);
+            uint32_t groupEnd;
+            if (lacksRollups(sourceLevel, targetLevel, targetPath, targetStart, interval, groupEnd)) {
+                sourceReader.seek(groupStart);
+                ok = rewrite(sourceLevel, targetLevel, targetPath, groupEnd, interval, key);
+            }
+            sourceReader.seek(groupStart = groupEnd);
+        }
+        sourceReader.close();
+        targetReader.close();
+        return ok;
+    }
+
+private:
+
+    ShuntLogFiles& files;
+    ShuntRecordReader sourceReader;
+    ShuntRecordReader targetReader;
+    FullRecord full;          // The last source record read
+    RollupRecord rollup;
+    RollupRecord targetRollup;
+    ShuntRollupBuilder builder;
+    uint8_t out[SHUNT_RETENTION_BUFFER];
+    size_t outLength;
+    bool outFailed;
+    char outPath[56];
+
+    bool retire(ShuntLogLevel level, int64_t fileStart, const char* path, int64_t now, bool low) {
+        ShuntLogLevel target = level == SHUNT_LOG_FULL ? SHUNT_LOG_MINUTE : SHUNT_LOG_HOUR;
+        if (!compact(level, path, target, shunt_log_file_start(target, now))) {
+            stats.errors++;
+            // Short of space the file goes anyway; otherwise it stays until the rollups can be written
+            if (!low) return false;
+        }
+        files.remove(path);
+        removeEmptyParents(path, level == SHUNT_LOG_FULL ? "/full" : "/daily");
+        if (level == SHUNT_LOG_FULL) {
+            char indexPath[48];
+            shunt_index_path(fileStart, indexPath, sizeof(indexPath));
+            files.remove(indexPath);
+            removeEmptyParents(indexPath, "/index/full");
+            stats.fullRetired++;
+        } else {
+            stats.minuteRetired++;
+        }
+        return true;
+    }
+
+    void removeEmptyParents(const char* path, const char* top) {
+        shunt_remove_empty_parents(files, path, top);
+    }
+
+    bool oldestFull(int64_t& fileStart, char* path, size_t capacity) {
+        return shunt_full_find(files, false, fileStart, path, capacity);
+    }
+
+    // The oldest /daily file, "/daily/YYYYMMDD.bin0"
+    bool oldestMinute(int64_t& fileStart, char* path, size_t capacity) {
+        char name[32];
+        bool isDir;
+        if (!files.first("/daily", name, sizeof(name), isDir) || isDir) return false;
+        if (!shunt_rollup_parse(SHUNT_LOG_MINUTE, name, fileStart)) return false;
+        snprintf(path, capacity, "/daily/%s", name);
+        return true;
+    }
+
+    // Decodes the next valid source record and finds the start of the target interval it's in
+    bool nextSource(ShuntLogLevel level, uint32_t interval, int64_t& key) {
+        const uint8_t* bytes;
+        while ((bytes = sourceReader.next()) != NULL) {
+            int64_t start;
+            if (level == SHUNT_LOG_FULL) {
+                if (!shunt_log_decode_full(bytes, sourceReader.recordSize, full)) continue;
+                start = full.timestamp;
+            } else {
+                if (!shunt_log_decode_rollup(bytes, sourceReader.recordSize, rollup)) continue;
+                // Written at the end of its interval
+                uint32_t seconds = shunt_log_level_seconds(level);
+                start = shunt_retention_floor(rollup.timestamp, seconds) - seconds;
+            }
+            key = shunt_retention_floor(start, interval);
+            return true;
+        }
+        return false;
+    }
+
+    // Interval a rollup record was written for: the one that ended just before it
+    static int64_t targetKey(const RollupRecord& record, uint32_t interval) {
+        return shunt_retention_floor(record.timestamp, interval) - interval;
+    }
+
+    // Next valid record of the target file and its interval; false at the end
+    bool nextTarget(uint32_t interval, const uint8_t*& bytes, int64_t& key) {
+        while ((bytes = targetReader.next()) != NULL) {
+            if (!shunt_log_decode_rollup(bytes, targetReader.recordSize, targetRollup)) continue;
+            key = targetKey(targetRollup, interval);
+            return true;
+        }
+        return false;
+    }
+
+    // Reads the source records that go in `targetPath` (leaving `groupEnd` after them) and says
+    // whether the file lacks any of their intervals
+    bool lacksRollups(ShuntLogLevel sourceLevel, ShuntLogLevel targetLevel, const char* targetPath, int64_t targetStart,
+                      uint32_t interval, uint32_t& groupEnd) {
+        bool exists = targetReader.open(targetPath, targetLevel);
+        bool lacks = !exists;
+        bool targetDone = false;
+        int64_t targetKeyNow = 0;
+        int64_t checked = 0;
+        bool first = true;
+        int64_t key;
+        groupEnd = sourceReader.position();
+        while (nextSource(sourceLevel, interval, key)) {
+            if (shunt_log_file_start(targetLevel, key + interval) != targetStart) break;
+            groupEnd = sourceReader.position();
+            if (lacks || (!first && key == checked)) continue;
+            if (first) {
+                // Straight to the first interval; the file's records are in time order too
+                targetReader.seek(shunt_log_lower_bound(targetReader.storage, targetReader.recordSize, targetReader.count,
+                                                        key + interval));
+                targetDone = !nextTargetKey(interval, targetKeyNow);
+                first = false;
+            }
+            while (!targetDone && targetKeyNow < key) targetDone = !nextTargetKey(interval, targetKeyNow);
+            if (targetDone || targetKeyNow != key) lacks = true;
+            checked = key;
+        }
+        return lacks;
+    }
+
+    bool nextTargetKey(uint32_t interval, int64_t& key) {
+        const uint8_t* bytes;
+        return nextTarget(interval, bytes, key);
+    }
+
+    // Writes the target file again next to it with the missing rollups of the source records
+    // before `groupEnd` merged in, then swaps it in
+    bool rewrite(ShuntLogLevel sourceLevel, ShuntLogLevel targetLevel, const char* targetPath, uint32_t groupEnd,
+                 uint32_t interval, int64_t firstKey) {
+        snprintf(outPath, sizeof(outPath), "%s.tmp", targetPath);
+        files.remove(outPath);
+        outLength = 0;
+        outFailed = false;
+        bool exists = targetReader.open(targetPath, targetLevel);
+        uint8_t timestampSize = exists ? targetReader.timestampSize
+                                       : shunt_log_rollup_timestamp_size(sourceReader.timestampSize);
+        uint32_t recordSize = shunt_log_record_size(targetLevel, timestampSize);
+
+        // Everything before the first interval as it is
+        uint32_t mergeFrom = exists ? shunt_log_lower_bound(targetReader.storage, targetReader.recordSize,
+                                                            targetReader.count, firstKey + interval) : 0;
+        const uint8_t* bytes;
+        while (targetReader.position() < mergeFrom && (bytes = targetReader.next()) != NULL) {
+            write(bytes, recordSize);
+        }
+
+        const uint8_t* pending = NULL;
+        int64_t pendingKey = 0;
+        if (exists) nextTarget(interval, pending, pendingKey);
+        builder.reset();
+        int64_t current = 0;
+        int64_t key;
+        while (nextSource(sourceLevel, interval, key) && sourceReader.position() <= groupEnd) {
+            if (builder.count > 0 && key != current) {
+                emit(current, interval, timestampSize, recordSize, pending, pendingKey);
+                builder.reset();
+            }
+            current = key;
+            if (sourceLevel == SHUNT_LOG_FULL) {
+                builder.add(full);
+            } else {
+                builder.add(rollup);
+            }
+        }
+        if (builder.count > 0) emit(current, interval, timestampSize, recordSize, pending, pendingKey);
+
+        // And everything after
+        while (pending != NULL) {
+            write(pending, recordSize);
+            nextTarget(interval, pending, pendingKey);
+        }
+        flush();
+        targetReader.close();
+        if (outFailed || !files.replace(outPath, targetPath)) {
+            files.remove(outPath);
+            return false;
+        }
+        stats.filesRewritten++;
+        return true;
+    }
+
+    // Writes the rollup of `key`, the file's own if it has one, after the file's earlier records
+    void emit(int64_t key, uint32_t interval, uint8_t timestampSize, uint32_t recordSize, const uint8_t*& pending,
+              int64_t& pendingKey) {
+        while (pending != NULL && pendingKey < key) {
+            write(pending, recordSize);
+            nextTarget(interval, pending, pendingKey);
+        }
+        if (pending != NULL && pendingKey == key) {
+            write(pending, recordSize);
+            nextTarget(interval, pending, pendingKey);
+            return;
+        }
+        RollupRecord computed;
+        builder.finish(key + interval, computed);
+        uint8_t encoded[SHUNT_LOG_MAX_RECORD_SIZE];
+        write(encoded, shunt_log_encode_rollup(computed, timestampSize, encoded));
+        stats.rollupsAdded++;
+    }
+
+    void write(const uint8_t* data, size_t length) {
+        if (outLength + length > sizeof(out)) flush();
+        memcpy(out + outLength, data, length);
+        outLength += length;
+    }
+
+    void flush() {
+        if (outLength > 0 && !outFailed && !files.append(outPath, out, outLength)) outFailed = true;
+        outLength = 0;
+    }
+};
+
+#endif
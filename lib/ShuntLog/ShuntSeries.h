@@ -0,0 +1,258 @@
+#ifndef SHUNTSERIES_h
+#define SHUNTSERIES_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ShuntLog.h"
+#include "ShuntCursor.h"
+
+/*
+ * Time-range queries over the on-card logs for one channel.
+ *
+ * Output is a series of buckets `resolution` seconds wide, aligned to `from`, each with the
+ * min/mean/max of the raw bus and shunt registers (1.25 mV and 2.5 uV per LSB). Buckets with no
+ * data are left out. As JSON:
+ *   {"channel":0,"level":"minute","resolution":300,"from":..,"to":..,
+ *    "points":[[ts,busMin,busMean,busMax,shuntMin,shuntMean,shuntMax],...]}
+ * As binary, just the points, SERIES_POINT_SIZE bytes each, little-endian:
+ *   i64 ts, i32 busMin, i32 busMean, i32 busMax, i32 shuntMin, i32 shuntMean, i32 shuntMax
+ *
+ * Rollup means are averaged per record, which is exact as long as each minute/hour is complete.
+ */
+
+#define SERIES_POINT_SIZE 32
+
+// Points returned when the caller doesn't pick a resolution
+#ifndef SERIES_DEFAULT_POINTS
+#define SERIES_DEFAULT_POINTS 500
+#endif
+
+// Upper bound on log bytes one query may read; a finer level that would need more falls back to
+// the next coarser one, so a week never scans 10k minute records
+#ifndef SERIES_MAX_SCAN_BYTES
+#define SERIES_MAX_SCAN_BYTES (1024UL * 1024UL)
+#endif
+
+struct SeriesQuery {
+    uint8_t channel;
+    int64_t from;
+    int64_t to;
+    uint32_t resolution;  // 0 picks one that gives about SERIES_DEFAULT_POINTS points
+    bool binary;
+};
+
+struct SeriesPoint {
+    int64_t timestamp;
+    int32_t busMin;
+    int32_t busMean;
+    int32_t busMax;
+    int32_t shuntMin;
+    int32_t shuntMean;
+    int32_t shuntMax;
+};
+
+inline size_t series_encode_point(const SeriesPoint& point, uint8_t* out) {
+    for (uint8_t i = 0; i < 8; i++) out[i] = (uint8_t)((uint64_t)point.timestamp >> (8 * i));
+    const int32_t values[6] = {point.busMin, point.busMean, point.busMax, point.shuntMin, point.shuntMean, point.shuntMax};
+    for (uint8_t v = 0; v < 6; v++) {
+        for (uint8_t i = 0; i < 4; i++) out[8 + 4 * v + i] = (uint8_t)((uint32_t)values[v] >> (8 * i));
+    }
+    return SERIES_POINT_SIZE;
+}
+
+// Fills in a default resolution and picks the coarsest level that still resolves it, moving to a
+// coarser level (and resolution) if the finer one would read more than SERIES_MAX_SCAN_BYTES
+inline ShuntLogLevel series_plan(SeriesQuery& query) {
+    uint64_t span = (uint64_t)(query.to - query.from);
+    if (query.resolution == 0) {
+        query.resolution = (uint32_t)((span + SERIES_DEFAULT_POINTS - 1) / SERIES_DEFAULT_POINTS);
+        if (query.resolution == 0) query.resolution = 1;
+    }
+    ShuntLogLevel level = SHUNT_LOG_FULL;
+    if (query.resolution >= shunt_log_level_seconds(SHUNT_LOG_MINUTE)) level = SHUNT_LOG_MINUTE;
+    if (query.resolution >= shunt_log_level_seconds(SHUNT_LOG_HOUR)) level = SHUNT_LOG_HOUR;
+    while (level != SHUNT_LOG_HOUR
+           && span / shunt_log_level_seconds(level) * shunt_log_record_size(level, 8) > SERIES_MAX_SCAN_BYTES) {
+        level = (ShuntLogLevel)(level + 1);
+    }
+    if (query.resolution < shunt_log_level_seconds(level)) query.resolution = shunt_log_level_seconds(level);
+    return level;
+}
+
+// Min/mean/max accumulator for one output bucket
+struct SeriesBucket {
+    int64_t start;
+    uint32_t count;
+    int64_t busMin, busSum, busMax;
+    int64_t shuntMin, shuntSum, shuntMax;
+
+    void reset(int64_t bucketStart) {
+        start = bucketStart;
+        count = 0;
+        busMin = shuntMin = INT64_MAX;
+        busMax = shuntMax = INT64_MIN;
+        busSum = shuntSum = 0;
+    }
+
+    void add(int64_t bMin, int64_t bMean, int64_t bMax, int64_t sMin, int64_t sMean, int64_t sMax) {
+        if (bMin < busMin) busMin = bMin;
+        if (bMax > busMax) busMax = bMax;
+        if (sMin < shuntMin) shuntMin = sMin;
+        if (sMax > shuntMax) shuntMax = sMax;
+        busSum += bMean;
+        shuntSum += sMean;
+        count++;
+    }
+
+    SeriesPoint point() const {
+        SeriesPoint p;
+        p.timestamp = start;
+        p.busMin = (int32_t)busMin;
+        p.busMean = (int32_t)(busSum / count);
+        p.busMax = (int32_t)busMax;
+        p.shuntMin = (int32_t)shuntMin;
+        p.shuntMean = (int32_t)(shuntSum / count);
+        p.shuntMax = (int32_t)shuntMax;
+        return p;
+    }
+};
+
+// Bytes of a pending piece of output still to hand over, `offset` of `length` having gone already.
+// Clamped to `size`, the buffer holding it, so a length that overran it can't read past the end.
+inline size_t series_pending_left(size_t length, size_t offset, size_t size) {
+    if (length > size) length = size;
+    return offset < length ? length - offset : 0;
+}
+
+// Streams one query as a sequence of chunks. Holds one record (in the cursor) and one formatted
+// point, so RAM use does not depend on the range.
+class ShuntSeriesReader {
+public:
+
+    SeriesQuery query;
+    ShuntLogLevel level;
+    ShuntLogCursor cursor;
+    uint32_t points;
+
+    // `liveFileStart` is the full-rate file being written, as for ShuntLogCursor
+    ShuntSeriesReader(ShuntLogStorage& storage, const SeriesQuery& request, int64_t liveFileStart = 0)
+        : query(request), level(series_plan(query)), cursor(storage, level, query.from, query.to, liveFileStart),
+          points(0), stage(HEADER), pendingLength(0), pendingOffset(0) {
+        bucket.reset(query.from);
+    }
+
+    bool finished() const {
+        return stage == DONE && pendingOffset == pendingLength;
+    }
+
+    // Writes as much output as fits; a point is never split across calls. Returns 0 once finished.
+    size_t fill(uint8_t* out, size_t capacity) {
+        size_t written = 0;
+        while (true) {
+            size_t length = series_pending_left(pendingLength, pendingOffset, sizeof(pending));
+            if (length > 0) {
+                if (length > capacity - written) {
+                    if (written > 0 || pendingOffset > 0) return written;
+                    // Smaller than one point: hand it over in pieces
+                    length = capacity - written;
+                }
+                memcpy(out + written, pending + pendingOffset, length);
+                written += length;
+                pendingOffset += length;
+                if (pendingOffset < pendingLength) return written;
+            }
+            pendingOffset = pendingLength = 0;
+            if (stage == DONE) {
+                cursor.close();
+                return written;
+            }
+            produce();
+        }
+    }
+
+private:
+
+    enum Stage { HEADER, POINTS, FOOTER, DONE };
+
+    Stage stage;
+    SeriesBucket bucket;
+    char pending[160];
+    size_t pendingLength;
+    size_t pendingOffset;
+
+    // Puts the next piece of output in `pending`
+    void produce() {
+        if (stage == HEADER) {
+            stage = POINTS;
+            if (query.binary) return;
+            int length = snprintf(pending, sizeof(pending),
+                                  "{\"channel\":%u,\"level\":\"%s\",\"resolution\":%lu,\"from\":%lld,\"to\":%lld,\"points\":[",
+                                  query.channel, shunt_log_level_name(level), (unsigned long)query.resolution,
+                                  (long long)query.from, (long long)query.to);
+            pendingLength = length > 0 && (size_t)length < sizeof(pending) ? (size_t)length : 0;
+            return;
+        }
+        if (stage == FOOTER) {
+            stage = DONE;
+            if (!query.binary) {
+                memcpy(pending, "]}", 2);
+                pendingLength = 2;
+            }
+            return;
+        }
+        // Feed records until a bucket closes or the range is exhausted
+        int64_t values[6];
+        while (nextValues(values)) {
+            int64_t bucketStart = query.from + (cursor.start - query.from) / query.resolution * query.resolution;
+            bool closed = bucketStart != bucket.start && bucket.count > 0;
+            if (closed) emit();
+            if (bucketStart != bucket.start) bucket.reset(bucketStart);
+            bucket.add(values[0], values[1], values[2], values[3], values[4], values[5]);
+            if (closed) return;
+        }
+        if (bucket.count > 0) emit();
+        bucket.count = 0;
+        stage = FOOTER;
+    }
+
+    void emit() {
+        SeriesPoint point = bucket.point();
+        if (query.binary) {
+            pendingLength = series_encode_point(point, (uint8_t*)pending);
+        } else {
+            int length = snprintf(pending, sizeof(pending), "%s[%lld,%ld,%ld,%ld,%ld,%ld,%ld]", points ? "," : "",
+                                  (long long)point.timestamp, (long)point.busMin, (long)point.busMean, (long)point.busMax,
+                                  (long)point.shuntMin, (long)point.shuntMean, (long)point.shuntMax);
+            pendingLength = length > 0 && (size_t)length < sizeof(pending) ? (size_t)length : 0;
+        }
+        points++;
+    }
+
+    // The query channel's bus and shunt min/mean/max from the next record
+    bool nextValues(int64_t* values) {
+        uint8_t ch = query.channel;
+        while (cursor.next()) {
+            if (level == SHUNT_LOG_FULL) {
+                if (shunt_log_missing(cursor.full, ch)) continue;
+                values[0] = values[1] = values[2] = cursor.full.busRaw[ch];
+                values[3] = values[4] = values[5] = cursor.full.shuntRaw[ch];
+                return true;
+            }
+            const RollupRecord& rollup = cursor.rollup;
+            if (shunt_log_missing(rollup, ch)) continue;
+            values[0] = rollup.busMin[ch];
+            values[1] = rollup.busMean[ch];
+            values[2] = rollup.busMax[ch];
+            values[3] = rollup.shuntMin[ch];
+            values[4] = rollup.shuntMean[ch];
+            values[5] = rollup.shuntMax[ch];
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif
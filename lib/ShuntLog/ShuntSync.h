@@ -0,0 +1,269 @@
+#ifndef SHUNTSYNC_h
+#define SHUNTSYNC_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ShuntLog.h"
+#include "ShuntIndex.h"
+#include "ShuntSeries.h"
+
+/*
+ * Incremental export of the full-rate logs for collectors.
+ *
+ * A cursor is a position in the logs: the start (name) of a /full file and a byte offset in it,
+ * written "<fileStart>-<offset>". Each request streams every whole record after the cursor, moving
+ * on to the following files through the manifest and ending with the file being written, then
+ * a trailer with the cursor to send next time. Nothing is kept between requests, so the next
+ * request can come from any collector that has the cursor.
+ *
+ * Body, little-endian:
+ *   SYNC_RECORD_SIZE bytes per record: i64 timestamp, u32 micros (after the second the sample was
+ *   taken, 0 from files that only have the second), u32 busRaw[5], i32 shuntRaw[5]
+ *   trailer, SYNC_TRAILER_SIZE bytes: u32 SYNC_MAGIC, i64 next fileStart, u32 next offset,
+ *   u32 records in this body, u32 flags (SYNC_FLAG_MORE: stopped at the limit, ask again now)
+ * Records that fail their check are skipped. Missing samples are passed on as the logger wrote
+ * them, SHUNT_LOG_MISSING_BUS and SHUNT_LOG_MISSING_SHUNT.
+ */
+
+#define SYNC_RECORD_SIZE 52
+#define SYNC_TRAILER_SIZE 24
+#define SYNC_MAGIC 0x32434e53UL  // "SNC2"; "SNC1" records had no micros
+#define SYNC_FLAG_MORE 1
+
+// Records per request unless the collector asks for fewer
+#ifndef SYNC_MAX_RECORDS
+#define SYNC_MAX_RECORDS 3600
+#endif
+
+// Bytes of log read from SD per call
+#ifndef SYNC_READ_BUFFER
+#define SYNC_READ_BUFFER 1536
+#endif
+
+struct ShuntSyncCursor {
+    int64_t fileStart;
+    uint32_t offset;
+};
+
+inline bool shunt_sync_cursor_parse(const char* text, ShuntSyncCursor& cursor) {
+    char* end;
+    long long fileStart = strtoll(text, &end, 10);
+    if (end == text || *end != '-') return false;
+    const char* offsetText = end + 1;
+    unsigned long offset = strtoul(offsetText, &end, 10);
+    if (end == offsetText || *end != 0) return false;
+    cursor.fileStart = fileStart;
+    cursor.offset = (uint32_t)offset;
+    return true;
+}
+
+inline size_t shunt_sync_cursor_format(const ShuntSyncCursor& cursor, char* out, size_t capacity) {
+    int length = snprintf(out, capacity, "%lld-%lu", (long long)cursor.fileStart, (unsigned long)cursor.offset);
+    return length > 0 ? (size_t)length : 0;
+}
+
+inline size_t shunt_sync_encode(const FullRecord& record, uint8_t* out) {
+    for (uint8_t i = 0; i < 8; i++) out[i] = (uint8_t)((uint64_t)record.timestamp >> (8 * i));
+    for (uint8_t i = 0; i < 4; i++) out[8 + i] = (uint8_t)(record.micros >> (8 * i));
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+        for (uint8_t i = 0; i < 4; i++) out[12 + 4 * ch + i] = (uint8_t)(record.busRaw[ch] >> (8 * i));
+        for (uint8_t i = 0; i < 4; i++) out[32 + 4 * ch + i] = (uint8_t)((uint32_t)record.shuntRaw[ch] >> (8 * i));
+    }
+    return SYNC_RECORD_SIZE;
+}
+
+// Where a collector without a cursor starts: the first file with records at or after `since`,
+// or the file being written when the manifest has nothing that late
+inline ShuntSyncCursor shunt_sync_start(ShuntLogStorage& storage, int64_t since, int64_t liveFileStart) {
+    ShuntSyncCursor cursor = {liveFileStart, 0};
+    if (storage.open(SHUNT_MANIFEST_PATH)) {
+        uint32_t count = storage.size() / SHUNT_MANIFEST_ENTRY_SIZE;
+        uint32_t index = shunt_manifest_lower_bound(storage, count, since);
+        ShuntManifestEntry entry;
+        if (index < count && shunt_manifest_read(storage, index, entry)) cursor.fileStart = entry.fileStart;
+        storage.close();
+    }
+    return cursor;
+}
+
+// Streams one sync request as a sequence of chunks; holds one read buffer and one encoded record
+class ShuntSyncReader {
+public:
+
+    ShuntSyncCursor cursor;   // After the last record streamed
+    uint32_t records;
+    uint32_t recordsSkipped;
+    uint32_t filesOpened;
+    bool more;
+
+    // `liveFileStart` is the file being written, which ends the stream
+    ShuntSyncReader(ShuntLogStorage& storage, const ShuntSyncCursor& start, int64_t liveFileStart,
+                    uint32_t limit = SYNC_MAX_RECORDS)
+        : cursor(start), records(0), recordsSkipped(0), filesOpened(0), more(false), storage(storage),
+          liveFileStart(liveFileStart), limit(limit > 0 && limit < SYNC_MAX_RECORDS ? limit : SYNC_MAX_RECORDS),
+          stage(RECORDS), fileOpen(false), bufferOffset(0), bufferLength(0), pendingLength(0), pendingOffset(0) {}
+
+    ~ShuntSyncReader() {
+        closeFile();
+    }
+
+    bool finished() const {
+        return stage == DONE && pendingOffset == pendingLength;
+    }
+
+    // Writes as much output as fits; a record is never split across calls. Returns 0 once finished.
+    size_t fill(uint8_t* out, size_t capacity) {
+        size_t written = 0;
+        while (true) {
+            size_t length = series_pending_left(pendingLength, pendingOffset, sizeof(pending));
+            if (length > 0) {
+                if (length > capacity - written) {
+                    if (written > 0 || pendingOffset > 0) return written;
+                    // Smaller than one record: hand it over in pieces
+                    length = capacity - written;
+                }
+                memcpy(out + written, pending + pendingOffset, length);
+                written += length;
+                pendingOffset += length;
+                if (pendingOffset < pendingLength) return written;
+            }
+            pendingOffset = pendingLength = 0;
+            if (stage == DONE) {
+                closeFile();
+                return written;
+            }
+            produce();
+        }
+    }
+
+private:
+
+    enum Stage { RECORDS, TRAILER, DONE };
+
+    ShuntLogStorage& storage;
+    int64_t liveFileStart;
+    uint32_t limit;
+    Stage stage;
+
+    bool fileOpen;
+    uint32_t recordSize;
+    uint32_t fileEnd;        // Whole records only; the file being written may end in a torn one
+    uint8_t buffer[SYNC_READ_BUFFER];
+    uint32_t bufferOffset;   // File offset of buffer[0]
+    uint32_t bufferLength;
+
+    uint8_t pending[SYNC_TRAILER_SIZE > SYNC_RECORD_SIZE ? SYNC_TRAILER_SIZE : SYNC_RECORD_SIZE];
+    size_t pendingLength;
+    size_t pendingOffset;
+
+    void closeFile() {
+        if (fileOpen) storage.close();
+        fileOpen = false;
+    }
+
+    // Puts the next record, or the trailer, in `pending`
+    void produce() {
+        if (stage == TRAILER) {
+            stage = DONE;
+            uint32_t flags = more ? SYNC_FLAG_MORE : 0;
+            shunt_index_put(pending, SYNC_MAGIC, 4);
+            shunt_index_put(pending + 4, (uint64_t)cursor.fileStart, 8);
+            shunt_index_put(pending + 12, cursor.offset, 4);
+            shunt_index_put(pending + 16, records, 4);
+            shunt_index_put(pending + 20, flags, 4);
+            pendingLength = SYNC_TRAILER_SIZE;
+            return;
+        }
+        FullRecord record;
+        while (records < limit) {
+            const uint8_t* bytes = nextRecord();
+            if (bytes == NULL) {
+                stage = TRAILER;
+                return;
+            }
+            if (!shunt_log_decode_full(bytes, recordSize, record)) {
+                recordsSkipped++;
+                continue;
+            }
+            pendingLength = shunt_sync_encode(record, pending);
+            records++;
+            return;
+        }
+        more = true;
+        stage = TRAILER;
+    }
+
+    // Moves the cursor past the next whole record and returns its bytes; NULL when there are no more
+    const uint8_t* nextRecord() {
+        while (true) {
+            if (!fileOpen && !openFile()) return NULL;
+            if (cursor.offset + recordSize <= fileEnd) {
+                if (cursor.offset < bufferOffset || cursor.offset + recordSize > bufferOffset + bufferLength) {
+                    uint32_t length = SYNC_READ_BUFFER / recordSize * recordSize;
+                    if (length > fileEnd - cursor.offset) length = fileEnd - cursor.offset;
+                    bufferOffset = cursor.offset;
+                    bufferLength = storage.readAt(cursor.offset, buffer, length);
+                    if (bufferLength < recordSize) {
+                        // Shorter than it said; leave the rest for the next request
+                        fileEnd = cursor.offset;
+                        continue;
+                    }
+                }
+                const uint8_t* bytes = buffer + (cursor.offset - bufferOffset);
+                cursor.offset += recordSize;
+                return bytes;
+            }
+            closeFile();
+            if (!nextFile()) return NULL;
+        }
+    }
+
+    // Opens the cursor's file, moving on while it is missing or not a log
+    bool openFile() {
+        char path[40];
+        while (true) {
+            shunt_log_path(SHUNT_LOG_FULL, cursor.fileStart, path, sizeof(path));
+            if (storage.open(path)) {
+                filesOpened++;
+                uint8_t header[SHUNT_LOG_FIELD_OVERHEAD];
+                uint8_t timestampSize = shunt_log_timestamp_size(header, storage.readAt(0, header, sizeof(header)));
+                if (timestampSize != 0) {
+                    fileOpen = true;
+                    recordSize = shunt_log_record_size(SHUNT_LOG_FULL, timestampSize);
+                    fileEnd = storage.size() / recordSize * recordSize;
+                    cursor.offset -= cursor.offset % recordSize;
+                    bufferOffset = bufferLength = 0;
+                    return true;
+                }
+                storage.close();
+            }
+            if (!nextFile()) return false;
+        }
+    }
+
+    // Moves the cursor to the start of the file after it: from the manifest, or the one being written
+    bool nextFile() {
+        // Nothing comes after the file being written
+        if (cursor.fileStart >= liveFileStart) return false;
+        int64_t next = liveFileStart;
+        if (storage.open(SHUNT_MANIFEST_PATH)) {
+            uint32_t count = storage.size() / SHUNT_MANIFEST_ENTRY_SIZE;
+            uint32_t index = shunt_manifest_after(storage, count, cursor.fileStart);
+            ShuntManifestEntry entry;
+            if (index < count && shunt_manifest_read(storage, index, entry) && entry.fileStart < liveFileStart) {
+                next = entry.fileStart;
+            }
+            storage.close();
+        }
+        if (next <= cursor.fileStart) return false;
+        cursor.fileStart = next;
+        cursor.offset = 0;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef SHUNTSYSTEMLOG_h
+#define SHUNTSYSTEMLOG_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ShuntLog.h"
+
+/*
+ * The logger's own memory, logged beside the shunts so a reset after days of uptime can be traced
+ * back to the heap running low or breaking up, or a task running out of stack.
+ *
+ *   /system/YYYYMM.bin0  one record per SHUNT_SYSTEM_RECORD_SECONDS, fields and check as in
+ *       ShuntLog.h, no CRLF:
+ *       i64 timestamp (the end of the interval), u32 uptime seconds, u32 reset reason
+ *       (esp_reset_reason() of the boot), u32 free heap, u32 largest free block, u32 least free heap
+ *       since boot, SHUNT_SYSTEM_TASKS x u32 stack each task has never used, in
+ *       SHUNT_SYSTEM_TASK_NAMES order (SHUNT_SYSTEM_NO_TASK if it isn't running), u32 messages
+ *       queued to a websocket client, u32 live stream frames queued for one, check
+ *
+ * The readings are the worst of those taken over the interval: the lowest free heap and largest
+ * block, the deepest queues. Heap is the 8-bit capable RAM malloc() hands out, in bytes.
+ */
+
+#define SHUNT_SYSTEM_RECORD_SECONDS 300
+
+#define SHUNT_SYSTEM_TASKS 8
+#define SHUNT_SYSTEM_NO_TASK 0xFFFFFFFFu
+
+// The FreeRTOS names of the tasks watched, in record order ("tiT" is lwIP's)
+static const char* const SHUNT_SYSTEM_TASK_NAMES[SHUNT_SYSTEM_TASKS] = {
+    "loopTask", "async_tcp", "network", "tiT", "ina watch", "log_drain", "retention", "system",
+};
+
+#define SHUNT_SYSTEM_FIELDS (5 + SHUNT_SYSTEM_TASKS + 2)
+#define SHUNT_SYSTEM_RECORD_SIZE \
+    (SHUNT_LOG_FIELD_OVERHEAD + 8 + SHUNT_SYSTEM_FIELDS * (SHUNT_LOG_FIELD_OVERHEAD + 4) + SHUNT_LOG_FIELD_OVERHEAD + 8)
+
+struct ShuntSystemSample {
+    uint32_t freeHeap;
+    uint32_t largestFreeBlock;
+    uint32_t minFreeHeap;
+    uint32_t stackFree[SHUNT_SYSTEM_TASKS];
+    uint32_t wsQueued;    // in the fullest client's queue
+    uint32_t liveQueued;  // for the furthest behind subscriber
+};
+
+struct ShuntSystemRecord {
+    int64_t timestamp;
+    uint32_t uptime;
+    uint32_t resetReason;
+    ShuntSystemSample worst;
+};
+
+// How much of the free heap is out of reach of the largest allocation it could satisfy, in percent
+inline uint8_t shunt_system_fragmentation(const ShuntSystemSample& sample) {
+    if (sample.freeHeap == 0) return 0;
+    return (uint8_t)(100 - (uint64_t)sample.largestFreeBlock * 100 / sample.freeHeap);
+}
+
+// The worst of the samples taken over one record's interval
+class ShuntSystemInterval {
+public:
+
+    ShuntSystemSample worst;
+    uint32_t samples;
+
+    ShuntSystemInterval() : samples(0) {}
+
+    void reset() {
+        samples = 0;
+    }
+
+    void add(const ShuntSystemSample& sample) {
+        if (samples++ == 0) {
+            worst = sample;
+            return;
+        }
+        low(worst.freeHeap, sample.freeHeap);
+        low(worst.largestFreeBlock, sample.largestFreeBlock);
+        low(worst.minFreeHeap, sample.minFreeHeap);
+        // A task started since is SHUNT_SYSTEM_NO_TASK until then, so it takes its first reading
+        for (uint8_t i = 0; i < SHUNT_SYSTEM_TASKS; i++) low(worst.stackFree[i], sample.stackFree[i]);
+        if (sample.wsQueued > worst.wsQueued) worst.wsQueued = sample.wsQueued;
+        if (sample.liveQueued > worst.liveQueued) worst.liveQueued = sample.liveQueued;
+    }
+
+private:
+
+    static void low(uint32_t& worst, uint32_t value) {
+        if (value < worst) worst = value;
+    }
+};
+
+inline size_t shunt_system_encode(const ShuntSystemRecord& record, uint8_t* out) {
+    ShuntLogFieldWriter writer(out);
+    writer.add(record.timestamp, 8);
+    writer.add(record.uptime, 4);
+    writer.add(record.resetReason, 4);
+    writer.add(record.worst.freeHeap, 4);
+    writer.add(record.worst.largestFreeBlock, 4);
+    writer.add(record.worst.minFreeHeap, 4);
+    for (uint8_t i = 0; i < SHUNT_SYSTEM_TASKS; i++) writer.add(record.worst.stackFree[i], 4);
+    writer.add(record.worst.wsQueued, 4);
+    writer.add(record.worst.liveQueued, 4);
+    writer.finish(false);
+    return writer.length;
+}
+
+inline bool shunt_system_decode(const uint8_t* data, size_t length, ShuntSystemRecord& record) {
+    ShuntLogFieldReader reader(data, length);
+    record.timestamp = reader.readSigned(8);
+    record.uptime = reader.readUnsigned32();
+    record.resetReason = reader.readUnsigned32();
+    record.worst.freeHeap = reader.readUnsigned32();
+    record.worst.largestFreeBlock = reader.readUnsigned32();
+    record.worst.minFreeHeap = reader.readUnsigned32();
+    for (uint8_t i = 0; i < SHUNT_SYSTEM_TASKS; i++) record.worst.stackFree[i] = reader.readUnsigned32();
+    record.worst.wsQueued = reader.readUnsigned32();
+    record.worst.liveQueued = reader.readUnsigned32();
+    reader.verifyChecksum();
+    return reader.ok;
+}
+
+// The file for `timestamp`, or with `monthsBack`, the one that many months before it
+inline size_t shunt_system_path(int64_t timestamp, uint16_t monthsBack, char* out, size_t capacity) {
+    ShuntLogTime t;
+    shunt_log_civil(timestamp, t);
+    int32_t months = (int32_t)t.year * 12 + (t.month - 1) - monthsBack;
+    int length = snprintf(out, capacity, "/system/%04d%02d.bin0", (int)(months / 12), (int)(months % 12 + 1));
+    return length > 0 ? (size_t)length : 0;
+}
+
+#endif
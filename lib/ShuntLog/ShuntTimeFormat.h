@@ -0,0 +1,138 @@
+#ifndef SHUNTTIMEFORMAT_h
+#define SHUNTTIMEFORMAT_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ShuntLog.h"
+
+/*
+ * Timestamps and log paths rendered into the caller's buffer, for the logger's hot path. The
+ * calendar date is worked out and formatted once a day and kept; the time of day is six digits
+ * written by hand. No allocation, no strftime, no snprintf.
+ *
+ * Not thread-safe: each task that formats keeps its own.
+ */
+class ShuntTimeFormat {
+public:
+    static const size_t ISO_LENGTH = 19;        // "2023-07-23T11:34:25"
+    static const size_t COMPACT_LENGTH = 15;    // "20230723T113425"
+
+    // "2023-07-23T11:34:25"; 0 if it doesn't fit with its terminator
+    size_t iso(int64_t timestamp, char* out, size_t capacity) {
+        if (capacity <= ISO_LENGTH) return 0;
+        uint32_t seconds = load(timestamp);
+        memcpy(out, isoDate, 10);
+        out[10] = 'T';
+        writeTime(seconds, out + 11, ':');
+        out[ISO_LENGTH] = 0;
+        return ISO_LENGTH;
+    }
+
+    // "20230723T113425"
+    size_t compact(int64_t timestamp, char* out, size_t capacity) {
+        if (capacity <= COMPACT_LENGTH) return 0;
+        uint32_t seconds = load(timestamp);
+        memcpy(out, compactDate, 8);
+        out[8] = 'T';
+        writeTime(seconds, out + 9, 0);
+        out[COMPACT_LENGTH] = 0;
+        return COMPACT_LENGTH;
+    }
+
+    // The same as shunt_log_path()
+    size_t path(ShuntLogLevel level, int64_t fileStart, char* out, size_t capacity) {
+        uint32_t seconds = load(fileStart);
+        PathWriter writer = {out, capacity, 0};
+        switch (level) {
+            case SHUNT_LOG_HOUR:
+                writer.add("/hourly/", 8);
+                writer.add(compactDate, 6);
+                break;
+            case SHUNT_LOG_MINUTE:
+                writer.add("/daily/", 7);
+                writer.add(compactDate, 8);
+                break;
+            default: {
+                char time[8];
+                writeTime(seconds, time, 0);
+                writer.add("/full/", 6);
+                if (SHUNT_FULL_PARTITION == SHUNT_PARTITION_NONE) {
+                    writer.add(compactDate, 8);
+                    writer.add("T", 1);
+                    writer.add(time, 6);
+                } else {
+                    writer.add(slashedDate, 10);
+                    writer.add("/", 1);
+                    writer.add(time, 2);
+                    if (SHUNT_FULL_PARTITION == SHUNT_PARTITION_HOUR) writer.add("/", 1);
+                    writer.add(time + 2, 4);
+                }
+                break;
+            }
+        }
+        writer.add(".bin0", 5);
+        if (writer.length >= capacity) return 0;
+        out[writer.length] = 0;
+        return writer.length;
+    }
+
+private:
+    int64_t dayStart = 0;
+    bool loaded = false;
+    char isoDate[10];       // "2023-07-23"
+    char compactDate[8];    // "20230723"
+    char slashedDate[10];   // "2023/07/23"
+
+    struct PathWriter {
+        char* out;
+        size_t capacity;
+        size_t length;
+
+        void add(const char* text, size_t count) {
+            if (length + count < capacity) memcpy(out + length, text, count);
+            length += count;
+        }
+    };
+
+    static void writeDigits(uint32_t value, char* out, uint8_t count) {
+        for (uint8_t i = count; i > 0; i--) {
+            out[i - 1] = (char)('0' + value % 10);
+            value /= 10;
+        }
+    }
+
+    // "hh:mm:ss", or "hhmmss" with no separator
+    static void writeTime(uint32_t seconds, char* out, char separator) {
+        uint8_t step = separator ? 3 : 2;
+        writeDigits(seconds / 3600, out, 2);
+        writeDigits(seconds / 60 % 60, out + step, 2);
+        writeDigits(seconds % 60, out + 2 * step, 2);
+        if (separator) out[2] = out[5] = separator;
+    }
+
+    // Formats the day's date if it isn't the one cached, returns the seconds into the day
+    uint32_t load(int64_t timestamp) {
+        int64_t seconds = timestamp - dayStart;
+        if (loaded && seconds >= 0 && seconds < 86400) return (uint32_t)seconds;
+        ShuntLogTime t;
+        shunt_log_civil(timestamp, t);
+        seconds = t.hour * 3600 + t.minute * 60 + t.second;
+        dayStart = timestamp - seconds;
+        loaded = true;
+        writeDigits((uint32_t)t.year, compactDate, 4);
+        writeDigits(t.month, compactDate + 4, 2);
+        writeDigits(t.day, compactDate + 6, 2);
+        memcpy(isoDate, compactDate, 4);
+        isoDate[4] = '-';
+        memcpy(isoDate + 5, compactDate + 4, 2);
+        isoDate[7] = '-';
+        memcpy(isoDate + 8, compactDate + 6, 2);
+        memcpy(slashedDate, isoDate, 10);
+        slashedDate[4] = slashedDate[7] = '/';
+        return (uint32_t)seconds;
+    }
+};
+
+#endif
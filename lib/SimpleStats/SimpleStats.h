@@ -37,6 +37,14 @@ public:
         return static_cast<int32_t>(mean64);
     }
 
+    // Folds another set of statistics into this one, e.g. a minute into its hour
+    void merge(const SimpleStats& other) {
+        sum += other.sum;
+        count += other.count;
+        if(other.min < min) min = other.min;
+        if(other.max > max) max = other.max;
+    }
+
     // Method to reset the statistics
     void reset() {
         sum = 0;
@@ -0,0 +1,56 @@
+import argparse
+import struct
+import time
+import urllib.request
+
+import arrow
+
+LEVELS = {1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG"}
+# seq (u32), timestamp micros since boot (u64), level (u8), message length (u8)
+RECORD_HEADER = struct.Struct("<LQBB")
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Follow the shunt meter's in-memory log over HTTP.")
+    parser.add_argument("--host", required=True, help="Hostname or IP of the shunt meter")
+    parser.add_argument("--since", type=int, default=None, help="Cursor to start from (default: oldest record)")
+    parser.add_argument("--follow", action="store_true", help="Keep polling for new records")
+    parser.add_argument("--interval", type=float, default=2.0, help="Seconds between polls with --follow")
+    return parser.parse_args()
+
+
+def records(data: bytes):
+    offset = 0
+    while offset + RECORD_HEADER.size <= len(data):
+        seq, timestamp_micros, level, length = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        message = data[offset:offset + length].decode("utf-8", errors="replace")
+        offset += length
+        yield seq, timestamp_micros, level, message
+
+
+def fetch(host: str, since):
+    url = f"http://{host}/api/log"
+    if since is not None:
+        url += f"?since={since}"
+    with urllib.request.urlopen(url) as response:
+        next_cursor = int(response.headers["X-Log-Next-Cursor"])
+        clock_offset = int(response.headers["X-Log-Clock-Offset-Us"])
+        return response.read(), next_cursor, clock_offset
+
+
+def main():
+    args = parse_args()
+    since = args.since
+    while True:
+        data, since, clock_offset = fetch(args.host, since)
+        for seq, timestamp_micros, level, message in records(data):
+            timestamp = arrow.get((timestamp_micros + clock_offset) / 1000000).format("YYYY-MM-DD HH:mm:ss.SSS")
+            print(f"{seq:>8} {timestamp} {LEVELS.get(level, level):<5} {message}")
+        if not args.follow:
+            break
+        time.sleep(args.interval)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,92 @@
+import argparse
+import os
+import re
+
+# Names of /full files (and their /index/full sidecars) in each layout, relative to the directory
+LAYOUTS = {
+    "none": "{Y}{m}{d}T{H}{M}{S}",
+    "day": "{Y}/{m}/{d}/{H}{M}{S}",
+    "hour": "{Y}/{m}/{d}/{H}/{M}{S}",
+}
+NAME_PATTERN = re.compile(
+    r"^(?P<Y>\d{4})(?:/(?P<m1>\d{2})/(?P<d1>\d{2})/(?P<H1>\d{2})/?(?P<MS1>\d{4})"
+    r"|(?P<m2>\d{2})(?P<d2>\d{2})T(?P<H2>\d{2})(?P<MS2>\d{4}))$"
+)
+# The full-rate logs and their indexes, each with the extension it uses
+DIRECTORIES = (("full", ".bin0"), ("index/full", ".idx"))
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(
+        description="Move the shunt meter's full-rate logs on a mounted SD card into another /full layout "
+        "(SHUNT_FULL_PARTITION), along with their index files."
+    )
+    parser.add_argument("--root", required=True, help="Where the card is mounted")
+    parser.add_argument("--layout", choices=LAYOUTS, default="day", help="Layout to move to (default: day)")
+    parser.add_argument("--dry-run", action="store_true", help="Print the moves without making them")
+    return parser.parse_args()
+
+
+def parse_name(relative: str):
+    """The time fields of a log's path relative to its directory, minus the extension, or None."""
+    match = NAME_PATTERN.match(relative)
+    if match is None:
+        return None
+    groups = match.groupdict()
+    flat = groups["m2"] is not None
+    suffix = "2" if flat else "1"
+    minute_second = groups["MS" + suffix]
+    return {
+        "Y": groups["Y"],
+        "m": groups["m" + suffix],
+        "d": groups["d" + suffix],
+        "H": groups["H" + suffix],
+        "M": minute_second[:2],
+        "S": minute_second[2:],
+    }
+
+
+def migrate(root: str, directory: str, extension: str, layout: str, dry_run: bool):
+    base = os.path.join(root, directory)
+    moved = skipped = 0
+    if not os.path.isdir(base):
+        return moved, skipped
+    for parent, _, files in os.walk(base):
+        for name in files:
+            if not name.endswith(extension):
+                continue
+            source = os.path.join(parent, name)
+            relative = os.path.relpath(source, base).replace(os.sep, "/")[: -len(extension)]
+            fields = parse_name(relative)
+            if fields is None:
+                continue
+            target_relative = LAYOUTS[layout].format(**fields)
+            if target_relative == relative:
+                continue
+            target = os.path.join(base, *target_relative.split("/")) + extension
+            if os.path.exists(target):
+                print(f"skipping {source}: {target} exists")
+                skipped += 1
+                continue
+            print(f"{source} -> {target}")
+            moved += 1
+            if not dry_run:
+                os.makedirs(os.path.dirname(target), exist_ok=True)
+                os.rename(source, target)
+    if not dry_run:
+        # Partitions left empty by the moves
+        for parent, directories, files in os.walk(base, topdown=False):
+            if parent != base and not os.listdir(parent):
+                os.rmdir(parent)
+    return moved, skipped
+
+
+def main():
+    args = parse_args()
+    for directory, extension in DIRECTORIES:
+        moved, skipped = migrate(args.root, directory, extension, args.layout, args.dry_run)
+        print(f"/{directory}: {moved} moved, {skipped} skipped")
+
+
+if __name__ == "__main__":
+    main()
@@ -30,6 +30,8 @@ def process_file(input_file, output_file):
             for row in reader.rows():
                 print(row["timestamp"])
                 writer.writerow(row)
+            if reader.skipped_bytes:
+                print(f"Skipped {reader.skipped_bytes} damaged bytes, picked up again {reader.recoveries} times")
 
 
 def main():
@@ -5,12 +5,22 @@ import arrow
 
 COLUMNS = ["timestamp"]
 PADDING_LENGTH_BYTES = 4 + 4 + 2
-TIMESTAMP_LENGTH_BYTES = 4
 SHUNT_LENGTH_BYTES = 4 + 4
 SHUNT_COUNT = 5
 CHECKSUM_LENGTH = 8
 NEWLINE_LENGTH = 2
-SNAPSHOT_LENGTH = TIMESTAMP_LENGTH_BYTES + (SHUNT_LENGTH_BYTES * SHUNT_COUNT) + CHECKSUM_LENGTH + NEWLINE_LENGTH
+
+# High half of the check field that ends each record (see lib/ShuntLog/ShuntLog.h); older files
+# hold a plain sum there instead
+SYNC_WORD = 0x5A4C53A5
+SYNC_BYTES = struct.pack("<L", SYNC_WORD)
+
+# A full-rate timestamp this long is the second and the µs into it the sample was taken
+TIMESTAMP_MICROS_LENGTH = 12
+
+# A shunt with no sample: its INA didn't answer, or there isn't one
+MISSING_BUS_RAW = 0xFFFFFFFF
+MISSING_SHUNT_RAW = -0x80000000
 
 # 2.5 uV per LSB
 SHUNT_VOLTS_PER_LSB = 0.0000025
@@ -21,13 +31,45 @@ BUS_VOLTS_PER_LSB = 0.00125
 SHUNT_OHMS = 0.0001
 
 
-SNAPSHOT_LENGTH += PADDING_LENGTH_BYTES * 12
+def snapshot_length(timestamp_length: int) -> int:
+    """Bytes in one full-rate record for a 4 or 8 byte time_t, or the 12 byte timestamp."""
+    return (
+        timestamp_length + (SHUNT_LENGTH_BYTES * SHUNT_COUNT) + CHECKSUM_LENGTH + NEWLINE_LENGTH
+        + PADDING_LENGTH_BYTES * 12
+    )
+
+
+def _crc32c_table():
+    table = []
+    for i in range(256):
+        crc = i
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+        table.append(crc)
+    return table
+
+
+CRC32C_TABLE = _crc32c_table()
+
+
+def crc32c(data: bytes, crc: int = 0) -> int:
+    crc ^= 0xFFFFFFFF
+    for b in data:
+        crc = CRC32C_TABLE[(crc ^ b) & 0xFF] ^ (crc >> 8)
+    return crc ^ 0xFFFFFFFF
 
 
 class RowReader:
+    """
+    Rows of a /full log. A damaged record is skipped: the reader looks for the next sync marker and
+    carries on from the record it ends, so a torn write or a bad sector only costs the records in it.
+    """
+
     def __init__(self, f):
         self.f = f
         self.checksum = 0
+        self.skipped_bytes = 0
+        self.recoveries = 0
 
     def read(self, bio: BytesIO, length: int):
         z = struct.unpack("<l", bio.read(4))[0]
@@ -47,8 +89,12 @@ class RowReader:
         self.checksum += i
         return i
 
+    def read_timestamp_micros(self, bio: BytesIO):
+        seconds, micros = struct.unpack("<qL", self.read(bio, TIMESTAMP_MICROS_LENGTH))
+        return seconds, micros
+
     def read_checksum64(self, bio: BytesIO):
-        i = struct.unpack("<q", self.read(bio, 8))[0]
+        i = struct.unpack("<Q", self.read(bio, 8))[0]
         return i
 
     def read_int32(self, bio: BytesIO):
@@ -71,33 +117,74 @@ class RowReader:
         self.checksum += c
         return c.decode("utf-8")
 
-    def rows(self):
-        snapshot_data = self.f.read(SNAPSHOT_LENGTH)
-        while snapshot_data:
-            bio = BytesIO(snapshot_data)
-            row = {}
-            self.checksum = 0
-            unix_timestamp = self.read_int32(bio)
+    def parse(self, snapshot_data: bytes, timestamp_length: int):
+        """The row in one record; raises if it is damaged."""
+        bio = BytesIO(snapshot_data)
+        row = {}
+        self.checksum = 0
+        if timestamp_length == TIMESTAMP_MICROS_LENGTH:
+            unix_timestamp, micros = self.read_timestamp_micros(bio)
+            row["timestamp"] = arrow.get(unix_timestamp).format("YYYY-MM-DD HH:mm:ss") + f".{micros:06d}"
+        else:
+            unix_timestamp = self.read_int64(bio) if timestamp_length == 8 else self.read_int32(bio)
             row["timestamp"] = arrow.get(unix_timestamp).format("YYYY-MM-DD HH:mm:ss")
-            for deviceId in range(1, 6):  # Read bus and shunt voltages for each of 5 devices
-                bus_raw_voltage = self.read_uint32(bio)
-                shunt_raw_voltage = self.read_int32(bio)
-                shunt_volts = SHUNT_VOLTS_PER_LSB * shunt_raw_voltage
-                bus_volts = BUS_VOLTS_PER_LSB * bus_raw_voltage
-                bus_amps = shunt_volts / SHUNT_OHMS
-                bus_watts = bus_amps * bus_volts
-                row[f"bus_voltage_{deviceId}"] = bus_volts
-                row[f"shunt_voltage_{deviceId}"] = shunt_volts
-                row[f"current_{deviceId}"] = bus_amps
-                row[f"power_{deviceId}"] = bus_watts
-            checksum = self.read_checksum64(bio)
-            if checksum != self.checksum:
-                raise Exception(f"Checksum mismatch: {checksum} != {self.checksum}")
+        for deviceId in range(1, 6):  # Read bus and shunt voltages for each of 5 devices
+            bus_raw_voltage = self.read_uint32(bio)
+            shunt_raw_voltage = self.read_int32(bio)
+            if bus_raw_voltage == MISSING_BUS_RAW:
+                for column in ("bus_voltage", "shunt_voltage", "current", "power"):
+                    row[f"{column}_{deviceId}"] = None
+                continue
+            shunt_volts = SHUNT_VOLTS_PER_LSB * shunt_raw_voltage
+            bus_volts = BUS_VOLTS_PER_LSB * bus_raw_voltage
+            bus_amps = shunt_volts / SHUNT_OHMS
+            bus_watts = bus_amps * bus_volts
+            row[f"bus_voltage_{deviceId}"] = bus_volts
+            row[f"shunt_voltage_{deviceId}"] = shunt_volts
+            row[f"current_{deviceId}"] = bus_amps
+            row[f"power_{deviceId}"] = bus_watts
+        covered = bio.tell()
+        checksum = self.read_checksum64(bio)
+        if checksum >> 32 == SYNC_WORD:
+            crc = crc32c(snapshot_data[:covered])
+            if checksum & 0xFFFFFFFF != crc:
+                raise Exception(f"CRC mismatch: {checksum & 0xFFFFFFFF:08x} != {crc:08x}")
+        elif checksum != self.checksum & 0xFFFFFFFFFFFFFFFF:
+            raise Exception(f"Checksum mismatch: {checksum} != {self.checksum}")
+        new_line_chars = bio.read(2)
+        if new_line_chars != b"\r\n":
+            raise Exception(f"Expected new line, got {new_line_chars}")
+        return row
+
+    def resync(self, data: bytes, start: int, length: int, timestamp_length: int) -> int:
+        """Start of the first intact record at or after `start`, or len(data)."""
+        sync_offset = length - NEWLINE_LENGTH - 4 - 4
+        marker = data.find(SYNC_BYTES, start + sync_offset)
+        while marker != -1 and marker - sync_offset + length <= len(data):
+            candidate = marker - sync_offset
+            try:
+                self.parse(data[candidate:candidate + length], timestamp_length)
+                return candidate
+            except Exception:
+                marker = data.find(SYNC_BYTES, marker + 1)
+        return len(data)
+
+    def rows(self):
+        data = self.f.read()
+        # The first field's size is the firmware's time_t width, or 12 with the µs
+        timestamp_length = data[4] if len(data) > 4 and data[4] in (4, 8, TIMESTAMP_MICROS_LENGTH) else 4
+        length = snapshot_length(timestamp_length)
+        position = 0
+        while position + length <= len(data):
+            try:
+                row = self.parse(data[position:position + length], timestamp_length)
+            except Exception:
+                found = self.resync(data, position + 1, length, timestamp_length)
+                self.skipped_bytes += found - position
+                if found < len(data):
+                    self.recoveries += 1
+                position = found
+                continue
             yield row
-            new_line_chars = bio.read(2)
-            if new_line_chars != b"\r\n":
-                raise Exception(f"Expected new line, got {new_line_chars}")
-            excess = bio.read()
-            if len(excess) > 0:
-                raise Exception(f"Excess data: {excess}")
-            snapshot_data = self.f.read(SNAPSHOT_LENGTH)
+            position += length
+        self.skipped_bytes += len(data) - position
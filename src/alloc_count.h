@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <AllocCount.h>
+
+#include "logger.h"
+
+// Built with SHUNT_COUNT_ALLOCS (`pio run -e esp32dev-allocs`), the loop's heap allocations are
+// counted and any iteration that doesn't open a file but still allocates is logged as an error.
+// The counts, those of the iterations that did open files included, are in /api/system.
+// The linker sends every call to malloc() and friends through the wrappers below; newlib's
+// reentrant _malloc_r() and friends are wrapped too, since strdup() and the like come in that way.
+// Allocations by other tasks go straight through.
+
+#ifdef SHUNT_COUNT_ALLOCS
+
+AllocCounter loopAllocs;
+AllocWatch loopAllocWatch;
+// The task loop() runs in, once the first iteration has started
+TaskHandle_t loopAllocTask = NULL;
+
+inline void loopAllocNote() {
+  if (loopAllocTask != NULL && xTaskGetCurrentTaskHandle() == loopAllocTask) loopAllocs.note();
+}
+
+extern "C" {
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void* __real__malloc_r(struct _reent* reent, size_t size);
+void* __real__calloc_r(struct _reent* reent, size_t count, size_t size);
+void* __real__realloc_r(struct _reent* reent, void* pointer, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  loopAllocNote();
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  loopAllocNote();
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+  loopAllocNote();
+  return __real_realloc(pointer, size);
+}
+
+void* __wrap__malloc_r(struct _reent* reent, size_t size) {
+  loopAllocNote();
+  return __real__malloc_r(reent, size);
+}
+
+void* __wrap__calloc_r(struct _reent* reent, size_t count, size_t size) {
+  loopAllocNote();
+  return __real__calloc_r(reent, count, size);
+}
+
+void* __wrap__realloc_r(struct _reent* reent, void* pointer, size_t size) {
+  loopAllocNote();
+  return __real__realloc_r(reent, pointer, size);
+}
+
+}
+
+// At the top of each iteration
+void loopAllocBegin() {
+  if (loopAllocTask == NULL) loopAllocTask = xTaskGetCurrentTaskHandle();
+  loopAllocWatch.begin(loopAllocs);
+}
+
+// At the bottom; `rotated` if the iteration opened a file
+void loopAllocEnd(bool rotated) {
+  uint32_t worst = loopAllocWatch.worst;
+  uint32_t made = loopAllocWatch.end(loopAllocs, rotated);
+  // Only a new worst: the same leak every second would fill the log
+  if (made > worst) {
+    LOG_ERROR("loop() made %u heap allocations without opening a file (%u of %u iterations allocated)", made,
+              loopAllocWatch.allocatingIterations, loopAllocWatch.iterations);
+  }
+}
+
+#else
+
+inline void loopAllocBegin() {}
+inline void loopAllocEnd(bool rotated) {}
+
+#endif
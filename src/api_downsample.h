@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <sys/time.h>
+
+#include <ESPAsyncWebServer.h>
+#include <ShuntDownsample.h>
+
+#include "server.h"
+#include "logger.h"
+#include "log_storage.h"
+#include "api_sync.h"
+
+// A query and the SD file it is reading, kept alive by the chunked response
+struct DownsampleStreamState {
+  SdLogStorage storage;
+  ShuntDownsampleReader reader;
+
+  explicit DownsampleStreamState(const DownsampleQuery& query) : reader(storage, query, syncLiveFile()) {}
+};
+
+/**
+ * GET /api/downsample?from=<unix s>&to=<unix s>&points=<n>&mode=lttb|minmax&channels=<mask>
+ *                    &quantity=shunt|bus&format=json|bin
+ *
+ * At most `points` (default SERIES_DEFAULT_POINTS, up to DOWNSAMPLE_MAX_POINTS) chart points per
+ * channel for the range, downsampled on the fly from the finest log level a series query would
+ * read. `channels` is a bit mask (default all five), `to` defaults to now and `from` to a day before
+ * `to`. The level used is returned in X-Series-Level.
+ */
+void handleDownsampleRequest(AsyncWebServerRequest *request) {
+  DownsampleQuery query;
+  struct timeval tv_now;
+  gettimeofday(&tv_now, NULL);
+  query.to = request->hasParam("to") ? strtoll(request->getParam("to")->value().c_str(), NULL, 10) : tv_now.tv_sec;
+  query.from = request->hasParam("from") ? strtoll(request->getParam("from")->value().c_str(), NULL, 10) : query.to - 86400;
+  query.points = request->hasParam("points") ? strtoul(request->getParam("points")->value().c_str(), NULL, 10) : 0;
+  query.mode = request->hasParam("mode") && request->getParam("mode")->value() == "minmax" ? DOWNSAMPLE_MINMAX : DOWNSAMPLE_LTTB;
+  query.channels = request->hasParam("channels") ? strtoul(request->getParam("channels")->value().c_str(), NULL, 0)
+                                                 : (1 << SHUNT_LOG_CHANNELS) - 1;
+  query.bus = request->hasParam("quantity") && request->getParam("quantity")->value() == "bus";
+  query.binary = request->hasParam("format") && request->getParam("format")->value() == "bin";
+  query.channels &= (1 << SHUNT_LOG_CHANNELS) - 1;
+  if (query.channels == 0 || query.to <= query.from) {
+    request->send(400, "text/plain", "bad channels or range");
+    return;
+  }
+
+  std::shared_ptr<DownsampleStreamState> state = std::make_shared<DownsampleStreamState>(query);
+  LOG_DEBUG("Downsample: channels 0x%02x %lld..%lld to %u points from %s", query.channels, (long long)query.from,
+            (long long)query.to, state->reader.query.points, shunt_log_level_name(state->reader.level));
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+    query.binary ? "application/octet-stream" : "application/json",
+    [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return state->reader.fill(buffer, maxLen);
+    });
+  response->addHeader("X-Series-Level", shunt_log_level_name(state->reader.level));
+  request->send(response);
+}
+
+void setupDownsampleApi() {
+  server.on("/api/downsample", HTTP_GET, handleDownsampleRequest);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include "ff.h"
+
+#include <ESPAsyncWebServer.h>
+#include <DirListing.h>
+#include <ShuntLog.h>
+
+#include "server.h"
+#include "logger.h"
+#include "log_storage.h"
+
+// Summaries of the directories the logger writes to, dropped by listingChanged()
+struct CachedListing {
+  const char *path;
+  DirSummaryCache cache;
+};
+
+// A /full partition holds a day or an hour of files, short enough to list without one
+CachedListing cachedListings[] = {
+#if SHUNT_FULL_PARTITION == SHUNT_PARTITION_NONE
+  {"/full"},
+#endif
+  {"/daily"}, {"/hourly"}, {"/system"}};
+
+// Takes a C string so the logger's calls don't build a String
+DirSummaryCache *listingCache(const char *path) {
+  for (CachedListing &listing : cachedListings) {
+    if (strcmp(path, listing.path) == 0) return &listing.cache;
+  }
+  return NULL;
+}
+
+// Called by the logger whenever it creates or appends to a file in `path`
+void listingChanged(const char *path) {
+  DirSummaryCache *cache = listingCache(path);
+  if (cache != NULL) cache->invalidate();
+}
+
+// FAT timestamps are local time in 2 s steps; the logger keeps the clock in UTC
+int64_t fatTimeToUnix(WORD date, WORD time) {
+  return shunt_log_unix(1980 + (date >> 9), (date >> 5) & 15, date & 31, time >> 11, (time >> 5) & 63, (time & 31) * 2);
+}
+
+// Reads entries with FatFs directly: f_readdir returns each entry's size and date along with its
+// name, where readdir() + stat() would look every name up in the directory again
+class FatDirSource : public DirListingSource {
+public:
+
+  bool opened;
+
+  explicit FatDirSource(const String &path) {
+    String fatPath = String(SD_FATFS_DRIVE) + path;
+    opened = f_opendir(&dir, fatPath.c_str()) == FR_OK;
+  }
+
+  ~FatDirSource() {
+    if (opened) f_closedir(&dir);
+  }
+
+  bool next(DirEntryInfo &entry) override {
+    if (!opened || f_readdir(&dir, &info) != FR_OK || info.fname[0] == 0) return false;
+    entry.name = info.fname;
+    entry.dir = info.fattrib & AM_DIR;
+    entry.size = info.fsize;
+    entry.mtime = fatTimeToUnix(info.fdate, info.ftime);
+    return true;
+  }
+
+private:
+
+  FF_DIR dir;
+  FILINFO info;
+};
+
+// One listing in progress, kept alive by the chunked response
+struct ListingStreamState {
+  String path;
+  String pattern;
+  FatDirSource source;
+  DirSummaryCache *cache;
+  uint32_t generation;
+  DirSummary cached;
+  DirListingReader reader;
+
+  ListingStreamState(const String &dirPath, const String &match, DirListingQuery query, DirSummaryCache *summaryCache)
+    : path(dirPath), pattern(match), source(path), cache(summaryCache), generation(cache ? cache->current() : 0),
+      reader(source, path.c_str(), withPattern(query), cache && cache->get(cached) ? &cached : NULL) {}
+
+  // Keeps what a full scan learned for the next listing
+  ~ListingStreamState() {
+    DirSummary scanned;
+    if (cache != NULL && reader.scanned(scanned)) cache->store(scanned, generation);
+  }
+
+  DirListingQuery withPattern(DirListingQuery query) {
+    query.pattern = pattern.length() ? pattern.c_str() : NULL;
+    return query;
+  }
+};
+
+/**
+ * GET /api/list/<dir>?offset=<n>&limit=<n>&match=<glob>&hidden=true
+ *
+ * A page of the directory's entries with size and mtime, streamed as described in DirListing.h.
+ * Listings of the log directories use a summary kept since the logger last wrote there, so a page
+ * only reads the directory up to its end. /full is partitioned by date (see ShuntLog.h): list
+ * /api/list/full/2023/07/23 for a day's files.
+ */
+void handleListRequest(AsyncWebServerRequest *request) {
+  String dirPath = "/" + request->pathArg(0);
+  // Remove a trailing slash, if it exists
+  if (dirPath.length() > 1 && dirPath.endsWith("/")) {
+    dirPath = dirPath.substring(0, dirPath.length() - 1);
+  }
+  if (dirPath.indexOf("..") >= 0) {
+    request->send(400, "application/json", "{\"error\":\"bad path\"}");
+    return;
+  }
+
+  DirListingQuery query;
+  query.offset = request->hasParam("offset") ? strtoul(request->getParam("offset")->value().c_str(), NULL, 10) : 0;
+  query.limit = request->hasParam("limit") ? strtoul(request->getParam("limit")->value().c_str(), NULL, 10) : 0;
+  query.hidden = request->hasParam("hidden") && request->getParam("hidden")->value() == "true";
+  String match = request->hasParam("match") ? request->getParam("match")->value() : String();
+
+  std::shared_ptr<ListingStreamState> state = std::make_shared<ListingStreamState>(dirPath, match, query, listingCache(dirPath.c_str()));
+  if (!state->source.opened) {
+    LOG_WARN("Failed to open directory %s", dirPath.c_str());
+    request->send(404, "application/json", "{\"error\":\"no such directory\"}");
+    return;
+  }
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+    [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return state->reader.fill(buffer, maxLen);
+    });
+  request->send(response);
+}
+
+void setupListApi() {
+  server.on("^\\/api\\/list\\/(.*)$", HTTP_GET, handleListRequest);
+}
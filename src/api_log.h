@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <esp_timer.h>
+
+#include <ESPAsyncWebServer.h>
+
+#include "server.h"
+#include "logger.h"
+#include "sample_clock.h"
+
+// Streaming state for one /api/log response
+struct LogStreamState {
+  uint32_t cursor;
+  uint32_t end;
+  bool json;
+  bool opened;
+  bool started;
+  bool finished;
+};
+
+// Appends as many records as fit into `buffer`, never splitting one across chunks
+size_t fillLogChunk(LogStreamState& state, uint8_t* buffer, size_t maxLen) {
+  size_t written = 0;
+  LogRecord record;
+
+  if (state.json && !state.opened) {
+    // No room for the bracket; nothing has been read yet
+    if (maxLen == 0) return 0;
+    buffer[written++] = '[';
+  }
+  state.opened = true;
+  while (state.cursor < state.end) {
+    uint32_t recordCursor = state.cursor;
+    if (!logRing.read(state.cursor, record)) {
+      state.cursor = state.end;
+      break;
+    }
+    if (record.seq >= state.end) {
+      // Lapped past the snapshot; what is left was written after the request started
+      state.cursor = state.end;
+      break;
+    }
+    size_t size;
+    if (state.json) {
+      int length = snprintf((char*)buffer + written, maxLen - written,
+                            "%s{\"seq\":%u,\"ts\":%llu,\"level\":\"%s\",\"message\":\"%.*s\"}",
+                            state.started ? "," : "", record.seq, record.timestampMicros,
+                            log_level_name(record.level), record.length, record.message);
+      size = (length > 0 && (size_t)length < maxLen - written) ? length : 0;
+    } else {
+      size = log_record_encode(record, buffer + written, maxLen - written);
+    }
+    if (size == 0) {
+      // Doesn't fit, send it in the next chunk
+      state.cursor = recordCursor;
+      break;
+    }
+    state.started = true;
+    written += size;
+  }
+  if (state.cursor >= state.end && !state.finished && written < maxLen) {
+    if (state.json) {
+      buffer[written++] = ']';
+    }
+    state.finished = true;
+  }
+  return written;
+}
+
+/**
+ * GET /api/log?since=<seq>&format=bin|json
+ *
+ * Streams the records still held in the RAM log ring, starting at `since` (default: the oldest one).
+ * X-Log-Next-Cursor is the `since` to use next time. Timestamps are microseconds since boot; add
+ * X-Log-Clock-Offset-Us to get Unix time in microseconds.
+ */
+void handleLogRequest(AsyncWebServerRequest *request) {
+  std::shared_ptr<LogStreamState> state = std::make_shared<LogStreamState>();
+  state->end = logRing.head();
+  state->cursor = logRing.oldest();
+  state->json = request->hasParam("format") && request->getParam("format")->value() == "json";
+  state->opened = false;
+  state->started = false;
+  state->finished = false;
+  if (request->hasParam("since")) {
+    uint32_t since = strtoul(request->getParam("since")->value().c_str(), NULL, 10);
+    // A cursor from before a reboot can be ahead of the ring; start over from the oldest record
+    if (since <= state->end) {
+      state->cursor = max(since, state->cursor);
+    }
+  }
+
+  int64_t monotonic = esp_timer_get_time();
+  int64_t clockOffset = wallClockAt(monotonic) - monotonic;
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+    state->json ? "application/json" : "application/octet-stream",
+    [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      if (state->finished) return 0;
+      return fillLogChunk(*state, buffer, maxLen);
+    });
+  response->addHeader("X-Log-Next-Cursor", String(state->end));
+  response->addHeader("X-Log-Clock-Offset-Us", String(clockOffset));
+  request->send(response);
+}
+
+void setupLogApi() {
+  server.on("/api/log", HTTP_GET, handleLogRequest);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <sys/time.h>
+
+#include <ESPAsyncWebServer.h>
+#include <ShuntSeries.h>
+
+#include "server.h"
+#include "logger.h"
+#include "log_storage.h"
+#include "api_sync.h"
+
+// A query and the SD file it is reading, kept alive by the chunked response
+struct SeriesStreamState {
+  SdLogStorage storage;
+  ShuntSeriesReader reader;
+
+  explicit SeriesStreamState(const SeriesQuery& query) : reader(storage, query, syncLiveFile()) {}
+};
+
+/**
+ * GET /api/series?channel=<0-4>&from=<unix s>&to=<unix s>&resolution=<s>&format=json|bin
+ *
+ * Min/mean/max of one channel's raw registers in `resolution` second buckets, read from the
+ * coarsest log level (hourly, daily or full-rate files) that can resolve them. `to` defaults to now,
+ * `from` to a day before `to`, and `resolution` to about SERIES_DEFAULT_POINTS points. The level and
+ * resolution actually used are returned in X-Series-Level and X-Series-Resolution.
+ */
+void handleSeriesRequest(AsyncWebServerRequest *request) {
+  if (!request->hasParam("channel")) {
+    request->send(400, "text/plain", "channel is required");
+    return;
+  }
+  SeriesQuery query;
+  query.channel = strtoul(request->getParam("channel")->value().c_str(), NULL, 10);
+
+  struct timeval tv_now;
+  gettimeofday(&tv_now, NULL);
+  query.to = request->hasParam("to") ? strtoll(request->getParam("to")->value().c_str(), NULL, 10) : tv_now.tv_sec;
+  query.from = request->hasParam("from") ? strtoll(request->getParam("from")->value().c_str(), NULL, 10) : query.to - 86400;
+  query.resolution = request->hasParam("resolution") ? strtoul(request->getParam("resolution")->value().c_str(), NULL, 10) : 0;
+  query.binary = request->hasParam("format") && request->getParam("format")->value() == "bin";
+  if (query.channel >= SHUNT_LOG_CHANNELS || query.to <= query.from) {
+    request->send(400, "text/plain", "bad channel or range");
+    return;
+  }
+
+  std::shared_ptr<SeriesStreamState> state = std::make_shared<SeriesStreamState>(query);
+  LOG_DEBUG("Series: channel %u %lld..%lld every %us from %s", query.channel, (long long)query.from, (long long)query.to,
+            state->reader.query.resolution, shunt_log_level_name(state->reader.level));
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse(
+    query.binary ? "application/octet-stream" : "application/json",
+    [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return state->reader.fill(buffer, maxLen);
+    });
+  response->addHeader("X-Series-Level", shunt_log_level_name(state->reader.level));
+  response->addHeader("X-Series-Resolution", String(state->reader.query.resolution));
+  request->send(response);
+}
+
+void setupSeriesApi() {
+  server.on("/api/series", HTTP_GET, handleSeriesRequest);
+}
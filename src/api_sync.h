@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+
+#include <ESPAsyncWebServer.h>
+#include <ShuntSync.h>
+
+#include "server.h"
+#include "logger.h"
+#include "log_storage.h"
+
+// Start (name) of the /full file being written, set by openFullLogFile() in loop() and read by the
+// handler in the AsyncTCP task
+int64_t syncLiveFileStart = 0;
+portMUX_TYPE syncMux = portMUX_INITIALIZER_UNLOCKED;
+
+void syncSetLiveFile(int64_t fileStart) {
+  portENTER_CRITICAL(&syncMux);
+  syncLiveFileStart = fileStart;
+  portEXIT_CRITICAL(&syncMux);
+}
+
+int64_t syncLiveFile() {
+  portENTER_CRITICAL(&syncMux);
+  int64_t fileStart = syncLiveFileStart;
+  portEXIT_CRITICAL(&syncMux);
+  return fileStart;
+}
+
+// The reader and the SD file it has open, kept alive by the chunked response
+struct SyncStreamState {
+  SdLogStorage storage;
+  ShuntSyncReader reader;
+
+  SyncStreamState(const ShuntSyncCursor& cursor, int64_t live, uint32_t limit) : reader(storage, cursor, live, limit) {}
+};
+
+/**
+ * GET /api/sync?cursor=<fileStart-offset>&limit=<records>
+ * GET /api/sync?since=<unix s>&limit=<records>
+ *
+ * Every full-rate record after the cursor, across file rotations, as the binary stream described
+ * in ShuntSync.h; the trailer holds the cursor for the next request. Without a cursor it starts at
+ * the first file with records at or after `since`, or at the file being written. At most
+ * SYNC_MAX_RECORDS records per request; the trailer says when there are more.
+ */
+void handleSyncRequest(AsyncWebServerRequest *request) {
+  int64_t live = syncLiveFile();
+  if (live == 0) {
+    request->send(503, "text/plain", "not logging yet");
+    return;
+  }
+  ShuntSyncCursor cursor;
+  if (request->hasParam("cursor")) {
+    if (!shunt_sync_cursor_parse(request->getParam("cursor")->value().c_str(), cursor)) {
+      request->send(400, "text/plain", "bad cursor");
+      return;
+    }
+  } else {
+    SdLogStorage storage;
+    int64_t since = request->hasParam("since") ? strtoll(request->getParam("since")->value().c_str(), NULL, 10) : live;
+    cursor = shunt_sync_start(storage, since, live);
+  }
+  uint32_t limit = request->hasParam("limit") ? strtoul(request->getParam("limit")->value().c_str(), NULL, 10) : 0;
+
+  std::shared_ptr<SyncStreamState> state = std::make_shared<SyncStreamState>(cursor, live, limit);
+  char start[32];
+  shunt_sync_cursor_format(cursor, start, sizeof(start));
+  LOG_DEBUG("Sync: from %s", start);
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream",
+    [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return state->reader.fill(buffer, maxLen);
+    });
+  response->addHeader("X-Sync-Start", start);
+  request->send(response);
+}
+
+void setupSyncApi() {
+  server.on("/api/sync", HTTP_GET, handleSyncRequest);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ArduinoOTA.h>
+
+#include <BootSequence.h>
+
+#include "server.h"
+#include "logger.h"
+
+// How often the network task looks at the connection, and polls OTA once it is up
+#define NETWORK_POLL_MS 100
+
+// setup()'s stages, up to the first sample, and the network task's, up to the services
+BootTimeline bootTimeline;
+BootTimeline networkTimeline;
+NetworkBoot networkBoot;
+
+const char* networkSsid = NULL;
+const char* networkPassword = NULL;
+
+void initOTA() {
+
+  ArduinoOTA
+    .onStart([]() {
+      LOG_INFO("Starting OTA update");
+      // Print EOF character to close connections
+      char eof_msg[2] = {0x04, 0};
+      ws.printfAll(eof_msg);
+      ws.closeAll();
+      String type;
+      if (ArduinoOTA.getCommand() == U_FLASH)
+        type = "sketch";
+      else // U_SPIFFS
+        type = "filesystem";
+
+      // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
+      Serial.println("Start updating " + type);
+    })
+    .onEnd([]() {
+      Serial.println("\nEnd");
+    })
+    .onProgress([](unsigned int progress, unsigned int total) {
+      Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+    })
+    .onError([](ota_error_t error) {
+      Serial.printf("Error[%u]: ", error);
+      if (error == OTA_AUTH_ERROR) Serial.println("Auth Failed");
+      else if (error == OTA_BEGIN_ERROR) Serial.println("Begin Failed");
+      else if (error == OTA_CONNECT_ERROR) Serial.println("Connect Failed");
+      else if (error == OTA_RECEIVE_ERROR) Serial.println("Receive Failed");
+      else if (error == OTA_END_ERROR) Serial.println("End Failed");
+    });
+
+  // Advertises the board over mDNS too
+  ArduinoOTA.begin();
+}
+
+// Joins the access point, starts the services on the first connection, then keeps OTA polled. Runs
+// beside the sampler for as long as the board is up.
+void networkTask(void* parameter) {
+  networkTimeline.begin(millis());
+  networkTimeline.stage("wifi", millis());
+  uint32_t drops = 0;
+  while (true) {
+    switch (networkBoot.step(millis(), WiFi.status() == WL_CONNECTED)) {
+      case NETWORK_CONNECT:
+        if (networkBoot.attempts == 1) {
+          WiFi.mode(WIFI_STA);
+        } else {
+          LOG_WARN("No Wi-Fi yet, joining %s again (attempt %u)", networkSsid, networkBoot.attempts);
+          WiFi.disconnect();
+        }
+        WiFi.begin(networkSsid, networkPassword);
+        break;
+      case NETWORK_START_SERVICES: {
+        networkTimeline.stage("services", millis());
+        initOTA();
+        server.begin();
+        networkTimeline.finish(millis());
+        char stages[96];
+        networkTimeline.format(stages, sizeof(stages));
+        IPAddress ip = WiFi.localIP();
+        LOG_INFO("Network up at %u.%u.%u.%u, %u ms after power-on: %s", ip[0], ip[1], ip[2], ip[3],
+                 networkTimeline.endMs, stages);
+        break;
+      }
+      case NETWORK_CONNECTED: {
+        IPAddress ip = WiFi.localIP();
+        LOG_INFO("Wi-Fi back at %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+        break;
+      }
+      case NETWORK_WAIT:
+        break;
+    }
+    if (networkBoot.drops != drops) {
+      drops = networkBoot.drops;
+      LOG_WARN("Wi-Fi lost (%u times since boot)", drops);
+    }
+    if (networkBoot.servicesStarted) {
+      ArduinoOTA.handle();
+    }
+    vTaskDelay(pdMS_TO_TICKS(NETWORK_POLL_MS));
+  }
+}
+
+// Called first thing in setup(): the network comes up while the SD card, RTC and INAs are set up.
+// The web handlers are registered by setup() meanwhile; the server only listens once connected.
+void startNetwork(const char* ssid, const char* password) {
+  networkSsid = ssid;
+  networkPassword = password;
+  // OTA writes flash from this task's stack
+  xTaskCreatePinnedToCore(networkTask, "network", 8192, NULL, 1, NULL, 0);
+}
+
+// The boot report once setup() is done: how long each stage took to the first sample
+void reportBoot() {
+  bootTimeline.finish(millis());
+  char stages[160];
+  bootTimeline.format(stages, sizeof(stages));
+  LOG_INFO("Logging %u ms after power-on: %s", bootTimeline.endMs, stages);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include <INA.h>
+#include <I2CRecovery.h>
+
+#include "logger.h"
+
+#define INA_MAX_BUSES 2
+
+// How long a transfer may take before it is abandoned; an INA read takes under a millisecond
+#define INA_I2C_TIMEOUT_MS 10
+
+static_assert(INA_I2C_SHORT_READ == I2C_SHORT_READ, "INA short reads must count as I2C short reads");
+
+// Per bus, since boot. Updated with the bus's lock held (see ina_health.h).
+I2CBusStats inaBusStats[INA_MAX_BUSES];
+// Whether the last recovery left the bus idle
+bool inaBusClear[INA_MAX_BUSES] = {true, true};
+
+// The bus's pins, switched from the controller to GPIO for the bus clear
+struct GpioI2CPins {
+  int sdaPin;
+  int sclPin;
+
+  void releaseSda() { pinMode(sdaPin, INPUT_PULLUP); }
+  void releaseScl() { pinMode(sclPin, INPUT_PULLUP); }
+  void driveSdaLow() { drive(sdaPin); }
+  void driveSclLow() { drive(sclPin); }
+  bool sda() { return digitalRead(sdaPin) == HIGH; }
+  bool scl() { return digitalRead(sclPin) == HIGH; }
+  // Half a 100 kHz clock
+  void wait() { delayMicroseconds(5); }
+
+  static void drive(int pin) {
+    pinMode(pin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(pin, LOW);
+  }
+};
+
+// Sets up a bus's controller the way the INAs are read
+void i2cBegin(INA_Class* ina) {
+  ina->_wire->begin(ina->sda_pin, ina->scl_pin, INA_I2C_STANDARD_MODE);
+  ina->_wire->setTimeOut(INA_I2C_TIMEOUT_MS);
+}
+
+// Takes the pins off the controller, clears the bus (see I2CRecovery.h) and starts the controller
+// again. A few hundred µs. With the bus's lock held.
+bool i2cRecoverBus(uint8_t bus, INA_Class* ina) {
+  ina->_wire->end();
+  GpioI2CPins pins = {ina->sda_pin, ina->scl_pin};
+  bool clear = i2c_bus_clear(pins);
+  i2cBegin(ina);
+  I2CBusStats& stats = inaBusStats[bus];
+  if (clear) {
+    stats.recoveries++;
+  } else {
+    stats.failedRecoveries++;
+  }
+  // Only the first of a run, a bus that stays stuck would fill the log
+  if (!clear && inaBusClear[bus]) {
+    LOG_ERROR("I2C bus %u still held low after a bus clear", bus);
+  } else if (clear && !inaBusClear[bus]) {
+    LOG_INFO("I2C bus %u clear again", bus);
+  }
+  inaBusClear[bus] = clear;
+  return clear;
+}
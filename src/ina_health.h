@@ -0,0 +1,236 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+#include <INA.h>
+#include <InaHealth.h>
+#include <ShuntLog.h>
+
+#include <ESPAsyncWebServer.h>
+
+#include "server.h"
+#include "logger.h"
+#include "i2c_bus.h"
+
+// How often the watcher looks for missing devices to probe and buses to scan
+#define INA_WATCH_POLL_MS 250
+
+// What is logged as each shunt: the device read for it, and whether it is answering. Devices get
+// the shunts in the order they were found, and keep them: one attached later takes the shunt of a
+// device on its bus that has dropped out, or else the next free one, rather than moving the others
+// along.
+struct InaChannel {
+  INA_Class* ina = NULL;  // NULL while nothing is fitted
+  uint8_t bus = 0;
+  uint8_t device = 0;     // INA_Class device number
+  uint8_t address = 0;
+  InaDeviceHealth health;
+};
+
+InaChannel inaChannels[SHUNT_LOG_CHANNELS];
+
+// One per bus. The sampler holds it across its reads of a device, the watcher across one probe,
+// so neither is held up for more than a few register reads; the health states and scan backoffs
+// are only touched with it held too.
+SemaphoreHandle_t inaBusLocks[INA_MAX_BUSES];
+InaBackoff inaScans[INA_MAX_BUSES] = {
+  InaBackoff(INA_HEALTH_SCAN_MS, INA_HEALTH_MAX_SCAN_MS),
+  InaBackoff(INA_HEALTH_SCAN_MS, INA_HEALTH_MAX_SCAN_MS),
+};
+
+// Sets a device up the way ina_setup() does, after begin() has calibrated it
+typedef void (*InaConfigure)(INA_Class* ina, uint8_t deviceNumber);
+
+std::vector<INA_Class*> inaWatchBuses;
+uint16_t inaWatchMaxBusAmps = 0;
+uint32_t inaWatchMicroOhmR = 0;
+InaConfigure inaWatchConfigure = NULL;
+
+// The shunt a device just found on `bus` is logged as: one on the same bus whose device has dropped
+// out, since a device that comes back may come back at another address, or else the next free one.
+// SHUNT_LOG_CHANNELS if there is neither.
+uint8_t inaChannelFor(uint8_t bus) {
+  INA_Class* ina = inaWatchBuses[bus];
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    if (inaChannels[ch].ina == ina && !inaChannels[ch].health.present()) return ch;
+  }
+  uint8_t ch = 0;
+  while (ch < SHUNT_LOG_CHANNELS && inaChannels[ch].ina != NULL) ch++;
+  return ch;
+}
+
+// Gives devices `first` to `first + count - 1` of a bus their shunts. With the bus's lock held once
+// the sampler is running.
+void inaChannelsAdd(uint8_t bus, uint8_t first, uint8_t count) {
+  INA_Class* ina = inaWatchBuses[bus];
+  for (uint8_t device = first; device < first + count; device++) {
+    uint8_t ch = inaChannelFor(bus);
+    uint8_t address = ina->getDeviceAddress(device);
+    if (ch == SHUNT_LOG_CHANNELS) {
+      LOG_WARN("No shunt left to log the INA at 0x%02x on bus %u as", address, bus);
+      return;
+    }
+    InaChannel& channel = inaChannels[ch];
+    if (channel.ina != NULL) {
+      uint8_t was = channel.address;
+      channel.device = device;
+      channel.address = address;
+      channel.health.probed(true, millis());
+      LOG_INFO("Shunt %u is back as the INA at 0x%02x on bus %u, was 0x%02x (%u recoveries)", ch, address, bus, was,
+               channel.health.recoveries);
+      continue;
+    }
+    channel.bus = bus;
+    channel.device = device;
+    channel.address = address;
+    channel.health = InaDeviceHealth();
+    channel.ina = ina;
+    LOG_INFO("Shunt %u is the INA at 0x%02x on bus %u", ch, address, bus);
+  }
+}
+
+// Reads one shunt; false, with nothing in `busRaw` and `shuntRaw`, if it has nothing to show
+bool inaRead(uint8_t ch, uint32_t& busRaw, int32_t& shuntRaw) {
+  InaChannel& channel = inaChannels[ch];
+  if (channel.ina == NULL) return false;
+  xSemaphoreTake(inaBusLocks[channel.bus], portMAX_DELAY);
+  bool ok = false;
+  bool lost = false;
+  if (channel.health.present()) {
+    channel.ina->takeI2CError();  // Left by the watcher's probes
+    shuntRaw = channel.ina->getShuntRaw(channel.device);
+    busRaw = channel.ina->getBusRaw(channel.device);
+    uint8_t error = channel.ina->takeI2CError();
+    inaBusStats[channel.bus].count(error);
+    // A timeout or a lost arbitration: whatever is holding the bus would fail every read after
+    if (i2c_needs_recovery(error)) i2cRecoverBus(channel.bus, channel.ina);
+    ok = error == I2C_OK;
+    lost = channel.health.read(ok, millis());
+    // It may come back somewhere else
+    if (lost) inaScans[channel.bus].start(millis());
+  }
+  xSemaphoreGive(inaBusLocks[channel.bus]);
+  if (lost) {
+    LOG_WARN("INA at 0x%02x on bus %u stopped answering, shunt %u missing (%u dropouts, %u failed reads)",
+             channel.address, channel.bus, ch, channel.health.dropouts, channel.health.errors);
+  }
+  return ok;
+}
+
+// Probes a missing device; one that answers again is set up from scratch, as a power cycle
+// would have reset it
+void inaReprobe(uint8_t ch) {
+  InaChannel& channel = inaChannels[ch];
+  xSemaphoreTake(inaBusLocks[channel.bus], portMAX_DELAY);
+  bool back = false;
+  if (channel.health.probeDue(millis())) {
+    // Not if the bus itself is still stuck
+    if (!inaBusClear[channel.bus]) i2cRecoverBus(channel.bus, channel.ina);
+    uint16_t config;
+    bool answered = channel.ina->readRegister(INA_CONFIGURATION_REGISTER, channel.address, config);
+    if (answered) {
+      channel.ina->begin(inaWatchMaxBusAmps, inaWatchMicroOhmR, channel.device);
+      inaWatchConfigure(channel.ina, channel.device);
+      answered = !channel.ina->takeI2CError();
+    }
+    back = channel.health.probed(answered, millis());
+  }
+  xSemaphoreGive(inaBusLocks[channel.bus]);
+  if (back) {
+    LOG_INFO("INA at 0x%02x on bus %u is back, shunt %u logging again (%u recoveries)", channel.address, channel.bus,
+             ch, channel.health.recoveries);
+  }
+}
+
+// Looks for devices attached since the boot, one address at a time like WireScanner
+void inaScan(uint8_t bus) {
+  INA_Class* ina = inaWatchBuses[bus];
+  bool found = false;
+  for (uint8_t address = 0x40; address <= 0x4F; address++) {
+    xSemaphoreTake(inaBusLocks[bus], portMAX_DELAY);
+    uint8_t first = ina->device_count;
+    uint8_t added = ina->addDevice(address, inaWatchMaxBusAmps, inaWatchMicroOhmR);
+    for (uint8_t device = first; device < first + added; device++) inaWatchConfigure(ina, device);
+    if (added > 0) {
+      LOG_INFO("New INA at 0x%02x on bus %u", address, bus);
+      inaChannelsAdd(bus, first, added);
+      found = true;
+    }
+    xSemaphoreGive(inaBusLocks[bus]);
+  }
+  xSemaphoreTake(inaBusLocks[bus], portMAX_DELAY);
+  if (found) {
+    inaScans[bus].start(millis());
+  } else {
+    inaScans[bus].retry(millis());
+  }
+  xSemaphoreGive(inaBusLocks[bus]);
+}
+
+void inaWatchTask(void* parameter) {
+  while (true) {
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+      if (inaChannels[ch].ina != NULL) inaReprobe(ch);
+    }
+    for (uint8_t bus = 0; bus < inaWatchBuses.size() && bus < INA_MAX_BUSES; bus++) {
+      if (inaScans[bus].due(millis())) inaScan(bus);
+    }
+    vTaskDelay(pdMS_TO_TICKS(INA_WATCH_POLL_MS));
+  }
+}
+
+// Called once ina_setup() has found the devices: gives them their shunts and starts watching for
+// ones that drop out or turn up
+void startInaWatch(const std::vector<INA_Class*>& buses, uint16_t maxBusAmps, uint32_t microOhmR,
+                   InaConfigure configure) {
+  inaWatchBuses = buses;
+  inaWatchMaxBusAmps = maxBusAmps;
+  inaWatchMicroOhmR = microOhmR;
+  inaWatchConfigure = configure;
+  for (uint8_t bus = 0; bus < buses.size() && bus < INA_MAX_BUSES; bus++) {
+    inaBusLocks[bus] = xSemaphoreCreateMutex();
+    buses[bus]->_wire->setTimeOut(INA_I2C_TIMEOUT_MS);
+    inaChannelsAdd(bus, 0, buses[bus]->device_count);
+    inaScans[bus].start(millis());
+  }
+  xTaskCreatePinnedToCore(inaWatchTask, "ina watch", 4096, NULL, 1, NULL, 0);
+}
+
+/**
+ * GET /api/i2c
+ *
+ * Per bus, the sampler's reads since boot by how they ended and the bus clears they needed; per
+ * shunt, the INA read for it and how often it has failed, dropped out and come back.
+ */
+void handleI2CRequest(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->print("{\"buses\":[");
+  for (uint8_t bus = 0; bus < inaWatchBuses.size() && bus < INA_MAX_BUSES; bus++) {
+    const I2CBusStats& stats = inaBusStats[bus];
+    response->printf("%s{\"bus\":%u,\"sda\":%d,\"scl\":%d,\"clear\":%s,\"reads\":%u,\"nacks\":%u,\"timeouts\":%u,"
+                     "\"short_reads\":%u,\"bus_errors\":%u,\"recoveries\":%u,\"failed_recoveries\":%u}",
+                     bus == 0 ? "" : ",", bus, inaWatchBuses[bus]->sda_pin, inaWatchBuses[bus]->scl_pin,
+                     inaBusClear[bus] ? "true" : "false", stats.reads, stats.nacks, stats.timeouts, stats.shortReads,
+                     stats.busErrors, stats.recoveries, stats.failedRecoveries);
+  }
+  response->print("],\"shunts\":[");
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    const InaChannel& channel = inaChannels[ch];
+    if (channel.ina == NULL) {
+      response->printf("%s{\"shunt\":%u,\"state\":\"none\"}", ch == 0 ? "" : ",", ch);
+      continue;
+    }
+    response->printf("%s{\"shunt\":%u,\"bus\":%u,\"address\":%u,\"state\":\"%s\",\"errors\":%u,\"dropouts\":%u,"
+                     "\"recoveries\":%u}",
+                     ch == 0 ? "" : ",", ch, channel.bus, channel.address,
+                     channel.health.present() ? "ok" : "missing", channel.health.errors, channel.health.dropouts,
+                     channel.health.recoveries);
+  }
+  response->print("]}");
+  request->send(response);
+}
+
+void setupI2CApi() {
+  server.on("/api/i2c", HTTP_GET, handleI2CRequest);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <vector>
+
+#include <INA.h>
+#include <InaTopology.h>
+
+#include "logger.h"
+
+// Where the INAs found at the last full scan are kept (see InaTopology.h)
+#define INA_TOPOLOGY_NAMESPACE "ina"
+#define INA_TOPOLOGY_KEY "topology"
+
+bool inaTopologyLoad(InaTopology& topology) {
+  Preferences preferences;
+  if (!preferences.begin(INA_TOPOLOGY_NAMESPACE, true)) return false;
+  uint8_t blob[INA_TOPOLOGY_MAX_SIZE];
+  size_t length = preferences.getBytesLength(INA_TOPOLOGY_KEY);
+  bool loaded = length > 0 && length <= sizeof(blob) &&
+                preferences.getBytes(INA_TOPOLOGY_KEY, blob, length) == length && topology.decode(blob, length);
+  preferences.end();
+  return loaded;
+}
+
+// Only when it changed: NVS is flash, and this runs on every boot that had to scan
+void inaTopologySave(const InaTopology& topology) {
+  InaTopology saved;
+  if (topology.count == 0 || (inaTopologyLoad(saved) && saved == topology)) return;
+  Preferences preferences;
+  if (!preferences.begin(INA_TOPOLOGY_NAMESPACE, false)) {
+    LOG_ERROR("Couldn't open NVS to cache the INA topology");
+    return;
+  }
+  uint8_t blob[INA_TOPOLOGY_MAX_SIZE];
+  size_t length = topology.encode(blob);
+  if (preferences.putBytes(INA_TOPOLOGY_KEY, blob, length) != length) {
+    LOG_ERROR("Couldn't cache the INA topology");
+  }
+  preferences.end();
+}
+
+// What begin() found on each bus, with the configuration registers as setup() left them. Empty if a
+// device didn't answer: better no cache than one that never matches. `settings` is the fingerprint
+// of the configuration they were given.
+void inaTopologyCapture(const std::vector<INA_Class*>& buses, uint32_t settings, InaTopology& topology) {
+  topology.clear();
+  topology.settings = settings;
+  for (uint8_t bus = 0; bus < buses.size(); bus++) {
+    INA_Class* ina = buses[bus];
+    for (uint8_t i = 0; i < ina->device_count; i++) {
+      inaEEPROM found = ina->getDeviceSettings(i);
+      InaTopologyDevice device;
+      device.bus = bus;
+      device.address = found.address;
+      device.type = found.type;
+      device.maxBusAmps = found.maxBusAmps;
+      device.microOhmR = found.microOhmR;
+      if (!ina->readRegister(INA_CONFIGURATION_REGISTER, found.address, device.config) || !topology.add(device)) {
+        topology.clear();
+        return;
+      }
+    }
+  }
+}
+
+// Takes the cached devices as they are if each still reads back its configuration: one register
+// read apiece instead of the scan, the resets and the reconfiguration. Returns how many were
+// restored, 0 if the boot has to scan.
+uint8_t inaTopologyRestore(const std::vector<INA_Class*>& buses, uint32_t settings) {
+  InaTopology topology;
+  if (!inaTopologyLoad(topology)) return 0;
+  if (topology.settings != settings) {
+    LOG_INFO("INA settings changed since they were cached, scanning");
+    return 0;
+  }
+  uint8_t matched = topology.check(settings, [&](uint8_t bus, uint8_t address, uint16_t& value) {
+    return bus < buses.size() && buses[bus]->readRegister(INA_CONFIGURATION_REGISTER, address, value);
+  });
+  if (matched < topology.count) {
+    const InaTopologyDevice& device = topology.devices[matched];
+    LOG_INFO("INA at 0x%02x on bus %u isn't as cached, scanning", device.address, device.bus);
+    return 0;
+  }
+  for (uint8_t bus = 0; bus < buses.size(); bus++) {
+    inaEEPROM devices[INA_TOPOLOGY_MAX_DEVICES];
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < topology.count; i++) {
+      const InaTopologyDevice& device = topology.devices[i];
+      if (device.bus != bus) continue;
+      inaEEPROM& restored = devices[count++];
+      restored.type = device.type;
+      restored.operatingMode = device.config & INA_CONFIG_MODE_MASK;
+      restored.address = device.address;
+      restored.maxBusAmps = device.maxBusAmps;
+      restored.microOhmR = device.microOhmR;
+    }
+    buses[bus]->restore(devices, count);
+  }
+  return topology.count;
+}
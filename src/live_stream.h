@@ -0,0 +1,156 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <LiveStream.h>
+
+#include "server.h"
+#include "logger.h"
+#include "sample_clock.h"
+
+#define LIVE_STREAM_MAX_CLIENTS 8
+
+// Messages allowed in a client's AsyncWebSocket queue before we hold frames back in our own queue
+#define LIVE_MAX_IN_FLIGHT 4
+
+struct LiveClient {
+  bool active;
+  uint32_t clientId;
+  LiveClientState state;
+};
+
+LiveClient liveClients[LIVE_STREAM_MAX_CLIENTS];
+
+// The websocket callbacks and sending run in the AsyncTCP task, publishing in loop()
+portMUX_TYPE liveStreamMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Deepest queues the sender has found since liveStreamTakeQueuePeaks(): messages waiting in one
+// client's AsyncWebSocket queue, and frames in one subscriber's own
+uint32_t liveWsQueuePeak = 0;
+uint32_t liveFrameQueuePeak = 0;
+
+// Handles a binary message from a websocket client, returns false if it wasn't a live stream message
+bool liveStreamHandleMessage(AsyncWebSocketClient *client, const uint8_t *data, size_t len) {
+  LiveSubscription subscription;
+  if (!live_parse_subscribe(data, len, SAMPLE_PERIOD_MS, subscription)) {
+    return false;
+  }
+
+  int8_t slot = -1;
+  portENTER_CRITICAL(&liveStreamMux);
+  for (uint8_t i = 0; i < LIVE_STREAM_MAX_CLIENTS; i++) {
+    if (liveClients[i].active && liveClients[i].clientId == client->id()) {
+      slot = i;
+      break;
+    }
+    if (!liveClients[i].active && slot < 0) {
+      slot = i;
+    }
+  }
+  if (slot >= 0) {
+    liveClients[slot].active = subscription.channelMask != 0;
+    liveClients[slot].clientId = client->id();
+    liveClients[slot].state = LiveClientState();
+    liveClients[slot].state.subscribe(subscription);
+  }
+  portEXIT_CRITICAL(&liveStreamMux);
+
+  if (slot < 0) {
+    LOG_WARN("Live stream: no free slot for client %u", client->id());
+    return true;
+  }
+  LOG_INFO("Live stream: client %u mask 0x%02x every %u samples", client->id(), subscription.channelMask, subscription.decimation);
+  return true;
+}
+
+void liveStreamRemoveClient(uint32_t clientId) {
+  portENTER_CRITICAL(&liveStreamMux);
+  for (LiveClient& liveClient : liveClients) {
+    if (liveClient.active && liveClient.clientId == clientId) {
+      liveClient.active = false;
+    }
+  }
+  portEXIT_CRITICAL(&liveStreamMux);
+}
+
+// Feeds one sample to every subscriber; frames are queued and sent by liveStreamPump
+void liveStreamPublish(const LiveSample& sample) {
+  portENTER_CRITICAL(&liveStreamMux);
+  for (LiveClient& liveClient : liveClients) {
+    if (liveClient.active) {
+      liveClient.state.add(sample);
+    }
+  }
+  portEXIT_CRITICAL(&liveStreamMux);
+}
+
+// Hands one client's queued frames to AsyncWebSocket, but only while it keeps up with what it
+// already has. In the AsyncTCP task, which the client belongs to.
+void liveStreamPump(AsyncWebSocketClient *client) {
+  uint32_t clientId = client->id();
+  int8_t slot = -1;
+  // Before sending, when they are deepest
+  uint32_t wsQueued = client->queueLen();
+  portENTER_CRITICAL(&liveStreamMux);
+  for (uint8_t i = 0; i < LIVE_STREAM_MAX_CLIENTS; i++) {
+    if (liveClients[i].active && liveClients[i].clientId == clientId) {
+      slot = i;
+      if (wsQueued > liveWsQueuePeak) liveWsQueuePeak = wsQueued;
+      if (liveClients[i].state.queue.count > liveFrameQueuePeak) liveFrameQueuePeak = liveClients[i].state.queue.count;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&liveStreamMux);
+  if (slot < 0) return;
+  LiveClient& liveClient = liveClients[slot];
+  uint8_t buffer[LIVE_FRAME_MAX_SIZE];
+  while (client->status() == WS_CONNECTED && !client->queueIsFull() && client->queueLen() < LIVE_MAX_IN_FLIGHT) {
+    LiveFrame frame;
+    portENTER_CRITICAL(&liveStreamMux);
+    bool hasFrame = liveClient.active && liveClient.clientId == clientId && liveClient.state.next(frame);
+    portEXIT_CRITICAL(&liveStreamMux);
+    if (!hasFrame) break;
+    size_t size = live_encode_frame(frame, buffer, sizeof(buffer));
+    client->binary(buffer, size);
+  }
+}
+
+void liveStreamTakeQueuePeaks(uint32_t& wsQueued, uint32_t& framesQueued) {
+  portENTER_CRITICAL(&liveStreamMux);
+  wsQueued = liveWsQueuePeak;
+  framesQueued = liveFrameQueuePeak;
+  liveWsQueuePeak = 0;
+  liveFrameQueuePeak = 0;
+  portEXIT_CRITICAL(&liveStreamMux);
+}
+
+/**
+ * GET /api/live/clients
+ *
+ * Per-subscriber counters: requested and current period, frames queued/sent/coalesced and how
+ * many times the client was slowed down for lagging.
+ */
+void handleLiveClientsRequest(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->print("[");
+  bool first = true;
+  for (LiveClient& liveClient : liveClients) {
+    portENTER_CRITICAL(&liveStreamMux);
+    LiveClient snapshot = liveClient;
+    portEXIT_CRITICAL(&liveStreamMux);
+    if (!snapshot.active) continue;
+    response->printf("%s\n{\"id\":%u,\"mask\":%u,\"requested_period_ms\":%u,\"period_ms\":%u,"
+                     "\"queued\":%u,\"sent\":%u,\"coalesced\":%u,\"downgrades\":%u}",
+                     first ? "" : ",", snapshot.clientId, snapshot.state.decimator.subscription.channelMask,
+                     snapshot.state.requestedDecimation * SAMPLE_PERIOD_MS, snapshot.state.decimation() * SAMPLE_PERIOD_MS,
+                     snapshot.state.queue.count, snapshot.state.framesSent, snapshot.state.framesCoalesced,
+                     snapshot.state.downgrades);
+    first = false;
+  }
+  response->print("]");
+  request->send(response);
+}
+
+void setupLiveStream() {
+  server.on("/api/live/clients", HTTP_GET, handleLiveClientsRequest);
+}
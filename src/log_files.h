@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include "FS.h"
+#include "SD.h"
+
+#include <ESPAsyncWebServer.h>
+#include <HttpRange.h>
+#include <ShuntLog.h>
+
+#include "server.h"
+#include "logger.h"
+
+// The file behind one download, open until the response is done with it
+struct LogFileDownload {
+  File file;
+  uint32_t offset;
+  uint32_t length;
+};
+
+static const char* logFileContentType(const String& path) {
+  if (path.endsWith(".csv")) return "text/csv";
+  if (path.endsWith(".txt")) return "text/plain";
+  return "application/octet-stream";
+}
+
+/**
+ * GET /<dir>/<file> for the data directories, with byte ranges and conditional requests (see
+ * HttpRange.h), so a collector can fetch just what was appended to a file since its last poll.
+ * Paths below the directory may be nested, as in /full/2023/07/23/110000.bin0.
+ */
+void handleLogFileRequest(AsyncWebServerRequest *request, const char *dir) {
+  String path = String(dir) + "/" + request->pathArg(0);
+  if (path.indexOf("..") >= 0) {
+    request->send(400);
+    return;
+  }
+  if (!SD.exists(path)) {
+    // Links to a /full file from before the layout changed lead to where it is now
+    int64_t fileStart;
+    char current[40];
+    if (strcmp(dir, "/full") == 0 && shunt_full_parse(request->pathArg(0).c_str(), fileStart) &&
+        shunt_log_path(SHUNT_LOG_FULL, fileStart, current, sizeof(current)) && path != current && SD.exists(current)) {
+      AsyncWebServerResponse *response = request->beginResponse(301);
+      response->addHeader("Location", current);
+      request->send(response);
+      return;
+    }
+    request->send(404);
+    return;
+  }
+  std::shared_ptr<LogFileDownload> download = std::make_shared<LogFileDownload>();
+  download->file = SD.open(path, FILE_READ);
+  if (!download->file || download->file.isDirectory()) {
+    request->send(404);
+    return;
+  }
+
+  HttpConditionalHeaders headers;
+  headers.range = request->hasHeader("Range") ? request->getHeader("Range")->value().c_str() : NULL;
+  headers.ifNoneMatch = request->hasHeader("If-None-Match") ? request->getHeader("If-None-Match")->value().c_str() : NULL;
+  headers.ifModifiedSince = request->hasHeader("If-Modified-Since") ? request->getHeader("If-Modified-Since")->value().c_str() : NULL;
+  headers.ifRange = request->hasHeader("If-Range") ? request->getHeader("If-Range")->value().c_str() : NULL;
+  HttpFilePlan plan;
+  http_file_plan(download->file.size(), download->file.getLastWrite(), headers, plan);
+  LOG_DEBUG("Log file %s: %d, %u bytes from %u", path.c_str(), plan.status, plan.length, plan.offset);
+
+  AsyncWebServerResponse *response;
+  if (plan.status == 304 || plan.status == 416) {
+    download->file.close();
+    response = request->beginResponse(plan.status);
+  } else {
+    download->offset = plan.offset;
+    download->length = plan.length;
+    response = request->beginResponse(logFileContentType(path), plan.length,
+      [download](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        if (index >= download->length) return 0;
+        size_t length = download->length - index;
+        if (length > maxLen) length = maxLen;
+        uint32_t position = download->offset + index;
+        if (download->file.position() != position && !download->file.seek(position)) return 0;
+        return download->file.read(buffer, length);
+      });
+    response->setCode(plan.status);
+  }
+  response->addHeader("ETag", plan.etag);
+  response->addHeader("Last-Modified", plan.lastModified);
+  response->addHeader("Accept-Ranges", "bytes");
+  // Files still being appended to change under the same URL; always revalidate
+  response->addHeader("Cache-Control", "no-cache");
+  if (plan.contentRange[0]) response->addHeader("Content-Range", plan.contentRange);
+  request->send(response);
+}
+
+void setupLogFiles() {
+  server.on("^\\/daily\\/(.+)$", HTTP_GET, [](AsyncWebServerRequest *request) { handleLogFileRequest(request, "/daily"); });
+  server.on("^\\/hourly\\/(.+)$", HTTP_GET, [](AsyncWebServerRequest *request) { handleLogFileRequest(request, "/hourly"); });
+  server.on("^\\/full\\/(.+)$", HTTP_GET, [](AsyncWebServerRequest *request) { handleLogFileRequest(request, "/full"); });
+  server.on("^\\/system\\/(.+)$", HTTP_GET, [](AsyncWebServerRequest *request) { handleLogFileRequest(request, "/system"); });
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+#include "ff.h"
+
+#include <ShuntLog.h>
+
+// FatFs drive the SD card is mounted as; SD.begin() takes the first free one
+#ifndef SD_FATFS_DRIVE
+#define SD_FATFS_DRIVE "0:"
+#endif
+
+// Counted by pace() for each open, directory read or removal
+#define SD_LOG_OP_BYTES 512
+
+// ShuntLogStorage over the SD card. One instance per request; holds at most one open file.
+class SdLogStorage : public ShuntLogStorage {
+public:
+
+  ~SdLogStorage() {
+    close();
+  }
+
+  bool open(const char* path) override {
+    close();
+    // SD.open() logs an error for missing files, and gaps in the logs are normal
+    if (!SD.exists(path)) return false;
+    file = SD.open(path, FILE_READ);
+    return (bool)file;
+  }
+
+  uint32_t size() override {
+    return file ? file.size() : 0;
+  }
+
+  size_t readAt(uint32_t offset, uint8_t* buffer, size_t length) override {
+    if (!file || !file.seek(offset)) return 0;
+    return file.read(buffer, length);
+  }
+
+  void close() override {
+    if (file) file.close();
+  }
+
+private:
+
+  File file;
+};
+
+// ShuntLogFiles over the SD card. The file being appended to stays open until another call or
+// finish(). Subclasses can hold each operation back with pace().
+class SdLogFiles : public ShuntLogFiles {
+public:
+
+  virtual ~SdLogFiles() {
+    finish();
+  }
+
+  bool append(const char* path, const uint8_t* data, size_t length) override {
+    if (!out || outPath != path) {
+      finish();
+      pace(SD_LOG_OP_BYTES);
+      // Creates the directories too
+      out = SD.open(path, FILE_APPEND, true);
+      if (!out) return false;
+      outPath = path;
+    }
+    pace(length);
+    return out.write(data, length) == length;
+  }
+
+  bool remove(const char* path) override {
+    finish();
+    pace(SD_LOG_OP_BYTES);
+    // SD.remove() logs an error for missing files
+    return !SD.exists(path) || SD.remove(path);
+  }
+
+  // FAT has no rename over an existing file. A reset between the two leaves only `from`, which the
+  // next rewrite of the file starts over.
+  bool replace(const char* from, const char* to) override {
+    finish();
+    pace(SD_LOG_OP_BYTES);
+    if (SD.exists(to) && !SD.remove(to)) return false;
+    return SD.rename(from, to);
+  }
+
+  bool removeDir(const char* path) override {
+    pace(SD_LOG_OP_BYTES);
+    // FatFs refuses to remove a directory that isn't empty
+    return SD.rmdir(path);
+  }
+
+  bool first(const char* dir, char* name, size_t capacity, bool& isDir) override {
+    return edge(dir, name, capacity, isDir, false);
+  }
+
+  bool last(const char* dir, char* name, size_t capacity, bool& isDir) override {
+    return edge(dir, name, capacity, isDir, true);
+  }
+
+  // The SD library can't shorten a file; FatFs can
+  bool truncate(const char* path, uint32_t size) override {
+    finish();
+    pace(SD_LOG_OP_BYTES);
+    String fatPath = String(SD_FATFS_DRIVE) + path;
+    FIL fil;
+    if (f_open(&fil, fatPath.c_str(), FA_WRITE) != FR_OK) return false;
+    bool ok = f_lseek(&fil, size) == FR_OK && f_truncate(&fil) == FR_OK;
+    return f_close(&fil) == FR_OK && ok;
+  }
+
+  // FatFs counts the free clusters once after mounting (the whole FAT, slow on a big card) and
+  // keeps track after that
+  uint64_t freeBytes() override {
+    return SD.totalBytes() - SD.usedBytes();
+  }
+
+  void finish() override {
+    if (out) out.close();
+    outPath = "";
+  }
+
+protected:
+
+  virtual void pace(size_t bytes) {}
+
+private:
+
+  File out;
+  String outPath;
+  FF_DIR fatDir;
+  FILINFO info;
+
+  // The entry with the smallest or largest name, reading the directory with FatFs for the names alone
+  bool edge(const char* dir, char* name, size_t capacity, bool& isDir, bool largest) {
+    pace(SD_LOG_OP_BYTES);
+    String fatPath = String(SD_FATFS_DRIVE) + dir;
+    if (f_opendir(&fatDir, fatPath.c_str()) != FR_OK) return false;
+    bool found = false;
+    uint32_t entries = 0;
+    while (f_readdir(&fatDir, &info) == FR_OK && info.fname[0] != 0) {
+      // A sector of entries at a time
+      if (++entries % 16 == 0) pace(SD_LOG_OP_BYTES);
+      if (info.fname[0] == '.' || strlen(info.fname) >= capacity) continue;
+      int order = found ? strcmp(info.fname, name) : 0;
+      if (!found || (largest ? order > 0 : order < 0)) {
+        strcpy(name, info.fname);
+        isDir = info.fattrib & AM_DIR;
+        found = true;
+      }
+    }
+    f_closedir(&fatDir);
+    return found;
+  }
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <esp_timer.h>
+
+#include <LogRing.h>
+#include "server.h"
+
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above this level are compiled out entirely, e.g. -DSHUNT_LOG_LEVEL=4 to get debug output
+#ifndef SHUNT_LOG_LEVEL
+#define SHUNT_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Records kept in RAM; this is also the history served by /api/log
+#ifndef LOG_RING_CAPACITY
+#define LOG_RING_CAPACITY 128
+#endif
+
+// How often the drain task wakes up to push new records to Serial
+#define LOG_DRAIN_INTERVAL_MS 20
+
+// Websocket clients sent the log, each from its own place in the ring
+#define LOG_WS_MAX_CLIENTS 8
+
+// Messages allowed in a client's AsyncWebSocket queue before the log waits for it to catch up
+#define LOG_WS_MAX_IN_FLIGHT 8
+
+#if SHUNT_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+#if SHUNT_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+#if SHUNT_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+#if SHUNT_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+LogRing<LOG_RING_CAPACITY> logRing;
+
+const char* log_level_name(uint8_t level) {
+  switch (level) {
+    case LOG_LEVEL_ERROR: return "ERROR";
+    case LOG_LEVEL_WARN: return "WARN";
+    case LOG_LEVEL_INFO: return "INFO";
+    default: return "DEBUG";
+  }
+}
+
+// Formats into a stack buffer and copies (escaped) into the ring; Serial is written from the drain
+// task and websocket clients from their own callbacks (logStreamPump)
+void log_write(uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void log_write(uint8_t level, const char *format, ...) {
+  char buffer[LOG_RING_MESSAGE_SIZE];
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length < 0) return;
+  if (length >= (int)sizeof(buffer)) length = sizeof(buffer) - 1;
+
+  logRing.write(level, esp_timer_get_time(), buffer, length);
+}
+
+// Builds the websocket/Serial JSON line for one record, returns its length
+size_t log_format_json(const LogRecord& record, char* out, size_t outSize) {
+  int length = snprintf(out, outSize, "{\"type\":\"LOG_MESSAGE\",\"level\":\"%s\",\"message\":\"%.*s\"}",
+                        log_level_name(record.level), record.length, record.message);
+  if (length < 0) return 0;
+  return (size_t)length < outSize ? length : outSize - 1;
+}
+
+size_t log_format_dropped(uint32_t dropped, char* out, size_t outSize) {
+  int length = snprintf(out, outSize, "{\"type\":\"LOG_MESSAGE\",\"level\":\"WARN\",\"message\":\"%u log messages dropped\"}",
+                        dropped);
+  if (length < 0) return 0;
+  return (size_t)length < outSize ? length : outSize - 1;
+}
+
+struct LogWsClient {
+  bool active;
+  uint32_t clientId;
+  uint32_t cursor;  // Next record to send it
+};
+
+// Only touched from the websocket callbacks, all in the AsyncTCP task
+LogWsClient logWsClients[LOG_WS_MAX_CLIENTS];
+
+// From now on the client is sent each new record
+void logAddClient(uint32_t clientId) {
+  for (LogWsClient& logClient : logWsClients) {
+    if (!logClient.active) {
+      logClient.active = true;
+      logClient.clientId = clientId;
+      logClient.cursor = logRing.head();
+      return;
+    }
+  }
+  LOG_WARN("Log: no free slot for websocket client %u", clientId);
+}
+
+void logRemoveClient(uint32_t clientId) {
+  for (LogWsClient& logClient : logWsClients) {
+    if (logClient.active && logClient.clientId == clientId) logClient.active = false;
+  }
+}
+
+// Sends one client what it hasn't had while its queue has room. A client that can't keep up isn't
+// queued more: it falls behind in the ring and is told how many records it missed. In the AsyncTCP
+// task, which the client belongs to.
+void logStreamPump(AsyncWebSocketClient *client) {
+  static char json[LOG_RING_MESSAGE_SIZE + 64];
+  LogWsClient *logClient = NULL;
+  for (LogWsClient& slot : logWsClients) {
+    if (slot.active && slot.clientId == client->id()) logClient = &slot;
+  }
+  if (logClient == NULL) return;
+  LogRecord record;
+  uint32_t dropped = 0;
+  while (client->status() == WS_CONNECTED && !client->queueIsFull() && client->queueLen() < LOG_WS_MAX_IN_FLIGHT
+         && logRing.read(logClient->cursor, record, &dropped)) {
+    if (dropped > 0) {
+      client->text(json, log_format_dropped(dropped, json, sizeof(json)));
+      dropped = 0;
+      if (client->queueIsFull() || client->queueLen() >= LOG_WS_MAX_IN_FLIGHT) {
+        // The record goes next time
+        logClient->cursor = record.seq;
+        return;
+      }
+    }
+    client->text(json, log_format_json(record, json, sizeof(json)));
+  }
+}
+
+void logDrainTask(void* parameter) {
+  static char json[LOG_RING_MESSAGE_SIZE + 64];
+  uint32_t cursor = logRing.oldest();
+  LogRecord record;
+  while (true) {
+    uint32_t dropped = 0;
+    while (logRing.read(cursor, record, &dropped)) {
+      if (dropped > 0) {
+        Serial.write((const uint8_t*)json, log_format_dropped(dropped, json, sizeof(json)));
+        Serial.write('\n');
+        dropped = 0;
+      }
+      size_t length = log_format_json(record, json, sizeof(json));
+      Serial.write((const uint8_t*)json, length);
+      Serial.write('\n');
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+  }
+}
+
+void logger_setup() {
+  xTaskCreatePinnedToCore(logDrainTask, "log_drain", 4096, NULL, 1, NULL, 0);
+}
@@ -23,8 +23,12 @@
 #include <cstring>
 
 #include "functions.h"
-#include <ESP32Time.h>
 #include <SimpleStats.h>
+#include <FixedPoint.h>
+#include <ShuntLog.h>
+#include <ShuntIndex.h>
+#include <ShuntRecovery.h>
+#include <ShuntTimeFormat.h>
 
 #include <ESPmDNS.h>
 #include <WiFiUdp.h>
@@ -33,7 +37,13 @@
 #include "sd_functions.h"
 
 #include "ArduinoJson.h"
+#include "logger.h"
 #include "site.h"
+#include "retention.h"
+#include "boot.h"
+#include "ina_topology.h"
+#include "ina_health.h"
+#include "alloc_count.h"
 
 #include "shunt_version.h"
 
@@ -45,6 +55,8 @@ const uint32_t SERIAL_SPEED{115200}; ///< Use fast serial speed
 const uint32_t SHUNT_MICRO_OHM{100}; ///< Shunt resistance in Micro-Ohm, e.g. 100000 is 0.1 Ohm
 
 const uint16_t MAXIMUM_AMPS{1}; ///< Max expected amps, clamped from 1A to a max of 1022A
+const uint32_t INA_CONVERSION_US{8500}; ///< Bus and shunt conversion time, rounded to the 8.244ms step
+const uint16_t INA_AVERAGING{16};       ///< Conversions averaged into each reading
 uint8_t devicesFound{0};        ///< Number of INAs found
 INA_Class* ina_a;                  ///< INA class instantiation to use EEPROM
 INA_Class* ina_b;                  ///< INA class instantiation to use EEPROM
@@ -64,14 +76,12 @@ TwoWire* wire_b;
 #define WIRE_B_SDA 21
 #define WIRE_B_SCL 22
 
+// Raw register -> uV/nV/uA/uW multipliers, precomputed from the shunt resistance
+const ShuntScale shuntScale(SHUNT_MICRO_OHM);
 
-// 2.5 uV per LSB
-#define SHUNT_VOLTS_PER_LSB 0.0000025
+// Timestamps and paths for setup() and loop()
+ShuntTimeFormat timeFormat;
 
-// 1.25 mV per LSB
-#define BUS_VOLTS_PER_LSB 0.00125
-
-ESP32Time esp32rtc;
 // Replace with your network credentials
 const char* ssid = "blah";
 const char* password = "blahblah";
@@ -85,12 +95,36 @@ const char* ap_ssid = "CurrentShunt";
 const char* ap_password = "yellowwhitered";
 
 File log_file;
+// The day's minute rollups, kept open from one minute to the next: opening a file allocates
+File daily_file;
+int64_t dailyFileStart = 0;
+// Directory of the /full file being written, whose listing changes with every rollover
+char fullLogDir[40];
+
+// Index of the /full file being written, saved to /index when it is rotated
+ShuntIndexBuilder fullIndex;
+const uint32_t FULL_RECORD_SIZE = shunt_log_record_size(SHUNT_LOG_FULL, SHUNT_LOG_TIMESTAMP_MICROS);
+
+// A full-rate record's timestamp: the second and the µs into it the shunts were read
+struct __attribute__((packed)) SampleTimestamp {
+  int64_t seconds;
+  uint32_t micros;
+};
+
+// FatFs puts a file's new size in its directory entry only on a flush or close, so this is how many
+// seconds of full-rate records a power cut can lose
+#define LOG_FLUSH_SECONDS 10
 
 struct ShuntStats {
     SimpleStats busVoltageStats;
     SimpleStats shuntVoltageStats;
+    // Minutes folded in since the last hourly rollup
+    SimpleStats hourlyBusVoltageStats;
+    SimpleStats hourlyShuntVoltageStats;
+    // SHUNT_LOG_MISSING_SHUNT and SHUNT_LOG_MISSING_BUS when the last read got nothing
     int32_t lastShuntRawVoltage;
     uint32_t lastBusRawVoltage;
+    ShuntReading lastReading;
 };
 
 ShuntStats shuntStatsArray[5];
@@ -109,85 +143,106 @@ void initSoftAP() {
     Serial.println(WiFi.softAPIP());
 }
 
-void initWiFi() {
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  Serial.print("Connecting to WiFi ..");
-  while (WiFi.status() != WL_CONNECTED) {
-    Serial.print('.');
-    delay(1000);
-  }
-  Serial.println(WiFi.localIP());
+// How long setup() waits between attempts at what logging can't start without, the SD card
+#define BOOT_RETRY_MS 1000
+
+// Conversion times, averaging and mode, for one device or UINT8_MAX for all of them on the bus
+void configureINA(INA_Class* ina, uint8_t deviceNumber) {
+  ina->setBusConversion(INA_CONVERSION_US, deviceNumber);   // Maximum conversion time 8.244ms
+  ina->setShuntConversion(INA_CONVERSION_US, deviceNumber); // Maximum conversion time 8.244ms
+  ina->setAveraging(INA_AVERAGING, deviceNumber);           // Average each reading n-times
+  ina->setMode(INA_MODE_CONTINUOUS_BOTH, deviceNumber);     // Bus/shunt measured continuously
 }
 
-void ina_setup() {
+// One pass over both buses; returns how many INAs were found. A bus with nothing on it is left out
+// rather than waited for: the INA watcher (ina_health.h) picks up devices attached later. After a
+// reset that left the INAs powered they are taken from the cache in NVS with one read each; a full
+// scan only when they don't match it, and what it finds is cached.
+uint8_t ina_setup() {
 
   ina_a = new INA_Class(0, WIRE_A_SDA, WIRE_A_SCL, 0);
   ina_b = new INA_Class(0, WIRE_B_SDA, WIRE_B_SCL, 1);
   inaVector = {ina_a, ina_b};
   // inaVector = {ina_a};
 
+  // Everything the devices are configured from below, so a cache from other settings isn't used
+  const uint32_t settingsValues[] = {MAXIMUM_AMPS, SHUNT_MICRO_OHM, INA_CONVERSION_US, INA_AVERAGING,
+                                     INA_MODE_CONTINUOUS_BOTH};
+  uint32_t settings = ina_topology_fingerprint(settingsValues, 5);
+  devicesFound = inaTopologyRestore(inaVector, settings);
+  if (devicesFound > 0) {
+    LOG_INFO("%u INAs as cached, scan skipped", devicesFound);
+    return devicesFound;
+  }
+
   Serial.print("\n\nDisplay INA Readings V1.0.8\n");
   Serial.print(" - Searching & Initializing INA devices\n");
+  devicesFound = 0;
   for (INA_Class* ina : inaVector) {
     Serial.print("   - Begin\n");
-    devicesFound = ina->begin(MAXIMUM_AMPS, SHUNT_MICRO_OHM); // Expected max Amp & shunt resistance
-    while (devicesFound == 0)
-    {
-      Serial.println(F("No INA device found, retrying in 10 seconds..."));
-      delay(10000);                                            // Wait 10 seconds before retrying
-      devicesFound = ina->begin(MAXIMUM_AMPS, SHUNT_MICRO_OHM); // Expected max Amp & shunt resistance
-    }                                                          // while no devices detected
+    uint8_t found = ina->begin(MAXIMUM_AMPS, SHUNT_MICRO_OHM); // Expected max Amp & shunt resistance
+    if (found == 0) {
+      LOG_WARN("No INA devices on the bus %s", ina == ina_a ? "A" : "B");
+      continue;
+    }
+    devicesFound += found;
     Serial.print(F(" - Detected "));
-    Serial.print(devicesFound);
+    Serial.print(found);
     Serial.println(F(" INA devices on the I2C bus"));
-    ina->setBusConversion(8500);            // Maximum conversion time 8.244ms
-    ina->setShuntConversion(8500);          // Maximum conversion time 8.244ms
-    ina->setAveraging(16);                  // Average each reading n-times
-    ina->setMode(INA_MODE_CONTINUOUS_BOTH); // Bus/shunt measured continuously
+    configureINA(ina, UINT8_MAX);
   }
 
   Serial.print(F("Lp   Nr AdrPin Type   Bus         Shunt       Bus         Bus\n"));
   Serial.print(F("==== == ====== ====== =========== =========== =========== ===========\n"));
 
+  InaTopology topology;
+  inaTopologyCapture(inaVector, settings, topology);
+  inaTopologySave(topology);
+  return devicesFound;
 }
 
-void initOTA() {
-
-  ArduinoOTA
-    .onStart([]() {
-      dual_log("Starting OTA update");
-      // Print EOF character to close connections
-      char eof_msg[2] = {0x04, 0};
-      ws.printfAll(eof_msg);
-      ws.closeAll();
-      String type;
-      if (ArduinoOTA.getCommand() == U_FLASH)
-        type = "sketch";
-      else // U_SPIFFS
-        type = "filesystem";
-
-      // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
-      Serial.println("Start updating " + type);
-    })
-    .onEnd([]() {
-      Serial.println("\nEnd");
-    })
-    .onProgress([](unsigned int progress, unsigned int total) {
-      Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
-    })
-    .onError([](ota_error_t error) {
-      Serial.printf("Error[%u]: ", error);
-      if (error == OTA_AUTH_ERROR) Serial.println("Auth Failed");
-      else if (error == OTA_BEGIN_ERROR) Serial.println("Begin Failed");
-      else if (error == OTA_CONNECT_ERROR) Serial.println("Connect Failed");
-      else if (error == OTA_RECEIVE_ERROR) Serial.println("Receive Failed");
-      else if (error == OTA_END_ERROR) Serial.println("End Failed");
-    });
-
-  ArduinoOTA.begin();
+
+// Starts `stats` from what recovery found of the interval the boot is in; each rollup the builder
+// took in stands for `weight` samples
+void seedStats(SimpleStats& stats, const ShuntRollupBuilder& carry, uint8_t ch, bool shunt, uint32_t weight) {
+  uint32_t added;
+  int64_t sum, min, max;
+  carry.totals(ch, shunt, added, sum, min, max);
+  if (added == 0) return;
+  stats.sum = sum * weight;
+  stats.count = added * weight;
+  stats.min = min;
+  stats.max = max;
 }
 
+// Cuts what a power cut tore off the newest files and writes the rollups, index and manifest entry
+// the logger would have written at its next rollover (see ShuntRecovery.h). Runs before the first
+// file is opened.
+void recoverLogs() {
+  SdLogStorage source;
+  SdLogStorage target;
+  SdLogFiles files;
+  // About 6 KB, only needed once
+  ShuntRecovery* recovery = new ShuntRecovery(source, target, files);
+  recovery->run(wallClockSeconds());
+  const ShuntRecoveryStats& stats = recovery->stats;
+  if (stats.filesTruncated + stats.filesRemoved + stats.minutesRebuilt + stats.hoursRebuilt + stats.indexesRebuilt > 0) {
+    LOG_INFO("Recovery: %u files cut back by %u B, %u empty removed, %u minute and %u hour rollups and %u indexes rebuilt",
+             stats.filesTruncated, stats.bytesTruncated, stats.filesRemoved, stats.minutesRebuilt, stats.hoursRebuilt,
+             stats.indexesRebuilt);
+  }
+  if (stats.errors > 0) {
+    LOG_ERROR("Recovery: %u files couldn't be fixed", stats.errors);
+  }
+  // Minutes went into the hour as ~60 samples each
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    seedStats(shuntStatsArray[ch].busVoltageStats, recovery->minuteCarry, ch, false, 1);
+    seedStats(shuntStatsArray[ch].shuntVoltageStats, recovery->minuteCarry, ch, true, 1);
+    seedStats(shuntStatsArray[ch].hourlyBusVoltageStats, recovery->hourCarry, ch, false, 60);
+    seedStats(shuntStatsArray[ch].hourlyShuntVoltageStats, recovery->hourCarry, ch, true, 60);
+  }
+  delete recovery;
+}
 
 /**
  * @brief SETUP
@@ -196,15 +251,18 @@ void initOTA() {
 void setup()
 {
   Serial.begin(SERIAL_SPEED);
+  logger_setup();
+  bootTimeline.begin(millis());
+
+  // Wi-Fi, OTA and the web server come up in the background from here; nothing below waits for them
+  startNetwork(ssid, password);
 
   // SD Card Setup
+  bootTimeline.stage("sd", millis());
   Serial.println("Initializing SD card...");
-  int sd_mounted = sd_setup();
-  while(sd_mounted != 0) {
-    Serial.println("FAILED: Waiting 10 seconds...");
-    delay(10000);
-    Serial.println("Reinitializing SD card...");
-    sd_mounted = sd_setup();
+  while (sd_setup() != 0) {
+    LOG_ERROR("SD card mount failed, retrying");
+    delay(BOOT_RETRY_MS);
   }
 
   // Set up directory structure (if the dirs do not exist)
@@ -216,14 +274,25 @@ void setup()
   if (!SD.exists("/full")) {
     SD.mkdir("/full");
   }
-
-  // Connect to a wifi hotspot
-  initWiFi();
+  // Add "/hourly"
+  if (!SD.exists("/hourly")) {
+    SD.mkdir("/hourly");
+  }
+  // Add "/system"
+  if (!SD.exists("/system")) {
+    SD.mkdir("/system");
+  }
+  // Add "/index/full"
+  if (!SD.exists("/index/full")) {
+    SD.mkdir("/index");
+    SD.mkdir("/index/full");
+  }
 
   // // Host an Access Point
   // initSoftAP();
 
   // DS3231 Setup
+  bootTimeline.stage("rtc", millis());
   Serial.println("Initializing DS3231...");
   Wire.begin(WIRE_A_SDA, WIRE_A_SCL, INA_I2C_STANDARD_MODE);
   // rtc.begin();
@@ -232,246 +301,353 @@ void setup()
   // // Set the initial date and time
   // rtc.setTimeDate(2023, 7, 13, 1, 18, 0);
 
+  // The RTC ticks its seconds out on SQW; read just after a tick, it gives the time to the
+  // microsecond rather than the second, and the ticks keep the sample clock on it from then on
+  rtc.enableSquareWave1Hz();
+  int64_t edge = sampleClockAwaitEdge();
+
   // The the date and time at startup to set the internal ESP32 RTC
   uint8_t second, minute, hour, dayOfWeek, dayOfMonth, month;
   uint16_t year;
   rtc.getTimeDate(&year, &month, &dayOfMonth, &hour, &minute, &second, &dayOfWeek);
-  // Initialize the internal ESP32 RTC
-  esp32rtc.setTime(second,minute, hour, dayOfMonth, month, year);
-  Serial.println("Time set to: " + esp32rtc.getTime("%Y-%m-%dT%H:%M:%S"));
+  // Sets the system clock and the sample clock's model from it
+  sampleClockSetTime(shunt_log_unix(year, month, dayOfMonth, hour, minute, second), edge);
+  char iso[24];
+  timeFormat.iso(wallClockSeconds(), iso, sizeof(iso));
+  Serial.printf("Time set to: %s\n", iso);
 
+  // Tidy up after a power cut, now that the clock is right
+  bootTimeline.stage("recovery", millis());
+  recoverLogs();
 
   // INA226 Setup
+  bootTimeline.stage("ina", millis());
   Serial.println("Initializing INA226...");
-  ina_setup();
+  if (ina_setup() == 0) {
+    LOG_ERROR("No INA devices found, logging the shunts as missing until one is attached");
+  }
+  startInaWatch(inaVector, MAXIMUM_AMPS, SHUNT_MICRO_OHM, configureINA);
 
-  // Website
+  // Website: the handlers only, the network task starts the server once it has an address
+  bootTimeline.stage("web", millis());
   setupWebHandlers();
 
-  // Over The Air Updates
-  initOTA();
+  // Ages out old logs in the background
+  setupRetention();
+  // Heap, stacks and queues, every few seconds in the background
+  startSystemStats();
 
   // Record start time
   log_file = SD.open("/log.txt", FILE_WRITE);
-  String logMessage = "Started at: " + rtc.getTimestamp();
-  log_file.println(logMessage);
-  log_file.println(WiFi.localIP());
+  timeFormat.iso(wallClockSeconds(), iso, sizeof(iso));
+  log_file.printf("Started at: %s\n", iso);
+
+  // Last, so the first tick doesn't find setup() still running: wakes loop() for each sample
+  setupSampleClock();
+  reportBoot();
 }
 
 
 
 
 
-String getINAMeasurements(INA_Class* ina, uint8_t deviceIndex, ShuntStats* stats) {
+// Reads one shunt into its stats' last values; a shunt that couldn't be read is marked missing
+// rather than left at its last reading. Returns whether it was read.
+bool getINAMeasurements(uint8_t ch, ShuntStats* stats) {
+
+  int32_t shuntRawVoltage;
+  uint32_t busRawVoltage;
+  if (!inaRead(ch, busRawVoltage, shuntRawVoltage)) {
+    stats->lastBusRawVoltage = SHUNT_LOG_MISSING_BUS;
+    stats->lastShuntRawVoltage = SHUNT_LOG_MISSING_SHUNT;
+    stats->lastReading = ShuntReading();
+    return false;
+  }
+  shuntScale.convert(busRawVoltage, shuntRawVoltage, stats->lastReading);
 
-  static char sprintfBuffer[100];                                       // Buffer to format output
-  static char busChar[20], shuntChar[20], busMAChar[20], busMWChar[20]; // Output buffers
-  int32_t shuntRawVoltage = ina->getShuntRaw(deviceIndex);
-  uint32_t busRawVoltage = ina->getBusRaw(deviceIndex);
-  float shuntVolts = SHUNT_VOLTS_PER_LSB * shuntRawVoltage;
-  float busVolts = BUS_VOLTS_PER_LSB * busRawVoltage;
-  float busAmps = shuntVolts * 10000.0;
-  float busWatts = busAmps * busVolts;
-  sprintf(sprintfBuffer, "%f,%f,%f,%f,", busVolts, shuntVolts, busAmps, busWatts);
-  
-  stats->busVoltageStats.add_measurement(busRawVoltage);
-  stats->shuntVoltageStats.add_measurement(shuntRawVoltage);
   stats->lastBusRawVoltage = busRawVoltage;
   stats->lastShuntRawVoltage = shuntRawVoltage;
-
-  String buffer = sprintfBuffer;
-  return buffer;
+  return true;
 }
 
-
-void getSimpleINAMeasurements(INA_Class* ina, uint8_t deviceIndex, ShuntStats& stats) {
-
-  int32_t shuntRawVoltage = ina->getShuntRaw(deviceIndex);
-  uint32_t busRawVoltage = ina->getBusRaw(deviceIndex);
-  stats.busVoltageStats.add_measurement(busRawVoltage);
-  stats.shuntVoltageStats.add_measurement(shuntRawVoltage);
-  stats.lastBusRawVoltage = busRawVoltage;
-  stats.lastShuntRawVoltage = shuntRawVoltage;
-}
-
-String getINAMeasurementsForCSV(INA_Class* ina, uint8_t deviceIndex) {
-
-  static char sprintfBuffer[100];                                       // Buffer to format output
-  static char busChar[20], shuntChar[20], busMAChar[20], busMWChar[20]; // Output buffers
-  int32_t shuntRawVoltage = ina->getShuntRaw(deviceIndex);
-  uint32_t busRawVoltage = ina->getBusRaw(deviceIndex);
-  float shuntVolts = SHUNT_VOLTS_PER_LSB * shuntRawVoltage;
-  float busVolts = BUS_VOLTS_PER_LSB * busRawVoltage;
-  float busAmps = shuntVolts * 10000.0;
-  float busWatts = busAmps * busVolts;
-  sprintf(sprintfBuffer, "%f,%f,%f,%f,", busVolts, shuntVolts, busAmps, busWatts);
-  return String(sprintfBuffer);
+// Formats "busVolts,shuntVolts,busAmps,busWatts," into the caller's buffer for the debug log, returns
+// the length
+size_t formatINAMeasurementsForCSV(const ShuntReading& reading, char* buffer, size_t bufferSize) {
+  FixedWriter writer(buffer, bufferSize);
+  writer.appendFixed(reading.busMicroVolts, 6);
+  writer.append(',');
+  writer.appendFixed(reading.shuntNanoVolts, 9);
+  writer.append(',');
+  writer.appendFixed(reading.microAmps, 6);
+  writer.append(',');
+  writer.appendFixed(reading.microWatts, 6);
+  writer.append(',');
+  return writer.length;
 }
 
-void showINAMeasurements()
+// Reads every shunt into its stats' last values, returns how many were read. `readMicros` is the
+// wall time halfway through the reads.
+int showINAMeasurements(int64_t& readMicros)
 {
-  int statsIdx = 0;
-  for (INA_Class* ina : inaVector) {
-    for (uint8_t i = 0; i < ina->device_count; i++) // Loop through all devices
-    {
-      dual_log("showedINAMeasurements: stats: %u", statsIdx);
-
-      // getINAMeasurementsForCSV(ina, i);
-      String buffer = getINAMeasurements(ina, i, &shuntStatsArray[statsIdx]);
-      // dual_log("%u: %s", statsIdx, buffer.c_str());
-      statsIdx++;
-    } 
+  int64_t start = esp_timer_get_time();
+  int read = 0;
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    if (getINAMeasurements(ch, &shuntStatsArray[ch])) read++;
   }
+  readMicros = wallClockAt(start + (esp_timer_get_time() - start) / 2);
+  return read;
 }
 
-void showTime() {
-  Serial.println(rtc.getTimestamp());
-}
-
-String getESP32RTCFSSafeTimestamp() {
-  return esp32rtc.getTime("%Y%m%dT%H%M%S");
+// Adds the last values read to the minute's stats, after any rollover has started a new minute. A
+// missing shunt adds nothing; a minute without any of its samples is written empty, min > max.
+void addINAMeasurements() {
+  for (ShuntStats& stats : shuntStatsArray) {
+    if (stats.lastBusRawVoltage == SHUNT_LOG_MISSING_BUS) continue;
+    stats.busVoltageStats.add_measurement(stats.lastBusRawVoltage);
+    stats.shuntVoltageStats.add_measurement(stats.lastShuntRawVoltage);
+  }
 }
 
-String getESP32RTCFSSafeDatestamp() {
-  return esp32rtc.getTime("%Y%m%d");
-}
+// CRC-32C of the record written so far
+uint32_t recordCrc = 0;
 
-String getESP32RTCISO8601Timestamp() {
-  return esp32rtc.getTime("%Y-%m-%dT%H:%M:%S");
+template<typename T>
+void writeWithSize(File& file, const T& value) {
+    // i32 0, u16 size, value, i32 0, in one write
+    uint8_t field[SHUNT_LOG_FIELD_OVERHEAD + sizeof(T)] = {0};
+    field[4] = sizeof(T);
+    memcpy(field + 6, &value, sizeof(T));
+    file.write(field, sizeof(field));
+    recordCrc = shunt_crc32c(field, sizeof(field), recordCrc);
 }
 
-int32_t remainingMillisThisSecond() {
-  struct timeval tv_now;
-  gettimeofday(&tv_now, NULL);
-  return ((1000000 - tv_now.tv_usec) / 1000) + 1;
+// Ends a record with its CRC and the sync marker (see ShuntLog.h)
+void writeRecordCheck(File& file) {
+  uint64_t check = shunt_log_check(recordCrc);
+  writeWithSize(file, check);
 }
 
-// Calculate a checksum
-uint64_t checksum = 0;
-
-template<typename T>
-void writeWithSize(const T& value) {
-    uint16_t size = sizeof(value);
-    int32_t zero = 0;
-    log_file.write((uint8_t*)&zero, sizeof(zero));
-    log_file.write((uint8_t*)&size, sizeof(size));
-    log_file.write((uint8_t*)&value, sizeof(value));
-    log_file.write((uint8_t*)&zero, sizeof(zero));
-    checksum += value;
+// Writes min, mean and max of a set of stats
+void writeAggregation(File& file, const SimpleStats& stats) {
+  writeWithSize(file, stats.min);
+  writeWithSize(file, stats.get_mean());
+  writeWithSize(file, stats.max);
 }
 
-void appendAggregationsToDailyFile() {
-  log_file.close();
-  String timestampedLogFilePath = "/daily/" + getESP32RTCFSSafeDatestamp() + ".bin0";
+// Keeps daily_file on the day holding `timestamp`; returns true if it had to open it
+bool openDailyFile(time_t timestamp) {
+  int64_t fileStart = shunt_log_file_start(SHUNT_LOG_MINUTE, timestamp);
+  if (daily_file && fileStart == dailyFileStart) return false;
+  daily_file.close();
+  char timestampedLogFilePath[40];
+  timeFormat.path(SHUNT_LOG_MINUTE, timestamp, timestampedLogFilePath, sizeof(timestampedLogFilePath));
   Serial.print("Daily log file path: ");
   Serial.println(timestampedLogFilePath);
-  log_file = SD.open(timestampedLogFilePath, FILE_APPEND);
+  daily_file = SD.open(timestampedLogFilePath, FILE_APPEND);
+  if (!daily_file) {
+    LOG_ERROR("Failed to open %s", timestampedLogFilePath);
+  }
+  dailyFileStart = fileStart;
+  return true;
+}
+
+// `timestamp` is the first sample of the next minute, so the rollup is stamped with the end of its own.
+// Returns true if it opened the day's file.
+bool appendAggregationsToDailyFile(time_t timestamp) {
+  bool opened = openDailyFile(timestamp);
   
-  // Reset the checksum
-  checksum = 0;
-  // Write the current timestamp
-  struct timeval tv_now;
-  gettimeofday(&tv_now, NULL);
-  writeWithSize(tv_now.tv_sec);
+  // Start a new record
+  recordCrc = 0;
+  // Write the timestamp, whole seconds at 8 bytes whatever the toolchain's time_t
+  writeWithSize(daily_file, (int64_t)timestamp);
   // Write the average voltages from the stats for each shunt
 
   // Loop through each shunt stats
   for (ShuntStats& stats : shuntStatsArray) {
     // Write the bus voltage stats
-    writeWithSize(stats.busVoltageStats.min);
-    writeWithSize(stats.busVoltageStats.get_mean());
-    writeWithSize(stats.busVoltageStats.max);
+    writeAggregation(daily_file, stats.busVoltageStats);
     // Write the shunt voltage stats
-    writeWithSize(stats.shuntVoltageStats.min);
-    writeWithSize(stats.shuntVoltageStats.get_mean());
-    writeWithSize(stats.shuntVoltageStats.max);
-    // Reset the stats
+    writeAggregation(daily_file, stats.shuntVoltageStats);
+    // Carry the minute into the hour, then reset the stats
+    stats.hourlyBusVoltageStats.merge(stats.busVoltageStats);
+    stats.hourlyShuntVoltageStats.merge(stats.shuntVoltageStats);
     stats.busVoltageStats.reset();
     stats.shuntVoltageStats.reset();
   }
 
-  // Write the checksum
-  writeWithSize(checksum);
+  // Write the CRC and sync marker
+  writeRecordCheck(daily_file);
+  // The file stays open, so this is what puts the record on the card
+  daily_file.flush();
+  listingChanged("/daily");
+  return opened;
 }
 
-void openNewLogFile() {
+// Same record layout as the daily file, one per hour, so long-range queries read 60x less. Opened
+// for each record: once an hour doesn't earn a file handle of its own.
+void appendAggregationsToHourlyFile(time_t timestamp) {
+  char timestampedLogFilePath[40];
+  timeFormat.path(SHUNT_LOG_HOUR, timestamp, timestampedLogFilePath, sizeof(timestampedLogFilePath));
+  LOG_INFO("Hourly log file path: %s", timestampedLogFilePath);
+  File hourly_file = SD.open(timestampedLogFilePath, FILE_APPEND);
+  listingChanged("/hourly");
+
+  recordCrc = 0;
+  writeWithSize(hourly_file, (int64_t)timestamp);
+  for (ShuntStats& stats : shuntStatsArray) {
+    writeAggregation(hourly_file, stats.hourlyBusVoltageStats);
+    writeAggregation(hourly_file, stats.hourlyShuntVoltageStats);
+    stats.hourlyBusVoltageStats.reset();
+    stats.hourlyShuntVoltageStats.reset();
+  }
+  writeRecordCheck(hourly_file);
+  hourly_file.close();
+}
+
+// Writes the sparse index of the /full file just finished and adds it to the manifest
+void writeFullIndex() {
+  uint8_t buffer[SHUNT_INDEX_MAX_ENTRIES * SHUNT_INDEX_ENTRY_SIZE];
+  char path[40];
+  shunt_index_path(fullIndex.manifest.fileStart, path, sizeof(path));
+  File index_file = SD.open(path, FILE_WRITE, true);
+  if (!index_file) {
+    LOG_ERROR("Failed to open %s", path);
+  } else {
+    index_file.write(buffer, fullIndex.encodeIndex(buffer));
+    index_file.close();
+  }
+
+  File manifest_file = SD.open(SHUNT_MANIFEST_PATH, FILE_APPEND);
+  if (!manifest_file) {
+    LOG_ERROR("Failed to open %s", SHUNT_MANIFEST_PATH);
+    return;
+  }
+  shunt_manifest_encode(fullIndex.manifest, buffer);
+  manifest_file.write(buffer, SHUNT_MANIFEST_ENTRY_SIZE);
+  manifest_file.close();
+}
+
+// Starts a new /full file once the current one has had its SHUNT_FULL_FILE_SECONDS, or opens it
+// again if that failed last time. `timestamp` is the sample about to be written. Returns true if
+// it opened a file.
+bool openFullLogFile(time_t timestamp) {
+  // Named from the same clock the index uses, so the manifest can find the file again
+  int64_t fileStart = fullIndex.manifest.fileStart;
+  bool rotate = fileStart == 0 ||
+                shunt_log_file_start(SHUNT_LOG_FULL, timestamp) != shunt_log_file_start(SHUNT_LOG_FULL, fileStart);
+  if (!rotate && log_file) return false;
+  // The first time round, /log.txt from setup()
   log_file.close();
-  String timestampedLogFilePath = "/full/" + getESP32RTCFSSafeTimestamp() + ".bin0";
-  Serial.print("Log file path: ");
-  Serial.println(timestampedLogFilePath);
-  log_file = SD.open(timestampedLogFilePath, FILE_APPEND);
+  if (rotate) {
+    if (fullIndex.manifest.records > 0) {
+      writeFullIndex();
+    }
+    fileStart = timestamp;
+    fullIndex.begin(fileStart);
+  }
+  char timestampedLogFilePath[40];
+  timeFormat.path(SHUNT_LOG_FULL, fileStart, timestampedLogFilePath, sizeof(timestampedLogFilePath));
+  if (rotate) {
+    Serial.print("Log file path: ");
+    Serial.println(timestampedLogFilePath);
+  }
+  // Creates the partition's directories for its first file
+  log_file = SD.open(timestampedLogFilePath, FILE_APPEND, true);
+  if (!log_file) {
+    LOG_ERROR("Failed to open %s", timestampedLogFilePath);
+  }
+  syncSetLiveFile(fileStart);
+  *strrchr(timestampedLogFilePath, '/') = 0;
+  strcpy(fullLogDir, timestampedLogFilePath);
+  listingChanged(fullLogDir);
+  return true;
 }
 
 void loop() {
+  // Sleeps until the sample clock ticks, then reads straight away: everything after this can run
+  // late without moving the sample
+  SampleTick tick = sampleClockWait();
+  loopAllocBegin();
+  LOG_DEBUG("showINAMeasurements");
+  int64_t readMicros;
+  int devicesRead = showINAMeasurements(readMicros);
+  LOG_DEBUG("showedINAMeasurements: %d of %d shunts", devicesRead, SHUNT_LOG_CHANNELS);
+
+  // Filed under the tick's own second, so a slow loop can't repeat or skip one; the µs are when
+  // the reads actually happened, late wakeups included
+  time_t unix_timestamp = tick.wallMicros / 1000000;
+  SampleTimestamp sampleTimestamp;
+  sampleTimestamp.seconds = unix_timestamp;
+  int64_t intoSecond = readMicros - (int64_t)unix_timestamp * 1000000;
+  sampleTimestamp.micros = intoSecond < 0 ? 0 : (uint32_t)intoSecond;
+  ShuntLogTime sampleTime;
+  shunt_log_civil(unix_timestamp, sampleTime);
 
   static int lastMinute = 255;
-  static String timestampedLogFilePath;
-  int minute = esp32rtc.getMinute();
+  static int lastHour = 255;
+  // Whether this iteration opened a file, the one thing in it allowed to allocate
+  bool rotated = false;
+  int minute = sampleTime.minute;
   if (minute != lastMinute) {
     if (lastMinute != 255) {
-      dual_log("appendAggregationsToDailyFile");
-      appendAggregationsToDailyFile();
+      LOG_INFO("appendAggregationsToDailyFile");
+      rotated |= appendAggregationsToDailyFile(unix_timestamp);
     }
-    dual_log("openNewLogFile");
-    openNewLogFile();
+    int hour = sampleTime.hour;
+    if (hour != lastHour) {
+      if (lastHour != 255) {
+        LOG_INFO("appendAggregationsToHourlyFile");
+        appendAggregationsToHourlyFile(unix_timestamp);
+        rotated = true;
+      }
+      lastHour = hour;
+    }
+    rotated |= openFullLogFile(unix_timestamp);
+    // Its size on the card moves on with each flush
+    listingChanged(fullLogDir);
     lastMinute = minute;
   }
+  addINAMeasurements();
 
-  // Calculate remaining milliseconds this second
-  int32_t remainingMillis = remainingMillisThisSecond();
-  // Use sprintf to make a string with the log message "Remaining: 53ms"
-  char logMessage[20];
-  dual_log("Remaining: %dms", remainingMillis);
-
-  // ws.printfAll("{\"type\": \"LOG_MESSAGE\", \"data\": { \"message\": \"Remaining millis: %d\" } }", remainingMillis);
-  // Calculate millis to delay to hit the .5 second
-  int32_t delayMillis = remainingMillis - 500;
-  // If we are past the half second mark, don't delay
-  if (delayMillis > 0) {
-    delay(delayMillis);
-  }
-  
-  struct timeval tv_now;
-  // gettimeofday(&tv_now, NULL);
-  // Serial.print("Unix Time: ");
-  // Serial.println(tv_now.tv_sec);
-  // Serial.print("Micros: ");
-  // Serial.println(tv_now.tv_usec);
-  
-  // Reset the checksum
-  checksum = 0;
-
-  // Write the current timestamp
-  gettimeofday(&tv_now, NULL);
-  time_t unix_timestamp = tv_now.tv_sec;
-  writeWithSize(unix_timestamp);
-  dual_log("showINAMeasurements");
+  // Start a new record
+  recordCrc = 0;
 
-  // Show the INA226 measurements
-  showINAMeasurements();
-  dual_log("showedINAMeasurements");
+  // Write the sample's timestamp
+  writeWithSize(log_file, sampleTimestamp);
 
   // Loop through each shunt stats
+  LiveSample liveSample;
+  liveSample.timestampMicros = readMicros;
   int shunt_idx = 0;
   for (ShuntStats& stats : shuntStatsArray) {
     // Write the bus voltage stats
-    writeWithSize(stats.lastBusRawVoltage);
+    writeWithSize(log_file, stats.lastBusRawVoltage);
     // Write the shunt voltage stats
-    writeWithSize(stats.lastShuntRawVoltage);
-    dual_log("Shunt %d: {bus_voltage:%d, shunt_voltage:%d}", shunt_idx, stats.lastBusRawVoltage, stats.lastShuntRawVoltage);
+    writeWithSize(log_file, stats.lastShuntRawVoltage);
+    bool missing = stats.lastBusRawVoltage == SHUNT_LOG_MISSING_BUS;
+    liveSample.busRaw[shunt_idx] = missing ? LIVE_MISSING_BUS : live_bus_raw(stats.lastBusRawVoltage);
+    liveSample.shuntRaw[shunt_idx] = missing ? LIVE_MISSING_SHUNT : live_shunt_raw(stats.lastShuntRawVoltage);
+#if SHUNT_LOG_LEVEL >= LOG_LEVEL_DEBUG
+    char csv[80];
+    size_t csvLength = formatINAMeasurementsForCSV(stats.lastReading, csv, sizeof(csv));
+    LOG_DEBUG("Shunt %d: {bus_voltage:%u, shunt_voltage:%d} %.*s", shunt_idx, stats.lastBusRawVoltage,
+              stats.lastShuntRawVoltage, (int)csvLength, csv);
+#endif
     shunt_idx++;
   }
-  dual_log("Writing checksum");
-
-  // Write the checksum
-  writeWithSize(checksum);
+  LOG_DEBUG("Writing check");
 
-  Serial.println();
-  log_file.println();
-  dual_log("OTA handle");
+  // Write the CRC and sync marker
+  writeRecordCheck(log_file);
+  fullIndex.add(unix_timestamp, FULL_RECORD_SIZE);
 
-  ArduinoOTA.handle();
-  dual_log("Delay");
+  // Queue the raw sample for websocket subscribers
+  liveStreamPublish(liveSample);
 
-  delay(500);
-}
\ No newline at end of file
+  log_file.println();
+  if (unix_timestamp % LOG_FLUSH_SECONDS == 0) {
+    log_file.flush();
+  }
+  retentionSampleWritten();
+  loopAllocEnd(rotated);
+}
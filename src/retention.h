@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+
+#include <ShuntLog.h>
+#include <ShuntRetention.h>
+
+#include "log_storage.h"
+#include "logger.h"
+#include "api_list.h"
+#include "api_sync.h"
+
+// Full-rate files older than this many days are rolled up into /daily and removed
+#ifndef RETENTION_FULL_DAYS
+#define RETENTION_FULL_DAYS 30
+#endif
+
+// Minute rollups older than this many months are rolled up into /hourly and removed; /hourly is kept
+#ifndef RETENTION_MINUTE_MONTHS
+#define RETENTION_MINUTE_MONTHS 12
+#endif
+
+// Below this much free space the oldest files go early, full-rate ones first
+#ifndef RETENTION_FREE_FLOOR_MB
+#define RETENTION_FREE_FLOOR_MB 256
+#endif
+
+// How often the retention task looks for files to retire
+#define RETENTION_PASS_SECONDS 600
+
+// The retention task reads and writes the card only in the quiet part of the second after the
+// sampler has written its record, and at most this much each second, so it never holds the card
+// when a sample is due
+#define RETENTION_IO_WINDOW_MS 300
+#define RETENTION_IO_BYTES_PER_SLOT 16384
+
+TaskHandle_t retentionTaskHandle = NULL;
+volatile uint32_t retentionSampleMillis = 0;
+uint32_t retentionSlotMillis = 0;
+size_t retentionSlotBytes = 0;
+
+// Called by loop() right after it has written a sample
+void retentionSampleWritten() {
+  retentionSampleMillis = millis();
+  if (retentionTaskHandle != NULL) xTaskNotifyGive(retentionTaskHandle);
+}
+
+// Waits until `bytes` more of I/O fit in the window after the last sample write. While the logger
+// isn't writing (no sample for a couple of seconds) there is nothing to keep out of the way of.
+void retentionThrottle(size_t bytes) {
+  while (true) {
+    uint32_t sample = retentionSampleMillis;
+    if (sample != retentionSlotMillis) {
+      retentionSlotMillis = sample;
+      retentionSlotBytes = 0;
+    }
+    if (millis() - sample < RETENTION_IO_WINDOW_MS &&
+        (retentionSlotBytes == 0 || retentionSlotBytes + bytes <= RETENTION_IO_BYTES_PER_SLOT)) {
+      retentionSlotBytes += bytes;
+      return;
+    }
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2000)) == 0) return;
+  }
+}
+
+// Log reads paced by retentionThrottle()
+class ThrottledLogStorage : public SdLogStorage {
+public:
+
+  bool open(const char* path) override {
+    retentionThrottle(SD_LOG_OP_BYTES);
+    return SdLogStorage::open(path);
+  }
+
+  size_t readAt(uint32_t offset, uint8_t* buffer, size_t length) override {
+    retentionThrottle(length);
+    return SdLogStorage::readAt(offset, buffer, length);
+  }
+};
+
+// The card as ShuntRetention changes it, paced by retentionThrottle()
+class ThrottledLogFiles : public SdLogFiles {
+protected:
+
+  void pace(size_t bytes) override {
+    retentionThrottle(bytes);
+  }
+};
+
+// Too big for the task's stack
+ThrottledLogStorage retentionSource;
+ThrottledLogStorage retentionTarget;
+ThrottledLogFiles retentionFiles;
+ShuntRetention retention(retentionSource, retentionTarget, retentionFiles,
+                         {RETENTION_FULL_DAYS, RETENTION_MINUTE_MONTHS, (uint64_t)RETENTION_FREE_FLOOR_MB << 20});
+
+void retentionTask(void* parameter) {
+  while (true) {
+    // Nothing to go by until the logger has a file open
+    if (syncLiveFile() != 0) {
+      ShuntRetentionStats before = retention.stats;
+      struct timeval tv_now;
+      gettimeofday(&tv_now, NULL);
+      while (retention.step(tv_now.tv_sec, syncLiveFile())) {
+#if SHUNT_FULL_PARTITION == SHUNT_PARTITION_NONE
+        listingChanged("/full");
+#endif
+        listingChanged("/daily");
+        listingChanged("/hourly");
+      }
+      retentionFiles.finish();
+      const ShuntRetentionStats& after = retention.stats;
+      if (after.fullRetired != before.fullRetired || after.minuteRetired != before.minuteRetired) {
+        LOG_INFO("Retention: %u full-rate and %u minute files retired, %u rollups added",
+                 after.fullRetired - before.fullRetired, after.minuteRetired - before.minuteRetired,
+                 after.rollupsAdded - before.rollupsAdded);
+      }
+      if (after.errors != before.errors) {
+        LOG_ERROR("Retention: %u rollup files couldn't be written", after.errors - before.errors);
+      }
+    }
+    vTaskDelay(pdMS_TO_TICKS(RETENTION_PASS_SECONDS * 1000));
+  }
+}
+
+// Below the logger's priority: it only runs when everything else is waiting
+void setupRetention() {
+  xTaskCreatePinnedToCore(retentionTask, "retention", 4096, NULL, 0, &retentionTaskHandle, 0);
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <Arduino.h>
+#include <sys/time.h>
+#include "esp_timer.h"
+
+#include <SampleClock.h>
+#include <ClockDiscipline.h>
+
+#include "server.h"
+#include "logger.h"
+
+// Time between samples; the log stamps whole seconds, so keep this a whole number of them or a
+// divisor of one
+#ifndef SAMPLE_PERIOD_MS
+#define SAMPLE_PERIOD_MS 1000
+#endif
+
+// How far into each period the sample is taken: mid-period keeps it clear of the boundary
+#ifndef SAMPLE_PHASE_MS
+#define SAMPLE_PHASE_MS (SAMPLE_PERIOD_MS / 2)
+#endif
+
+// GPIO wired to the DS3231's SQW/INT pin
+#ifndef RTC_SQW_PIN
+#define RTC_SQW_PIN 25
+#endif
+
+// How far the system clock (file names, rollup timestamps) may wander from the disciplined one
+// before it is slewed back, and past which it is set outright
+#define SYSTEM_CLOCK_SLEW_MICROS 1000
+#define SYSTEM_CLOCK_STEP_MICROS 500000
+
+// Shared by loop(), the SQW interrupt and the web server's task
+portMUX_TYPE sampleClockMux = portMUX_INITIALIZER_UNLOCKED;
+SampleSchedule sampleSchedule;
+ClockDiscipline sampleDiscipline;
+volatile int64_t sqwEdgeMicros = 0;
+volatile uint32_t sqwEdgeCount = 0;
+int64_t systemClockOffset = 0;
+
+uint32_t sqwEdgesUsed = 0;
+TaskHandle_t sampleTaskHandle = NULL;
+esp_timer_handle_t sampleTimer = NULL;
+
+void IRAM_ATTR onSqwEdge() {
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&sampleClockMux);
+  sqwEdgeMicros = now;
+  sqwEdgeCount++;
+  portEXIT_CRITICAL_ISR(&sampleClockMux);
+}
+
+// Starts timestamping SQW edges and waits up to a couple of seconds for one. Returns its monotonic
+// time, or 0 if the pin isn't ticking.
+int64_t sampleClockAwaitEdge() {
+  pinMode(RTC_SQW_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(RTC_SQW_PIN), onSqwEdge, FALLING);
+  uint32_t count = sqwEdgeCount;
+  uint32_t start = millis();
+  while (sqwEdgeCount == count) {
+    if (millis() - start > 2000) {
+      LOG_ERROR("No square wave from the RTC on GPIO %d, sample clock undisciplined", RTC_SQW_PIN);
+      return 0;
+    }
+    delay(1);
+  }
+  portENTER_CRITICAL(&sampleClockMux);
+  int64_t edge = sqwEdgeMicros;
+  portEXIT_CRITICAL(&sampleClockMux);
+  return edge;
+}
+
+// Sets the system clock and the sample clock's model from an RTC read of `seconds`, taken just
+// after the edge at `edge` (0 if there wasn't one: then only to the second)
+void sampleClockSetTime(time_t seconds, int64_t edge) {
+  portENTER_CRITICAL(&sampleClockMux);
+  sampleDiscipline.begin(edge != 0 ? edge : esp_timer_get_time(), (int64_t)seconds * 1000000);
+  int64_t reference = sampleDiscipline.toReference(esp_timer_get_time());
+  portEXIT_CRITICAL(&sampleClockMux);
+  struct timeval tv_now = {(time_t)(reference / 1000000), (suseconds_t)(reference % 1000000)};
+  settimeofday(&tv_now, NULL);
+}
+
+// Feeds the latest SQW edge to the model, then keeps the system clock on it. Only loop() changes
+// the model, so it can read it without the lock.
+void sampleClockDiscipline() {
+  portENTER_CRITICAL(&sampleClockMux);
+  bool fresh = sqwEdgeCount != sqwEdgesUsed;
+  if (fresh) {
+    sqwEdgesUsed = sqwEdgeCount;
+    sampleDiscipline.edge(sqwEdgeMicros);
+  }
+  portEXIT_CRITICAL(&sampleClockMux);
+  if (!fresh) return;
+
+  struct timeval tv_now;
+  gettimeofday(&tv_now, NULL);
+  int64_t reference = sampleDiscipline.toReference(esp_timer_get_time());
+  int64_t offset = (int64_t)tv_now.tv_sec * 1000000 + tv_now.tv_usec - reference;
+  portENTER_CRITICAL(&sampleClockMux);
+  systemClockOffset = offset;
+  portEXIT_CRITICAL(&sampleClockMux);
+  if (offset > SYSTEM_CLOCK_STEP_MICROS || offset < -SYSTEM_CLOCK_STEP_MICROS) {
+    struct timeval tv_set = {(time_t)(reference / 1000000), (suseconds_t)(reference % 1000000)};
+    settimeofday(&tv_set, NULL);
+    LOG_INFO("System clock was %lldus off the RTC, set", (long long)offset);
+  } else if (offset > SYSTEM_CLOCK_SLEW_MICROS || offset < -SYSTEM_CLOCK_SLEW_MICROS) {
+    struct timeval delta = {(time_t)(-offset / 1000000), (suseconds_t)(-offset % 1000000)};
+    adjtime(&delta, NULL);
+  }
+}
+
+// Wall time at esp_timer time `monotonic` (a sample's, a log record's), from the disciplined clock:
+// integer arithmetic, no system call
+int64_t wallClockAt(int64_t monotonic) {
+  portENTER_CRITICAL(&sampleClockMux);
+  int64_t wall = sampleDiscipline.toReference(monotonic);
+  portEXIT_CRITICAL(&sampleClockMux);
+  return wall;
+}
+
+int64_t wallClockMicros() {
+  return wallClockAt(esp_timer_get_time());
+}
+
+time_t wallClockSeconds() {
+  return (time_t)(wallClockMicros() / 1000000);
+}
+
+// esp_timer callbacks run in the esp_timer task, so this only wakes the sampler
+void onSampleTick(void* arg) {
+  xTaskNotifyGive(sampleTaskHandle);
+}
+
+// Blocks the calling task until its next sample is due and says which one it is
+SampleTick sampleClockWait() {
+  SampleTick tick;
+  while (true) {
+    sampleClockDiscipline();
+    portENTER_CRITICAL(&sampleClockMux);
+    bool taken = sampleSchedule.take(sampleDiscipline.toReference(esp_timer_get_time()), tick);
+    int64_t due = sampleDiscipline.toMonotonic(sampleSchedule.nextTime());
+    portEXIT_CRITICAL(&sampleClockMux);
+    // One tick at a time, each aimed with the latest correction
+    esp_timer_stop(sampleTimer);
+    int64_t wait = due - esp_timer_get_time();
+    esp_timer_start_once(sampleTimer, wait > 0 ? wait : 1);
+    if (taken) break;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SAMPLE_PERIOD_MS * 2));
+  }
+  if (tick.missed > 0) {
+    LOG_ERROR("Sampler missed %u ticks", tick.missed);
+  }
+  return tick;
+}
+
+/**
+ * GET /api/sample-clock
+ *
+ * How late the sampler has been to its ticks since boot, as a histogram of wakeup latency in µs
+ * (each bucket counts samples up to its "le" edge), plus the ticks it missed and the ones dropped
+ * because the clock was set back. "rtc" is the discipline to the DS3231: the phase error at the
+ * last square-wave edge, the crystal's drift it is correcting and how far the system clock was off.
+ */
+void handleSampleClockRequest(AsyncWebServerRequest *request) {
+  portENTER_CRITICAL(&sampleClockMux);
+  SampleClockStats stats = sampleSchedule.stats;
+  ClockDisciplineStats rtcStats = sampleDiscipline.stats;
+  int32_t driftPpb = sampleDiscipline.ratePpb();
+  bool locked = sampleDiscipline.locked();
+  int64_t systemOffset = systemClockOffset;
+  portEXIT_CRITICAL(&sampleClockMux);
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"period_ms\":%u,\"phase_ms\":%u,\"samples\":%u,\"missed\":%u,\"duplicates\":%u,"
+                   "\"max_us\":%lld,\"mean_us\":%lld,\"p99_us\":%lld,\"buckets\":[",
+                   SAMPLE_PERIOD_MS, SAMPLE_PHASE_MS, stats.samples, stats.missed, stats.duplicates,
+                   (long long)stats.maxLate, (long long)stats.meanLate(), (long long)stats.percentile(990));
+  for (uint8_t i = 0; i < SAMPLE_JITTER_BUCKETS; i++) {
+    if (i < SAMPLE_JITTER_BUCKETS - 1) {
+      response->printf("%s{\"le\":%lld,\"count\":%u}", i == 0 ? "" : ",", (long long)SAMPLE_JITTER_EDGES[i],
+                       stats.buckets[i]);
+    } else {
+      response->printf(",{\"le\":null,\"count\":%u}", stats.buckets[i]);
+    }
+  }
+  response->printf("],\"rtc\":{\"locked\":%s,\"edges\":%u,\"rejected\":%u,\"steps\":%u,\"offset_us\":%lld,"
+                   "\"drift_ppb\":%d,\"system_offset_us\":%lld}}",
+                   locked ? "true" : "false", rtcStats.edges, rtcStats.rejected, rtcStats.steps,
+                   (long long)rtcStats.offset, driftPpb, (long long)systemOffset);
+  request->send(response);
+}
+
+// Called from setup() once the clock is set, on the task that will call sampleClockWait()
+void setupSampleClock() {
+  sampleTaskHandle = xTaskGetCurrentTaskHandle();
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = onSampleTick;
+  timerArgs.name = "sample";
+  esp_timer_create(&timerArgs, &sampleTimer);
+
+  portENTER_CRITICAL(&sampleClockMux);
+  // At least a millisecond out, so the first wait isn't already late
+  sampleSchedule.begin(sampleDiscipline.toReference(esp_timer_get_time()), (int64_t)SAMPLE_PERIOD_MS * 1000,
+                       (int64_t)SAMPLE_PHASE_MS * 1000, 1000);
+  portEXIT_CRITICAL(&sampleClockMux);
+}
+
+void setupSampleClockApi() {
+  server.on("/api/sample-clock", HTTP_GET, handleSampleClockRequest);
+}
@@ -1,9 +1,13 @@
 
 #pragma once
 
+// Files FatFs can have open at once, each slot allocated at mount. The logger keeps two open
+// (the /full file and the day's rollups), which leaves the rest for downloads and retention.
+#define SD_MAX_OPEN_FILES 6
+
 int sd_setup() {
 
-  if(!SD.begin(5)){
+  if(!SD.begin(5, SPI, 4000000, "/sd", SD_MAX_OPEN_FILES)){
     Serial.println("Card Mount Failed");
     return -1;
   }
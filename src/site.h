@@ -13,7 +13,52 @@
 #include "sd_functions.h"
 #include "ArduinoJson.h"
 #include "server.h"
-
+#include "logger.h"
+#include "api_log.h"
+#include "api_list.h"
+#include "api_series.h"
+#include "api_downsample.h"
+#include "api_sync.h"
+#include "log_files.h"
+#include "live_stream.h"
+#include "sample_clock.h"
+#include "ina_health.h"
+#include "system_stats.h"
+
+
+// How often the oldest websocket clients are closed when there are too many
+#define WS_CLEANUP_INTERVAL_MS 1000
+
+// Called on WS_EVT_CONNECT. AsyncWebSocket isn't safe to send on from other tasks, so the log and
+// the live frames go out from the client's own TCP callbacks in the AsyncTCP task: on each ack, as
+// soon as the last ones are through, and on each poll (every 500 ms) for what came while it was
+// idle. The client's handlers run after ours, since either can close and free it. There is no
+// public hook that runs in the AsyncTCP task, so this replaces the handlers AsyncWebSocketClient
+// installed and calls its _onAck()/_onPoll() itself; the library is pinned in platformio.ini for
+// that reason.
+void wsAttachClient(AsyncWebSocketClient *client) {
+  AsyncClient *tcp = client->client();
+  tcp->onAck([](void *arg, AsyncClient *tcp, size_t len, uint32_t time) {
+    AsyncWebSocketClient *client = (AsyncWebSocketClient*)arg;
+    // Live frames first, they are the ones that go stale
+    liveStreamPump(client);
+    logStreamPump(client);
+    client->_onAck(len, time);
+  }, client);
+  tcp->onPoll([](void *arg, AsyncClient *tcp) {
+    static uint32_t lastCleanup = 0;
+    AsyncWebSocketClient *client = (AsyncWebSocketClient*)arg;
+    liveStreamPump(client);
+    logStreamPump(client);
+    if (millis() - lastCleanup > WS_CLEANUP_INTERVAL_MS) {
+      // Closes the oldest clients once there are more than DEFAULT_MAX_WS_CLIENTS. Their slots
+      // here go on WS_EVT_DISCONNECT, like any other client's.
+      ws.cleanupClients();
+      lastCleanup = millis();
+    }
+    client->_onPoll();
+  }, client);
+}
 
 void onEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len){
   if(type == WS_EVT_CONNECT){
@@ -21,9 +66,13 @@ void onEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
     Serial.printf("ws[%s][%u] connect\n", server->url(), client->id());
     client->printf("Hello Client %u :)", client->id());
     client->ping();
+    logAddClient(client->id());
+    wsAttachClient(client);
   } else if(type == WS_EVT_DISCONNECT){
     //client disconnected
     Serial.printf("ws[%s][%u] disconnect: %u\n", server->url(), client->id());
+    liveStreamRemoveClient(client->id());
+    logRemoveClient(client->id());
   } else if(type == WS_EVT_ERROR){
     //error was received from the other end
     Serial.printf("ws[%s][%u] error(%u): %s\n", server->url(), client->id(), *((uint16_t*)arg), (char*)data);
@@ -47,7 +96,7 @@ void onEvent(AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventTyp
       }
       if(info->opcode == WS_TEXT)
         client->text("I got your text message");
-      else
+      else if(!liveStreamHandleMessage(client, data, len))
         client->binary("I got your binary message");
     } else {
       //message is comprised of multiple frames or the frame is split into multiple packets
@@ -91,32 +140,32 @@ void handleUpload(AsyncWebServerRequest *request, String filename, size_t index,
     if(request->hasHeader("Content-Length")){
       AsyncWebHeader* h = request->getHeader("Content-Length");
       upload_file_size = atoi(h->value().c_str());
-      dual_log("Content-Length: %u\n", upload_file_size);
+      LOG_DEBUG("Content-Length: %u", upload_file_size);
     }
     char path[128];
     String dir_path = request->pathArg(0);
-    dual_log("dirpath: %s", dir_path.c_str());
+    LOG_DEBUG("dirpath: %s", dir_path.c_str());
     // If the path is empty, then we are uploading to the root of the SD card
     if (dir_path.length() == 0) {
       sprintf(path, "/%s", filename.c_str());
     } else {
       sprintf(path, "/%s/%s", dir_path.c_str(), filename.c_str());
     }
-    dual_log("UploadStart: %s, size (B): %u, writing to: %s", filename.c_str(), upload_file_size, path);
+    LOG_INFO("UploadStart: %s, size (B): %u, writing to: %s", filename.c_str(), upload_file_size, path);
     upload_file = SD.open(path, FILE_WRITE);
     if (!upload_file) {
-      dual_log("Failed to open file for writing");
+      LOG_ERROR("Failed to open file for writing");
       return;
     }
   }
-  dual_log("Uploading: %s, %u / %u", filename.c_str(), index, upload_file_size);
+  LOG_DEBUG("Uploading: %s, %u / %u", filename.c_str(), index, upload_file_size);
   if (upload_file.write(data, len) != len) {
-    dual_log("Write failed");
+    LOG_ERROR("Write failed");
   }
   if(final){
     upload_file.flush();
     upload_file.close();
-    dual_log("UploadEnd: %s, %u B", filename.c_str(), index+len);
+    LOG_INFO("UploadEnd: %s, %u B", filename.c_str(), index+len);
   }
 }
 
@@ -142,64 +191,22 @@ void setupWebHandlers() {
     request->send(200);
   }, handleUpload);
 
-  server.on("^\\/api\\/list\\/(.*)$", HTTP_GET, [](AsyncWebServerRequest *request){
-
-    String dirPath = "/sd/" + request->pathArg(0);
-    AsyncResponseStream *response = request->beginResponseStream("application/json");
-    response->addHeader("Content-Type","application/json");
-
-    // List files on the SD card at the path
-    DIR *dir;
-    struct dirent *entry;
-
-    // Remove a trailing slash, if it exists
-    if (dirPath.endsWith("/")) {
-      dirPath = dirPath.substring(0, dirPath.length() - 1);
-    }
-
-
-    //List all parameters
-    bool show_hidden = false;
-    int params = request->params();
-    for(int i=0;i<params;i++){
-      AsyncWebParameter* p = request->getParam(i);
-      if (p->name() == "hidden") {
-        if (p->value() == "true") {
-          show_hidden = true;
-        }
-      }
-    }
-
-    // List directory contents
-    dir = opendir(dirPath.c_str());
-    if (!dir) {
-        printf("Failed to open directory %s\n", dirPath);
-        return;
-    }
-    response->print("[\"./\", \"../\"");
-    while ((entry = readdir(dir)) != NULL) {
-      // If hidden (begins with .), skip
-      if (entry->d_name[0] == '.' && !show_hidden) {
-        continue;
-      }
-      if (entry->d_type == DT_DIR) {
-        response->printf(",\n\"%s/\"", entry->d_name);
-      } else if (entry->d_type == DT_REG) {
-        response->printf(",\n\"%s\"", entry->d_name);
-      }
-    }
-    response->print("]");
-    closedir(dir);
-    request->send(response);
-  });
+  setupListApi();
+  setupLogApi();
+  setupSeriesApi();
+  setupDownsampleApi();
+  setupSyncApi();
+  setupLiveStream();
+  setupSampleClockApi();
+  setupI2CApi();
+  setupSystemApi();
 
   server.serveStatic("/www", SD, "/www");
-  server.serveStatic("/daily", SD, "/daily");
-  server.serveStatic("/full", SD, "/full");
+  setupLogFiles();
 
   server.onNotFound(onNotFoundRequest);
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
-  server.begin();
+  // server.begin() is the network task's, once Wi-Fi is up (see boot.h)
 
 }
 
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+
+#include <ESPAsyncWebServer.h>
+#include <ShuntSystemLog.h>
+
+#include "server.h"
+#include "logger.h"
+#include "sample_clock.h"
+#include "live_stream.h"
+#include "api_list.h"
+#include "alloc_count.h"
+
+// How often the heap, stacks and queues are read. Walking the heap for its largest block takes
+// the heap's lock for a moment, which the sampler never waits on: it doesn't allocate.
+#define SYSTEM_STATS_SAMPLE_MS 5000
+
+// /system files older than this are removed as the month turns
+#define SYSTEM_STATS_KEEP_MONTHS 12
+
+// The latest reading and the interval being collected, shared with the web server's task
+portMUX_TYPE systemStatsMux = portMUX_INITIALIZER_UNLOCKED;
+ShuntSystemSample systemStatsLast;
+uint32_t systemStatsLastMillis = 0;
+ShuntSystemInterval systemStatsInterval;
+
+uint32_t systemResetReason = 0;
+
+void systemStatsRead(ShuntSystemSample& sample) {
+  sample.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  sample.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  sample.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  // By name each time: a handle kept from a task that has since ended would point at freed memory
+  for (uint8_t i = 0; i < SHUNT_SYSTEM_TASKS; i++) {
+    TaskHandle_t task = xTaskGetHandle(SHUNT_SYSTEM_TASK_NAMES[i]);
+    // In bytes on the ESP32, whose stacks are counted in bytes
+    sample.stackFree[i] = task == NULL ? SHUNT_SYSTEM_NO_TASK : uxTaskGetStackHighWaterMark(task);
+  }
+  liveStreamTakeQueuePeaks(sample.wsQueued, sample.liveQueued);
+}
+
+// Appends the interval's record to its month's file, starting the month by removing the file that
+// has aged out
+void systemStatsWrite(const ShuntSystemRecord& record) {
+  static char lastPath[32] = "";
+  char path[32];
+  shunt_system_path(record.timestamp, 0, path, sizeof(path));
+  if (strcmp(path, lastPath) != 0) {
+    char expired[32];
+    // And a year of months before it, in case the logger was off when they aged out
+    for (uint16_t months = SYSTEM_STATS_KEEP_MONTHS; months < SYSTEM_STATS_KEEP_MONTHS + 12; months++) {
+      shunt_system_path(record.timestamp, months, expired, sizeof(expired));
+      if (SD.exists(expired)) SD.remove(expired);
+    }
+    strcpy(lastPath, path);
+  }
+  uint8_t buffer[SHUNT_SYSTEM_RECORD_SIZE];
+  size_t length = shunt_system_encode(record, buffer);
+  File file = SD.open(path, FILE_APPEND, true);
+  if (!file || file.write(buffer, length) != length) {
+    LOG_ERROR("Failed to write %s", path);
+  }
+  file.close();
+  listingChanged("/system");
+}
+
+void systemStatsTask(void* parameter) {
+  int64_t interval = wallClockSeconds() / SHUNT_SYSTEM_RECORD_SECONDS;
+  TickType_t wake = xTaskGetTickCount();
+  while (true) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(SYSTEM_STATS_SAMPLE_MS));
+    ShuntSystemSample sample;
+    systemStatsRead(sample);
+    int64_t now = wallClockSeconds() / SHUNT_SYSTEM_RECORD_SECONDS;
+    ShuntSystemRecord record;
+    bool ended = now != interval && systemStatsInterval.samples > 0;
+    portENTER_CRITICAL(&systemStatsMux);
+    systemStatsLast = sample;
+    systemStatsLastMillis = millis();
+    if (ended) {
+      record.worst = systemStatsInterval.worst;
+      systemStatsInterval.reset();
+    }
+    systemStatsInterval.add(sample);
+    portEXIT_CRITICAL(&systemStatsMux);
+    if (ended) {
+      record.timestamp = now * SHUNT_SYSTEM_RECORD_SECONDS;
+      record.uptime = (uint32_t)(esp_timer_get_time() / 1000000);
+      record.resetReason = systemResetReason;
+      systemStatsWrite(record);
+    }
+    interval = now;
+  }
+}
+
+/**
+ * GET /api/system
+ *
+ * The heap, the stack each task has never used and the deepest websocket and live stream queues,
+ * as last read (every SYSTEM_STATS_SAMPLE_MS), plus the worst of them so far in the interval being
+ * logged to /system. With SHUNT_COUNT_ALLOCS, the loop's heap allocations too.
+ */
+void handleSystemRequest(AsyncWebServerRequest *request) {
+  portENTER_CRITICAL(&systemStatsMux);
+  ShuntSystemSample last = systemStatsLast;
+  uint32_t lastMillis = systemStatsLastMillis;
+  ShuntSystemSample worst = systemStatsInterval.worst;
+  uint32_t samples = systemStatsInterval.samples;
+  portEXIT_CRITICAL(&systemStatsMux);
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->printf("{\"uptime_s\":%u,\"reset_reason\":%u,\"age_ms\":%u,\"heap\":{\"free\":%u,\"largest_free_block\":%u,"
+                   "\"min_free\":%u,\"fragmentation_pct\":%u},\"queues\":{\"ws\":%u,\"live\":%u},\"tasks\":[",
+                   (uint32_t)(esp_timer_get_time() / 1000000), systemResetReason, millis() - lastMillis, last.freeHeap,
+                   last.largestFreeBlock, last.minFreeHeap, shunt_system_fragmentation(last), last.wsQueued,
+                   last.liveQueued);
+  for (uint8_t i = 0; i < SHUNT_SYSTEM_TASKS; i++) {
+    response->printf("%s{\"name\":\"%s\",", i == 0 ? "" : ",", SHUNT_SYSTEM_TASK_NAMES[i]);
+    if (last.stackFree[i] == SHUNT_SYSTEM_NO_TASK) {
+      response->print("\"stack_free\":null}");
+    } else {
+      response->printf("\"stack_free\":%u}", last.stackFree[i]);
+    }
+  }
+  response->print("]");
+  if (samples > 0) {
+    response->printf(",\"interval\":{\"samples\":%u,\"free\":%u,\"largest_free_block\":%u,\"ws\":%u,\"live\":%u}",
+                     samples, worst.freeHeap, worst.largestFreeBlock, worst.wsQueued, worst.liveQueued);
+  }
+#ifdef SHUNT_COUNT_ALLOCS
+  response->printf(",\"loop_allocs\":{\"iterations\":%u,\"allocating\":%u,\"allocations\":%u,\"worst\":%u,"
+                   "\"rotations\":%u,\"rotation_allocations\":%u,\"rotation_worst\":%u}",
+                   loopAllocWatch.iterations, loopAllocWatch.allocatingIterations, loopAllocWatch.allocations,
+                   loopAllocWatch.worst, loopAllocWatch.rotations, loopAllocWatch.rotationAllocations,
+                   loopAllocWatch.rotationWorst);
+#endif
+  response->print("}");
+  request->send(response);
+}
+
+void setupSystemApi() {
+  server.on("/api/system", HTTP_GET, handleSystemRequest);
+}
+
+// Once the clock is set. Its own task, below the logger's priority, so none of this is on the
+// sampler's time.
+void startSystemStats() {
+  systemResetReason = esp_reset_reason();
+  systemStatsRead(systemStatsLast);
+  systemStatsLastMillis = millis();
+  xTaskCreatePinnedToCore(systemStatsTask, "system", 4096, NULL, 0, NULL, 0);
+}
@@ -0,0 +1,227 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <stdlib.h>
+#include <new>
+#include <vector>
+#include "unity.h"
+#include "AllocCount.h"
+#include "SimpleStats.h"
+#include "FixedPoint.h"
+#include "ShuntLog.h"
+#include "ShuntIndex.h"
+#include "ShuntTimeFormat.h"
+#include "LiveStream.h"
+#include "InaHealth.h"
+#include "I2CRecovery.h"
+#include "LogRing.h"
+
+// Every allocation the test makes, the way the firmware's --wrap=malloc hooks count the loop's
+AllocCounter testAllocs;
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+// operator new comes through here too
+extern "C" void* malloc(size_t size) {
+  testAllocs.note();
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  testAllocs.note();
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+  testAllocs.note();
+  return __libc_realloc(pointer, size);
+}
+#else
+void* operator new(size_t size) {
+  testAllocs.note();
+  void* pointer = malloc(size == 0 ? 1 : size);
+  if (pointer == NULL) throw std::bad_alloc();
+  return pointer;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+  free(pointer);
+}
+#endif
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+volatile size_t sink;
+
+void test_allocations_are_counted(void) {
+  AllocWatch watch;
+  watch.begin(testAllocs);
+  std::vector<int> values;
+  for (int i = 0; i < 100; i++) values.push_back(i);
+  sink = values.size();
+  uint32_t made = watch.end(testAllocs, false);
+  TEST_ASSERT_TRUE(made > 0);
+  TEST_ASSERT_EQUAL(made, watch.worst);
+  TEST_ASSERT_EQUAL(1, watch.allocatingIterations);
+  TEST_ASSERT_FALSE(watch.clean());
+
+  watch.begin(testAllocs);
+  sink = values.size();
+  TEST_ASSERT_EQUAL(0, watch.end(testAllocs, false));
+  TEST_ASSERT_EQUAL(2, watch.iterations);
+  TEST_ASSERT_EQUAL(1, watch.allocatingIterations);
+}
+
+void test_rotations_are_counted_apart(void) {
+  AllocWatch watch;
+  watch.begin(testAllocs);
+  std::vector<int> values(64);
+  sink = values.size();
+  TEST_ASSERT_EQUAL(0, watch.end(testAllocs, true));
+  TEST_ASSERT_EQUAL(1, watch.rotations);
+  TEST_ASSERT_TRUE(watch.rotationAllocations > 0);
+  TEST_ASSERT_EQUAL(watch.rotationAllocations, watch.rotationWorst);
+  TEST_ASSERT_EQUAL(0, watch.iterations);
+  TEST_ASSERT_TRUE(watch.clean());
+}
+
+// What loop() does with each sample, minus the SD card and the I2C bus: the libraries it calls,
+// writing into a buffer that stands in for the file
+struct SampleLoop {
+  ShuntScale scale{100};
+  SimpleStats bus[SHUNT_LOG_CHANNELS];
+  SimpleStats shunt[SHUNT_LOG_CHANNELS];
+  SimpleStats hourlyBus[SHUNT_LOG_CHANNELS];
+  SimpleStats hourlyShunt[SHUNT_LOG_CHANNELS];
+  InaDeviceHealth health[SHUNT_LOG_CHANNELS];
+  I2CBusStats busStats;
+  ShuntIndexBuilder index;
+  ShuntTimeFormat timeFormat;
+  LiveClientState live;
+  LogRing<16> log;
+  uint8_t record[SHUNT_LOG_MAX_RECORD_SIZE];
+  size_t written = 0;
+  int lastMinute = -1;
+
+  void rollup(int64_t timestamp) {
+    char path[40];
+    timeFormat.path(SHUNT_LOG_MINUTE, timestamp, path, sizeof(path));
+    ShuntLogFieldWriter writer(record);
+    writer.add(timestamp, 8);
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+      for (const SimpleStats* stats : {&bus[ch], &shunt[ch]}) {
+        writer.add(stats->min, 8);
+        writer.add(stats->get_mean(), 4);
+        writer.add(stats->max, 8);
+      }
+      hourlyBus[ch].merge(bus[ch]);
+      hourlyShunt[ch].merge(shunt[ch]);
+      bus[ch].reset();
+      shunt[ch].reset();
+    }
+    writer.finish(false);
+    written += writer.length;
+  }
+
+  void sample(int64_t timestamp, uint32_t micros) {
+    ShuntLogTime time;
+    shunt_log_civil(timestamp, time);
+    if (time.minute != lastMinute) {
+      if (lastMinute >= 0) rollup(timestamp);
+      lastMinute = time.minute;
+    }
+    ShuntLogFieldWriter writer(record);
+    writer.addTimestamp(timestamp, micros, SHUNT_LOG_TIMESTAMP_MICROS);
+    LiveSample liveSample;
+    liveSample.timestampMicros = timestamp * 1000000 + micros;
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+      // Shunt 4 has dropped out
+      bool ok = ch != 4;
+      busStats.count(ok ? I2C_OK : I2C_NACK_ADDRESS);
+      health[ch].read(ok, (uint32_t)timestamp * 1000);
+      uint32_t busRaw = ok ? 9600 + ch : SHUNT_LOG_MISSING_BUS;
+      int32_t shuntRaw = ok ? -200 + (int32_t)(timestamp % 7) : SHUNT_LOG_MISSING_SHUNT;
+      if (ok) {
+        ShuntReading reading;
+        scale.convert(busRaw, shuntRaw, reading);
+        bus[ch].add_measurement(busRaw);
+        shunt[ch].add_measurement(shuntRaw);
+      }
+      writer.add(busRaw, 4);
+      writer.add(shuntRaw, 4);
+      liveSample.busRaw[ch] = ok ? live_bus_raw(busRaw) : LIVE_MISSING_BUS;
+      liveSample.shuntRaw[ch] = ok ? live_shunt_raw(shuntRaw) : LIVE_MISSING_SHUNT;
+    }
+    writer.finish(true);
+    written += writer.length;
+    index.add(timestamp, writer.length);
+    live.add(liveSample);
+    LiveFrame frame;
+    if (timestamp % 3 == 0) live.next(frame);
+    char stamp[ShuntTimeFormat::ISO_LENGTH + 1];
+    log.write(1, liveSample.timestampMicros, stamp, timeFormat.iso(timestamp, stamp, sizeof(stamp)));
+  }
+};
+
+void test_sample_loop_does_not_allocate(void) {
+  static SampleLoop loop;
+  loop.live.subscribe({0x1F, 2});
+  loop.index.begin(1700000000);
+  AllocWatch watch;
+  // A day and a bit: minute rollups, the date changing and the index thinning out
+  for (int64_t t = 1700000000; t < 1700000000 + 90000; t++) {
+    watch.begin(testAllocs);
+    loop.sample(t, (uint32_t)(t % 1000) * 997);
+    watch.end(testAllocs, false);
+  }
+  TEST_ASSERT_EQUAL(90000, watch.iterations);
+  TEST_ASSERT_EQUAL(0, watch.allocations);
+  TEST_ASSERT_TRUE(watch.clean());
+  TEST_ASSERT_TRUE(loop.written > 0);
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_allocations_are_counted);
+  RUN_TEST(test_rotations_are_counted_apart);
+  RUN_TEST(test_sample_loop_does_not_allocate);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
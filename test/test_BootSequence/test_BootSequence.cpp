@@ -0,0 +1,129 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include <string.h>
+#include "unity.h"
+#include "BootSequence.h"
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+void test_timeline_times_each_stage(void) {
+  BootTimeline timeline;
+  timeline.begin(40);
+  timeline.stage("sd", 40);
+  timeline.stage("rtc", 160);
+  timeline.stage("ina", 1163);
+  timeline.finish(1190);
+  TEST_ASSERT_EQUAL_UINT8(3, timeline.count);
+  TEST_ASSERT_EQUAL_UINT32(1003, timeline.stages[1].ms);
+  TEST_ASSERT_EQUAL_UINT32(1150, timeline.totalMs());
+
+  char text[64];
+  TEST_ASSERT_EQUAL(strlen("sd 120 ms, rtc 1003 ms, ina 27 ms"), timeline.format(text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("sd 120 ms, rtc 1003 ms, ina 27 ms", text);
+
+  // Cut short rather than overrun
+  TEST_ASSERT_EQUAL(9, timeline.format(text, 10));
+  TEST_ASSERT_EQUAL_STRING("sd 120 ms", text);
+}
+
+void test_timeline_folds_extra_stages_into_the_last(void) {
+  BootTimeline timeline;
+  timeline.begin(0);
+  for (uint32_t i = 0; i < BOOT_MAX_STAGES + 3; i++) timeline.stage("step", i * 10);
+  timeline.finish((BOOT_MAX_STAGES + 3) * 10);
+  TEST_ASSERT_EQUAL_UINT8(BOOT_MAX_STAGES, timeline.count);
+  TEST_ASSERT_EQUAL_UINT32(40, timeline.stages[BOOT_MAX_STAGES - 1].ms);
+  TEST_ASSERT_EQUAL_UINT32((BOOT_MAX_STAGES + 3) * 10, timeline.totalMs());
+}
+
+void test_network_starts_services_once_connected(void) {
+  NetworkBoot network;
+  TEST_ASSERT_EQUAL(NETWORK_CONNECT, network.step(0, false));
+  TEST_ASSERT_EQUAL(NETWORK_WAIT, network.step(100, false));
+  TEST_ASSERT_EQUAL(NETWORK_START_SERVICES, network.step(3200, true));
+  TEST_ASSERT_EQUAL(NETWORK_UP, network.state);
+  TEST_ASSERT_EQUAL(NETWORK_WAIT, network.step(3300, true));
+  TEST_ASSERT_EQUAL_UINT32(1, network.attempts);
+}
+
+void test_network_backs_off_without_an_access_point(void) {
+  NetworkBoot network;
+  uint32_t now = 0;
+  TEST_ASSERT_EQUAL(NETWORK_CONNECT, network.step(now, false));
+  // 15 s, 30 s, 60 s, ... up to the maximum
+  uint32_t expected = NETWORK_CONNECT_TIMEOUT_MS;
+  for (uint8_t i = 0; i < 8; i++) {
+    TEST_ASSERT_EQUAL(NETWORK_WAIT, network.step(now + expected - 1, false));
+    now += expected;
+    TEST_ASSERT_EQUAL(NETWORK_CONNECT, network.step(now, false));
+    expected = expected * 2 > NETWORK_CONNECT_MAX_TIMEOUT_MS ? NETWORK_CONNECT_MAX_TIMEOUT_MS : expected * 2;
+    TEST_ASSERT_EQUAL_UINT32(expected, network.timeoutMs());
+  }
+  TEST_ASSERT_EQUAL_UINT32(NETWORK_CONNECT_MAX_TIMEOUT_MS, network.timeoutMs());
+  TEST_ASSERT_EQUAL_UINT32(9, network.attempts);
+  TEST_ASSERT_FALSE(network.servicesStarted);
+
+  // Across millis() wrapping
+  NetworkBoot wrapped;
+  TEST_ASSERT_EQUAL(NETWORK_CONNECT, wrapped.step(0xFFFFF000u, false));
+  TEST_ASSERT_EQUAL(NETWORK_WAIT, wrapped.step(0x00000100u, false));
+  TEST_ASSERT_EQUAL(NETWORK_CONNECT, wrapped.step(0xFFFFF000u + NETWORK_CONNECT_TIMEOUT_MS, false));
+}
+
+void test_network_reconnects_without_restarting_services(void) {
+  NetworkBoot network;
+  network.step(0, false);
+  TEST_ASSERT_EQUAL(NETWORK_START_SERVICES, network.step(2000, true));
+
+  // Dropped: the driver gets a chance to rejoin by itself first
+  TEST_ASSERT_EQUAL(NETWORK_WAIT, network.step(60000, false));
+  TEST_ASSERT_EQUAL_UINT32(1, network.drops);
+  TEST_ASSERT_EQUAL(NETWORK_CONNECTED, network.step(64000, true));
+  TEST_ASSERT_EQUAL_UINT32(1, network.attempts);
+
+  // And is started over if it doesn't
+  network.step(70000, false);
+  TEST_ASSERT_EQUAL(NETWORK_CONNECT, network.step(70000 + NETWORK_CONNECT_TIMEOUT_MS, false));
+  TEST_ASSERT_EQUAL(NETWORK_CONNECTED, network.step(90000, true));
+  TEST_ASSERT_EQUAL_UINT32(2, network.drops);
+  // A good connection resets the backoff
+  TEST_ASSERT_EQUAL_UINT32(NETWORK_CONNECT_TIMEOUT_MS, network.timeoutMs());
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_timeline_times_each_stage);
+  RUN_TEST(test_timeline_folds_extra_stages_into_the_last);
+  RUN_TEST(test_network_starts_services_once_connected);
+  RUN_TEST(test_network_backs_off_without_an_access_point);
+  RUN_TEST(test_network_reconnects_without_restarting_services);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
@@ -0,0 +1,220 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "DirListing.h"
+
+#include <string>
+#include <vector>
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+struct FakeEntry {
+  std::string name;
+  bool dir;
+  uint32_t size;
+  int64_t mtime;
+};
+
+// Entries from a vector instead of the card
+class VectorSource : public DirListingSource {
+public:
+  std::vector<FakeEntry> entries;
+  size_t position;
+
+  VectorSource() : position(0) {}
+
+  bool next(DirEntryInfo& entry) override {
+    if (position >= entries.size()) return false;
+    const FakeEntry& e = entries[position++];
+    entry.name = e.name.c_str();
+    entry.dir = e.dir;
+    entry.size = e.size;
+    entry.mtime = e.mtime;
+    return true;
+  }
+};
+
+// A day of minute files and a few others
+static VectorSource makeDirectory() {
+  VectorSource source;
+  char name[32];
+  for (uint32_t minute = 0; minute < 1440; minute++) {
+    snprintf(name, sizeof(name), "20230723T%02u%02u00.bin0", minute / 60, minute % 60);
+    source.entries.push_back({name, false, 10440, 1690070400 + minute * 60 + 59});
+  }
+  source.entries.push_back({".hidden", false, 7, 1});
+  source.entries.push_back({"old", true, 0, 1690000000});
+  source.entries.push_back({"notes.txt", false, 100, 1690000000});
+  return source;
+}
+
+static std::string readAll(DirListingReader& reader, size_t chunk = 512) {
+  std::string out;
+  std::vector<uint8_t> buffer(chunk);
+  while (!reader.finished()) {
+    size_t length = reader.fill(buffer.data(), buffer.size());
+    out.append((const char*)buffer.data(), length);
+  }
+  return out;
+}
+
+void test_glob(void) {
+  TEST_ASSERT_TRUE(dir_glob_match("*.bin0", "20230723T000000.bin0"));
+  TEST_ASSERT_TRUE(dir_glob_match("20230723T01*", "20230723T010000.bin0"));
+  TEST_ASSERT_TRUE(dir_glob_match("2023072?T*00.bin?", "20230723T010000.bin0"));
+  TEST_ASSERT_TRUE(dir_glob_match("*", ""));
+  TEST_ASSERT_TRUE(dir_glob_match("a*b*c", "aXbYbZc"));
+  TEST_ASSERT_FALSE(dir_glob_match("*.bin0", "notes.txt"));
+  TEST_ASSERT_FALSE(dir_glob_match("a*b*c", "aXbYbZ"));
+  TEST_ASSERT_FALSE(dir_glob_match("?", ""));
+}
+
+void test_json_escape(void) {
+  char out[16];
+  TEST_ASSERT_EQUAL(13, dir_json_escape(out, sizeof(out), "a\"b\\c\x01"));
+  TEST_ASSERT_EQUAL_STRING("a\\\"b\\\\c\\u0001", out);
+  TEST_ASSERT_EQUAL(0, dir_json_escape(out, 4, "abcd"));
+}
+
+void test_first_page_builds_summary(void) {
+  VectorSource source = makeDirectory();
+  DirListingQuery query = {0, 2, NULL, false};
+  DirListingReader reader(source, "/full", query, NULL);
+  std::string json = readAll(reader);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"path\":\"/full\",\"offset\":0,\"limit\":2,\"entries\":["
+      "{\"name\":\"20230723T000000.bin0\",\"size\":10440,\"mtime\":1690070459},"
+      "{\"name\":\"20230723T000100.bin0\",\"size\":10440,\"mtime\":1690070519}],"
+      "\"next\":2,\"total\":1442,\"bytes\":15033700}",
+      json.c_str());
+  // No summary yet, so it read to the end to make one
+  DirSummary summary;
+  TEST_ASSERT_TRUE(reader.scanned(summary));
+  TEST_ASSERT_EQUAL_UINT32(1442, summary.entries);
+  TEST_ASSERT_EQUAL_INT64(1690070400 + 1439 * 60 + 59, summary.newest);
+  TEST_ASSERT_EQUAL_UINT32(1443, reader.read);
+}
+
+void test_pages_with_cached_summary(void) {
+  VectorSource whole = makeDirectory();
+  DirListingQuery all = {0, 1000, NULL, false};
+  DirListingReader first(whole, "/full", all, NULL);
+  readAll(first);
+  DirSummary summary;
+  TEST_ASSERT_TRUE(first.scanned(summary));
+
+  // Paging through with the summary reads no further than each page and lists every entry once
+  uint32_t offset = 0;
+  uint32_t pages = 0;
+  uint32_t listed = 0;
+  while (true) {
+    VectorSource source = makeDirectory();
+    DirListingQuery query = {offset, 500, NULL, false};
+    DirListingReader reader(source, "/full", query, &summary);
+    std::string json = readAll(reader, 300);
+    TEST_ASSERT_TRUE(json.find("\"total\":1442,") != std::string::npos);
+    listed += reader.listed;
+    pages++;
+    size_t next = json.find("\"next\":");
+    if (json.compare(next + 7, 4, "null") == 0) break;
+    TEST_ASSERT_FALSE(reader.complete);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(offset + 500 + 1 + 1, reader.read);
+    offset = strtoul(json.c_str() + next + 7, NULL, 10);
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, pages);
+  TEST_ASSERT_EQUAL_UINT32(1442, listed);
+}
+
+void test_filter_and_hidden(void) {
+  VectorSource source = makeDirectory();
+  DirListingQuery query = {0, 100, "*T01??00.bin0", false};
+  DirListingReader reader(source, "/full", query, NULL);
+  std::string json = readAll(reader);
+  TEST_ASSERT_EQUAL_UINT32(60, reader.listed);
+  // A filtered listing that reaches the end has exact totals, but they don't make a summary
+  TEST_ASSERT_TRUE(json.find("\"next\":null,\"total\":60,\"bytes\":626400}") != std::string::npos);
+  DirSummary summary;
+  TEST_ASSERT_FALSE(reader.scanned(summary));
+
+  VectorSource partial = makeDirectory();
+  DirListingQuery page = {0, 10, "*.bin0", false};
+  DirListingReader paged(partial, "/full", page, NULL);
+  json = readAll(paged);
+  // One that doesn't stops after the page
+  TEST_ASSERT_TRUE(json.find("\"next\":10,\"total\":null,\"bytes\":null}") != std::string::npos);
+  TEST_ASSERT_EQUAL_UINT32(11, paged.read);
+
+  VectorSource withHidden = makeDirectory();
+  DirListingQuery hidden = {1440, 10, NULL, true};
+  DirListingReader tail(withHidden, "/full", hidden, NULL);
+  json = readAll(tail);
+  TEST_ASSERT_TRUE(json.find("{\"name\":\".hidden\",\"size\":7,\"mtime\":1},{\"name\":\"old\",\"dir\":true,\"mtime\":1690000000},"
+                             "{\"name\":\"notes.txt\"") != std::string::npos);
+  TEST_ASSERT_TRUE(json.find("\"total\":1443,") != std::string::npos);
+}
+
+void test_empty_directory(void) {
+  VectorSource source;
+  DirListingQuery query = {0, 0, "", false};
+  DirListingReader reader(source, "/daily", query, NULL);
+  TEST_ASSERT_EQUAL_STRING("{\"path\":\"/daily\",\"offset\":0,\"limit\":100,\"entries\":[],\"next\":null,\"total\":0,\"bytes\":0}",
+                           readAll(reader).c_str());
+}
+
+void test_summary_cache_generations(void) {
+  DirSummaryCache cache;
+  DirSummary summary = {3, 300, 100};
+  DirSummary out;
+  TEST_ASSERT_FALSE(cache.get(out));
+  uint32_t scan = cache.current();
+  cache.store(summary, scan);
+  TEST_ASSERT_TRUE(cache.get(out));
+  TEST_ASSERT_EQUAL_UINT32(3, out.entries);
+
+  // A rotation drops it, and a scan that overlapped the rotation isn't kept
+  scan = cache.current();
+  cache.invalidate();
+  TEST_ASSERT_FALSE(cache.get(out));
+  cache.store(summary, scan);
+  TEST_ASSERT_FALSE(cache.get(out));
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_glob);
+  RUN_TEST(test_json_escape);
+  RUN_TEST(test_first_page_builds_summary);
+  RUN_TEST(test_pages_with_cached_summary);
+  RUN_TEST(test_filter_and_hidden);
+  RUN_TEST(test_empty_directory);
+  RUN_TEST(test_summary_cache_generations);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
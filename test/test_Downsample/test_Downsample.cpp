@@ -0,0 +1,211 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "Downsample.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+// A day at 1 Hz: a slow load cycle, noise, a few steps and one single-sample spike
+static const int64_t X0 = 1690070400;
+static const uint32_t SAMPLES = 86400;
+static const uint32_t SPIKE_AT = 51234;
+
+static int32_t sampleAt(uint32_t i) {
+  double value = 2000.0 * sin(i * 2 * M_PI / 21600.0);
+  value += (int32_t)((i * 2654435761u) >> 24) % 64 - 32;
+  if (i / 7200 % 3 == 1) value += 800;
+  if (i == SPIKE_AT) value += 9000;
+  return (int32_t)value;
+}
+
+static std::vector<DownsamplePoint> runLttb(uint32_t points) {
+  LttbStream stream;
+  std::vector<DownsamplePoint> out;
+  DownsamplePoint point;
+  stream.setup(X0, X0 + SAMPLES, points);
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    stream.add(X0 + i, sampleAt(i));
+    while (stream.pop(point)) out.push_back(point);
+  }
+  stream.finish();
+  while (stream.pop(point)) out.push_back(point);
+  return out;
+}
+
+// Textbook LTTB over the whole array, to compare against
+static std::vector<DownsamplePoint> referenceLttb(uint32_t points) {
+  std::vector<DownsamplePoint> out;
+  double every = (double)(SAMPLES - 2) / (points - 2);
+  uint32_t a = 0;
+  out.push_back({X0, sampleAt(0), sampleAt(0)});
+  for (uint32_t b = 0; b < points - 2; b++) {
+    uint32_t start = (uint32_t)(b * every) + 1;
+    uint32_t end = (uint32_t)((b + 1) * every) + 1;
+    uint32_t nextEnd = (uint32_t)((b + 2) * every) + 1;
+    if (nextEnd > SAMPLES) nextEnd = SAMPLES;
+    double cx = 0, cy = 0;
+    for (uint32_t i = end; i < nextEnd; i++) {
+      cx += i;
+      cy += sampleAt(i);
+    }
+    cx /= nextEnd - end;
+    cy /= nextEnd - end;
+    double best = -1;
+    uint32_t pick = start;
+    for (uint32_t i = start; i < end; i++) {
+      double area = fabs(((double)i - a) * (cy - sampleAt(a)) - ((double)sampleAt(i) - sampleAt(a)) * (cx - a));
+      if (area > best) {
+        best = area;
+        pick = i;
+      }
+    }
+    out.push_back({X0 + pick, sampleAt(pick), sampleAt(pick)});
+    a = pick;
+  }
+  out.push_back({X0 + SAMPLES - 1, sampleAt(SAMPLES - 1), sampleAt(SAMPLES - 1)});
+  return out;
+}
+
+// What a chart shows: split the day into `columns` pixel columns and compare the vertical extent
+// of the line through `points` in each column with the extent of the original samples there.
+// Returns the mean of |min error| + |max error| per column.
+static double columnError(const std::vector<DownsamplePoint>& points, uint32_t columns) {
+  double sum = 0;
+  size_t segment = 0;
+  for (uint32_t c = 0; c < columns; c++) {
+    uint32_t first = (uint32_t)((uint64_t)c * SAMPLES / columns);
+    uint32_t end = (uint32_t)((uint64_t)(c + 1) * SAMPLES / columns);
+    int32_t trueMin = INT32_MAX, trueMax = INT32_MIN;
+    double drawnMin = INFINITY, drawnMax = -INFINITY;
+    for (uint32_t i = first; i < end; i++) {
+      int64_t x = X0 + i;
+      if (sampleAt(i) < trueMin) trueMin = sampleAt(i);
+      if (sampleAt(i) > trueMax) trueMax = sampleAt(i);
+      while (segment + 2 < points.size() && points[segment + 1].x <= x) segment++;
+      const DownsamplePoint& a = points[segment];
+      const DownsamplePoint& b = points[segment + 1];
+      double y = a.y + (double)(b.y - a.y) * (x - a.x) / (double)(b.x - a.x);
+      if (y < drawnMin) drawnMin = y;
+      if (y > drawnMax) drawnMax = y;
+    }
+    sum += fabs(drawnMin - trueMin) + fabs(drawnMax - trueMax);
+  }
+  return sum / columns;
+}
+
+void test_minmax_envelope_contains_every_sample(void) {
+  MinMaxStream stream;
+  std::vector<DownsamplePoint> out;
+  DownsamplePoint point;
+  stream.setup(X0, X0 + SAMPLES, 500);
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    stream.add(X0 + i, sampleAt(i));
+    while (stream.pop(point)) out.push_back(point);
+  }
+  stream.finish();
+  while (stream.pop(point)) out.push_back(point);
+
+  TEST_ASSERT_EQUAL(500, out.size());
+  size_t bucket = 0;
+  bool spikeShown = false;
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    while (bucket + 1 < out.size() && out[bucket + 1].x <= X0 + i) bucket++;
+    TEST_ASSERT_LESS_OR_EQUAL(X0 + i, out[bucket].x);
+    TEST_ASSERT_LESS_OR_EQUAL(sampleAt(i), out[bucket].y);
+    TEST_ASSERT_GREATER_OR_EQUAL(sampleAt(i), out[bucket].y2);
+    if (i == SPIKE_AT) spikeShown = out[bucket].y2 == sampleAt(i);
+  }
+  TEST_ASSERT_TRUE(spikeShown);
+}
+
+void test_lttb_keeps_real_samples_and_ends(void) {
+  std::vector<DownsamplePoint> out = runLttb(500);
+  TEST_ASSERT_LESS_OR_EQUAL(500, out.size());
+  TEST_ASSERT_GREATER_THAN(480, out.size());
+  TEST_ASSERT_EQUAL(X0, out.front().x);
+  TEST_ASSERT_EQUAL(X0 + SAMPLES - 1, out.back().x);
+  bool spikeKept = false;
+  for (size_t i = 0; i < out.size(); i++) {
+    if (i > 0) TEST_ASSERT_GREATER_THAN(out[i - 1].x, out[i].x);
+    TEST_ASSERT_EQUAL(sampleAt((uint32_t)(out[i].x - X0)), out[i].y);
+    if (out[i].x == X0 + SPIKE_AT) spikeKept = true;
+  }
+  TEST_ASSERT_TRUE(spikeKept);
+}
+
+// A 1000 pixel wide chart drawn from 500 streamed LTTB points should look about as much like the
+// full day as one from textbook LTTB, and more than one from plain decimation
+void test_lttb_fidelity_against_full_series(void) {
+  std::vector<DownsamplePoint> streamed = runLttb(500);
+  std::vector<DownsamplePoint> reference = referenceLttb(500);
+  std::vector<DownsamplePoint> decimated;
+  for (uint32_t i = 0; i < SAMPLES; i += SAMPLES / 499) decimated.push_back({X0 + i, sampleAt(i), sampleAt(i)});
+  decimated.push_back({X0 + SAMPLES - 1, sampleAt(SAMPLES - 1), sampleAt(SAMPLES - 1)});
+
+  double streamedError = columnError(streamed, 1000);
+  double referenceError = columnError(reference, 1000);
+  double decimatedError = columnError(decimated, 1000);
+  printf("Column extent error: streamed LTTB %.1f, reference LTTB %.1f, decimation %.1f\n", streamedError, referenceError,
+         decimatedError);
+  TEST_ASSERT_TRUE(streamedError <= referenceError * 1.15);
+  TEST_ASSERT_TRUE(streamedError < decimatedError);
+}
+
+void test_short_and_empty_inputs(void) {
+  LttbStream stream;
+  DownsamplePoint point;
+  stream.setup(X0, X0 + 10, 100);
+  stream.finish();
+  TEST_ASSERT_FALSE(stream.pop(point));
+
+  stream.setup(X0, X0 + 10, 100);
+  stream.add(X0, 5);
+  stream.add(X0 + 1, 7);
+  stream.finish();
+  TEST_ASSERT_TRUE(stream.pop(point));
+  TEST_ASSERT_EQUAL(5, point.y);
+  TEST_ASSERT_TRUE(stream.pop(point));
+  TEST_ASSERT_EQUAL(7, point.y);
+  TEST_ASSERT_FALSE(stream.pop(point));
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_minmax_envelope_contains_every_sample);
+  RUN_TEST(test_lttb_keeps_real_samples_and_ends);
+  RUN_TEST(test_lttb_fidelity_against_full_series);
+  RUN_TEST(test_short_and_empty_inputs);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
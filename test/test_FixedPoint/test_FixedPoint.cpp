@@ -0,0 +1,86 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "FixedPoint.h"
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+void test_shunt_scale_100_micro_ohm(void) {
+  ShuntScale scale(100);
+  ShuntReading reading;
+  // 12.0V bus, 1000 LSB shunt = 2.5mV across 100uOhm = 25A
+  scale.convert(9600, 1000, reading);
+  TEST_ASSERT_EQUAL_INT32(12000000, reading.busMicroVolts);
+  TEST_ASSERT_EQUAL_INT32(2500000, reading.shuntNanoVolts);
+  TEST_ASSERT_EQUAL_INT32(25000000, reading.microAmps);
+  TEST_ASSERT_EQUAL_INT64(300000000, reading.microWatts);
+}
+
+void test_shunt_scale_negative_current(void) {
+  ShuntScale scale(100);
+  ShuntReading reading;
+  scale.convert(9600, -3, reading);
+  TEST_ASSERT_EQUAL_INT32(-7500, reading.shuntNanoVolts);
+  TEST_ASSERT_EQUAL_INT32(-75000, reading.microAmps);
+  TEST_ASSERT_EQUAL_INT64(-900000, reading.microWatts);
+}
+
+void test_shunt_scale_inexact_resistance(void) {
+  // 2.5uV / 0.3 Ohm = 8.333uA per LSB
+  ShuntScale scale(300000);
+  TEST_ASSERT_EQUAL_INT32(8, scale.microAmps(1));
+  TEST_ASSERT_EQUAL_INT32(83333, scale.microAmps(10000));
+  TEST_ASSERT_EQUAL_INT32(-83333, scale.microAmps(-10000));
+}
+
+void test_fixed_writer(void) {
+  char buffer[32];
+  FixedWriter writer(buffer, sizeof(buffer));
+  writer.appendFixed(12345678, 6);
+  writer.append(',');
+  writer.appendFixed(-7500, 9);
+  writer.append(',');
+  writer.appendFixed(5, 0);
+  writer.append(',');
+  writer.appendInt(INT64_MIN);
+  TEST_ASSERT_EQUAL_STRING("12.345678,-0.000007500,5,-92233", buffer);
+  TEST_ASSERT_TRUE(writer.truncated);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(buffer) - 1, writer.length);
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_shunt_scale_100_micro_ohm);
+  RUN_TEST(test_shunt_scale_negative_current);
+  RUN_TEST(test_shunt_scale_inexact_resistance);
+  RUN_TEST(test_fixed_writer);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
@@ -0,0 +1,201 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "HttpRange.h"
+
+#include <string>
+#include <vector>
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+// What the log file handler does with a plan, minus the web server: status, headers and body
+struct Reply {
+  int status;
+  std::string etag;
+  std::string contentRange;
+  std::vector<uint8_t> body;
+};
+
+static Reply serve(const std::vector<uint8_t>& file, int64_t mtime, const HttpConditionalHeaders& headers) {
+  HttpFilePlan plan;
+  http_file_plan((uint32_t)file.size(), mtime, headers, plan);
+  Reply reply;
+  reply.status = plan.status;
+  reply.etag = plan.etag;
+  reply.contentRange = plan.contentRange;
+  reply.body.assign(file.begin() + plan.offset, file.begin() + plan.offset + plan.length);
+  return reply;
+}
+
+static void append(std::vector<uint8_t>& file, size_t length) {
+  for (size_t i = 0; i < length; i++) file.push_back((uint8_t)(file.size() * 31));
+}
+
+void test_http_dates(void) {
+  char text[HTTP_DATE_SIZE];
+  http_date_format(784111777, text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("Sun, 06 Nov 1994 08:49:37 GMT", text);
+  http_date_format(1690156800, text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("Mon, 24 Jul 2023 00:00:00 GMT", text);
+
+  int64_t time = 0;
+  TEST_ASSERT_TRUE(http_date_parse("Sun, 06 Nov 1994 08:49:37 GMT", time));
+  TEST_ASSERT_EQUAL_INT64(784111777, time);
+  TEST_ASSERT_TRUE(http_date_parse("Mon, 24 Jul 2023 00:00:00 GMT", time));
+  TEST_ASSERT_EQUAL_INT64(1690156800, time);
+  TEST_ASSERT_FALSE(http_date_parse("Sunday, 06-Nov-94 08:49:37 GMT", time));
+  TEST_ASSERT_FALSE(http_date_parse("Sun, 06 Foo 1994 08:49:37 GMT", time));
+}
+
+void test_range_parsing(void) {
+  uint32_t offset = 0, length = 0;
+  TEST_ASSERT_EQUAL(1, http_range_parse("bytes=0-99", 1000, offset, length));
+  TEST_ASSERT_EQUAL_UINT32(0, offset);
+  TEST_ASSERT_EQUAL_UINT32(100, length);
+  TEST_ASSERT_EQUAL(1, http_range_parse("bytes=900-", 1000, offset, length));
+  TEST_ASSERT_EQUAL_UINT32(900, offset);
+  TEST_ASSERT_EQUAL_UINT32(100, length);
+  TEST_ASSERT_EQUAL(1, http_range_parse("bytes=-10", 1000, offset, length));
+  TEST_ASSERT_EQUAL_UINT32(990, offset);
+  TEST_ASSERT_EQUAL_UINT32(10, length);
+  // A last byte past the end is clamped, a suffix longer than the file is the whole file
+  TEST_ASSERT_EQUAL(1, http_range_parse("bytes=500-5000", 1000, offset, length));
+  TEST_ASSERT_EQUAL_UINT32(500, length);
+  TEST_ASSERT_EQUAL(1, http_range_parse("bytes=-5000", 1000, offset, length));
+  TEST_ASSERT_EQUAL_UINT32(0, offset);
+  TEST_ASSERT_EQUAL_UINT32(1000, length);
+
+  TEST_ASSERT_EQUAL(-1, http_range_parse("bytes=1000-", 1000, offset, length));
+  TEST_ASSERT_EQUAL(-1, http_range_parse("bytes=-0", 1000, offset, length));
+  TEST_ASSERT_EQUAL(-1, http_range_parse("bytes=0-", 0, offset, length));
+
+  TEST_ASSERT_EQUAL(0, http_range_parse("bytes=0-9,20-29", 1000, offset, length));
+  TEST_ASSERT_EQUAL(0, http_range_parse("bytes=9-0", 1000, offset, length));
+  TEST_ASSERT_EQUAL(0, http_range_parse("items=0-9", 1000, offset, length));
+  TEST_ASSERT_EQUAL(0, http_range_parse("bytes=abc", 1000, offset, length));
+  TEST_ASSERT_EQUAL(0, http_range_parse("bytes=-", 1000, offset, length));
+}
+
+void test_etag_lists(void) {
+  char etag[HTTP_ETAG_SIZE];
+  http_etag(532, 1690156800, etag, sizeof(etag));
+  TEST_ASSERT_EQUAL_STRING("\"214-64bdbf00\"", etag);
+  TEST_ASSERT_TRUE(http_etag_list_matches("\"214-64bdbf00\"", etag));
+  TEST_ASSERT_TRUE(http_etag_list_matches("W/\"214-64bdbf00\"", etag));
+  TEST_ASSERT_TRUE(http_etag_list_matches("\"1-2\", \"214-64bdbf00\"", etag));
+  TEST_ASSERT_TRUE(http_etag_list_matches("*", etag));
+  TEST_ASSERT_FALSE(http_etag_list_matches("\"214-64bdbf01\"", etag));
+  TEST_ASSERT_FALSE(http_etag_list_matches("\"214-64bdbf00", etag));
+  TEST_ASSERT_FALSE(http_etag_list_matches("", etag));
+}
+
+void test_conditional_get(void) {
+  std::vector<uint8_t> file;
+  append(file, 532);
+  HttpConditionalHeaders none = {NULL, NULL, NULL, NULL};
+  Reply first = serve(file, 1690156800, none);
+  TEST_ASSERT_EQUAL(200, first.status);
+  TEST_ASSERT_EQUAL(532, first.body.size());
+
+  HttpConditionalHeaders match = {NULL, first.etag.c_str(), NULL, NULL};
+  Reply again = serve(file, 1690156800, match);
+  TEST_ASSERT_EQUAL(304, again.status);
+  TEST_ASSERT_EQUAL(0, again.body.size());
+
+  // If-Modified-Since only counts without If-None-Match
+  HttpConditionalHeaders since = {NULL, NULL, "Mon, 24 Jul 2023 00:00:00 GMT", NULL};
+  TEST_ASSERT_EQUAL(304, serve(file, 1690156800, since).status);
+  TEST_ASSERT_EQUAL(200, serve(file, 1690156801, since).status);
+  HttpConditionalHeaders both = {NULL, "\"0-0\"", "Mon, 24 Jul 2023 00:00:00 GMT", NULL};
+  TEST_ASSERT_EQUAL(200, serve(file, 1690156800, both).status);
+
+  // Range with a stale If-Range gets the whole file, a current one gets the range
+  HttpConditionalHeaders staleRange = {"bytes=0-9", NULL, NULL, "\"0-0\""};
+  TEST_ASSERT_EQUAL(200, serve(file, 1690156800, staleRange).status);
+  HttpConditionalHeaders currentRange = {"bytes=0-9", NULL, NULL, first.etag.c_str()};
+  Reply ranged = serve(file, 1690156800, currentRange);
+  TEST_ASSERT_EQUAL(206, ranged.status);
+  TEST_ASSERT_EQUAL_STRING("bytes 0-9/532", ranged.contentRange.c_str());
+  HttpConditionalHeaders dateRange = {"bytes=0-9", NULL, NULL, "Mon, 24 Jul 2023 00:00:00 GMT"};
+  TEST_ASSERT_EQUAL(206, serve(file, 1690156800, dateRange).status);
+  TEST_ASSERT_EQUAL(200, serve(file, 1690156860, dateRange).status);
+}
+
+// A collector keeping a copy of a daily file that grows by a rollup record a minute, asking for
+// just the tail each time
+void test_collector_pulls_appended_tail(void) {
+  std::vector<uint8_t> file;
+  std::vector<uint8_t> copy;
+  std::string etag;
+  int64_t mtime = 1690156800;
+  uint32_t transferred = 0;
+  uint32_t notModified = 0;
+  for (uint32_t poll = 0; poll < 30; poll++) {
+    // Appends on two polls out of three
+    if (poll % 3 != 2) {
+      append(file, 532);
+      mtime += 60;
+    }
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%zu-", copy.size());
+    HttpConditionalHeaders headers = {copy.empty() ? NULL : range, etag.empty() ? NULL : etag.c_str(), NULL, NULL};
+    Reply reply = serve(file, mtime, headers);
+    if (reply.status == 304) {
+      notModified++;
+      continue;
+    }
+    TEST_ASSERT_TRUE(reply.status == (copy.empty() ? 200 : 206));
+    copy.insert(copy.end(), reply.body.begin(), reply.body.end());
+    transferred += reply.body.size();
+    etag = reply.etag;
+  }
+  TEST_ASSERT_TRUE(copy == file);
+  TEST_ASSERT_EQUAL_UINT32(file.size(), transferred);
+  TEST_ASSERT_EQUAL_UINT32(10, notModified);
+
+  // Without a validator, asking for the bytes after the end says how big the file is
+  char range[32];
+  snprintf(range, sizeof(range), "bytes=%zu-", file.size());
+  HttpConditionalHeaders atEnd = {range, NULL, NULL, NULL};
+  Reply reply = serve(file, mtime, atEnd);
+  TEST_ASSERT_EQUAL(416, reply.status);
+  TEST_ASSERT_EQUAL_STRING("bytes */10640", reply.contentRange.c_str());
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_http_dates);
+  RUN_TEST(test_range_parsing);
+  RUN_TEST(test_etag_lists);
+  RUN_TEST(test_conditional_get);
+  RUN_TEST(test_collector_pulls_appended_tail);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
@@ -0,0 +1,125 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "I2CRecovery.h"
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+// Two open-drain lines and a slave that holds SDA low for `heldBits` more clocks
+struct FakeBus {
+  bool sdaDriven = false;
+  bool sclDriven = false;
+  bool sclStuck = false;
+  uint8_t heldBits = 0;
+  uint32_t clocks = 0;
+  uint32_t stops = 0;
+
+  bool sda() { return !sdaDriven && heldBits == 0; }
+  bool scl() { return !sclDriven && !sclStuck; }
+  void driveSdaLow() { sdaDriven = true; }
+  void driveSclLow() { sclDriven = true; }
+  void releaseSda() {
+    // SDA rising with SCL high is a STOP
+    if (sdaDriven && scl() && heldBits == 0) stops++;
+    sdaDriven = false;
+  }
+  void releaseScl() {
+    bool rising = sclDriven && !sclStuck;
+    sclDriven = false;
+    if (!rising) return;
+    clocks++;
+    if (heldBits > 0) heldBits--;
+  }
+  void wait() {}
+};
+
+void test_idle_bus_just_gets_a_stop(void) {
+  FakeBus bus;
+  TEST_ASSERT_TRUE(i2c_bus_clear(bus));
+  TEST_ASSERT_EQUAL_UINT32(1, bus.stops);
+  TEST_ASSERT_TRUE(bus.sda() && bus.scl());
+}
+
+void test_slave_holding_sda_is_clocked_free(void) {
+  FakeBus bus;
+  bus.heldBits = 5;
+  TEST_ASSERT_TRUE(i2c_bus_clear(bus));
+  // Five to let go, one more in the STOP
+  TEST_ASSERT_EQUAL_UINT32(6, bus.clocks);
+  TEST_ASSERT_EQUAL_UINT32(1, bus.stops);
+  TEST_ASSERT_TRUE(bus.sda() && bus.scl());
+}
+
+void test_gives_up_after_nine_clocks(void) {
+  FakeBus bus;
+  bus.heldBits = 100;
+  TEST_ASSERT_FALSE(i2c_bus_clear(bus));
+  TEST_ASSERT_EQUAL_UINT32(I2C_CLEAR_CLOCKS, bus.clocks);
+  TEST_ASSERT_EQUAL_UINT32(0, bus.stops);
+  // SCL left released, not driven
+  TEST_ASSERT_FALSE(bus.sclDriven);
+
+  // Nor is a clock held low clocked at all
+  FakeBus stretched;
+  stretched.sclStuck = true;
+  stretched.heldBits = 1;
+  TEST_ASSERT_FALSE(i2c_bus_clear(stretched));
+  TEST_ASSERT_EQUAL_UINT32(0, stretched.clocks);
+}
+
+void test_stats_sort_the_errors(void) {
+  I2CBusStats stats;
+  const uint8_t errors[] = {I2C_OK, I2C_OK, I2C_NACK_ADDRESS, I2C_NACK_DATA, I2C_TIMEOUT, I2C_SHORT_READ,
+                            I2C_BUS_ERROR, I2C_DATA_TOO_LONG};
+  for (uint8_t error : errors) stats.count(error);
+  TEST_ASSERT_EQUAL_UINT32(8, stats.reads);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.nacks);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.timeouts);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.shortReads);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.busErrors);
+
+  // A device not answering is the device's problem, not the bus's
+  TEST_ASSERT_FALSE(i2c_needs_recovery(I2C_OK));
+  TEST_ASSERT_FALSE(i2c_needs_recovery(I2C_NACK_ADDRESS));
+  TEST_ASSERT_FALSE(i2c_needs_recovery(I2C_NACK_DATA));
+  TEST_ASSERT_TRUE(i2c_needs_recovery(I2C_TIMEOUT));
+  TEST_ASSERT_TRUE(i2c_needs_recovery(I2C_BUS_ERROR));
+  TEST_ASSERT_TRUE(i2c_needs_recovery(I2C_SHORT_READ));
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_bus_just_gets_a_stop);
+  RUN_TEST(test_slave_holding_sda_is_clocked_free);
+  RUN_TEST(test_gives_up_after_nine_clocks);
+  RUN_TEST(test_stats_sort_the_errors);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
@@ -0,0 +1,246 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "InaTopology.h"
+#include "InaHealth.h"
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+static const uint32_t SETTINGS_VALUES[] = {1, 100, 8500, 8500, 16, 7};
+static const uint32_t SETTINGS = ina_topology_fingerprint(SETTINGS_VALUES, 6);
+
+// Three INA226s on bus A, two on bus B, as the logger configures them
+static InaTopology fleet() {
+  InaTopology topology;
+  topology.settings = SETTINGS;
+  const uint8_t buses[] = {0, 0, 0, 1, 1};
+  const uint8_t addresses[] = {0x40, 0x41, 0x44, 0x40, 0x45};
+  for (uint8_t i = 0; i < 5; i++) {
+    InaTopologyDevice device = {buses[i], addresses[i], 1, 0x4F27, 1, 100};
+    topology.add(device);
+  }
+  return topology;
+}
+
+// What the buses read back: the cached configuration unless told otherwise
+struct FakeBus {
+  uint16_t config[2][128];
+  bool present[2][128];
+  uint32_t reads;
+
+  explicit FakeBus(const InaTopology& topology) : reads(0) {
+    for (uint8_t bus = 0; bus < 2; bus++) {
+      for (uint8_t address = 0; address < 128; address++) {
+        present[bus][address] = false;
+        config[bus][address] = 0;
+      }
+    }
+    for (uint8_t i = 0; i < topology.count; i++) {
+      present[topology.devices[i].bus][topology.devices[i].address] = true;
+      config[topology.devices[i].bus][topology.devices[i].address] = topology.devices[i].config;
+    }
+  }
+
+  bool operator()(uint8_t bus, uint8_t address, uint16_t& value) {
+    reads++;
+    if (!present[bus][address]) return false;
+    value = config[bus][address];
+    return true;
+  }
+};
+
+void test_round_trip(void) {
+  InaTopology topology = fleet();
+  uint8_t blob[INA_TOPOLOGY_MAX_SIZE];
+  size_t length = topology.encode(blob);
+  TEST_ASSERT_EQUAL(INA_TOPOLOGY_HEADER_SIZE + 5 * INA_TOPOLOGY_DEVICE_SIZE, length);
+
+  InaTopology decoded;
+  TEST_ASSERT_TRUE(decoded.decode(blob, length));
+  TEST_ASSERT_TRUE(decoded == topology);
+  TEST_ASSERT_EQUAL_UINT8(3, decoded.countOnBus(0));
+  TEST_ASSERT_EQUAL_UINT8(2, decoded.countOnBus(1));
+  TEST_ASSERT_EQUAL_HEX16(0x4F27, decoded.devices[4].config);
+  TEST_ASSERT_EQUAL_UINT8(0x45, decoded.devices[4].address);
+  TEST_ASSERT_EQUAL_HEX32(SETTINGS, decoded.settings);
+}
+
+void test_decode_rejects_other_layouts(void) {
+  InaTopology topology = fleet();
+  uint8_t blob[INA_TOPOLOGY_MAX_SIZE];
+  size_t length = topology.encode(blob);
+  InaTopology decoded;
+
+  // Cut short, or with an extra byte
+  TEST_ASSERT_FALSE(decoded.decode(blob, length - 1));
+  TEST_ASSERT_FALSE(decoded.decode(blob, length + 1));
+  TEST_ASSERT_EQUAL_UINT8(0, decoded.count);
+  // Another version
+  blob[4]++;
+  TEST_ASSERT_FALSE(decoded.decode(blob, length));
+  blob[4]--;
+  // Not ours at all
+  blob[0] ^= 0xFF;
+  TEST_ASSERT_FALSE(decoded.decode(blob, length));
+  blob[0] ^= 0xFF;
+  TEST_ASSERT_TRUE(decoded.decode(blob, length));
+
+  // Full is fine, past it isn't
+  InaTopology full;
+  InaTopologyDevice device = {0, 0x40, 1, 0x4F27, 1, 100};
+  for (uint8_t i = 0; i < INA_TOPOLOGY_MAX_DEVICES; i++) TEST_ASSERT_TRUE(full.add(device));
+  TEST_ASSERT_FALSE(full.add(device));
+  TEST_ASSERT_TRUE(decoded.decode(blob, full.encode(blob)));
+  TEST_ASSERT_EQUAL_UINT8(INA_TOPOLOGY_MAX_DEVICES, decoded.count);
+}
+
+void test_check_reads_each_device_once(void) {
+  InaTopology topology = fleet();
+  FakeBus bus(topology);
+  TEST_ASSERT_EQUAL_UINT8(5, topology.check(SETTINGS, bus));
+  TEST_ASSERT_EQUAL_UINT32(5, bus.reads);
+}
+
+void test_check_skips_a_cache_from_other_settings(void) {
+  InaTopology topology = fleet();
+  FakeBus bus(topology);
+  // Averaging 64 rather than 16: the devices read back as cached, but aren't what's wanted
+  const uint32_t values[] = {1, 100, 8500, 8500, 64, 7};
+  uint32_t settings = ina_topology_fingerprint(values, 6);
+  TEST_ASSERT_TRUE(settings != SETTINGS);
+  TEST_ASSERT_EQUAL_UINT8(0, topology.check(settings, bus));
+  TEST_ASSERT_EQUAL_UINT32(0, bus.reads);
+}
+
+void test_check_finds_the_first_mismatch(void) {
+  InaTopology topology = fleet();
+
+  // Power-cycled: back to the power-on configuration
+  FakeBus reset(topology);
+  reset.config[0][0x44] = 0x4127;
+  TEST_ASSERT_EQUAL_UINT8(2, topology.check(SETTINGS, reset));
+  // Stops at the first
+  TEST_ASSERT_EQUAL_UINT32(3, reset.reads);
+
+  // Unplugged
+  FakeBus gone(topology);
+  gone.present[1][0x45] = false;
+  TEST_ASSERT_EQUAL_UINT8(4, topology.check(SETTINGS, gone));
+
+  // Moved to another address: the cached one doesn't answer
+  FakeBus moved(topology);
+  moved.present[1][0x40] = false;
+  moved.present[1][0x4A] = true;
+  moved.config[1][0x4A] = 0x4F27;
+  TEST_ASSERT_EQUAL_UINT8(3, topology.check(SETTINGS, moved));
+
+  // Nothing cached is never a match
+  InaTopology empty;
+  FakeBus none(empty);
+  TEST_ASSERT_EQUAL_UINT8(0, empty.check(0, none));
+  TEST_ASSERT_EQUAL_UINT32(0, none.reads);
+}
+
+void test_health_gives_up_after_failures_in_a_row(void) {
+  InaDeviceHealth health;
+  // Odd failures are missing samples, not a missing device
+  for (uint8_t i = 0; i < 9; i++) {
+    TEST_ASSERT_FALSE(health.read(i % INA_HEALTH_FAILURES != 0, 1000 + i));
+  }
+  TEST_ASSERT_TRUE(health.present());
+  TEST_ASSERT_EQUAL_UINT32(3, health.errors);
+
+  for (uint8_t i = 1; i < INA_HEALTH_FAILURES; i++) TEST_ASSERT_FALSE(health.read(false, 2000 + i));
+  TEST_ASSERT_TRUE(health.read(false, 3000));
+  TEST_ASSERT_FALSE(health.present());
+  TEST_ASSERT_EQUAL_UINT32(1, health.dropouts);
+  // Only the once
+  TEST_ASSERT_FALSE(health.read(false, 3001));
+  TEST_ASSERT_EQUAL_UINT32(1, health.dropouts);
+}
+
+void test_health_reprobes_with_backoff(void) {
+  InaDeviceHealth health;
+  for (uint8_t i = 0; i < INA_HEALTH_FAILURES; i++) health.read(false, 10000);
+  TEST_ASSERT_FALSE(health.probeDue(10000 + INA_HEALTH_REPROBE_MS - 1));
+  TEST_ASSERT_TRUE(health.probeDue(10000 + INA_HEALTH_REPROBE_MS));
+
+  // 1 s, 2 s, 4 s, ... up to the maximum
+  uint32_t now = 10000;
+  uint32_t expected = INA_HEALTH_REPROBE_MS;
+  for (uint8_t i = 0; i < 10; i++) {
+    now += expected;
+    TEST_ASSERT_TRUE(health.probeDue(now));
+    TEST_ASSERT_FALSE(health.probed(false, now));
+    expected = expected * 2 > INA_HEALTH_MAX_REPROBE_MS ? INA_HEALTH_MAX_REPROBE_MS : expected * 2;
+    TEST_ASSERT_EQUAL_UINT32(expected, health.reprobe.waitMs);
+    TEST_ASSERT_FALSE(health.probeDue(now + expected - 1));
+  }
+
+  // Back: read again, and a later dropout starts the backoff over
+  TEST_ASSERT_TRUE(health.probed(true, now + expected));
+  TEST_ASSERT_TRUE(health.present());
+  TEST_ASSERT_FALSE(health.probeDue(now + 10 * INA_HEALTH_MAX_REPROBE_MS));
+  TEST_ASSERT_EQUAL_UINT32(1, health.recoveries);
+  for (uint8_t i = 0; i < INA_HEALTH_FAILURES; i++) health.read(false, 0xFFFFFF00u);
+  TEST_ASSERT_EQUAL_UINT32(INA_HEALTH_REPROBE_MS, health.reprobe.waitMs);
+  // Across millis() wrapping
+  TEST_ASSERT_FALSE(health.probeDue(0x00000010u));
+  TEST_ASSERT_TRUE(health.probeDue(0xFFFFFF00u + INA_HEALTH_REPROBE_MS));
+}
+
+void test_scan_backoff_starts_over(void) {
+  InaBackoff scan(INA_HEALTH_SCAN_MS, INA_HEALTH_MAX_SCAN_MS);
+  scan.start(0);
+  uint32_t now = 0;
+  for (uint8_t i = 0; i < 12; i++) {
+    now += scan.waitMs;
+    TEST_ASSERT_TRUE(scan.due(now));
+    scan.retry(now);
+  }
+  TEST_ASSERT_EQUAL_UINT32(INA_HEALTH_MAX_SCAN_MS, scan.waitMs);
+  scan.start(now);
+  TEST_ASSERT_FALSE(scan.due(now + INA_HEALTH_SCAN_MS - 1));
+  TEST_ASSERT_TRUE(scan.due(now + INA_HEALTH_SCAN_MS));
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_decode_rejects_other_layouts);
+  RUN_TEST(test_check_reads_each_device_once);
+  RUN_TEST(test_check_skips_a_cache_from_other_settings);
+  RUN_TEST(test_check_finds_the_first_mismatch);
+  RUN_TEST(test_health_gives_up_after_failures_in_a_row);
+  RUN_TEST(test_health_reprobes_with_backoff);
+  RUN_TEST(test_scan_backoff_starts_over);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
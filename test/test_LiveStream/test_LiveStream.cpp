@@ -0,0 +1,215 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "LiveStream.h"
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+static LiveSample makeSample(int64_t timestampMicros, uint16_t bus, int16_t shunt) {
+  LiveSample sample;
+  sample.timestampMicros = timestampMicros;
+  for (uint8_t ch = 0; ch < LIVE_STREAM_CHANNELS; ch++) {
+    sample.busRaw[ch] = bus + ch;
+    sample.shuntRaw[ch] = shunt - ch;
+  }
+  return sample;
+}
+
+void test_parse_subscribe(void) {
+  const uint8_t message[] = {LIVE_MSG_SUBSCRIBE, 0xFF, 0xB8, 0x0B};  // 3000 ms
+  LiveSubscription subscription;
+  TEST_ASSERT_TRUE(live_parse_subscribe(message, sizeof(message), 1000, subscription));
+  TEST_ASSERT_EQUAL_UINT8(0x1F, subscription.channelMask);
+  TEST_ASSERT_EQUAL_UINT16(3, subscription.decimation);
+
+  // Faster than the sample rate means every sample
+  const uint8_t fast[] = {LIVE_MSG_SUBSCRIBE, 0x01, 100, 0};
+  TEST_ASSERT_TRUE(live_parse_subscribe(fast, sizeof(fast), 1000, subscription));
+  TEST_ASSERT_EQUAL_UINT16(1, subscription.decimation);
+
+  TEST_ASSERT_FALSE(live_parse_subscribe(fast, 3, 1000, subscription));
+}
+
+void test_single_sample_frame(void) {
+  LiveDecimator decimator;
+  LiveSubscription subscription = {0x05, 1};
+  decimator.subscribe(subscription);
+  LiveFrame liveFrame;
+  TEST_ASSERT_TRUE(decimator.add(makeSample(123456789, 9600, -40), liveFrame));
+  uint8_t frame[LIVE_FRAME_MAX_SIZE];
+  size_t size = live_encode_frame(liveFrame, frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_size_t(LIVE_FRAME_HEADER_SIZE + 2 * 4, size);
+  TEST_ASSERT_EQUAL_UINT8(LIVE_MSG_SAMPLES, frame[0]);
+  TEST_ASSERT_EQUAL_UINT8(0x05, frame[1]);
+  TEST_ASSERT_EQUAL_UINT16(1, live_get16(frame + 2));
+  // Channel 0 then channel 2
+  TEST_ASSERT_EQUAL_UINT16(9600, live_get16(frame + 16));
+  TEST_ASSERT_EQUAL_INT(-40, (int16_t)live_get16(frame + 18));
+  TEST_ASSERT_EQUAL_UINT16(9602, live_get16(frame + 20));
+  TEST_ASSERT_EQUAL_INT(-42, (int16_t)live_get16(frame + 22));
+}
+
+void test_decimation_keeps_min_max(void) {
+  LiveDecimator decimator;
+  LiveSubscription subscription = {0x01, 4};
+  decimator.subscribe(subscription);
+  LiveFrame liveFrame;
+  const int16_t shunts[] = {10, -500, 30, 20};
+  for (uint8_t i = 0; i < 4; i++) {
+    bool complete = decimator.add(makeSample(1000000 * (i + 1), 9600 + i * 10, shunts[i]), liveFrame);
+    TEST_ASSERT_EQUAL(i == 3, complete);
+  }
+  uint8_t frame[LIVE_FRAME_MAX_SIZE];
+  size_t size = live_encode_frame(liveFrame, frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_size_t(LIVE_FRAME_HEADER_SIZE + 8, size);
+  TEST_ASSERT_EQUAL_UINT16(4, live_get16(frame + 2));
+  TEST_ASSERT_EQUAL_UINT8(0, frame[4]);
+  TEST_ASSERT_EQUAL_UINT8(0x40, frame[8]);  // 1000000 = 0x0F4240
+  TEST_ASSERT_EQUAL_UINT16(9600, live_get16(frame + 16));
+  TEST_ASSERT_EQUAL_UINT16(9630, live_get16(frame + 18));
+  TEST_ASSERT_EQUAL_INT(-500, (int16_t)live_get16(frame + 20));
+  TEST_ASSERT_EQUAL_INT(30, (int16_t)live_get16(frame + 22));
+
+  // The next frame starts from scratch
+  TEST_ASSERT_FALSE(decimator.add(makeSample(5000000, 9700, 0), liveFrame));
+}
+
+void test_missing_samples_are_marked(void) {
+  LiveDecimator decimator;
+  LiveSubscription single = {0x03, 1};
+  decimator.subscribe(single);
+  LiveSample sample = makeSample(1000000, 9600, -40);
+  sample.busRaw[1] = LIVE_MISSING_BUS;
+  sample.shuntRaw[1] = LIVE_MISSING_SHUNT;
+  LiveFrame liveFrame;
+  TEST_ASSERT_TRUE(decimator.add(sample, liveFrame));
+  uint8_t frame[LIVE_FRAME_MAX_SIZE];
+  live_encode_frame(liveFrame, frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_UINT16(9600, live_get16(frame + 16));
+  TEST_ASSERT_EQUAL_UINT16(LIVE_MISSING_BUS, live_get16(frame + 20));
+  TEST_ASSERT_EQUAL_INT(LIVE_MISSING_SHUNT, (int16_t)live_get16(frame + 22));
+
+  // Decimated: the extremes of the samples there were, min > max where there were none
+  LiveSubscription decimated = {0x03, 3};
+  decimator.subscribe(decimated);
+  for (uint8_t i = 0; i < 3; i++) {
+    sample = makeSample(1000000 * (i + 1), 9600 + i * 10, -40);
+    sample.busRaw[1] = LIVE_MISSING_BUS;
+    if (i == 1) sample.busRaw[0] = LIVE_MISSING_BUS;
+    decimator.add(sample, liveFrame);
+  }
+  live_encode_frame(liveFrame, frame, sizeof(frame));
+  TEST_ASSERT_EQUAL_UINT16(9600, live_get16(frame + 16));
+  TEST_ASSERT_EQUAL_UINT16(9620, live_get16(frame + 18));
+  TEST_ASSERT_TRUE(live_get16(frame + 24) > live_get16(frame + 26));
+
+  // And stay that way when merged with frames that had some
+  LiveFrame other = liveFrame;
+  other.busMin[1] = other.busMax[1] = 9700;
+  live_merge_frames(liveFrame, other);
+  TEST_ASSERT_EQUAL_UINT16(9700, liveFrame.busMin[1]);
+  TEST_ASSERT_EQUAL_UINT16(9700, liveFrame.busMax[1]);
+}
+
+void test_wide_readings_are_clamped(void) {
+  TEST_ASSERT_EQUAL_UINT16(9600, live_bus_raw(9600));
+  TEST_ASSERT_EQUAL_UINT16(LIVE_MAX_BUS, live_bus_raw(0x10000 + 9600));
+  TEST_ASSERT_EQUAL_UINT16(LIVE_MAX_BUS, live_bus_raw(0xFFFF));
+  TEST_ASSERT_EQUAL_INT(-40, live_shunt_raw(-40));
+  TEST_ASSERT_EQUAL_INT(LIVE_MAX_SHUNT, live_shunt_raw(70000));
+  // Never the missing marker
+  TEST_ASSERT_EQUAL_INT(-LIVE_MAX_SHUNT, live_shunt_raw(-70000));
+  TEST_ASSERT_EQUAL_INT(-LIVE_MAX_SHUNT, live_shunt_raw(INT16_MIN));
+}
+
+void test_unsubscribed_sends_nothing(void) {
+  LiveDecimator decimator;
+  LiveFrame liveFrame;
+  TEST_ASSERT_FALSE(decimator.add(makeSample(0, 0, 0), liveFrame));
+}
+
+void test_full_queue_coalesces_oldest(void) {
+  LiveFrameQueue<3> queue;
+  LiveDecimator decimator;
+  LiveSubscription subscription = {0x01, 1};
+  decimator.subscribe(subscription);
+  LiveFrame liveFrame;
+  const int16_t shunts[] = {5, -900, 7, 8};
+  for (uint8_t i = 0; i < 4; i++) {
+    decimator.add(makeSample(i, 9600, shunts[i]), liveFrame);
+    TEST_ASSERT_EQUAL(i < 3, queue.push(liveFrame));
+  }
+  TEST_ASSERT_EQUAL_UINT8(3, queue.count);
+  TEST_ASSERT_TRUE(queue.pop(liveFrame));
+  // Frames 0 and 1 merged, keeping the spike
+  TEST_ASSERT_EQUAL_UINT32(0, liveFrame.frameSeq);
+  TEST_ASSERT_EQUAL_UINT16(2, liveFrame.sampleCount);
+  TEST_ASSERT_EQUAL_INT(-900, liveFrame.shuntMin[0]);
+  TEST_ASSERT_EQUAL_INT(5, liveFrame.shuntMax[0]);
+  TEST_ASSERT_TRUE(queue.pop(liveFrame));
+  TEST_ASSERT_EQUAL_UINT32(2, liveFrame.frameSeq);
+  TEST_ASSERT_TRUE(queue.pop(liveFrame));
+  TEST_ASSERT_EQUAL_UINT32(3, liveFrame.frameSeq);
+  TEST_ASSERT_FALSE(queue.pop(liveFrame));
+}
+
+void test_stalled_client_is_downgraded_then_recovers(void) {
+  LiveClientState client;
+  LiveSubscription subscription = {0x1F, 1};
+  client.subscribe(subscription);
+  for (uint32_t i = 0; i < 100000; i++) {
+    client.add(makeSample(i, 9600, 0));
+  }
+  TEST_ASSERT_EQUAL_UINT8(LIVE_QUEUE_DEPTH, client.queue.count);
+  TEST_ASSERT_EQUAL_UINT16(LIVE_MAX_DOWNGRADE, client.decimation());
+  TEST_ASSERT_GREATER_THAN(0, client.framesCoalesced);
+
+  // Once it drains every frame again it works its way back to the requested rate
+  LiveFrame liveFrame;
+  for (uint32_t i = 0; i < 300000; i++) {
+    client.add(makeSample(i, 9600, 0));
+    while (client.next(liveFrame)) {}
+  }
+  TEST_ASSERT_EQUAL_UINT16(1, client.decimation());
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_subscribe);
+  RUN_TEST(test_single_sample_frame);
+  RUN_TEST(test_decimation_keeps_min_max);
+  RUN_TEST(test_missing_samples_are_marked);
+  RUN_TEST(test_wide_readings_are_clamped);
+  RUN_TEST(test_unsubscribed_sends_nothing);
+  RUN_TEST(test_full_queue_coalesces_oldest);
+  RUN_TEST(test_stalled_client_is_downgraded_then_recovers);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
@@ -0,0 +1,94 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "LogRing.h"
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+void test_json_escape(void) {
+  char out[32];
+  size_t length = json_escape(out, sizeof(out), "a\"b\\c\nd", 7);
+  out[length] = '\0';
+  TEST_ASSERT_EQUAL_STRING("a\\\"b\\\\c\\u000ad", out);
+
+  // Never split an escape sequence when truncating
+  length = json_escape(out, 4, "ab\"c", 4);
+  out[length] = '\0';
+  TEST_ASSERT_EQUAL_STRING("ab\\\"", out);
+  length = json_escape(out, 3, "ab\"c", 4);
+  out[length] = '\0';
+  TEST_ASSERT_EQUAL_STRING("ab", out);
+}
+
+void test_write_then_read(void) {
+  static LogRing<4> ring;
+  uint32_t cursor = ring.head();
+  LogRecord record;
+  TEST_ASSERT_FALSE(ring.read(cursor, record));
+
+  ring.write(3, 1000, "hello", 5);
+  ring.write(1, 2000, "world", 5);
+  TEST_ASSERT_TRUE(ring.read(cursor, record));
+  TEST_ASSERT_EQUAL_UINT32(0, record.seq);
+  TEST_ASSERT_EQUAL_UINT8(3, record.level);
+  TEST_ASSERT_EQUAL_UINT64(1000, record.timestampMicros);
+  TEST_ASSERT_EQUAL_MEMORY("hello", record.message, 5);
+  TEST_ASSERT_TRUE(ring.read(cursor, record));
+  TEST_ASSERT_EQUAL_UINT32(1, record.seq);
+  TEST_ASSERT_FALSE(ring.read(cursor, record));
+  TEST_ASSERT_EQUAL_UINT32(2, cursor);
+}
+
+void test_lapped_reader_skips_ahead(void) {
+  static LogRing<4> ring;
+  uint32_t cursor = 0;
+  for (int i = 0; i < 10; i++) {
+    ring.write(3, i, "x", 1);
+  }
+  LogRecord record;
+  uint32_t dropped = 0;
+  TEST_ASSERT_TRUE(ring.read(cursor, record, &dropped));
+  TEST_ASSERT_EQUAL_UINT32(6, dropped);
+  TEST_ASSERT_EQUAL_UINT32(6, record.seq);
+  TEST_ASSERT_EQUAL_UINT32(6, ring.oldest());
+  int remaining = 0;
+  while (ring.read(cursor, record, &dropped)) remaining++;
+  TEST_ASSERT_EQUAL_INT(3, remaining);
+  TEST_ASSERT_EQUAL_UINT32(6, dropped);
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_json_escape);
+  RUN_TEST(test_write_then_read);
+  RUN_TEST(test_lapped_reader_skips_ahead);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
@@ -0,0 +1,229 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "SampleClock.h"
+#include "ClockDiscipline.h"
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+static const int64_t SECOND = 1000000;
+// A wall clock somewhere in 2023, not on a second boundary
+static const int64_t NOW = 1700000000LL * SECOND + 123456;
+
+void test_first_tick_lands_mid_second(void) {
+  SampleSchedule schedule;
+  schedule.begin(NOW, SECOND, SECOND / 2, 1000);
+  TEST_ASSERT_EQUAL_INT64(1700000000LL * SECOND + 500000, schedule.tickTime(0));
+  TEST_ASSERT_EQUAL_INT64(schedule.tickTime(0) + 3 * SECOND, schedule.tickTime(3));
+
+  // Too close to the first candidate: the next one
+  schedule.begin(1700000000LL * SECOND + 499500, SECOND, SECOND / 2, 1000);
+  TEST_ASSERT_EQUAL_INT64(1700000001LL * SECOND + 500000, schedule.tickTime(0));
+
+  // A faster clock keeps the same phase in each of its periods
+  schedule.begin(NOW, 100000, 50000, 0);
+  TEST_ASSERT_EQUAL_INT64(50000, schedule.tickTime(7) % 100000);
+}
+
+void test_late_wakeups_keep_the_ideal_timestamp(void) {
+  SampleSchedule schedule;
+  schedule.begin(NOW, SECOND, SECOND / 2, 0);
+  SampleTick tick;
+
+  // Too early and repeated wakeups take nothing
+  TEST_ASSERT_FALSE(schedule.take(schedule.tickTime(0) - 1, tick));
+  TEST_ASSERT_TRUE(schedule.take(schedule.tickTime(0) + 40, tick));
+  TEST_ASSERT_EQUAL_UINT64(0, tick.index);
+  TEST_ASSERT_EQUAL_INT64(40, tick.lateMicros);
+  TEST_ASSERT_EQUAL_INT64(1700000000LL * SECOND + 500000, tick.wallMicros);
+  TEST_ASSERT_FALSE(schedule.take(schedule.tickTime(0) + 900, tick));
+  TEST_ASSERT_EQUAL_INT64(schedule.tickTime(1), schedule.nextTime());
+
+  // 400 ms late is still tick 1 and still stamped on its own second
+  TEST_ASSERT_TRUE(schedule.take(schedule.tickTime(1) + 400000, tick));
+  TEST_ASSERT_EQUAL_UINT64(1, tick.index);
+  TEST_ASSERT_EQUAL_UINT32(0, tick.missed);
+  TEST_ASSERT_EQUAL_INT64(1700000001LL * SECOND + 500000, tick.wallMicros);
+
+  // A sampler stuck for 2.3 s skips two ticks rather than writing them late or twice
+  TEST_ASSERT_TRUE(schedule.take(schedule.tickTime(4) + 300000, tick));
+  TEST_ASSERT_EQUAL_UINT64(4, tick.index);
+  TEST_ASSERT_EQUAL_UINT32(2, tick.missed);
+  TEST_ASSERT_EQUAL_INT64(1700000004LL * SECOND + 500000, tick.wallMicros);
+  TEST_ASSERT_EQUAL_UINT32(2, schedule.stats.missed);
+  TEST_ASSERT_EQUAL_UINT32(3, schedule.stats.samples);
+}
+
+void test_wall_clock_set_back(void) {
+  SampleSchedule schedule;
+  schedule.begin(NOW, SECOND, SECOND / 2, 0);
+  SampleTick tick;
+  TEST_ASSERT_TRUE(schedule.take(schedule.tickTime(0), tick));
+  TEST_ASSERT_TRUE(schedule.take(schedule.tickTime(1), tick));
+  TEST_ASSERT_TRUE(schedule.take(schedule.tickTime(2), tick));
+
+  // Set back two seconds: those seconds are already in the log, so they are dropped, not repeated
+  TEST_ASSERT_FALSE(schedule.take(schedule.tickTime(3) - 2 * SECOND, tick));
+  TEST_ASSERT_EQUAL_UINT32(1, schedule.stats.duplicates);
+  TEST_ASSERT_TRUE(schedule.take(schedule.tickTime(5) - 2 * SECOND, tick));
+  TEST_ASSERT_EQUAL_UINT64(3, tick.index);
+  TEST_ASSERT_EQUAL_UINT32(0, schedule.stats.missed);
+}
+
+// xorshift32, so the simulations are the same on every run
+static uint32_t noiseState = 0x2545F491;
+static uint32_t noise() {
+  noiseState ^= noiseState << 13;
+  noiseState ^= noiseState >> 17;
+  noiseState ^= noiseState << 5;
+  return noiseState;
+}
+
+// The monotonic clock of a crystal `ppm` fast, at true time `t`
+static int64_t drifting(int64_t t, int64_t start, int64_t ppm) {
+  return (t - start) + (t - start) * ppm / 1000000;
+}
+
+void test_discipline_follows_a_drifting_crystal(void) {
+  const int64_t start = 1700000000LL * SECOND;
+  const int64_t ppms[] = {50, -37, 0};
+  for (int64_t ppm : ppms) {
+    ClockDiscipline discipline;
+    // Booted 300 µs off, e.g. the I2C read of the RTC after its edge
+    discipline.begin(0, start + 300);
+    int64_t worst = 0;
+    for (int64_t second = 1; second <= 1800; second++) {
+      // Up to 30 µs of interrupt latency on each edge
+      int64_t edge = drifting(start + second * SECOND, start, ppm) + noise() % 30;
+      TEST_ASSERT_TRUE(discipline.edge(edge));
+      if (second > 600) {
+        int64_t error = discipline.stats.offset < 0 ? -discipline.stats.offset : discipline.stats.offset;
+        if (error > worst) worst = error;
+      }
+    }
+    // Locked to within the interrupt latency, and the rate is the crystal's
+    TEST_ASSERT_TRUE(worst < 40);
+    TEST_ASSERT_TRUE(discipline.locked());
+    TEST_ASSERT_INT32_WITHIN(1000, -ppm * 1000, discipline.ratePpb());
+    TEST_ASSERT_EQUAL_UINT32(0, discipline.stats.steps);
+
+    // And the model maps back and forth to the µs between edges
+    int64_t mid = drifting(start + 1800 * SECOND + SECOND / 2, start, ppm);
+    TEST_ASSERT_INT64_WITHIN(1, mid, discipline.toMonotonic(discipline.toReference(mid)));
+    TEST_ASSERT_INT64_WITHIN(50, start + 1800 * SECOND + SECOND / 2, discipline.toReference(mid));
+  }
+}
+
+void test_discipline_steps_and_ignores_noise(void) {
+  ClockDiscipline discipline;
+  discipline.begin(0, 1700000000LL * SECOND);
+  TEST_ASSERT_TRUE(discipline.edge(SECOND + 10));
+  TEST_ASSERT_TRUE(discipline.edge(2 * SECOND + 12));
+
+  // A glitch mid-second is ignored, and doesn't disturb the next real edge
+  TEST_ASSERT_FALSE(discipline.edge(2 * SECOND + 400000));
+  TEST_ASSERT_EQUAL_UINT32(1, discipline.stats.rejected);
+  TEST_ASSERT_TRUE(discipline.edge(3 * SECOND + 11));
+
+  // Edges lost for a minute still count: the gap is a whole number of seconds
+  TEST_ASSERT_TRUE(discipline.edge(63 * SECOND + 40));
+  TEST_ASSERT_EQUAL_UINT32(4, discipline.stats.edges);
+
+  // The RTC was set 0.3 s back: the first edge looks like noise, the second confirms it, and the
+  // clock steps to it rather than slewing for minutes
+  TEST_ASSERT_FALSE(discipline.edge(64 * SECOND + 300000));
+  TEST_ASSERT_TRUE(discipline.edge(65 * SECOND + 300000));
+  TEST_ASSERT_EQUAL_UINT32(1, discipline.stats.steps);
+  TEST_ASSERT_EQUAL_INT64(1700000065LL * SECOND, discipline.toReference(65 * SECOND + 300000));
+  TEST_ASSERT_EQUAL_INT32(0, discipline.ratePpb());
+}
+
+// A day on a 45 ppm crystal, sampling at 1 Hz off the disciplined clock: every second is logged
+// exactly once, and each sample is taken within a millisecond of mid-second by the RTC
+void test_disciplined_sampling_over_a_day(void) {
+  const int64_t start = 1700000000LL * SECOND;
+  const int64_t ppm = 45;
+  ClockDiscipline discipline;
+  discipline.begin(0, start);
+  SampleSchedule schedule;
+  schedule.begin(discipline.toReference(0), SECOND, SECOND / 2, 1000);
+
+  int64_t lastStamp = 0;
+  int64_t worst = 0;
+  for (int64_t second = 1; second <= 86400; second++) {
+    discipline.edge(drifting(start + second * SECOND, start, ppm) + noise() % 30);
+    // The timer fires when the model says the tick is due, the sampler wakes a little later
+    int64_t wake = discipline.toMonotonic(schedule.nextTime()) + noise() % 2000;
+    SampleTick tick;
+    TEST_ASSERT_TRUE(schedule.take(discipline.toReference(wake), tick));
+    if (lastStamp != 0) TEST_ASSERT_EQUAL_INT64(lastStamp + SECOND, tick.wallMicros);
+    lastStamp = tick.wallMicros;
+    // True time of the wakeup against the tick
+    int64_t truth = start + (wake * 1000000 + 500000) / (1000000 + ppm) - tick.wallMicros;
+    if (truth < 0) truth = -truth;
+    if (truth > worst) worst = truth;
+  }
+  TEST_ASSERT_TRUE(worst < 3000);
+  TEST_ASSERT_EQUAL_UINT32(0, schedule.stats.missed);
+  TEST_ASSERT_EQUAL_UINT32(0, schedule.stats.duplicates);
+}
+
+void test_jitter_histogram(void) {
+  SampleClockStats stats;
+  stats.reset();
+  stats.record(-5);
+  stats.record(50);
+  stats.record(51);
+  stats.record(1500);
+  stats.record(250000);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.buckets[0]);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.buckets[1]);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.buckets[5]);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.buckets[SAMPLE_JITTER_BUCKETS - 1]);
+  TEST_ASSERT_EQUAL_UINT32(5, stats.samples);
+  TEST_ASSERT_EQUAL_INT64(250000, stats.maxLate);
+  TEST_ASSERT_EQUAL_INT64((50 + 51 + 1500 + 250000) / 5, stats.meanLate());
+  TEST_ASSERT_EQUAL_INT64(100, stats.percentile(500));
+  TEST_ASSERT_EQUAL_INT64(2000, stats.percentile(800));
+  TEST_ASSERT_EQUAL_INT64(-1, stats.percentile(1000));
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_tick_lands_mid_second);
+  RUN_TEST(test_late_wakeups_keep_the_ideal_timestamp);
+  RUN_TEST(test_wall_clock_set_back);
+  RUN_TEST(test_discipline_follows_a_drifting_crystal);
+  RUN_TEST(test_discipline_steps_and_ignores_noise);
+  RUN_TEST(test_disciplined_sampling_over_a_day);
+  RUN_TEST(test_jitter_histogram);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
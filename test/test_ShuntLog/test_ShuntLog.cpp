@@ -0,0 +1,1200 @@
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+#include "unity.h"
+#include "ShuntLog.h"
+#include "ShuntSeries.h"
+#include "ShuntIndex.h"
+#include "ShuntDownsample.h"
+#include "ShuntSync.h"
+#include "ShuntRetention.h"
+#include "ShuntRecovery.h"
+#include "ShuntTimeFormat.h"
+#include "ShuntSystemLog.h"
+#include "MemoryLogStorage.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+void setUp(void) {
+  // No setup required
+}
+
+void tearDown(void) {
+  // No teardown required
+}
+
+// 2023-07-23T11:35:00Z
+static const int64_t T0 = 1690112100;
+
+static FullRecord makeFull(int64_t timestamp, uint32_t bus, int32_t shunt) {
+  FullRecord record;
+  record.timestamp = timestamp;
+  record.micros = 0;
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    record.busRaw[ch] = bus + ch;
+    record.shuntRaw[ch] = shunt - ch;
+  }
+  return record;
+}
+
+static RollupRecord makeRollup(int64_t timestamp, int32_t bus, int32_t shunt) {
+  RollupRecord record;
+  record.timestamp = timestamp;
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    record.busMin[ch] = bus - 10;
+    record.busMean[ch] = bus;
+    record.busMax[ch] = bus + 10;
+    record.shuntMin[ch] = shunt - 5;
+    record.shuntMean[ch] = shunt;
+    record.shuntMax[ch] = shunt + 5;
+  }
+  return record;
+}
+
+// One record per second from `start` for `seconds`, filed by SHUNT_FULL_FILE_SECONDS like the
+// logger does, or all appended to the file starting at `fileStart`
+static void writeFull(MemoryLogStorage& storage, int64_t start, uint32_t seconds, int64_t fileStart = -1,
+                      uint8_t timestampSize = 4) {
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  char path[40];
+  for (uint32_t i = 0; i < seconds; i++) {
+    int64_t timestamp = start + i;
+    shunt_log_path(SHUNT_LOG_FULL, fileStart >= 0 ? fileStart : shunt_log_file_start(SHUNT_LOG_FULL, timestamp), path,
+                   sizeof(path));
+    FullRecord record = makeFull(timestamp, 9600 + i % 100, -(int32_t)(i % 50));
+    if (timestampSize == SHUNT_LOG_TIMESTAMP_MICROS) record.micros = 500000 + i % 1000;
+    size_t length = shunt_log_encode_full(record, timestampSize, buffer);
+    storage.append(path, buffer, length);
+  }
+}
+
+// Like writeFull, but starts a file at `fileStart` (which may be mid-minute, as after a boot) and
+// every `rotateSeconds` after, writing the sidecar index and manifest entry as each one is closed
+static void writeIndexed(MemoryLogStorage& storage, int64_t fileStart, uint32_t seconds, uint32_t rotateSeconds = 60) {
+  uint8_t buffer[SHUNT_INDEX_MAX_ENTRIES * SHUNT_INDEX_ENTRY_SIZE];
+  char path[40];
+  ShuntIndexBuilder builder;
+  builder.begin(fileStart);
+  for (uint32_t i = 0; i <= seconds; i++) {
+    int64_t timestamp = fileStart + i;
+    if (i == seconds || (i > 0 && timestamp % rotateSeconds == 0)) {
+      shunt_index_path(builder.manifest.fileStart, path, sizeof(path));
+      storage.append(path, buffer, builder.encodeIndex(buffer));
+      shunt_manifest_encode(builder.manifest, buffer);
+      storage.append(SHUNT_MANIFEST_PATH, buffer, SHUNT_MANIFEST_ENTRY_SIZE);
+      if (i == seconds) break;
+      builder.begin(timestamp);
+    }
+    shunt_log_path(SHUNT_LOG_FULL, builder.manifest.fileStart, path, sizeof(path));
+    size_t length = shunt_log_encode_full(makeFull(timestamp, 9600 + i % 100, 0), 4, buffer);
+    builder.add(timestamp, length);
+    storage.append(path, buffer, length);
+  }
+}
+
+void test_full_record_round_trip(void) {
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  FullRecord decoded;
+  for (uint8_t timestampSize = 4; timestampSize <= 8; timestampSize += 4) {
+    size_t length = shunt_log_encode_full(makeFull(T0, 9600, -42), timestampSize, buffer);
+    TEST_ASSERT_EQUAL(shunt_log_record_size(SHUNT_LOG_FULL, timestampSize), length);
+    TEST_ASSERT_EQUAL_UINT8(timestampSize, shunt_log_timestamp_size(buffer, length));
+    TEST_ASSERT_TRUE(shunt_log_decode_full(buffer, length, decoded));
+    TEST_ASSERT_EQUAL_INT64(T0, decoded.timestamp);
+    TEST_ASSERT_EQUAL_UINT32(9604, decoded.busRaw[4]);
+    TEST_ASSERT_EQUAL_INT32(-46, decoded.shuntRaw[4]);
+  }
+  // 4 byte time_t is what the logger has always written
+  TEST_ASSERT_EQUAL(174, shunt_log_record_size(SHUNT_LOG_FULL, 4));
+
+  // With the µs the sample was taken at; they are dropped by the narrower layouts
+  FullRecord record = makeFull(T0, 9600, -42);
+  record.micros = 499873;
+  size_t length = shunt_log_encode_full(record, SHUNT_LOG_TIMESTAMP_MICROS, buffer);
+  TEST_ASSERT_EQUAL(182, length);
+  TEST_ASSERT_EQUAL(shunt_log_record_size(SHUNT_LOG_FULL, SHUNT_LOG_TIMESTAMP_MICROS), length);
+  TEST_ASSERT_EQUAL_UINT8(SHUNT_LOG_TIMESTAMP_MICROS, shunt_log_timestamp_size(buffer, length));
+  TEST_ASSERT_TRUE(shunt_log_decode_full(buffer, length, decoded));
+  TEST_ASSERT_EQUAL_INT64(T0, decoded.timestamp);
+  TEST_ASSERT_EQUAL_UINT32(499873, decoded.micros);
+  TEST_ASSERT_EQUAL_INT32(-46, decoded.shuntRaw[4]);
+  int64_t timestamp;
+  TEST_ASSERT_TRUE(shunt_log_decode_timestamp(buffer, length, timestamp));
+  TEST_ASSERT_EQUAL_INT64(T0, timestamp);
+  length = shunt_log_encode_full(record, 8, buffer);
+  TEST_ASSERT_TRUE(shunt_log_decode_full(buffer, length, decoded));
+  TEST_ASSERT_EQUAL_UINT32(0, decoded.micros);
+
+  TEST_ASSERT_EQUAL(532, shunt_log_record_size(SHUNT_LOG_MINUTE, 4));
+
+  // A flipped value no longer matches the checksum
+  length = shunt_log_encode_full(makeFull(T0, 9600, -42), 4, buffer);
+  buffer[20] ^= 1;
+  TEST_ASSERT_FALSE(shunt_log_decode_full(buffer, length, decoded));
+  // Truncated records are rejected
+  buffer[20] ^= 1;
+  TEST_ASSERT_FALSE(shunt_log_decode_full(buffer, length - 3, decoded));
+}
+
+void test_rollup_record_round_trip(void) {
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  RollupRecord decoded;
+  size_t length = shunt_log_encode_rollup(makeRollup(T0, 9650, -300), 4, buffer);
+  TEST_ASSERT_EQUAL(532, length);
+  TEST_ASSERT_TRUE(shunt_log_decode_rollup(buffer, length, decoded));
+  TEST_ASSERT_EQUAL_INT64(9640, decoded.busMin[2]);
+  TEST_ASSERT_EQUAL_INT32(-300, decoded.shuntMean[2]);
+  TEST_ASSERT_EQUAL_INT64(-295, decoded.shuntMax[2]);
+}
+
+void test_crc_catches_what_the_sum_missed(void) {
+  const char* digits = "123456789";
+  TEST_ASSERT_EQUAL_HEX32(0xE3069283, shunt_crc32c((const uint8_t*)digits, 9));
+  TEST_ASSERT_EQUAL_HEX32(0xE3069283, shunt_crc32c((const uint8_t*)digits + 4, 5, shunt_crc32c((const uint8_t*)digits, 4)));
+
+  // A record as older firmware wrote it, with the sum, still reads
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  FullRecord record = makeFull(T0, 9600, -42);
+  ShuntLogFieldWriter writer(buffer);
+  writer.add(record.timestamp, 4);
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    writer.add(record.busRaw[ch], 4);
+    writer.add(record.shuntRaw[ch], 4);
+  }
+  writer.write((int64_t)writer.checksum, 8);
+  buffer[writer.length++] = '\r';
+  buffer[writer.length++] = '\n';
+  FullRecord decoded;
+  TEST_ASSERT_TRUE(shunt_log_decode_full(buffer, writer.length, decoded));
+  TEST_ASSERT_EQUAL_UINT32(9603, decoded.busRaw[3]);
+
+  // Swapping busRaw[0] and busRaw[1] keeps the sum
+  uint8_t value[4];
+  memcpy(value, buffer + 20, 4);
+  memcpy(buffer + 20, buffer + 48, 4);
+  memcpy(buffer + 48, value, 4);
+  TEST_ASSERT_TRUE(shunt_log_decode_full(buffer, writer.length, decoded));
+  TEST_ASSERT_EQUAL_UINT32(9601, decoded.busRaw[0]);
+
+  // but not the CRC; nor does taking one off one value and adding it to another
+  size_t length = shunt_log_encode_full(record, 4, buffer);
+  memcpy(value, buffer + 20, 4);
+  memcpy(buffer + 20, buffer + 48, 4);
+  memcpy(buffer + 48, value, 4);
+  TEST_ASSERT_FALSE(shunt_log_decode_full(buffer, length, decoded));
+  length = shunt_log_encode_full(record, 4, buffer);
+  buffer[20]++;
+  buffer[48]--;
+  TEST_ASSERT_FALSE(shunt_log_decode_full(buffer, length, decoded));
+  // The marker is where the scanner looks for it
+  length = shunt_log_encode_full(record, 4, buffer);
+  TEST_ASSERT_EQUAL_HEX8(0xA5, buffer[shunt_log_sync_offset(SHUNT_LOG_FULL, length)]);
+  TEST_ASSERT_EQUAL_MEMORY("SLZ", buffer + shunt_log_sync_offset(SHUNT_LOG_FULL, length) + 1, 3);
+}
+
+// xorshift32, so every run corrupts the logs the same way
+static uint32_t fuzzRandom(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+void test_scanner_recovers_from_random_corruption(void) {
+  const uint32_t records = 400;
+  const ShuntLogLevel levels[] = {SHUNT_LOG_FULL, SHUNT_LOG_MINUTE};
+  uint32_t state = 2463534242u;
+  for (ShuntLogLevel level : levels) {
+    uint32_t seconds = shunt_log_level_seconds(level);
+    size_t recordSize = shunt_log_record_size(level, 4);
+    std::vector<uint8_t> original;
+    uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+    for (uint32_t i = 0; i < records; i++) {
+      size_t length = level == SHUNT_LOG_FULL ? shunt_log_encode_full(makeFull(T0 + i, 9600 + i, -(int32_t)i), 4, buffer)
+                                              : shunt_log_encode_rollup(makeRollup(T0 + i * 60, 9600 + i, -(int32_t)i), 4, buffer);
+      original.insert(original.end(), buffer, buffer + length);
+    }
+
+    for (uint32_t round = 0; round < 300; round++) {
+      // Flipped bits, and runs of bytes lost or put in, as torn writes leave them
+      std::vector<uint8_t> data = original;
+      uint32_t events = 1 + fuzzRandom(state) % 6;
+      for (uint32_t e = 0; e < events; e++) {
+        size_t at = fuzzRandom(state) % data.size();
+        size_t run = 1 + fuzzRandom(state) % 40;
+        switch (fuzzRandom(state) % 3) {
+          case 0:
+            data[at] ^= (uint8_t)(1 << fuzzRandom(state) % 8);
+            break;
+          case 1:
+            data.erase(data.begin() + at, data.begin() + std::min(at + run, data.size()));
+            break;
+          default:
+            for (size_t i = 0; i < run; i++) data.insert(data.begin() + at, (uint8_t)fuzzRandom(state));
+            break;
+        }
+      }
+      MemoryLogStorage storage;
+      storage.append("/fuzz.bin0", data.data(), data.size());
+      ShuntLogScanner scanner(storage);
+      TEST_ASSERT_TRUE(scanner.open("/fuzz.bin0", level));
+      TEST_ASSERT_EQUAL(recordSize, scanner.recordSize);
+
+      // Every record that comes back is one that was written, in order; each corruption costs at
+      // most the two records either side of it
+      uint32_t found = 0;
+      int64_t last = INT64_MIN;
+      uint32_t offset;
+      const uint8_t* record;
+      while ((record = scanner.next(offset)) != NULL) {
+        int64_t timestamp;
+        TEST_ASSERT_TRUE(shunt_log_decode_timestamp(record, recordSize, timestamp));
+        TEST_ASSERT_TRUE(timestamp > last);
+        uint32_t index = (uint32_t)((timestamp - T0) / (level == SHUNT_LOG_FULL ? 1 : seconds));
+        TEST_ASSERT_TRUE(index < records);
+        TEST_ASSERT_EQUAL_MEMORY(original.data() + index * recordSize, record, recordSize);
+        last = timestamp;
+        found++;
+      }
+      TEST_ASSERT_TRUE(found + 2 * events >= records);
+      TEST_ASSERT_EQUAL_UINT64(data.size() - (uint64_t)found * recordSize, scanner.skipped);
+    }
+  }
+}
+
+void test_civil_time_and_paths(void) {
+  ShuntLogTime t;
+  shunt_log_civil(T0 + 7, t);
+  TEST_ASSERT_EQUAL_INT32(2023, t.year);
+  TEST_ASSERT_EQUAL_UINT8(7, t.month);
+  TEST_ASSERT_EQUAL_UINT8(23, t.day);
+  TEST_ASSERT_EQUAL_UINT8(11, t.hour);
+  TEST_ASSERT_EQUAL_UINT8(35, t.minute);
+  TEST_ASSERT_EQUAL_UINT8(7, t.second);
+  TEST_ASSERT_EQUAL_INT64(T0, shunt_log_unix(2023, 7, 23, 11, 35, 0));
+
+  char path[40];
+  shunt_log_path(SHUNT_LOG_FULL, shunt_log_file_start(SHUNT_LOG_FULL, T0 + 7), path, sizeof(path));
+  TEST_ASSERT_EQUAL_STRING("/full/2023/07/23/110000.bin0", path);
+  shunt_index_path(T0 - 35, path, sizeof(path));
+  TEST_ASSERT_EQUAL_STRING("/index/full/2023/07/23/113425.idx", path);
+  shunt_log_path(SHUNT_LOG_MINUTE, shunt_log_file_start(SHUNT_LOG_MINUTE, T0), path, sizeof(path));
+  TEST_ASSERT_EQUAL_STRING("/daily/20230723.bin0", path);
+  shunt_log_path(SHUNT_LOG_HOUR, shunt_log_file_start(SHUNT_LOG_HOUR, T0), path, sizeof(path));
+  TEST_ASSERT_EQUAL_STRING("/hourly/202307.bin0", path);
+
+  // December rolls into the next year
+  int64_t december = shunt_log_unix(2023, 12, 1);
+  TEST_ASSERT_EQUAL_INT64(shunt_log_unix(2024, 1, 1), shunt_log_next_file_start(SHUNT_LOG_HOUR, december));
+}
+
+void test_full_layouts(void) {
+  char name[24];
+  shunt_full_name(T0 - 35, SHUNT_PARTITION_NONE, name, sizeof(name));
+  TEST_ASSERT_EQUAL_STRING("20230723T113425", name);
+  shunt_full_name(T0 - 35, SHUNT_PARTITION_DAY, name, sizeof(name));
+  TEST_ASSERT_EQUAL_STRING("2023/07/23/113425", name);
+  shunt_full_name(T0 - 35, SHUNT_PARTITION_HOUR, name, sizeof(name));
+  TEST_ASSERT_EQUAL_STRING("2023/07/23/11/3425", name);
+  TEST_ASSERT_EQUAL(0, shunt_full_name(T0, SHUNT_PARTITION_DAY, name, 10));
+
+  // Every layout's names parse back, so old links and files can be moved to the current one
+  int64_t fileStart = 0;
+  TEST_ASSERT_TRUE(shunt_full_parse("20230723T113425.bin0", fileStart));
+  TEST_ASSERT_EQUAL_INT64(T0 - 35, fileStart);
+  TEST_ASSERT_TRUE(shunt_full_parse("2023/07/23/113425.bin0", fileStart));
+  TEST_ASSERT_EQUAL_INT64(T0 - 35, fileStart);
+  TEST_ASSERT_TRUE(shunt_full_parse("2023/07/23/11/3425.bin0", fileStart));
+  TEST_ASSERT_EQUAL_INT64(T0 - 35, fileStart);
+  TEST_ASSERT_FALSE(shunt_full_parse("20230723T113425.bin", fileStart));
+  TEST_ASSERT_FALSE(shunt_full_parse("2023/07/23T113425.bin0", fileStart));
+  TEST_ASSERT_FALSE(shunt_full_parse("2023/07/2/113425.bin0", fileStart));
+  TEST_ASSERT_FALSE(shunt_full_parse("20231323T113425.bin0", fileStart));
+  TEST_ASSERT_FALSE(shunt_full_parse("2023", fileStart));
+
+  // Files start every SHUNT_FULL_FILE_SECONDS from midnight
+  int64_t hour = shunt_log_unix(2023, 7, 23, 11);
+  TEST_ASSERT_EQUAL_INT64(hour, shunt_log_file_start(SHUNT_LOG_FULL, T0 + 7));
+  TEST_ASSERT_EQUAL_INT64(hour + SHUNT_FULL_FILE_SECONDS, shunt_log_next_file_start(SHUNT_LOG_FULL, hour));
+}
+
+void test_time_format_matches_snprintf(void) {
+  ShuntTimeFormat format;
+  char text[40];
+  TEST_ASSERT_EQUAL(19, format.iso(T0 + 7, text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("2023-07-23T11:35:07", text);
+  TEST_ASSERT_EQUAL(15, format.compact(T0 - 35, text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("20230723T113425", text);
+  TEST_ASSERT_EQUAL(0, format.iso(T0, text, 19));
+
+  // Across midnights, month and year ends and back again, the cached date never goes stale, and
+  // paths come out the same as shunt_log_path()
+  char expected[40];
+  int64_t timestamp = shunt_log_unix(2023, 12, 31, 23, 59, 58);
+  for (int i = 0; i < 4000; i++) {
+    timestamp += i % 7 == 0 ? -86399 : 3601 + i;
+    for (uint8_t level = SHUNT_LOG_FULL; level <= SHUNT_LOG_HOUR; level++) {
+      int64_t fileStart = shunt_log_file_start((ShuntLogLevel)level, timestamp);
+      size_t length = shunt_log_path((ShuntLogLevel)level, fileStart, expected, sizeof(expected));
+      TEST_ASSERT_EQUAL(length, format.path((ShuntLogLevel)level, fileStart, text, sizeof(text)));
+      TEST_ASSERT_EQUAL_STRING(expected, text);
+    }
+    ShuntLogTime t;
+    shunt_log_civil(timestamp, t);
+    snprintf(expected, sizeof(expected), "%04d-%02u-%02uT%02u:%02u:%02u", (int)t.year, t.month, t.day, t.hour, t.minute,
+             t.second);
+    format.iso(timestamp, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING(expected, text);
+  }
+  TEST_ASSERT_EQUAL(0, format.path(SHUNT_LOG_MINUTE, T0, text, 20));
+}
+
+void test_lower_bound_skips_to_first_match(void) {
+  MemoryLogStorage storage;
+  writeFull(storage, T0, 60);
+  TEST_ASSERT_TRUE(storage.open("/full/2023/07/23/110000.bin0"));
+  TEST_ASSERT_EQUAL_UINT32(0, shunt_log_lower_bound(storage, 174, 60, T0 - 5));
+  TEST_ASSERT_EQUAL_UINT32(17, shunt_log_lower_bound(storage, 174, 60, T0 + 17));
+  TEST_ASSERT_EQUAL_UINT32(60, shunt_log_lower_bound(storage, 174, 60, T0 + 90));
+  // log2(60) reads, not a scan
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(3 * 7, storage.reads);
+}
+
+void test_plan_picks_coarsest_level(void) {
+  SeriesQuery query = {0, T0, T0 + 600, 0, false};
+  TEST_ASSERT_EQUAL(SHUNT_LOG_FULL, series_plan(query));
+  TEST_ASSERT_EQUAL_UINT32(2, query.resolution);
+
+  query.resolution = 60;
+  TEST_ASSERT_EQUAL(SHUNT_LOG_MINUTE, series_plan(query));
+
+  // A week at 10 minute resolution would read 5 MB of minute rollups; use the hourly ones
+  SeriesQuery week = {0, T0, T0 + 7 * 86400, 600, false};
+  TEST_ASSERT_EQUAL(SHUNT_LOG_HOUR, series_plan(week));
+  TEST_ASSERT_EQUAL_UINT32(3600, week.resolution);
+}
+
+void test_series_full_rate_binary(void) {
+  MemoryLogStorage storage;
+  writeFull(storage, T0, 180);  // Three minute files
+  SeriesQuery query = {2, T0 + 50, T0 + 130, 20, true};
+  ShuntSeriesReader reader(storage, query);
+  TEST_ASSERT_EQUAL(SHUNT_LOG_FULL, reader.level);
+
+  uint8_t out[1024];
+  size_t length = reader.fill(out, sizeof(out));
+  TEST_ASSERT_TRUE(reader.finished());
+  TEST_ASSERT_EQUAL(4 * SERIES_POINT_SIZE, length);
+  // The 80 in range plus the one that ends it
+  TEST_ASSERT_EQUAL_UINT32(81, reader.cursor.recordsRead);
+
+  // Second bucket covers T0+70..89: bus 9670..9689 (+2 for the channel)
+  int64_t timestamp = 0;
+  int32_t busMin = 0;
+  int32_t busMax = 0;
+  memcpy(&timestamp, out + SERIES_POINT_SIZE, 8);
+  memcpy(&busMin, out + SERIES_POINT_SIZE + 8, 4);
+  memcpy(&busMax, out + SERIES_POINT_SIZE + 16, 4);
+  TEST_ASSERT_EQUAL_INT64(T0 + 70, timestamp);
+  TEST_ASSERT_EQUAL_INT32(9672, busMin);
+  TEST_ASSERT_EQUAL_INT32(9691, busMax);
+}
+
+void test_series_never_splits_points(void) {
+  MemoryLogStorage storage;
+  writeFull(storage, T0, 60);
+  SeriesQuery query = {0, T0, T0 + 60, 1, true};
+  ShuntSeriesReader reader(storage, query);
+  uint8_t out[SERIES_POINT_SIZE * 2 + 5];
+  uint32_t chunks = 0;
+  size_t total = 0;
+  while (!reader.finished()) {
+    size_t length = reader.fill(out, sizeof(out));
+    TEST_ASSERT_EQUAL(0, length % SERIES_POINT_SIZE);
+    total += length;
+    chunks++;
+  }
+  TEST_ASSERT_EQUAL(60 * SERIES_POINT_SIZE, total);
+  TEST_ASSERT_EQUAL_UINT32(30, chunks);
+}
+
+void test_series_rollups_json(void) {
+  MemoryLogStorage storage;
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  char path[40];
+  // Rollups for 23:57 .. 00:02; the 23:59 one is stamped 00:00 and lands in the next day's file
+  int64_t midnight = shunt_log_unix(2023, 7, 24);
+  for (int64_t end = midnight - 120; end <= midnight + 180; end += 60) {
+    shunt_log_path(SHUNT_LOG_MINUTE, shunt_log_file_start(SHUNT_LOG_MINUTE, end), path, sizeof(path));
+    size_t length = shunt_log_encode_rollup(makeRollup(end, 9600 + (int32_t)(end - midnight) / 60, -100), 4, buffer);
+    storage.append(path, buffer, length);
+  }
+
+  SeriesQuery query = {1, midnight - 120, midnight + 120, 120, false};
+  ShuntSeriesReader reader(storage, query);
+  TEST_ASSERT_EQUAL(SHUNT_LOG_MINUTE, reader.level);
+  char out[512];
+  size_t length = reader.fill((uint8_t*)out, sizeof(out) - 1);
+  out[length] = 0;
+  char expected[256];
+  snprintf(expected, sizeof(expected),
+           "{\"channel\":1,\"level\":\"minute\",\"resolution\":120,\"from\":%lld,\"to\":%lld,\"points\":["
+           "[%lld,9589,9599,9610,-105,-100,-95],[%lld,9591,9601,9612,-105,-100,-95]]}",
+           (long long)query.from, (long long)query.to, (long long)(midnight - 120), (long long)midnight);
+  TEST_ASSERT_EQUAL_STRING(expected, out);
+  TEST_ASSERT_TRUE(reader.finished());
+}
+
+// Channel 1 drops out for the second half minute, channel 4 isn't fitted
+void test_missing_samples_are_left_out(void) {
+  MemoryLogStorage storage;
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  char path[40];
+  ShuntRollupBuilder minute;
+  for (uint32_t i = 0; i < 60; i++) {
+    FullRecord record = makeFull(T0 + i, 9600 + i, -(int32_t)i);
+    if (i >= 30) {
+      record.busRaw[1] = SHUNT_LOG_MISSING_BUS;
+      record.shuntRaw[1] = SHUNT_LOG_MISSING_SHUNT;
+    }
+    record.busRaw[4] = SHUNT_LOG_MISSING_BUS;
+    record.shuntRaw[4] = SHUNT_LOG_MISSING_SHUNT;
+    minute.add(record);
+    shunt_log_path(SHUNT_LOG_FULL, shunt_log_file_start(SHUNT_LOG_FULL, T0 + i), path, sizeof(path));
+    storage.append(path, buffer, shunt_log_encode_full(record, SHUNT_LOG_TIMESTAMP_MICROS, buffer));
+  }
+
+  // The rollup has the half minute there was, and nothing for the shunt that wasn't there
+  RollupRecord rollup;
+  minute.finish(T0 + 60, rollup);
+  TEST_ASSERT_EQUAL_INT32(9600 + 29, rollup.busMean[0]);
+  TEST_ASSERT_EQUAL_INT64(9601, rollup.busMin[1]);
+  TEST_ASSERT_EQUAL_INT32(9601 + 14, rollup.busMean[1]);
+  TEST_ASSERT_EQUAL_INT64(9601 + 29, rollup.busMax[1]);
+  TEST_ASSERT_EQUAL_INT64(-1 - 29, rollup.shuntMin[1]);
+  TEST_ASSERT_FALSE(shunt_log_missing(rollup, 1));
+  TEST_ASSERT_TRUE(shunt_log_missing(rollup, 4));
+  uint32_t added;
+  int64_t sum, min, max;
+  minute.totals(1, false, added, sum, min, max);
+  TEST_ASSERT_EQUAL_UINT32(30, added);
+  minute.totals(4, true, added, sum, min, max);
+  TEST_ASSERT_EQUAL_UINT32(0, added);
+
+  // An hour with the shunt back for one minute has just that minute's
+  ShuntRollupBuilder hour;
+  hour.add(rollup);
+  hour.add(makeRollup(T0 + 120, 9000, -50));
+  RollupRecord hourly;
+  hour.finish(T0 + 3600, hourly);
+  TEST_ASSERT_EQUAL_INT32(9000, hourly.busMean[4]);
+  TEST_ASSERT_EQUAL_INT32((9615 + 9000) / 2, hourly.busMean[1]);
+
+  // Readers only see the samples there were
+  SeriesQuery query = {1, T0, T0 + 60, 1, true};
+  ShuntSeriesReader series(storage, query);
+  uint8_t out[4096];
+  size_t length = 0;
+  while (!series.finished()) length += series.fill(out + length, sizeof(out) - length);
+  TEST_ASSERT_EQUAL(30 * SERIES_POINT_SIZE, length);
+  SeriesQuery unfitted = {4, T0, T0 + 60, 1, true};
+  ShuntSeriesReader none(storage, unfitted);
+  length = 0;
+  while (!none.finished()) length += none.fill(out + length, sizeof(out) - length);
+  TEST_ASSERT_EQUAL(0, length);
+
+  DownsampleQuery downsample = {T0, T0 + 60, 10, DOWNSAMPLE_MINMAX, 0x12, false, true};
+  ShuntDownsampleReader reader(storage, downsample);
+  length = 0;
+  while (!reader.finished()) length += reader.fill(out + length, 100);
+  TEST_ASSERT_TRUE(length > 0);
+  for (size_t offset = 0; offset < length; offset += DOWNSAMPLE_POINT_SIZE) {
+    TEST_ASSERT_EQUAL_UINT8(1, out[offset]);
+    int32_t value = 0;
+    memcpy(&value, out + offset + 9, 4);
+    TEST_ASSERT_TRUE(value <= 0 && value >= -1 - 29);
+  }
+}
+
+void test_index_builder_and_seek(void) {
+  MemoryLogStorage storage;
+  writeIndexed(storage, T0, 60);
+  TEST_ASSERT_EQUAL(60 / SHUNT_INDEX_STRIDE + 1, storage.files["/index/full/2023/07/23/113500.idx"].size() / SHUNT_INDEX_ENTRY_SIZE);
+
+  ShuntManifestEntry entry;
+  shunt_manifest_decode(storage.files[SHUNT_MANIFEST_PATH].data(), entry);
+  TEST_ASSERT_EQUAL_INT64(T0, entry.fileStart);
+  TEST_ASSERT_EQUAL_INT64(T0, entry.firstTimestamp);
+  TEST_ASSERT_EQUAL_INT64(T0 + 59, entry.lastTimestamp);
+  TEST_ASSERT_EQUAL_UINT32(60, entry.records);
+  TEST_ASSERT_EQUAL_UINT32(60 * 174, entry.bytes);
+
+  TEST_ASSERT_TRUE(storage.open("/index/full/2023/07/23/113500.idx"));
+  uint32_t count = storage.size() / SHUNT_INDEX_ENTRY_SIZE;
+  TEST_ASSERT_EQUAL_UINT32(0, shunt_index_seek(storage, count, T0));
+  // Starts at the indexed record before the target, at most a stride early
+  TEST_ASSERT_EQUAL_UINT32(16 * 174, shunt_index_seek(storage, count, T0 + 20));
+  TEST_ASSERT_EQUAL_UINT32(16 * 174, shunt_index_seek(storage, count, T0 + 24));
+  TEST_ASSERT_EQUAL_UINT32(56 * 174, shunt_index_seek(storage, count, T0 + 600));
+}
+
+void test_manifest_finds_boot_files(void) {
+  MemoryLogStorage storage;
+  // Boots at 11:34:25, runs 3 minutes, reboots at 11:40:43 after a gap
+  writeIndexed(storage, T0 - 35, 215);
+  writeIndexed(storage, T0 + 343, 100);
+  TEST_ASSERT_EQUAL(7 * SHUNT_MANIFEST_ENTRY_SIZE, storage.files[SHUNT_MANIFEST_PATH].size());
+
+  ShuntLogCursor cursor(storage, SHUNT_LOG_FULL, T0 + 300, T0 + 400);
+  uint32_t records = 0;
+  int64_t first = 0;
+  while (cursor.next()) {
+    if (records++ == 0) first = cursor.start;
+  }
+  TEST_ASSERT_EQUAL_UINT32(57, records);
+  TEST_ASSERT_EQUAL_INT64(T0 + 343, first);
+  // Only the manifest, the boot file and its index; no probing of the empty minutes
+  TEST_ASSERT_EQUAL_UINT32(2, cursor.filesOpened);
+
+  // A range starting inside the first boot file
+  ShuntLogCursor early(storage, SHUNT_LOG_FULL, T0 - 10, T0 + 10);
+  records = 0;
+  while (early.next()) records++;
+  TEST_ASSERT_EQUAL_UINT32(20, records);
+  // Small files are binary-searched, so only the record that ends the range is extra
+  TEST_ASSERT_EQUAL_UINT32(20 + 1, early.recordsRead);
+}
+
+void test_cursor_seeks_large_files_with_index(void) {
+  MemoryLogStorage storage;
+  // Hour-long files, 3600 records each
+  int64_t hour = shunt_log_unix(2023, 7, 23, 11);
+  writeIndexed(storage, hour, 7200, 3600);
+  ShuntLogCursor cursor(storage, SHUNT_LOG_FULL, hour + 1000, hour + 1010);
+  uint32_t records = 0;
+  while (cursor.next()) records++;
+  TEST_ASSERT_EQUAL_UINT32(10, records);
+  // 3600 records fit 64 entries at a stride of 64; starts at most that early
+  TEST_ASSERT_EQUAL(57 * SHUNT_INDEX_ENTRY_SIZE, storage.files["/index/full/2023/07/23/110000.idx"].size());
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(10 + 64 + 1, cursor.recordsRead);
+  TEST_ASSERT_GREATER_THAN_UINT32(10 + 1, cursor.recordsRead);
+}
+
+void test_cursor_finds_live_file_after_manifest(void) {
+  MemoryLogStorage storage;
+  // The last session's hour, rotated into the manifest, then a boot at 11:34:25 whose file has no
+  // manifest entry yet and isn't on the hour
+  int64_t hour = shunt_log_unix(2023, 7, 23, 10);
+  writeIndexed(storage, hour, 3000, 3600);
+  writeFull(storage, T0 - 35, 100, T0 - 35);
+
+  ShuntLogCursor blind(storage, SHUNT_LOG_FULL, T0 - 60, T0 + 30);
+  TEST_ASSERT_FALSE(blind.next());
+
+  ShuntLogCursor cursor(storage, SHUNT_LOG_FULL, hour + 2990, T0 + 30, T0 - 35);
+  uint32_t records = 0;
+  int64_t last = 0;
+  while (cursor.next()) {
+    TEST_ASSERT_TRUE(cursor.start > last);
+    last = cursor.start;
+    records++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(10 + 65, records);
+  TEST_ASSERT_EQUAL_INT64(T0 + 29, last);
+
+  // The series reader is handed it too
+  SeriesQuery query = {0, T0 - 60, T0 + 30, 1, true};
+  ShuntSeriesReader reader(storage, query, T0 - 35);
+  uint8_t out[4096];
+  TEST_ASSERT_EQUAL(65 * SERIES_POINT_SIZE, reader.fill(out, sizeof(out)));
+
+  // Once it is on the hour the probe finds it, and it is read once
+  writeFull(storage, hour + 7200, 20, hour + 7200);
+  ShuntLogCursor onHour(storage, SHUNT_LOG_FULL, hour + 7190, hour + 7230, hour + 7200);
+  records = 0;
+  while (onHour.next()) records++;
+  TEST_ASSERT_EQUAL_UINT32(20, records);
+}
+
+void test_cursor_finds_mid_minute_file_without_manifest(void) {
+  MemoryLogStorage storage;
+  // The first boot on a fresh card, at 11:35:17: no manifest at all
+  writeFull(storage, T0 + 17, 120, T0 + 17);
+  TEST_ASSERT_EQUAL(0, storage.files.count(SHUNT_MANIFEST_PATH));
+
+  ShuntLogCursor cursor(storage, SHUNT_LOG_FULL, T0, T0 + 60, T0 + 17);
+  uint32_t records = 0;
+  int64_t first = 0;
+  while (cursor.next()) {
+    if (records++ == 0) first = cursor.start;
+  }
+  TEST_ASSERT_EQUAL_INT64(T0 + 17, first);
+  TEST_ASSERT_EQUAL_UINT32(43, records);
+  TEST_ASSERT_EQUAL_UINT32(1, cursor.filesOpened);
+
+  // A range inside it is sought into, not read from the start
+  ShuntLogCursor inside(storage, SHUNT_LOG_FULL, T0 + 100, T0 + 110, T0 + 17);
+  records = 0;
+  while (inside.next()) records++;
+  TEST_ASSERT_EQUAL_UINT32(10, records);
+  TEST_ASSERT_EQUAL_UINT32(10 + 1, inside.recordsRead);
+}
+
+void test_downsample_lttb_binary_per_channel(void) {
+  MemoryLogStorage storage;
+  writeFull(storage, T0, 600);
+  DownsampleQuery query = {T0, T0 + 600, 50, DOWNSAMPLE_LTTB, 0x05, false, true};
+  ShuntDownsampleReader reader(storage, query);
+  TEST_ASSERT_EQUAL(SHUNT_LOG_FULL, reader.level);
+
+  uint8_t out[4096];
+  size_t length = 0;
+  while (!reader.finished()) length += reader.fill(out + length, 100);
+  TEST_ASSERT_EQUAL(0, length % DOWNSAMPLE_POINT_SIZE);
+  uint32_t perChannel[SHUNT_LOG_CHANNELS] = {0};
+  int64_t last[SHUNT_LOG_CHANNELS] = {0};
+  for (size_t offset = 0; offset < length; offset += DOWNSAMPLE_POINT_SIZE) {
+    uint8_t ch = out[offset];
+    int64_t timestamp = 0;
+    int32_t value = 0;
+    memcpy(&timestamp, out + offset + 1, 8);
+    memcpy(&value, out + offset + 9, 4);
+    TEST_ASSERT_TRUE(ch == 0 || ch == 2);
+    if (perChannel[ch] == 0) TEST_ASSERT_EQUAL_INT64(T0, timestamp);
+    if (perChannel[ch] > 0) TEST_ASSERT_GREATER_THAN(last[ch], timestamp);
+    // A real sample: makeFull's shunt for that second and channel
+    TEST_ASSERT_EQUAL_INT32(-(int32_t)((timestamp - T0) % 50) - ch, value);
+    last[ch] = timestamp;
+    perChannel[ch]++;
+  }
+  TEST_ASSERT_EQUAL_UINT32(perChannel[0], perChannel[2]);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(50, perChannel[0]);
+  TEST_ASSERT_GREATER_THAN_UINT32(40, perChannel[0]);
+  TEST_ASSERT_EQUAL_INT64(T0 + 599, last[0]);
+}
+
+void test_downsample_minmax_rollups_json(void) {
+  MemoryLogStorage storage;
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  char path[40];
+  int64_t midnight = shunt_log_unix(2023, 7, 24);
+  for (int64_t end = midnight - 120; end <= midnight + 180; end += 60) {
+    shunt_log_path(SHUNT_LOG_MINUTE, shunt_log_file_start(SHUNT_LOG_MINUTE, end), path, sizeof(path));
+    size_t length = shunt_log_encode_rollup(makeRollup(end, 9600 + (int32_t)(end - midnight) / 60, -100), 4, buffer);
+    storage.append(path, buffer, length);
+  }
+
+  // Two points asked for is raised to the minimum of three: a bus envelope per 80 s from the
+  // rollup min/max, each bucket stamped with its start
+  DownsampleQuery query = {midnight - 120, midnight + 120, 2, DOWNSAMPLE_MINMAX, 0x02, true, false};
+  ShuntDownsampleReader reader(storage, query);
+  TEST_ASSERT_EQUAL(SHUNT_LOG_MINUTE, reader.level);
+  TEST_ASSERT_EQUAL_UINT32(3, reader.query.points);
+  char out[512];
+  size_t length = reader.fill((uint8_t*)out, sizeof(out) - 1);
+  out[length] = 0;
+  char expected[256];
+  snprintf(expected, sizeof(expected),
+           "{\"level\":\"minute\",\"mode\":\"minmax\",\"quantity\":\"bus\",\"from\":%lld,\"to\":%lld,\"points\":["
+           "[1,%lld,9589,9610],[1,%lld,9591,9611],[1,%lld,9592,9612]]}",
+           (long long)query.from, (long long)query.to, (long long)(midnight - 120), (long long)(midnight - 40),
+           (long long)(midnight + 40));
+  TEST_ASSERT_EQUAL_STRING(expected, out);
+}
+
+// Runs one sync request, checking the trailer and that the records are consecutive seconds from
+// `expectedFirst`; returns the records and leaves the next cursor in `cursor`
+static uint32_t sync(MemoryLogStorage& storage, ShuntSyncCursor& cursor, int64_t live, int64_t expectedFirst,
+                     uint32_t limit = SYNC_MAX_RECORDS, bool* more = NULL) {
+  ShuntSyncReader reader(storage, cursor, live, limit);
+  std::vector<uint8_t> body;
+  uint8_t chunk[500];
+  while (!reader.finished()) {
+    size_t length = reader.fill(chunk, sizeof(chunk));
+    body.insert(body.end(), chunk, chunk + length);
+  }
+  TEST_ASSERT_EQUAL(reader.records * SYNC_RECORD_SIZE + SYNC_TRAILER_SIZE, body.size());
+  const uint8_t* trailer = body.data() + body.size() - SYNC_TRAILER_SIZE;
+  TEST_ASSERT_EQUAL_UINT32(SYNC_MAGIC, (uint32_t)shunt_index_get(trailer, 4));
+  cursor.fileStart = (int64_t)shunt_index_get(trailer + 4, 8);
+  cursor.offset = (uint32_t)shunt_index_get(trailer + 12, 4);
+  TEST_ASSERT_EQUAL_UINT32(reader.records, (uint32_t)shunt_index_get(trailer + 16, 4));
+  if (more) *more = shunt_index_get(trailer + 20, 4) & SYNC_FLAG_MORE;
+  for (uint32_t i = 0; i < reader.records; i++) {
+    TEST_ASSERT_EQUAL_INT64(expectedFirst + i, (int64_t)shunt_index_get(body.data() + i * SYNC_RECORD_SIZE, 8));
+  }
+  return reader.records;
+}
+
+void test_sync_follows_rotations_and_growth(void) {
+  MemoryLogStorage storage;
+  // Boots at 11:34:25 and runs to 11:38:00 in closed files, then writes 11:38
+  writeIndexed(storage, T0 - 35, 215);
+  int64_t live = T0 + 180;
+  writeFull(storage, live, 20, live);
+
+  ShuntSyncCursor cursor = shunt_sync_start(storage, T0 - 100, live);
+  TEST_ASSERT_EQUAL_INT64(T0 - 35, cursor.fileStart);
+  TEST_ASSERT_EQUAL_UINT32(215 + 20, sync(storage, cursor, live, T0 - 35));
+  TEST_ASSERT_EQUAL_INT64(live, cursor.fileStart);
+  TEST_ASSERT_EQUAL_UINT32(20 * 174, cursor.offset);
+
+  // Nothing new: an empty body and the same cursor
+  TEST_ASSERT_EQUAL_UINT32(0, sync(storage, cursor, live, 0));
+  TEST_ASSERT_EQUAL_UINT32(20 * 174, cursor.offset);
+
+  // The live file grows, with half a record torn off the end, then rotates
+  writeFull(storage, live + 20, 40, live);
+  char path[40];
+  shunt_log_path(SHUNT_LOG_FULL, live, path, sizeof(path));
+  storage.files[path].resize(storage.files[path].size() - 87);
+  TEST_ASSERT_EQUAL_UINT32(39, sync(storage, cursor, live, live + 20));
+  std::vector<uint8_t>& file = storage.files[path];
+  file.resize(file.size() - file.size() % 174);
+  writeFull(storage, live + 59, 1, live);
+  uint8_t entry[SHUNT_MANIFEST_ENTRY_SIZE];
+  shunt_manifest_encode({live, live, live + 59, 60, 60 * 174}, entry);
+  storage.append(SHUNT_MANIFEST_PATH, entry, sizeof(entry));
+  writeFull(storage, live + 60, 30, live + 60);
+  TEST_ASSERT_EQUAL_UINT32(1 + 30, sync(storage, cursor, live + 60, live + 59));
+  TEST_ASSERT_EQUAL_INT64(live + 60, cursor.fileStart);
+
+  // A stale cursor whose file has gone picks up at the next file
+  ShuntSyncCursor stale = {T0 - 35, 174 * 3};
+  shunt_log_path(SHUNT_LOG_FULL, T0 - 35, path, sizeof(path));
+  storage.files.erase(path);
+  TEST_ASSERT_EQUAL_UINT32(180 + 90, sync(storage, stale, live + 60, T0));
+}
+
+void test_sync_records_carry_micros(void) {
+  MemoryLogStorage storage;
+  // A file from before microsecond stamps, then the live one with them
+  writeFull(storage, T0, 5, T0);
+  uint8_t entry[SHUNT_MANIFEST_ENTRY_SIZE];
+  shunt_manifest_encode({T0, T0, T0 + 4, 5, 5 * 174}, entry);
+  storage.append(SHUNT_MANIFEST_PATH, entry, sizeof(entry));
+  int64_t live = T0 + 5;
+  writeFull(storage, live, 5, live, SHUNT_LOG_TIMESTAMP_MICROS);
+
+  ShuntSyncCursor cursor = {T0, 0};
+  ShuntSyncReader reader(storage, cursor, live);
+  uint8_t body[10 * SYNC_RECORD_SIZE + SYNC_TRAILER_SIZE];
+  TEST_ASSERT_EQUAL(sizeof(body), reader.fill(body, sizeof(body)));
+  for (uint32_t i = 0; i < 10; i++) {
+    const uint8_t* record = body + i * SYNC_RECORD_SIZE;
+    uint32_t n = i < 5 ? i : i - 5;
+    TEST_ASSERT_EQUAL_INT64(T0 + i, (int64_t)shunt_index_get(record, 8));
+    TEST_ASSERT_EQUAL_UINT32(i < 5 ? 0 : 500000 + n, (uint32_t)shunt_index_get(record + 8, 4));
+    for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+      TEST_ASSERT_EQUAL_UINT32(9600 + n + ch, (uint32_t)shunt_index_get(record + 12 + 4 * ch, 4));
+      TEST_ASSERT_EQUAL_INT32(-(int32_t)n - ch, (int32_t)(uint32_t)shunt_index_get(record + 32 + 4 * ch, 4));
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(SYNC_MAGIC, (uint32_t)shunt_index_get(body + 10 * SYNC_RECORD_SIZE, 4));
+}
+
+void test_sync_limit_and_resume(void) {
+  MemoryLogStorage storage;
+  writeIndexed(storage, T0, 300);
+  int64_t live = T0 + 300;
+  writeFull(storage, live, 10, live);
+  ShuntSyncCursor cursor = {T0, 0};
+  bool more = false;
+  uint32_t total = 0;
+  uint32_t requests = 0;
+  do {
+    total += sync(storage, cursor, live, T0 + total, 100, &more);
+    requests++;
+  } while (more);
+  TEST_ASSERT_EQUAL_UINT32(310, total);
+  TEST_ASSERT_EQUAL_UINT32(4, requests);
+
+  ShuntSyncCursor parsed;
+  char text[32];
+  shunt_sync_cursor_format(cursor, text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("1690112400-1740", text);
+  TEST_ASSERT_TRUE(shunt_sync_cursor_parse(text, parsed));
+  TEST_ASSERT_EQUAL_INT64(cursor.fileStart, parsed.fileStart);
+  TEST_ASSERT_EQUAL_UINT32(cursor.offset, parsed.offset);
+  TEST_ASSERT_FALSE(shunt_sync_cursor_parse("1690112400", parsed));
+  TEST_ASSERT_FALSE(shunt_sync_cursor_parse("1690112400-", parsed));
+  TEST_ASSERT_FALSE(shunt_sync_cursor_parse("abc-1", parsed));
+}
+
+// Rollups at `level` for the intervals starting in [from, to), written at the end of each like the
+// logger does
+static void writeRollups(MemoryLogStorage& storage, ShuntLogLevel level, int64_t from, int64_t to) {
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  char path[40];
+  uint32_t seconds = shunt_log_level_seconds(level);
+  for (int64_t start = from; start < to; start += seconds) {
+    int64_t written = start + seconds + start / seconds % 2;
+    shunt_log_path(level, shunt_log_file_start(level, written), path, sizeof(path));
+    storage.append(path, buffer, shunt_log_encode_rollup(makeRollup(written, 9600 + (int32_t)(start / seconds % 7), -100), 4, buffer));
+  }
+}
+
+static std::vector<RollupRecord> readRollups(MemoryLogStorage& storage, const char* path) {
+  std::vector<RollupRecord> records;
+  std::vector<uint8_t>& file = storage.files[path];
+  size_t size = shunt_log_record_size(SHUNT_LOG_MINUTE, shunt_log_timestamp_size(file.data(), file.size()));
+  for (size_t offset = 0; offset + size <= file.size(); offset += size) {
+    RollupRecord record;
+    TEST_ASSERT_TRUE(shunt_log_decode_rollup(file.data() + offset, size, record));
+    if (!records.empty()) TEST_ASSERT_TRUE(records.back().timestamp < record.timestamp);
+    records.push_back(record);
+  }
+  return records;
+}
+
+void test_retention_fills_missing_rollups_before_deleting(void) {
+  MemoryLogStorage storage;
+  int64_t day = shunt_log_unix(2023, 7, 20);
+  // Two hours of full-rate files with their indexes, and minute rollups for 9:00 to 12:10 that lack
+  // 10:30 to 10:39
+  writeFull(storage, day + 10 * 3600, 7200);
+  uint8_t index[SHUNT_INDEX_ENTRY_SIZE] = {0};
+  char path[40];
+  for (int64_t start = day + 10 * 3600; start < day + 12 * 3600; start += 3600) {
+    shunt_index_path(start, path, sizeof(path));
+    storage.append(path, index, sizeof(index));
+  }
+  writeRollups(storage, SHUNT_LOG_MINUTE, day + 9 * 3600, day + 10 * 3600 + 30 * 60);
+  writeRollups(storage, SHUNT_LOG_MINUTE, day + 10 * 3600 + 40 * 60, day + 12 * 3600 + 10 * 60);
+  std::vector<uint8_t> before = storage.files["/daily/20230720.bin0"];
+  // And the file being written
+  writeFull(storage, T0, 10);
+  int64_t live = shunt_log_file_start(SHUNT_LOG_FULL, T0);
+
+  MemoryLogStorage source(&storage);
+  MemoryLogStorage target(&storage);
+  MemoryLogFiles files(storage, 1ULL << 32);
+  ShuntRetentionPolicy policy = {2, 3, 0};
+  ShuntRetention retention(source, target, files, policy);
+  TEST_ASSERT_EQUAL_INT64(shunt_log_unix(2023, 7, 21), retention.fullCutoff(T0));
+  uint32_t steps = 0;
+  while (retention.step(T0, live)) steps++;
+  TEST_ASSERT_EQUAL_UINT32(2, steps);
+  TEST_ASSERT_EQUAL_UINT32(2, retention.stats.fullRetired);
+  TEST_ASSERT_EQUAL_UINT32(10, retention.stats.rollupsAdded);
+  TEST_ASSERT_EQUAL_UINT32(1, retention.stats.filesRewritten);
+
+  // The files, their indexes and their partitions are gone; the live file isn't
+  for (std::map<std::string, std::vector<uint8_t> >::iterator it = storage.files.begin(); it != storage.files.end(); it++) {
+    TEST_ASSERT_TRUE(it->first.find("2023/07/20") == std::string::npos);
+    TEST_ASSERT_TRUE(it->first.find(".tmp") == std::string::npos);
+  }
+  shunt_log_path(SHUNT_LOG_FULL, live, path, sizeof(path));
+  TEST_ASSERT_EQUAL(10 * 174, storage.files[path].size());
+
+  // The rollups that were there are untouched, the missing ten merged in where they belong
+  std::vector<RollupRecord> records = readRollups(storage, "/daily/20230720.bin0");
+  TEST_ASSERT_EQUAL(before.size() / 532 + 10, records.size());
+  TEST_ASSERT_EQUAL_MEMORY(before.data(), storage.files["/daily/20230720.bin0"].data(), 90 * 532);
+  const RollupRecord& added = records[90];
+  TEST_ASSERT_EQUAL_INT64(day + 10 * 3600 + 31 * 60, added.timestamp);
+  // Samples 1800..1859 of writeFull: bus 9600 + 0..59, shunt -(0..49) then -(0..9)
+  for (uint8_t ch = 0; ch < SHUNT_LOG_CHANNELS; ch++) {
+    TEST_ASSERT_EQUAL_INT64(9600 + ch, added.busMin[ch]);
+    TEST_ASSERT_EQUAL_INT32(9629 + ch, added.busMean[ch]);
+    TEST_ASSERT_EQUAL_INT64(9659 + ch, added.busMax[ch]);
+    TEST_ASSERT_EQUAL_INT64(-49 - ch, added.shuntMin[ch]);
+    TEST_ASSERT_EQUAL_INT32(-21 - ch, added.shuntMean[ch]);
+    TEST_ASSERT_EQUAL_INT64(-ch, added.shuntMax[ch]);
+  }
+  TEST_ASSERT_EQUAL_INT64(day + 10 * 3600 + 41 * 60, records[100].timestamp);
+}
+
+void test_retention_ages_minutes_and_keeps_free_space(void) {
+  MemoryLogStorage storage;
+  // Two hours of March in minute rollups; the hourly file only has the first
+  int64_t march = shunt_log_unix(2023, 3, 5);
+  writeRollups(storage, SHUNT_LOG_MINUTE, march, march + 7200);
+  writeRollups(storage, SHUNT_LOG_HOUR, march, march + 3600);
+  // Yesterday and today, this month's hourly file and the live full-rate file
+  writeRollups(storage, SHUNT_LOG_MINUTE, shunt_log_unix(2023, 7, 22), shunt_log_unix(2023, 7, 22, 1));
+  writeRollups(storage, SHUNT_LOG_MINUTE, shunt_log_unix(2023, 7, 23), shunt_log_unix(2023, 7, 23, 1));
+  writeRollups(storage, SHUNT_LOG_HOUR, shunt_log_unix(2023, 7, 1), shunt_log_unix(2023, 7, 23));
+  writeFull(storage, T0, 10);
+  int64_t live = shunt_log_file_start(SHUNT_LOG_FULL, T0);
+
+  MemoryLogStorage source(&storage);
+  MemoryLogStorage target(&storage);
+  MemoryLogFiles files(storage, 1ULL << 32);
+  ShuntRetentionPolicy policy = {7, 3, 0};
+  ShuntRetention retention(source, target, files, policy);
+  TEST_ASSERT_EQUAL_INT64(shunt_log_unix(2023, 4, 1), retention.minuteCutoff(T0));
+  TEST_ASSERT_TRUE(retention.step(T0, live));
+  TEST_ASSERT_FALSE(retention.step(T0, live));
+  TEST_ASSERT_EQUAL_UINT32(1, retention.stats.minuteRetired);
+  TEST_ASSERT_TRUE(storage.files.find("/daily/20230305.bin0") == storage.files.end());
+
+  // The hour the hourly file lacked, from its sixty minutes: min of the minimums, max of the
+  // maximums, mean of the means
+  std::vector<RollupRecord> hours = readRollups(storage, "/hourly/202303.bin0");
+  TEST_ASSERT_EQUAL(2, hours.size());
+  int64_t sum = 0;
+  for (int64_t minute = march + 3600; minute < march + 7200; minute += 60) sum += 9600 + minute / 60 % 7;
+  TEST_ASSERT_EQUAL_INT64(march + 7200, hours[1].timestamp);
+  TEST_ASSERT_EQUAL_INT64(9600 - 10, hours[1].busMin[0]);
+  TEST_ASSERT_EQUAL_INT64(9606 + 10, hours[1].busMax[0]);
+  TEST_ASSERT_EQUAL_INT32(sum / 60, hours[1].busMean[0]);
+  TEST_ASSERT_EQUAL_INT32(-100, hours[1].shuntMean[0]);
+
+  // Short of space, yesterday's minutes go early, but no further
+  files.capacity = 0;
+  retention.policy.freeFloor = 1;
+  TEST_ASSERT_TRUE(retention.step(T0, live));
+  TEST_ASSERT_FALSE(retention.step(T0, live));
+  TEST_ASSERT_TRUE(storage.files.find("/daily/20230722.bin0") == storage.files.end());
+  TEST_ASSERT_TRUE(storage.files.find("/daily/20230723.bin0") != storage.files.end());
+  TEST_ASSERT_EQUAL(22 * 24, storage.files["/hourly/202307.bin0"].size() / 532);
+  TEST_ASSERT_EQUAL_UINT32(2, retention.stats.minuteRetired);
+  TEST_ASSERT_EQUAL_UINT32(0, retention.stats.errors);
+}
+
+// The card as the power cut left it: an hour file up to 11:35:20 ending in half a record, minute
+// rollups up to 11:34 ending in part of one, hour rollups up to 10:00, no index for the hour file
+static void writeTorn(MemoryLogStorage& storage, int64_t day) {
+  writeFull(storage, day + 11 * 3600, 35 * 60 + 21);
+  writeRollups(storage, SHUNT_LOG_MINUTE, day, day + 11 * 3600 + 35 * 60);
+  writeRollups(storage, SHUNT_LOG_HOUR, day, day + 11 * 3600);
+  uint8_t buffer[SHUNT_LOG_MAX_RECORD_SIZE];
+  storage.append("/full/2023/07/23/110000.bin0", buffer, shunt_log_encode_full(makeFull(day + 11 * 3600 + 35 * 60 + 21, 1, 1), 4, buffer) - 74);
+  storage.append("/daily/20230723.bin0", buffer, shunt_log_encode_rollup(makeRollup(day + 11 * 3600 + 36 * 60, 1, 1), 4, buffer) - 232);
+}
+
+void test_recovery_truncates_and_rebuilds(void) {
+  MemoryLogStorage storage;
+  MemoryLogStorage target(&storage);
+  MemoryLogFiles files(storage, 1 << 30);
+  int64_t day = shunt_log_unix(2023, 7, 23);
+  writeTorn(storage, day);
+  // And the file a boot that didn't last opened
+  storage.files["/full/2023/07/23/114000.bin0"];
+
+  ShuntRecovery recovery(storage, target, files);
+  recovery.run(day + 12 * 3600 + 10 * 60 + 30);
+  TEST_ASSERT_EQUAL_UINT32(1, recovery.stats.filesRemoved);
+  TEST_ASSERT_EQUAL_UINT32(2, recovery.stats.filesTruncated);
+  TEST_ASSERT_EQUAL_UINT32(100 + 300, recovery.stats.bytesTruncated);
+  TEST_ASSERT_EQUAL_UINT32(1, recovery.stats.minutesRebuilt);
+  TEST_ASSERT_EQUAL_UINT32(1, recovery.stats.hoursRebuilt);
+  TEST_ASSERT_EQUAL_UINT32(1, recovery.stats.indexesRebuilt);
+  TEST_ASSERT_EQUAL_UINT32(0, recovery.stats.errors);
+  TEST_ASSERT_EQUAL_UINT32(0, recovery.minuteCarry.count);
+  TEST_ASSERT_EQUAL_UINT32(0, recovery.hourCarry.count);
+  TEST_ASSERT_EQUAL(0, storage.files.count("/full/2023/07/23/114000.bin0"));
+  TEST_ASSERT_EQUAL(2121 * 174, storage.files["/full/2023/07/23/110000.bin0"].size());
+
+  // 11:35 from its 21 seconds
+  std::vector<RollupRecord> minutes = readRollups(storage, "/daily/20230723.bin0");
+  TEST_ASSERT_EQUAL(11 * 60 + 36, minutes.size());
+  TEST_ASSERT_EQUAL_INT64(day + 11 * 3600 + 36 * 60, minutes.back().timestamp);
+  TEST_ASSERT_EQUAL_INT64(9601, minutes.back().busMin[1]);
+  TEST_ASSERT_EQUAL_INT32(9611, minutes.back().busMean[1]);
+  TEST_ASSERT_EQUAL_INT64(9621, minutes.back().busMax[1]);
+  TEST_ASSERT_EQUAL_INT64(-21, minutes.back().shuntMin[1]);
+  TEST_ASSERT_EQUAL_INT64(-1, minutes.back().shuntMax[1]);
+
+  // 11:00 from its 36 minutes
+  std::vector<RollupRecord> hours = readRollups(storage, "/hourly/202307.bin0");
+  TEST_ASSERT_EQUAL(12, hours.size());
+  TEST_ASSERT_EQUAL_INT64(day + 12 * 3600, hours.back().timestamp);
+  int64_t busSum = 0;
+  for (size_t i = 11 * 60; i < minutes.size(); i++) busSum += minutes[i].busMean[0];
+  TEST_ASSERT_EQUAL_INT32((int32_t)(busSum / 36), hours.back().busMean[0]);
+
+  // The index and manifest entry rotation would have written
+  ShuntManifestEntry entry;
+  TEST_ASSERT_TRUE(storage.open(SHUNT_MANIFEST_PATH));
+  TEST_ASSERT_EQUAL_UINT32(SHUNT_MANIFEST_ENTRY_SIZE, storage.size());
+  TEST_ASSERT_TRUE(shunt_manifest_read(storage, 0, entry));
+  TEST_ASSERT_EQUAL_INT64(day + 11 * 3600, entry.fileStart);
+  TEST_ASSERT_EQUAL_INT64(day + 11 * 3600 + 35 * 60 + 20, entry.lastTimestamp);
+  TEST_ASSERT_EQUAL_UINT32(2121, entry.records);
+  TEST_ASSERT_EQUAL(1, storage.files.count("/index/full/2023/07/23/110000.idx"));
+
+  // Again, as after another boot: nothing more to do
+  std::map<std::string, std::vector<uint8_t> > before = storage.files;
+  recovery.run(day + 12 * 3600 + 20 * 60);
+  TEST_ASSERT_EQUAL_UINT32(0, recovery.stats.filesTruncated + recovery.stats.filesRemoved + recovery.stats.minutesRebuilt +
+                              recovery.stats.hoursRebuilt + recovery.stats.indexesRebuilt);
+  TEST_ASSERT_TRUE(before == storage.files);
+}
+
+void test_recovery_carries_the_boot_minute_and_hour(void) {
+  MemoryLogStorage storage;
+  MemoryLogStorage target(&storage);
+  MemoryLogFiles files(storage, 1 << 30);
+  int64_t day = shunt_log_unix(2023, 7, 23);
+  writeTorn(storage, day);
+
+  // Back within the minute: the logger's own rollups will cover 11:35 and 11:00
+  ShuntRecovery recovery(storage, target, files);
+  recovery.run(day + 11 * 3600 + 35 * 60 + 50);
+  TEST_ASSERT_EQUAL_UINT32(2, recovery.stats.filesTruncated);
+  TEST_ASSERT_EQUAL_UINT32(0, recovery.stats.minutesRebuilt);
+  TEST_ASSERT_EQUAL_UINT32(0, recovery.stats.hoursRebuilt);
+  TEST_ASSERT_EQUAL(11 * 60 + 35, readRollups(storage, "/daily/20230723.bin0").size());
+  TEST_ASSERT_EQUAL(11, readRollups(storage, "/hourly/202307.bin0").size());
+
+  uint32_t added;
+  int64_t sum, min, max;
+  TEST_ASSERT_EQUAL_UINT32(21, recovery.minuteCarry.count);
+  recovery.minuteCarry.totals(0, false, added, sum, min, max);
+  TEST_ASSERT_EQUAL_UINT32(21, added);
+  TEST_ASSERT_EQUAL_INT64(9600 * 21 + 210, sum);
+  TEST_ASSERT_EQUAL_INT64(9600, min);
+  TEST_ASSERT_EQUAL_INT64(9620, max);
+  recovery.minuteCarry.totals(0, true, added, sum, min, max);
+  TEST_ASSERT_EQUAL_INT64(-20, min);
+  TEST_ASSERT_EQUAL_INT64(0, max);
+  TEST_ASSERT_EQUAL_UINT32(35, recovery.hourCarry.count);
+}
+
+// Full-rate files with the µs in their timestamps roll up to whole seconds
+void test_recovery_rolls_up_microsecond_files(void) {
+  MemoryLogStorage storage;
+  MemoryLogStorage target(&storage);
+  MemoryLogFiles files(storage, 1 << 30);
+  int64_t day = shunt_log_unix(2023, 7, 23);
+  writeFull(storage, day + 11 * 3600, 10 * 60 + 21, -1, SHUNT_LOG_TIMESTAMP_MICROS);
+  TEST_ASSERT_EQUAL(621 * 182, storage.files["/full/2023/07/23/110000.bin0"].size());
+
+  ShuntRecovery recovery(storage, target, files);
+  recovery.run(day + 12 * 3600 + 10 * 60);
+  TEST_ASSERT_EQUAL_UINT32(0, recovery.stats.filesTruncated);
+  TEST_ASSERT_EQUAL_UINT32(11, recovery.stats.minutesRebuilt);
+  TEST_ASSERT_EQUAL_UINT32(1, recovery.stats.hoursRebuilt);
+  std::vector<uint8_t>& daily = storage.files["/daily/20230723.bin0"];
+  TEST_ASSERT_EQUAL_UINT8(8, shunt_log_timestamp_size(daily.data(), daily.size()));
+  std::vector<RollupRecord> minutes = readRollups(storage, "/daily/20230723.bin0");
+  TEST_ASSERT_EQUAL(11, minutes.size());
+  TEST_ASSERT_EQUAL_INT64(day + 11 * 3600 + 60, minutes[0].timestamp);
+  TEST_ASSERT_EQUAL_INT64(9600, minutes[0].busMin[0]);
+  TEST_ASSERT_EQUAL_INT64(9659, minutes[0].busMax[0]);
+
+  // And the scanner finds their width when the first record is torn
+  storage.files["/full/2023/07/23/110000.bin0"][0] = 0xFF;
+  ShuntLogScanner scanner(storage);
+  TEST_ASSERT_TRUE(scanner.open("/full/2023/07/23/110000.bin0", SHUNT_LOG_FULL));
+  TEST_ASSERT_EQUAL_UINT32(182, scanner.recordSize);
+}
+
+static ShuntSystemSample makeSystemSample(uint32_t freeHeap, uint32_t largest, uint32_t queued) {
+  ShuntSystemSample sample;
+  sample.freeHeap = freeHeap;
+  sample.largestFreeBlock = largest;
+  sample.minFreeHeap = freeHeap;
+  for (uint8_t i = 0; i < SHUNT_SYSTEM_TASKS; i++) sample.stackFree[i] = 1000 + i;
+  sample.wsQueued = queued;
+  sample.liveQueued = queued * 2;
+  return sample;
+}
+
+// Each record keeps the lowest heap and the deepest queues of its interval
+void test_system_records_keep_the_worst(void) {
+  ShuntSystemInterval interval;
+  interval.add(makeSystemSample(120000, 60000, 1));
+  ShuntSystemSample low = makeSystemSample(90000, 70000, 0);
+  low.stackFree[1] = SHUNT_SYSTEM_NO_TASK;
+  interval.add(low);
+  interval.add(makeSystemSample(100000, 30000, 4));
+  TEST_ASSERT_EQUAL_UINT32(3, interval.samples);
+  TEST_ASSERT_EQUAL_UINT32(90000, interval.worst.freeHeap);
+  TEST_ASSERT_EQUAL_UINT32(30000, interval.worst.largestFreeBlock);
+  TEST_ASSERT_EQUAL_UINT32(90000, interval.worst.minFreeHeap);
+  TEST_ASSERT_EQUAL_UINT32(1001, interval.worst.stackFree[1]);
+  TEST_ASSERT_EQUAL_UINT32(4, interval.worst.wsQueued);
+  TEST_ASSERT_EQUAL_UINT32(8, interval.worst.liveQueued);
+  TEST_ASSERT_EQUAL_UINT8(70, shunt_system_fragmentation(makeSystemSample(100000, 30000, 0)));
+  interval.reset();
+  interval.add(makeSystemSample(110000, 50000, 0));
+  TEST_ASSERT_EQUAL_UINT32(110000, interval.worst.freeHeap);
+
+  ShuntSystemRecord record;
+  record.timestamp = T0;
+  record.uptime = 86400 * 3;
+  record.resetReason = 4;
+  record.worst = low;
+  uint8_t buffer[SHUNT_SYSTEM_RECORD_SIZE];
+  TEST_ASSERT_EQUAL(SHUNT_SYSTEM_RECORD_SIZE, shunt_system_encode(record, buffer));
+  ShuntSystemRecord decoded;
+  TEST_ASSERT_TRUE(shunt_system_decode(buffer, sizeof(buffer), decoded));
+  TEST_ASSERT_EQUAL_INT64(T0, decoded.timestamp);
+  TEST_ASSERT_EQUAL_UINT32(86400 * 3, decoded.uptime);
+  TEST_ASSERT_EQUAL_UINT32(4, decoded.resetReason);
+  TEST_ASSERT_EQUAL_UINT32(90000, decoded.worst.freeHeap);
+  TEST_ASSERT_EQUAL_UINT32(70000, decoded.worst.largestFreeBlock);
+  TEST_ASSERT_EQUAL_UINT32(SHUNT_SYSTEM_NO_TASK, decoded.worst.stackFree[1]);
+  TEST_ASSERT_EQUAL_UINT32(1007, decoded.worst.stackFree[7]);
+  TEST_ASSERT_EQUAL_UINT32(0, decoded.worst.liveQueued);
+  buffer[30] ^= 1;
+  TEST_ASSERT_FALSE(shunt_system_decode(buffer, sizeof(buffer), decoded));
+
+  char path[32];
+  shunt_system_path(T0, 0, path, sizeof(path));
+  TEST_ASSERT_EQUAL_STRING("/system/202307.bin0", path);
+  shunt_system_path(T0, 7, path, sizeof(path));
+  TEST_ASSERT_EQUAL_STRING("/system/202212.bin0", path);
+  shunt_system_path(T0, 19, path, sizeof(path));
+  TEST_ASSERT_EQUAL_STRING("/system/202112.bin0", path);
+}
+
+int runUnityTests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_record_round_trip);
+  RUN_TEST(test_rollup_record_round_trip);
+  RUN_TEST(test_crc_catches_what_the_sum_missed);
+  RUN_TEST(test_scanner_recovers_from_random_corruption);
+  RUN_TEST(test_civil_time_and_paths);
+  RUN_TEST(test_full_layouts);
+  RUN_TEST(test_time_format_matches_snprintf);
+  RUN_TEST(test_lower_bound_skips_to_first_match);
+  RUN_TEST(test_plan_picks_coarsest_level);
+  RUN_TEST(test_series_full_rate_binary);
+  RUN_TEST(test_series_never_splits_points);
+  RUN_TEST(test_series_rollups_json);
+  RUN_TEST(test_missing_samples_are_left_out);
+  RUN_TEST(test_index_builder_and_seek);
+  RUN_TEST(test_manifest_finds_boot_files);
+  RUN_TEST(test_cursor_seeks_large_files_with_index);
+  RUN_TEST(test_cursor_finds_live_file_after_manifest);
+  RUN_TEST(test_cursor_finds_mid_minute_file_without_manifest);
+  RUN_TEST(test_downsample_lttb_binary_per_channel);
+  RUN_TEST(test_downsample_minmax_rollups_json);
+  RUN_TEST(test_sync_follows_rotations_and_growth);
+  RUN_TEST(test_sync_records_carry_micros);
+  RUN_TEST(test_sync_limit_and_resume);
+  RUN_TEST(test_retention_fills_missing_rollups_before_deleting);
+  RUN_TEST(test_retention_ages_minutes_and_keeps_free_space);
+  RUN_TEST(test_recovery_truncates_and_rebuilds);
+  RUN_TEST(test_recovery_carries_the_boot_minute_and_hour);
+  RUN_TEST(test_recovery_rolls_up_microsecond_files);
+  RUN_TEST(test_system_records_keep_the_worst);
+  return UNITY_END();
+}
+
+/**
+  * For native dev-platform or for some embedded frameworks
+  */
+int main(void) {
+  return runUnityTests();
+}
+
+#ifdef ARDUINO
+/**
+  * For Arduino framework
+  */
+void setup() {
+  // Wait ~2 seconds before the Unity test runner
+  // establishes connection with a board Serial interface
+  delay(2000);
+
+  runUnityTests();
+}
+void loop() {}
+#endif
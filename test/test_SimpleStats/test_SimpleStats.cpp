@@ -1,13 +1,15 @@
+#ifdef ARDUINO
 #include "Arduino.h"
+#endif
 #include "unity.h"
 #include "SimpleStats.h"
 
 void setUp(void) {
-  // No setup required for this example
+  // No setup required
 }
 
 void tearDown(void) {
-  // No teardown required for this example
+  // No teardown required
 }
 
 void test_simple_stats(void) {
@@ -21,14 +23,28 @@ void test_simple_stats(void) {
   TEST_ASSERT_EQUAL_UINT32(3, stats.count);
 }
 
+void test_simple_stats_merge(void) {
+  SimpleStats minute;
+  SimpleStats hour;
+  minute.add_measurement(10);
+  minute.add_measurement(20);
+  hour.merge(minute);
+  minute.reset();
+  minute.add_measurement(-30);
+  hour.merge(minute);
+  TEST_ASSERT_EQUAL_INT32(0, hour.get_mean());
+  TEST_ASSERT_EQUAL_INT32(-30, hour.min);
+  TEST_ASSERT_EQUAL_INT32(20, hour.max);
+  TEST_ASSERT_EQUAL_UINT32(3, hour.count);
+}
+
 int runUnityTests(void) {
   UNITY_BEGIN();
   RUN_TEST(test_simple_stats);
+  RUN_TEST(test_simple_stats_merge);
   return UNITY_END();
 }
 
-// WARNING!!! PLEASE REMOVE UNNECESSARY MAIN IMPLEMENTATIONS //
-
 /**
   * For native dev-platform or for some embedded frameworks
   */
@@ -36,6 +52,7 @@ int main(void) {
   return runUnityTests();
 }
 
+#ifdef ARDUINO
 /**
   * For Arduino framework
   */
@@ -47,3 +64,4 @@ void setup() {
   runUnityTests();
 }
 void loop() {}
+#endif